@@ -0,0 +1,67 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2020 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+# Re-writes every map under the maps directory with the navigation data 
+# baked in, so that it does not need to be rebuilt from the tiles when the 
+# map is loaded. The baked data is specific to the build that produced it
+# and is only used for as long as the map's tiles are not modified: re-run
+# this script after updating the engine or editing the maps. Maps with
+# stale or incompatible data are loaded by rebuilding it as usual.
+
+import pf
+import os
+
+MAPS_DIR = "assets/maps"
+
+def bake_all():
+
+    nbaked = 0
+    for name in sorted(os.listdir(os.path.join(pf.get_basedir(), MAPS_DIR))):
+        if not name.endswith(".pfmap"):
+            continue
+        try:
+            pf.load_map(MAPS_DIR, name)
+            pf.save_map(MAPS_DIR, name, bake_nav=True)
+            nbaked += 1
+        except RuntimeError as e:
+            print str(e)
+    return nbaked
+
+def on_update(user, event):
+
+    n = bake_all()
+    print "Baked {0} map(s)".format(n)
+    pf.global_event(pf.SDL_QUIT, None)
+
+pf.register_event_handler(pf.EVENT_UPDATE_START, on_update, None)
@@ -0,0 +1,131 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2020 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+
+# Runs one of the engine microbenchmarks exposed by 'pf.bench' and prints
+# its' results. The benchmark name is given as the first argument and the map
+# to load, for the benchmarks that need one, as the optional second argument.
+#
+#   spatial_index   - the uniform grid spatial index against the point quadtree
+#                     for a number of entity counts
+#   nav_fields      - the flow field and LOS field builders over every chunk of
+#                     the map, for each of the flow field solvers
+#   event_dispatch  - the event dispatcher with a fixed and with a churning set
+#                     of handlers, for a number of handler counts
+#   pickle          - pickling and unpickling object graphs of various sizes
+
+import pf
+import sys
+
+def bench_spatial_index():
+
+    for nents in [1000, 4000, 16000]:
+        res = pf.bench("spatial_index", nents, 20)
+        for name in ["quadtree", "grid"]:
+            r = res[name]
+            print "{0:8s} ents: {1:6d}  insert: {2:8.2f} ms  move: {3:8.2f} ms  query: {4:8.2f} ms  results: {5:d}".format(
+                name, nents, r["insert_ms"], r["move_ms"], r["query_ms"], r["nresults"])
+        qt, grid = res["quadtree"], res["grid"]
+        print "ents: {0:6d}  move speedup: {1:5.2f}x  query speedup: {2:5.2f}x".format(
+            nents, 
+            qt["move_ms"] / max(grid["move_ms"], 1e-6), 
+            qt["query_ms"] / max(grid["query_ms"], 1e-6))
+
+def bench_nav_fields():
+
+    for name, solver in [("dijkstra", 0), ("sweep", 1)]:
+        pf.settings_set("pf.game.flow_field_solver", solver, persist=False)
+        res = pf.bench("nav_fields", 10)
+        print "{0:10s} flow: {1:6d} fields in {2:9.2f} ms ({3:9.1f} fields/s, {4:d} mismatched)".format(
+            name, res["flow_fields"], res["flow_ms"], res["flow_per_sec"], res["flow_mismatched"])
+        print "{0:10s} LOS:  {1:6d} fields in {2:9.2f} ms ({3:9.1f} fields/s)".format(
+            name, res["los_fields"], res["los_ms"], res["los_per_sec"])
+
+def bench_event_dispatch():
+
+    for nhandlers in [1, 8, 32, 128]:
+        res = pf.bench("event_dispatch", nhandlers, 20000)
+        print "handlers: {0:4d}  dispatch: {1:8.2f} ms  churn: {2:8.2f} ms  calls: {3:9d}  ({4:6.1f} ns/call)".format(
+            nhandlers, res["dispatch_ms"], res["churn_ms"], res["calls"], res["ns_per_call"])
+
+class Unit(object):
+    def __init__(self, i):
+        self.name = "unit_%d" % i
+        self.pos = (float(i), 0.0, -float(i))
+        self.hp = i % 100
+        self.tags = [u"tag_%d" % (i % 7), "melee"]
+
+def make_graph(n):
+    units = [Unit(i) for i in range(n // 10)]
+    return {
+        "floats": [i / 3.0 for i in range(n)],
+        "ints": range(-n // 2, n // 2),
+        "strings": [str(i) * 3 for i in range(n)],
+        "units": units,
+        "by_name": dict((u.name, u) for u in units),
+    }
+
+def bench_pickle():
+
+    for n in [1000, 10000, 100000]:
+        graph = make_graph(n)
+        res = pf.bench("pickle", graph)
+
+        copy = res["copy"]
+        assert copy["floats"] == graph["floats"]
+        assert copy["strings"] == graph["strings"]
+        assert copy["by_name"]["unit_0"] is copy["units"][0]
+
+        print "objects: {0:7d}  pickle: {1:9.2f} ms  unpickle: {2:9.2f} ms  size: {3:10d} bytes".format(
+            n, res["pickle_ms"], res["unpickle_ms"], res["size"])
+
+# name: (driver, default map or None)
+BENCHMARKS = {
+    "spatial_index":    (bench_spatial_index,   "plain.pfmap"),
+    "nav_fields":       (bench_nav_fields,      "demo.pfmap"),
+    "event_dispatch":   (bench_event_dispatch,  None),
+    "pickle":           (bench_pickle,          None),
+}
+
+def on_update(user, event):
+    user()
+    pf.global_event(pf.SDL_QUIT, None)
+
+def usage():
+    print "Usage: bench.py <{0}> [map]".format("|".join(sorted(BENCHMARKS.keys())))
+
+driver, default_map = BENCHMARKS.get(sys.argv[1] if len(sys.argv) > 1 else None, (usage, None))
+if default_map is not None:
+    pf.load_map("assets/maps", sys.argv[2] if len(sys.argv) > 2 else default_map)
+pf.register_event_handler(pf.EVENT_UPDATE_START, on_update, driver)
@@ -92,6 +92,12 @@ class PerfStatsWindow(pf.Window):
             hr=nav_stats["flow_hit_rate"], inv=nav_stats["flow_invalidated"]), \
             (0, 255, 0))
 
+        self.layout_row_dynamic(20, 1)
+        self.label_colored_wrap("[Flow Field Memory]  Used: {used:05d}/{cap:05d} KiB   Unique: {uniq:04d}   Shared: {shared:04d}   Evicted: {ev:04d}" \
+            .format(used=nav_stats["flow_bytes_used"] // 1024, cap=nav_stats["flow_bytes_max"] // 1024, 
+            uniq=nav_stats["flow_unique"], shared=nav_stats["flow_shared"], ev=nav_stats["flow_evicted"]), \
+            (0, 255, 0))
+
         self.layout_row_dynamic(20, 1)
         self.label_colored_wrap("[Dest:Field Mapping Cache] Used: {used:04d}/{cap:04d}   Hit Rate: {hr:02.03f}" \
             .format(used=nav_stats["ffid_used"], cap=nav_stats["ffid_max"], hr=nav_stats["ffid_hit_rate"]), \
@@ -102,6 +108,12 @@ class PerfStatsWindow(pf.Window):
             .format(used=nav_stats["grid_path_used"], cap=nav_stats["grid_path_max"], hr=nav_stats["grid_path_hit_rate"]), \
             (0, 255, 0))
 
+        self.layout_row_dynamic(20, 1)
+        self.label_colored_wrap("[Portal Route Cache] Used: {used:04d}/{cap:04d}   Hit Rate: {hr:02.03f} Invalidated: {inv:04d}" \
+            .format(used=nav_stats["route_used"], cap=nav_stats["route_max"], 
+            hr=nav_stats["route_hit_rate"], inv=nav_stats["route_invalidated"]), \
+            (0, 255, 0))
+
     def threads_tab(self):
         for name in self.frame_perfstats[self.tickindex]:
             t_frame_times = [0] * 100
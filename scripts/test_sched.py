@@ -0,0 +1,90 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2020 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+# Measures the throughput of the task scheduler as a function of the number 
+# of active worker threads. A batch of synthetic worker tasks is spawned, each 
+# of which does a small amount of work and yields. For every worker count, the 
+# number of task activations per frame is averaged over a number of frames.
+
+import pf
+
+NTASKS = 200
+WARMUP_FRAMES = 10
+SAMPLE_FRAMES = 60
+
+nworkers = pf.get_sched_perfstats()["nworkers"]
+curr_workers = 1
+frame = 0
+samples = []
+results = []
+
+def on_update(user, event):
+
+    global curr_workers, frame, samples
+
+    frame += 1
+    if frame <= WARMUP_FRAMES:
+        return
+
+    stats = pf.get_sched_perfstats()
+    samples += [(stats["tasks_run"], stats["tasks_stolen"])]
+    if len(samples) < SAMPLE_FRAMES:
+        return
+
+    avg_run = sum(s[0] for s in samples) / float(len(samples))
+    avg_stolen = sum(s[1] for s in samples) / float(len(samples))
+    results.append((curr_workers, avg_run, avg_stolen))
+    print "workers: {0:2d}  tasks/frame: {1:10.1f}  steals/frame: {2:8.1f}".format(
+        curr_workers, avg_run, avg_stolen)
+
+    frame = 0
+    samples = []
+    curr_workers += 1
+
+    if curr_workers > max(nworkers, 1):
+        pf.settings_set("pf.debug.sched_bench_tasks", 0, persist=False)
+        pf.settings_set("pf.debug.sched_active_workers", 0, persist=False)
+        base = results[0][1] if results[0][1] > 0 else 1.0
+        for nw, run, stolen in results:
+            print "workers: {0:2d}  speedup: {1:5.2f}x".format(nw, run / base)
+        pf.global_event(pf.SDL_QUIT, None)
+        return
+
+    pf.settings_set("pf.debug.sched_active_workers", curr_workers, persist=False)
+
+pf.load_map("assets/maps", "plain.pfmap")
+pf.settings_set("pf.debug.sched_active_workers", min(curr_workers, nworkers), persist=False)
+pf.settings_set("pf.debug.sched_bench_tasks", NTASKS, persist=False)
+pf.register_event_handler(pf.EVENT_UPDATE_START, on_update, None)
+
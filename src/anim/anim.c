@@ -113,28 +113,10 @@ static void a_make_bind_mat(int joint_idx, const struct skeleton *skel, mat4x4_t
     *out = bind_trans;
 }
 
-static void a_make_pose_mat(const struct entity *ent, int joint_idx, const struct skeleton *skel, mat4x4_t *out)
+static const mat4x4_t *a_curr_pose_mats(const struct entity *ent)
 {
     struct anim_ctx *ctx = ent->anim_ctx;
-    struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
-
-    mat4x4_t pose_trans;
-    PFM_Mat4x4_Identity(&pose_trans);
-
-    /* Same as a_make_bind_mat, except for the current pose. */
-    while(joint_idx >= 0) {
-
-        struct joint *joint = &skel->joints[joint_idx];
-        struct SQT   *pose_sqt = &sample->local_joint_poses[joint_idx];
-        mat4x4_t to_parent, to_curr = pose_trans;
-
-        a_mat_from_sqt(pose_sqt, &to_parent);
-        PFM_Mat4x4_Mult4x4(&to_parent, &to_curr, &pose_trans);
-
-        joint_idx = joint->parent_idx;
-    }
-
-    *out = pose_trans;
+    return ctx->active->samples[ctx->curr_frame].pose_mats;
 }
 
 /*****************************************************************************/
@@ -207,15 +189,12 @@ void A_Update(struct entity *ent)
 }
 
 void A_GetRenderState(const struct entity *ent, size_t *out_njoints, 
-                      mat4x4_t *out_curr_pose, const mat4x4_t **out_inv_bind_pose)
+                      const mat4x4_t **out_curr_pose, const mat4x4_t **out_inv_bind_pose)
 {
     assert(ent->flags & ENTITY_FLAG_ANIMATED);
     struct anim_data *priv = (struct anim_data*)ent->anim_private;
 
-    for(int j = 0; j < priv->skel.num_joints; j++) {
-        a_make_pose_mat(ent, j, &priv->skel, out_curr_pose + j);
-    }
-
+    *out_curr_pose = a_curr_pose_mats(ent);
     *out_njoints = priv->skel.num_joints;
     *out_inv_bind_pose = priv->skel.inv_bind_poses;
 }
@@ -258,12 +237,12 @@ const struct skeleton *A_GetCurrPoseSkeleton(const struct entity *ent)
     memcpy(ret->bind_sqts, priv->skel.bind_sqts, num_joints * sizeof(struct SQT));
 
     ret->inv_bind_poses = (void*)((char*)ret->bind_sqts + num_joints * sizeof(struct SQT));
+    const mat4x4_t *pose_mats = a_curr_pose_mats(ent);
 
     for(int i = 0; i < ret->num_joints; i++) {
     
         /* Update the inverse bind matrices for the current frame */
-        mat4x4_t pose_mat;
-        a_make_pose_mat(ent, i, ret, &pose_mat);
+        mat4x4_t pose_mat = pose_mats[i];
         PFM_Mat4x4_Inverse(&pose_mat, &ret->inv_bind_poses[i]);
     }
 
@@ -282,6 +261,39 @@ void A_PrepareInvBindMatrices(const struct skeleton *skel)
     }
 }
 
+void A_PreparePoseMatrices(const struct skeleton *skel, struct anim_sample *sample)
+{
+    for(int i = 0; i < skel->num_joints; i++) {
+
+        int parent_idx = skel->joints[i].parent_idx;
+        mat4x4_t to_parent;
+        a_mat_from_sqt(&sample->local_joint_poses[i], &to_parent);
+
+        /* Joints are normally stored with parents ahead of their children, in
+         * which case the parent's matrix is already baked and a single multiply
+         * gives us the object-space pose. Otherwise, walk up the heirarchy. 
+         */
+        if(parent_idx < i) {
+
+            if(parent_idx < 0)
+                sample->pose_mats[i] = to_parent;
+            else
+                PFM_Mat4x4_Mult4x4(&sample->pose_mats[parent_idx], &to_parent, &sample->pose_mats[i]);
+            continue;
+        }
+
+        mat4x4_t pose_trans = to_parent;
+        while(parent_idx >= 0) {
+
+            mat4x4_t to_curr = pose_trans;
+            a_mat_from_sqt(&sample->local_joint_poses[parent_idx], &to_parent);
+            PFM_Mat4x4_Mult4x4(&to_parent, &to_curr, &pose_trans);
+            parent_idx = skel->joints[parent_idx].parent_idx;
+        }
+        sample->pose_mats[i] = pose_trans;
+    }
+}
+
 const struct aabb *A_GetCurrPoseAABB(const struct entity *ent)
 {
     assert(ent->flags & ENTITY_FLAG_COLLISION);
@@ -155,6 +155,8 @@ size_t al_data_buffsize_from_header(const struct pfobj_hdr *header)
      *    1. a 'struct anim_sample' (for referencing this frame's SQT array)
      *    2. num_joint number of 'struct SQT's (each joint's transform
      *       for the current frame)
+     *    3. num_joint number of 'mat4x4_t's (each joint's baked pose 
+     *       matrix for the current frame)
      */
     for(unsigned as_idx  = 0; as_idx < header->num_as; as_idx++) {
 
@@ -162,46 +164,19 @@ size_t al_data_buffsize_from_header(const struct pfobj_hdr *header)
                (sizeof(struct anim_sample) + header->num_joints * sizeof(struct SQT));
     }
 
-    return ret;
-}
+    for(unsigned as_idx  = 0; as_idx < header->num_as; as_idx++) {
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
+        ret += header->frame_counts[as_idx] * header->num_joints * sizeof(mat4x4_t);
+    }
 
-size_t A_AL_CtxBuffSize(void)
-{
-    return sizeof(struct anim_ctx);
+    return ret;
 }
 
-/*
- * Animation data buff layout:
- *
- *  +---------------------------------+ <-- base
- *  | struct anim_data[1]             |
- *  +---------------------------------+
- *  | struct SQT[num_joints] (bind)   |
- *  +---------------------------------+
- *  | mat4x4_t[num_joints] (inv. bind)|
- *  +---------------------------------+
- *  | struct joint[num_joints]        |
- *  +---------------------------------+
- *  | struct anim_clip[num_as]        |
- *  +---------------------------------+
- *  | struct anim_samples[num_as      |
- *  |    * num_frames]                |
- *  +---------------------------------+
- *  | struct SQT[num_as * num_joints] |
- *  |    (stored in clip-major order) |
- *  +---------------------------------+
- *
- */
-
-void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
+static struct anim_data *al_data_init(const struct pfobj_hdr *header)
 {
     struct anim_data *ret = malloc(al_data_buffsize_from_header(header));
     if(!ret)
-        goto fail_alloc;
+        return NULL;
 
     /*-----------------------------------------------------------
      * First divide up the buffer betwen data members,
@@ -244,6 +219,66 @@ void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
         }
     }
 
+    for(int i = 0; i < header->num_as; i++) {
+        for(int f = 0; f < header->frame_counts[i]; f++) {
+
+            ret->anims[i].samples[f].pose_mats = (void*)unused_base;
+            unused_base += sizeof(mat4x4_t) * header->num_joints;
+        }
+    }
+
+    return ret;
+}
+
+static size_t al_total_frames(const struct pfobj_hdr *header)
+{
+    size_t ret = 0;
+    for(int i = 0; i < header->num_as; i++)
+        ret += header->frame_counts[i];
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+size_t A_AL_CtxBuffSize(void)
+{
+    return sizeof(struct anim_ctx);
+}
+
+/*
+ * Animation data buff layout:
+ *
+ *  +---------------------------------+ <-- base
+ *  | struct anim_data[1]             |
+ *  +---------------------------------+
+ *  | struct SQT[num_joints] (bind)   |
+ *  +---------------------------------+
+ *  | mat4x4_t[num_joints] (inv. bind)|
+ *  +---------------------------------+
+ *  | struct joint[num_joints]        |
+ *  +---------------------------------+
+ *  | struct anim_clip[num_as]        |
+ *  +---------------------------------+
+ *  | struct anim_samples[num_as      |
+ *  |    * num_frames]                |
+ *  +---------------------------------+
+ *  | struct SQT[num_as * num_joints] |
+ *  |    (stored in clip-major order) |
+ *  +---------------------------------+
+ *  | mat4x4_t[num_as * num_joints]   |
+ *  |    (stored in clip-major order) |
+ *  +---------------------------------+
+ *
+ */
+
+void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
+{
+    struct anim_data *ret = al_data_init(header);
+    if(!ret)
+        goto fail_alloc;
+
     /*---------------------------------------------------------------
      * Then we populate priv members with the file data 
      *---------------------------------------------------------------
@@ -261,6 +296,168 @@ void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
     }
 
     A_PrepareInvBindMatrices(&ret->skel);
+
+    for(int i = 0; i < header->num_as; i++) {
+        for(int f = 0; f < header->frame_counts[i]; f++) {
+            A_PreparePoseMatrices(&ret->skel, &ret->anims[i].samples[f]);
+        }
+    }
+
+    return ret;
+
+fail_parse:
+    free(ret);
+fail_alloc:
+    return NULL;
+}
+
+/*
+ * Cooked animation data layout:
+ *
+ *  +---------------------------------+
+ *  | uint32_t sizeof(struct SQT),    |
+ *  |   sizeof(struct joint),         |
+ *  |   sizeof(mat4x4_t),             |
+ *  |   sizeof(struct aabb)           |
+ *  +---------------------------------+
+ *  | struct SQT[num_joints] (bind)   |
+ *  +---------------------------------+
+ *  | mat4x4_t[num_joints] (inv. bind)|
+ *  +---------------------------------+
+ *  | struct joint[num_joints]        |
+ *  +---------------------------------+
+ *  | char[num_as][ANIM_NAME_LEN]     |
+ *  +---------------------------------+
+ *  | struct SQT[total_frames         |
+ *  |    * num_joints]                |
+ *  +---------------------------------+
+ *  | mat4x4_t[total_frames           |
+ *  |    * num_joints]                |
+ *  +---------------------------------+
+ *  | struct aabb[total_frames]       |
+ *  |    (only if has_collision)      |
+ *  +---------------------------------+
+ *
+ * The sample and pose matrix arrays of all clips are contiguous in the 
+ * in-memory layout, so each of them is copied with a single memcpy.
+ */
+
+bool A_AL_CookFromStream(const struct pfobj_hdr *header, SDL_RWops *stream, SDL_RWops *out)
+{
+    struct anim_data *data = A_AL_PrivFromStream(header, stream);
+    if(!data)
+        return false;
+
+    const uint32_t layout[4] = {
+        sizeof(struct SQT),
+        sizeof(struct joint),
+        sizeof(mat4x4_t),
+        sizeof(struct aabb)
+    };
+    const size_t nj = header->num_joints;
+    const size_t nframes = al_total_frames(header);
+    bool ret = false;
+
+    if(!AL_CookedWrite(out, layout, sizeof(layout)))
+        goto out;
+    if(!AL_CookedWrite(out, data->skel.bind_sqts, nj * sizeof(struct SQT)))
+        goto out;
+    if(!AL_CookedWrite(out, data->skel.inv_bind_poses, nj * sizeof(mat4x4_t)))
+        goto out;
+    if(!AL_CookedWrite(out, data->skel.joints, nj * sizeof(struct joint)))
+        goto out;
+
+    char names[MAX_ANIM_SETS][ANIM_NAME_LEN] = {0};
+    for(int i = 0; i < header->num_as; i++) {
+        pf_strlcpy(names[i], data->anims[i].name, ANIM_NAME_LEN);
+    }
+    if(!AL_CookedWrite(out, names, header->num_as * ANIM_NAME_LEN))
+        goto out;
+
+    if(nframes > 0) {
+
+        const struct anim_sample *first = &data->anims[0].samples[0];
+        if(!AL_CookedWrite(out, first->local_joint_poses, nframes * nj * sizeof(struct SQT)))
+            goto out;
+        if(!AL_CookedWrite(out, first->pose_mats, nframes * nj * sizeof(mat4x4_t)))
+            goto out;
+    }
+
+    if(header->has_collision) {
+        for(int i = 0; i < header->num_as; i++) {
+            for(int f = 0; f < header->frame_counts[i]; f++) {
+                if(!AL_CookedWrite(out, &data->anims[i].samples[f].sample_aabb, sizeof(struct aabb)))
+                    goto out;
+            }
+        }
+    }
+    ret = true;
+
+out:
+    free(data);
+    return ret;
+}
+
+void *A_AL_PrivFromCooked(const struct pfobj_hdr *header, struct cooked_reader *reader)
+{
+    struct anim_data *ret = al_data_init(header);
+    if(!ret)
+        goto fail_alloc;
+
+    const uint32_t *layout = AL_CookedRead(reader, 4 * sizeof(uint32_t));
+    if(!layout 
+    || layout[0] != sizeof(struct SQT)
+    || layout[1] != sizeof(struct joint)
+    || layout[2] != sizeof(mat4x4_t)
+    || layout[3] != sizeof(struct aabb))
+        goto fail_parse;
+
+    const size_t nj = header->num_joints;
+    const size_t nframes = al_total_frames(header);
+    const void *src;
+
+    if(!(src = AL_CookedRead(reader, nj * sizeof(struct SQT))))
+        goto fail_parse;
+    memcpy(ret->skel.bind_sqts, src, nj * sizeof(struct SQT));
+
+    if(!(src = AL_CookedRead(reader, nj * sizeof(mat4x4_t))))
+        goto fail_parse;
+    memcpy(ret->skel.inv_bind_poses, src, nj * sizeof(mat4x4_t));
+
+    if(!(src = AL_CookedRead(reader, nj * sizeof(struct joint))))
+        goto fail_parse;
+    memcpy(ret->skel.joints, src, nj * sizeof(struct joint));
+
+    if(!(src = AL_CookedRead(reader, header->num_as * ANIM_NAME_LEN)))
+        goto fail_parse;
+    for(int i = 0; i < header->num_as; i++) {
+        memcpy(ret->anims[i].name, ((const char*)src) + i * ANIM_NAME_LEN, ANIM_NAME_LEN);
+        ret->anims[i].name[ANIM_NAME_LEN-1] = '\0';
+    }
+
+    if(nframes > 0) {
+
+        struct anim_sample *first = &ret->anims[0].samples[0];
+
+        if(!(src = AL_CookedRead(reader, nframes * nj * sizeof(struct SQT))))
+            goto fail_parse;
+        memcpy(first->local_joint_poses, src, nframes * nj * sizeof(struct SQT));
+
+        if(!(src = AL_CookedRead(reader, nframes * nj * sizeof(mat4x4_t))))
+            goto fail_parse;
+        memcpy(first->pose_mats, src, nframes * nj * sizeof(mat4x4_t));
+    }
+
+    if(header->has_collision) {
+        for(int i = 0; i < header->num_as; i++) {
+            for(int f = 0; f < header->frame_counts[i]; f++) {
+                if(!(src = AL_CookedRead(reader, sizeof(struct aabb))))
+                    goto fail_parse;
+                memcpy(&ret->anims[i].samples[f].sample_aabb, src, sizeof(struct aabb));
+            }
+        }
+    }
+
     return ret;
 
 fail_parse:
@@ -46,6 +46,10 @@
 
 struct anim_sample{
     struct SQT  *local_joint_poses;
+    /* Object-space pose matrix of each joint, baked once at load time so 
+     * that all entities on the same frame of a clip share the same palette. 
+     */
+    mat4x4_t    *pose_mats;
     struct aabb  sample_aabb;
 };
 
@@ -37,6 +37,7 @@
 #define ANIM_PRIVATE_H
 
 struct skeleton;
+struct anim_sample;
 
 /* Computes the inverse bind matrix for each joint based on the 
  * joint's bind SQT. The inverse bind matrix will be used by the vertex
@@ -48,4 +49,11 @@ struct skeleton;
  */
 void A_PrepareInvBindMatrices(const struct skeleton *skel);
 
+/* Computes the object-space pose matrix of each joint for a single 
+ * sample of an animation clip from the sample's local joint SQTs. 
+ * The matrices will be written to 'sample->pose_mats', which is 
+ * expected to be allocated already.
+ */
+void A_PreparePoseMatrices(const struct skeleton *skel, struct anim_sample *sample);
+
 #endif
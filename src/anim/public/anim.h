@@ -45,6 +45,7 @@
 #include <SDL.h> /* for SDL_RWops */
 
 struct pfobj_hdr;
+struct cooked_reader;
 struct entity;
 struct skeleton;
 
@@ -94,11 +95,14 @@ void                   A_SetActiveClip(const struct entity *ent, const char *nam
 void                   A_Update(struct entity *ent);
 
 /* ---------------------------------------------------------------------------
- * Retreive a copy of the state needed to render an animated entity.
+ * Retreive the state needed to render an animated entity. The returned pose
+ * matrices are static data that is shared by all entities that are on the
+ * same frame of the same clip. They should not be modified or freed.
  * ---------------------------------------------------------------------------
  */
 void                   A_GetRenderState(const struct entity *ent, size_t *out_njoints, 
-                                        mat4x4_t *out_curr_pose, const mat4x4_t **out_inv_bind_pose);
+                                        const mat4x4_t **out_curr_pose, 
+                                        const mat4x4_t **out_inv_bind_pose);
 
 /* ---------------------------------------------------------------------------
  * Simple utility to get a reference to the skeleton structure in its' default
@@ -188,6 +192,21 @@ size_t A_AL_CtxBuffSize(void);
  */
 void  *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream);
 
+/* ---------------------------------------------------------------------------
+ * Consumes the same lines of the stream as 'A_AL_PrivFromStream' and writes
+ * the data, including the baked pose matrices, to 'out' in the cooked 
+ * (binary) format.
+ * ---------------------------------------------------------------------------
+ */
+bool   A_AL_CookFromStream(const struct pfobj_hdr *header, SDL_RWops *stream, SDL_RWops *out);
+
+/* ---------------------------------------------------------------------------
+ * Like 'A_AL_PrivFromStream', but populates the private data from a cooked 
+ * model. No parsing or matrix baking is performed.
+ * ---------------------------------------------------------------------------
+ */
+void  *A_AL_PrivFromCooked(const struct pfobj_hdr *header, struct cooked_reader *reader);
+
 /* ---------------------------------------------------------------------------
  * Dumps private animation data in PF Object format.
  * ---------------------------------------------------------------------------
@@ -42,6 +42,7 @@
 #include "game/public/game.h"
 #include "map/public/map.h"
 #include "lib/public/khash.h"
+#include "lib/public/vec.h"
 #include "lib/public/pf_string.h"
 
 #include <SDL.h>
@@ -51,7 +52,22 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h> 
+#include <sys/stat.h>
 
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define COOKED_MAGIC "PFOBJBIN"
+#define COOKED_ALIGN (8)
+#define MAX_LOAD_THREADS (16)
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 struct shared_resource{
     uint32_t     ent_flags;
@@ -60,7 +76,68 @@ struct shared_resource{
     struct aabb  aabb;
 };
 
+/* Precedes the raw 'struct pfobj_hdr' at the start of a cooked PFObj. The
+ * source stamp is used to detect cooked files that have gone stale. */
+struct cooked_hdr{
+    char     magic[8];
+    uint32_t version;
+    uint32_t pfobj_hdr_size;
+    uint64_t payload_size;
+    uint64_t src_size;
+    int64_t  src_mtime;
+};
+
+struct mapped_file{
+    const unsigned char *base;
+    size_t               size;
+#if defined(_WIN32)
+    HANDLE               file;
+    HANDLE               mapping;
+#endif
+};
+
+/* A model that has been parsed, but not yet handed over to the renderer */
+struct staged_resource{
+    struct shared_resource res;
+    bool                   cooked;
+    struct mapped_file     file;  /* only for cooked models */
+    const void            *vbuff; /* points into 'file' for cooked models */
+};
+
+struct parallel_job{
+    void       (*code)(void *arg, size_t idx);
+    void        *arg;
+    size_t       njobs;
+    SDL_atomic_t next;
+};
+
+struct preload_entry{
+    char                   path[512];
+    char                   basedir[512];
+    const char            *pfobj_name;
+    bool                   ok;
+    struct staged_resource staged;
+};
+
+struct preload_texture{
+    const char *basedir;
+    const char *name;
+    void       *image;
+};
+
+struct preload_ctx{
+    struct preload_entry   *entries;
+    struct preload_texture *textures;
+};
+
 KHASH_MAP_INIT_STR(entity_res, struct shared_resource)
+KHASH_SET_INIT_STR(name)
+
+VEC_TYPE(pentry, struct preload_entry)
+VEC_IMPL(static inline, pentry, struct preload_entry)
+
+VEC_TYPE(ptex, struct preload_texture)
+VEC_IMPL(static inline, ptex, struct preload_texture)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -168,18 +245,152 @@ static void al_set_ent_defaults(struct entity *ent)
     ent->vision_range = 0.0f;
 }
 
-static bool al_get_resource(const char *path, const char *basedir, 
-                            const char *pfobj_name, struct shared_resource *out)
+static size_t al_cooked_padding(size_t size)
 {
-    SDL_RWops *stream;
-    struct pfobj_hdr header;
+    return (COOKED_ALIGN - (size % COOKED_ALIGN)) % COOKED_ALIGN;
+}
 
-    khiter_t k = kh_get(entity_res, s_name_resource_table, pfobj_name);
-    if(k != kh_end(s_name_resource_table)) {
+static bool al_source_stamp(const char *path, uint64_t *out_size, int64_t *out_mtime)
+{
+    struct stat st;
+    if(stat(path, &st) != 0)
+        return false;
+    *out_size = st.st_size;
+    *out_mtime = st.st_mtime;
+    return true;
+}
 
-        *out = kh_value(s_name_resource_table, k);
-        return true;
+static bool al_map_file(const char *path, struct mapped_file *out)
+{
+#if defined(_WIN32)
+    out->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, 
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(out->file == INVALID_HANDLE_VALUE)
+        goto fail_open;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(out->file, &size) || size.QuadPart == 0)
+        goto fail_map;
+    out->size = size.QuadPart;
+
+    out->mapping = CreateFileMappingA(out->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!out->mapping)
+        goto fail_map;
+
+    out->base = MapViewOfFile(out->mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!out->base) {
+        CloseHandle(out->mapping);
+        goto fail_map;
     }
+    return true;
+
+fail_map:
+    CloseHandle(out->file);
+fail_open:
+    return false;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+        return false;
+
+    out->base = base;
+    out->size = st.st_size;
+    return true;
+#endif
+}
+
+static void al_unmap_file(struct mapped_file *file)
+{
+#if defined(_WIN32)
+    UnmapViewOfFile(file->base);
+    CloseHandle(file->mapping);
+    CloseHandle(file->file);
+#else
+    munmap((void*)file->base, file->size);
+#endif
+}
+
+static bool al_stage_cooked(const char *path, struct staged_resource *out)
+{
+    char cooked_path[512];
+    uint64_t src_size;
+    int64_t src_mtime;
+
+    pf_snprintf(cooked_path, sizeof(cooked_path), "%s" PFOBJ_COOKED_SUFFIX, path);
+
+    if(!al_map_file(cooked_path, &out->file))
+        goto fail_map;
+
+    struct cooked_reader reader = (struct cooked_reader){out->file.base, out->file.base + out->file.size};
+    const struct cooked_hdr *chdr = AL_CookedRead(&reader, sizeof(struct cooked_hdr));
+    if(!chdr)
+        goto fail_parse;
+
+    if(memcmp(chdr->magic, COOKED_MAGIC, sizeof(chdr->magic))
+    || chdr->version != PFOBJ_COOKED_VERSION
+    || chdr->pfobj_hdr_size != sizeof(struct pfobj_hdr))
+        goto fail_parse;
+
+    /* When the source is present, it must not have changed since cooking */
+    if(al_source_stamp(path, &src_size, &src_mtime)
+    && (src_size != chdr->src_size || src_mtime != chdr->src_mtime))
+        goto fail_parse;
+
+    const struct pfobj_hdr *phdr = AL_CookedRead(&reader, sizeof(struct pfobj_hdr));
+    if(!phdr || chdr->payload_size != (size_t)(reader.end - reader.pos))
+        goto fail_parse;
+
+    struct pfobj_hdr header = *phdr;
+    if(header.num_as > MAX_ANIM_SETS || !header.has_collision)
+        goto fail_parse;
+
+    out->res.ent_flags = 0;
+    out->res.render_private = R_AL_PrivParseCooked(&header, &reader, &out->vbuff);
+    if(!out->res.render_private)
+        goto fail_parse;
+
+    out->res.anim_private = A_AL_PrivFromCooked(&header, &reader);
+    if(!out->res.anim_private)
+        goto fail_anim;
+
+    const struct aabb *aabb = AL_CookedRead(&reader, sizeof(struct aabb));
+    if(!aabb)
+        goto fail_aabb;
+    out->res.aabb = *aabb;
+
+    if(header.num_as > 0) {
+        out->res.ent_flags |= ENTITY_FLAG_ANIMATED;
+    }
+    out->res.ent_flags |= ENTITY_FLAG_COLLISION;
+    out->cooked = true;
+    return true;
+
+fail_aabb:
+    free(out->res.anim_private);
+fail_anim:
+    free(out->res.render_private);
+fail_parse:
+    al_unmap_file(&out->file);
+fail_map:
+    return false;
+}
+
+static bool al_stage_ascii(const char *path, struct staged_resource *out)
+{
+    SDL_RWops *stream;
+    struct pfobj_hdr header;
+    void *vbuff;
 
     stream = SDL_RWFromFile(path, "r");
     if(!stream)
@@ -188,46 +399,292 @@ static bool al_get_resource(const char *path, const char *basedir,
     if(!al_parse_pfobj_header(stream, &header))
         goto fail_parse;
 
-    out->ent_flags = 0;
-    out->render_private = R_AL_PrivFromStream(basedir, &header, stream);
-    if(!out->render_private)
+    out->res.ent_flags = 0;
+    out->res.render_private = R_AL_PrivParse(&header, stream, &vbuff);
+    if(!out->res.render_private)
         goto fail_parse;
+    out->vbuff = vbuff;
 
-    out->anim_private = A_AL_PrivFromStream(&header, stream);
-    if(!out->anim_private)
-        goto fail_parse;
+    out->res.anim_private = A_AL_PrivFromStream(&header, stream);
+    if(!out->res.anim_private)
+        goto fail_anim;
 
     if(header.num_as > 0) {
-        out->ent_flags |= ENTITY_FLAG_ANIMATED;
+        out->res.ent_flags |= ENTITY_FLAG_ANIMATED;
     }
 
     if(!header.has_collision) {
         fprintf(stderr, "Imported entities required to have bounding boxes.\n");
-        goto fail_parse;
+        goto fail_aabb;
     }
 
-    out->ent_flags |= ENTITY_FLAG_COLLISION;
-    if(!AL_ParseAABB(stream, &out->aabb))
-        goto fail_parse;
-
-    int put_ret;
-    k = kh_put(entity_res, s_name_resource_table, pf_strdup(pfobj_name), &put_ret);
-    assert(put_ret != -1 && put_ret != 0);
-    kh_value(s_name_resource_table, k) = *out;
+    out->res.ent_flags |= ENTITY_FLAG_COLLISION;
+    if(!AL_ParseAABB(stream, &out->res.aabb))
+        goto fail_aabb;
 
+    out->cooked = false;
     SDL_RWclose(stream);
     return true;
 
+fail_aabb:
+    free(out->res.anim_private);
+fail_anim:
+    free(vbuff);
+    free(out->res.render_private);
 fail_parse:
     SDL_RWclose(stream);
 fail_init:
     return false;
 }
 
+/* Does all the parsing for a model without touching any global state, so
+ * that it's safe to call from any thread. The result is then made usable 
+ * with 'al_commit', from the main thread. 
+ */
+static bool al_stage(const char *path, struct staged_resource *out)
+{
+    /* Prefer the cooked version of the model, falling back to parsing the 
+     * text file when it is missing, stale, or was cooked by an incompatible 
+     * build of the engine. */
+    return al_stage_cooked(path, out)
+        || al_stage_ascii(path, out);
+}
+
+static void al_commit(const char *basedir, const char *pfobj_name, 
+                      struct staged_resource *staged, struct shared_resource *out)
+{
+    R_AL_PrivUpload(staged->res.render_private, basedir, staged->vbuff);
+
+    if(staged->cooked) {
+        al_unmap_file(&staged->file);
+    }else{
+        free((void*)staged->vbuff);
+    }
+
+    int put_ret;
+    khiter_t k = kh_put(entity_res, s_name_resource_table, pf_strdup(pfobj_name), &put_ret);
+    assert(put_ret != -1 && put_ret != 0);
+    kh_value(s_name_resource_table, k) = staged->res;
+
+    *out = staged->res;
+}
+
+/* Releases a staged model that will never be committed */
+static void al_unstage(struct staged_resource *staged)
+{
+    free(staged->res.anim_private);
+    free(staged->res.render_private);
+
+    if(staged->cooked) {
+        al_unmap_file(&staged->file);
+    }else{
+        free((void*)staged->vbuff);
+    }
+}
+
+static bool al_get_resource(const char *path, const char *basedir, 
+                            const char *pfobj_name, struct shared_resource *out)
+{
+    khiter_t k = kh_get(entity_res, s_name_resource_table, pfobj_name);
+    if(k != kh_end(s_name_resource_table)) {
+
+        *out = kh_value(s_name_resource_table, k);
+        return true;
+    }
+
+    struct staged_resource staged;
+    if(!al_stage(path, &staged))
+        return false;
+
+    al_commit(basedir, pfobj_name, &staged, out);
+    return true;
+}
+
+static int al_parallel_worker(void *arg)
+{
+    struct parallel_job *job = arg;
+    int idx;
+    while((idx = SDL_AtomicAdd(&job->next, 1)) < (int)job->njobs) {
+        job->code(job->arg, idx);
+    }
+    return 0;
+}
+
+static void al_preload_job(void *arg, size_t idx)
+{
+    struct preload_ctx *ctx = arg;
+    struct preload_entry *entry = &ctx->entries[idx];
+    entry->ok = al_stage(entry->path, &entry->staged);
+}
+
+static void al_decode_job(void *arg, size_t idx)
+{
+    struct preload_ctx *ctx = arg;
+    struct preload_texture *tex = &ctx->textures[idx];
+    tex->image = R_AL_TextureDecode(tex->basedir, tex->name);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
+void AL_RunParallel(void (*code)(void *arg, size_t idx), void *arg, size_t njobs)
+{
+    SDL_Thread *threads[MAX_LOAD_THREADS];
+    struct parallel_job job = {
+        .code = code,
+        .arg = arg,
+        .njobs = njobs,
+    };
+    SDL_AtomicSet(&job.next, 0);
+
+    /* The calling thread is one of the workers */
+    int nthreads = MIN(SDL_GetCPUCount(), MAX_LOAD_THREADS);
+    nthreads = MIN(nthreads, (int)njobs) - 1;
+
+    int nstarted = 0;
+    for(; nstarted < nthreads; nstarted++) {
+        threads[nstarted] = SDL_CreateThread(al_parallel_worker, "loader", &job);
+        if(!threads[nstarted])
+            break;
+    }
+
+    al_parallel_worker(&job);
+
+    for(int i = 0; i < nstarted; i++) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+}
+
+void AL_PreloadPFObjs(size_t count, const char *const base_paths[], const char *const pfobj_names[])
+{
+    struct preload_ctx ctx = {0};
+    vec_pentry_t entries;
+    vec_ptex_t textures;
+    vec_pentry_init(&entries);
+    vec_ptex_init(&textures);
+
+    khash_t(name) *seen = kh_init(name);
+    if(!seen)
+        goto out;
+
+    for(int i = 0; i < count; i++) {
+
+        if(kh_get(entity_res, s_name_resource_table, pfobj_names[i]) != kh_end(s_name_resource_table))
+            continue;
+        if(kh_get(name, seen, pfobj_names[i]) != kh_end(seen))
+            continue;
+
+        int put_ret;
+        kh_put(name, seen, pfobj_names[i], &put_ret);
+        if(put_ret == -1)
+            goto out;
+
+        struct preload_entry entry = {.pfobj_name = pfobj_names[i]};
+        pf_snprintf(entry.basedir, sizeof(entry.basedir), "%s/%s", g_basepath, base_paths[i]);
+        pf_snprintf(entry.path, sizeof(entry.path), "%s/%s/%s", g_basepath, base_paths[i], pfobj_names[i]);
+        if(!vec_pentry_push(&entries, entry))
+            goto out;
+    }
+
+    /* First, parse all the models */
+    ctx.entries = entries.array;
+    AL_RunParallel(al_preload_job, &ctx, vec_size(&entries));
+
+    /* Then decode every distinct texture referenced by them */
+    khash_t(name) *texpaths = kh_init(name);
+    if(!texpaths)
+        goto fail_texpaths;
+
+    bool texpaths_ok = true;
+    for(int i = 0; i < vec_size(&entries); i++) {
+
+        struct preload_entry *entry = &vec_AT(&entries, i);
+        if(!entry->ok)
+            continue;
+
+        void *priv = entry->staged.res.render_private;
+        for(int j = 0; j < R_AL_PrivNumTextures(priv); j++) {
+
+            char texpath[1024];
+            const char *texname = R_AL_PrivTextureName(priv, j);
+            pf_snprintf(texpath, sizeof(texpath), "%s/%s", entry->basedir, texname);
+
+            if(kh_get(name, texpaths, texpath) != kh_end(texpaths))
+                continue;
+
+            int put_ret;
+            char *key = pf_strdup(texpath);
+            if(key) {
+                kh_put(name, texpaths, key, &put_ret);
+            }
+
+            if(!key || put_ret == -1) {
+                free(key);
+                texpaths_ok = false;
+                goto texpaths_done;
+            }
+
+            if(!vec_ptex_push(&textures, (struct preload_texture){
+                .basedir = entry->basedir,
+                .name = texname,
+            })) {
+                texpaths_ok = false;
+                goto texpaths_done;
+            }
+        }
+    }
+
+texpaths_done:
+    for(khiter_t k = kh_begin(texpaths); k != kh_end(texpaths); k++) {
+        if(kh_exist(texpaths, k))
+            free((void*)kh_key(texpaths, k));
+    }
+    kh_destroy(name, texpaths);
+
+    if(!texpaths_ok)
+        goto fail_texpaths;
+
+    ctx.textures = textures.array;
+    AL_RunParallel(al_decode_job, &ctx, vec_size(&textures));
+
+    /* Finally, hand everything over to the renderer. The textures go first,
+     * so that the models find them already loaded. */
+    for(int i = 0; i < vec_size(&textures); i++) {
+
+        struct preload_texture *tex = &vec_AT(&textures, i);
+        if(tex->image) {
+            R_AL_TextureUpload(tex->basedir, tex->name, tex->image);
+        }
+    }
+
+    for(int i = 0; i < vec_size(&entries); i++) {
+
+        struct preload_entry *entry = &vec_AT(&entries, i);
+        if(!entry->ok)
+            continue;
+
+        struct shared_resource res;
+        al_commit(entry->basedir, entry->pfobj_name, &entry->staged, &res);
+    }
+    goto out;
+
+fail_texpaths:
+    for(int i = 0; i < vec_size(&entries); i++) {
+
+        struct preload_entry *entry = &vec_AT(&entries, i);
+        if(entry->ok) {
+            al_unstage(&entry->staged);
+        }
+    }
+out:
+    if(seen) {
+        kh_destroy(name, seen);
+    }
+    vec_ptex_destroy(&textures);
+    vec_pentry_destroy(&entries);
+}
+
 struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name, 
                                   const char *name, uint32_t uid)
 {
@@ -392,6 +849,89 @@ bool AL_ReadLine(SDL_RWops *stream, char *outbuff)
     return false;
 }
 
+const void *AL_CookedRead(struct cooked_reader *reader, size_t size)
+{
+    size_t padded = size + al_cooked_padding(size);
+    if((size_t)(reader->end - reader->pos) < padded)
+        return NULL;
+
+    const void *ret = reader->pos;
+    reader->pos += padded;
+    return ret;
+}
+
+bool AL_CookedWrite(SDL_RWops *stream, const void *data, size_t size)
+{
+    static const char zeroes[COOKED_ALIGN] = {0};
+    size_t pad = al_cooked_padding(size);
+
+    if(size && SDL_RWwrite(stream, data, size, 1) != 1)
+        return false;
+    if(pad && SDL_RWwrite(stream, zeroes, pad, 1) != 1)
+        return false;
+    return true;
+}
+
+bool AL_CookPFObj(const char *base_path, const char *pfobj_name)
+{
+    char pfobj_path[512], cooked_path[512];
+    struct pfobj_hdr header;
+    struct cooked_hdr chdr = {0};
+    struct aabb aabb;
+
+    pf_snprintf(pfobj_path, sizeof(pfobj_path), "%s/%s/%s", g_basepath, base_path, pfobj_name);
+    pf_snprintf(cooked_path, sizeof(cooked_path), "%s" PFOBJ_COOKED_SUFFIX, pfobj_path);
+
+    if(!al_source_stamp(pfobj_path, &chdr.src_size, &chdr.src_mtime))
+        goto fail_open;
+
+    SDL_RWops *stream = SDL_RWFromFile(pfobj_path, "r");
+    if(!stream)
+        goto fail_open;
+
+    SDL_RWops *out = SDL_RWFromFile(cooked_path, "wb");
+    if(!out)
+        goto fail_out;
+
+    if(!al_parse_pfobj_header(stream, &header) || !header.has_collision)
+        goto fail_cook;
+
+    /* Leave space for the header; it's written last, when the payload size is known */
+    if(!AL_CookedWrite(out, &chdr, sizeof(chdr)) 
+    || !AL_CookedWrite(out, &header, sizeof(header)))
+        goto fail_cook;
+    Sint64 payload_begin = SDL_RWtell(out);
+
+    if(!R_AL_CookFromStream(&header, stream, out))
+        goto fail_cook;
+
+    if(!A_AL_CookFromStream(&header, stream, out))
+        goto fail_cook;
+
+    if(!AL_ParseAABB(stream, &aabb) || !AL_CookedWrite(out, &aabb, sizeof(aabb)))
+        goto fail_cook;
+
+    memcpy(chdr.magic, COOKED_MAGIC, sizeof(chdr.magic));
+    chdr.version = PFOBJ_COOKED_VERSION;
+    chdr.pfobj_hdr_size = sizeof(struct pfobj_hdr);
+    chdr.payload_size = SDL_RWtell(out) - payload_begin;
+
+    if(SDL_RWseek(out, 0, RW_SEEK_SET) != 0 || !AL_CookedWrite(out, &chdr, sizeof(chdr)))
+        goto fail_cook;
+
+    SDL_RWclose(out);
+    SDL_RWclose(stream);
+    return true;
+
+fail_cook:
+    SDL_RWclose(out);
+    remove(cooked_path);
+fail_out:
+    SDL_RWclose(stream);
+fail_open:
+    return false;
+}
+
 bool AL_ParseAABB(SDL_RWops *stream, struct aabb *out)
 {
     char line[MAX_LINE_LEN];
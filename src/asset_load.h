@@ -38,12 +38,17 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <SDL.h> /* for SDL_RWops */
 
 #define MAX_ANIM_SETS 16
 #define MAX_LINE_LEN  256
 
+/* Cooked models are stored next to their source with this suffix appended */
+#define PFOBJ_COOKED_SUFFIX  ".bin"
+#define PFOBJ_COOKED_VERSION (1)
+
 #define READ_LINE(rwops, buff, fail_label)              \
     do{                                                 \
         if(!AL_ReadLine(rwops, buff))                   \
@@ -66,6 +71,13 @@ struct pfobj_hdr{
     bool     has_collision;
 };
 
+/* Sequential view of the sections of a cooked asset that is mapped into 
+ * memory. Every section is padded to a multiple of 8 bytes. */
+struct cooked_reader{
+    const unsigned char *pos;
+    const unsigned char *end;
+};
+
 struct pfmap_hdr{
     float    version;
     unsigned num_materials;
@@ -86,7 +98,28 @@ struct map    *AL_MapFromPFMapStream(SDL_RWops *stream, bool update_navgrid);
 void           AL_MapFree(struct map *map);
 size_t         AL_MapShallowCopySize(SDL_RWops *stream);
 
+/* Parses the specified models, and decodes their textures, using all the 
+ * available cores. The GL uploads are then queued from the calling (main) 
+ * thread. Models that fail to load are skipped here, so that the error is 
+ * reported when they are first instantiated. */
+void           AL_PreloadPFObjs(size_t count, const char *const base_paths[], 
+                                const char *const pfobj_names[]);
+
+/* Invoke 'code' once for every index in [0, njobs) on a set of short-lived 
+ * threads, returning once all the invocations have completed. For use during 
+ * loading only - it is independent of the scheduler's worker threads. */
+void           AL_RunParallel(void (*code)(void *arg, size_t idx), void *arg, size_t njobs);
+
 bool           AL_ReadLine(SDL_RWops *stream, char *outbuff);
 bool           AL_ParseAABB(SDL_RWops *stream, struct aabb *out);
 
+/* Convert the ASCII PFObj file to the binary 'cooked' format, which is then
+ * preferred by the loader, so long as it is newer than the source file. */
+bool           AL_CookPFObj(const char *base_path, const char *pfobj_name);
+
+/* Returns a pointer to the next 'size' bytes of the cooked asset and advances
+ * past them, or NULL if there is not enough data left. */
+const void    *AL_CookedRead(struct cooked_reader *reader, size_t size);
+bool           AL_CookedWrite(SDL_RWops *stream, const void *data, size_t size);
+
 #endif
@@ -36,6 +36,11 @@
 #include "collision.h"
 #include <assert.h>
 #include <float.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define MIN(a, b)     ((a) < (b) ? (a) : (b))
 #define MAX(a, b)     ((a) > (b) ? (a) : (b))
@@ -528,6 +533,104 @@ enum volume_intersec_type C_FrustumOBBIntersectionFast(const struct frustum *fru
     return VOLUME_INTERSEC_INSIDE;
 }
 
+void C_FrustumOBBsVisibleFast(const struct frustum *frustum, size_t count, 
+                              const struct obb *obbs, bool *out_visible)
+{
+    const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
+                                    &frustum->right, &frustum->near, &frustum->far};
+
+    /* The box corners are an affine transform of an AABB's corners, so every corner 
+     * is the center plus or minus each of the three half-edges. The greatest signed
+     * distance of any corner from a plane is then the distance of the center plus
+     * the projected half-edge lengths, and the box is outside the frustum if this
+     * is negative for any plane. This is equivalent to checking every corner.
+     */
+    float nx[ARR_SIZE(planes)], ny[ARR_SIZE(planes)], nz[ARR_SIZE(planes)], nd[ARR_SIZE(planes)];
+    for(int i = 0; i < ARR_SIZE(planes); i++) {
+        nx[i] = planes[i]->normal.x;
+        ny[i] = planes[i]->normal.y;
+        nz[i] = planes[i]->normal.z;
+        nd[i] = PFM_Vec3_Dot((vec3_t*)&planes[i]->normal, (vec3_t*)&planes[i]->point);
+    }
+
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    for(; i + 4 <= count; i += 4) {
+
+        /* Transpose 4 boxes into center and half-edge components */
+        float comps[12][4];
+        for(int k = 0; k < 4; k++) {
+
+            const vec3_t *c = obbs[i + k].corners;
+            for(int d = 0; d < 3; d++) {
+                comps[d][k]     = (c[0].raw[d] + c[7].raw[d]) * 0.5f;
+                comps[3 + d][k] = (c[4].raw[d] - c[0].raw[d]) * 0.5f;
+                comps[6 + d][k] = (c[2].raw[d] - c[0].raw[d]) * 0.5f;
+                comps[9 + d][k] = (c[1].raw[d] - c[0].raw[d]) * 0.5f;
+            }
+        }
+
+        __m128 v[12];
+        for(int j = 0; j < 12; j++)
+            v[j] = _mm_loadu_ps(comps[j]);
+
+        __m128 outside = _mm_setzero_ps();
+        for(int p = 0; p < ARR_SIZE(planes); p++) {
+
+            __m128 px = _mm_set1_ps(nx[p]);
+            __m128 py = _mm_set1_ps(ny[p]);
+            __m128 pz = _mm_set1_ps(nz[p]);
+
+            __m128 dist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, v[0]), 
+                _mm_mul_ps(py, v[1])), _mm_mul_ps(pz, v[2])), _mm_set1_ps(nd[p]));
+
+            for(int e = 1; e < 4; e++) {
+
+                __m128 proj = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, v[3*e + 0]), 
+                    _mm_mul_ps(py, v[3*e + 1])), _mm_mul_ps(pz, v[3*e + 2]));
+                dist = _mm_add_ps(dist, _mm_and_ps(proj, abs_mask));
+            }
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        for(int k = 0; k < 4; k++)
+            out_visible[i + k] = !(mask & (1 << k));
+    }
+#endif
+
+    for(; i < count; i++) {
+
+        const vec3_t *c = obbs[i].corners;
+        bool visible = true;
+
+        for(int p = 0; p < ARR_SIZE(planes) && visible; p++) {
+
+            const float n[3] = {nx[p], ny[p], nz[p]};
+            float dist = -nd[p];
+
+            for(int d = 0; d < 3; d++) {
+                dist += n[d] * (c[0].raw[d] + c[7].raw[d]) * 0.5f;
+            }
+
+            float proj[3] = {0};
+            for(int d = 0; d < 3; d++) {
+                proj[0] += n[d] * (c[4].raw[d] - c[0].raw[d]) * 0.5f;
+                proj[1] += n[d] * (c[2].raw[d] - c[0].raw[d]) * 0.5f;
+                proj[2] += n[d] * (c[1].raw[d] - c[0].raw[d]) * 0.5f;
+            }
+            dist += fabsf(proj[0]) + fabsf(proj[1]) + fabsf(proj[2]);
+
+            if(dist < 0.0f)
+                visible = false;
+        }
+        out_visible[i] = visible;
+    }
+}
+
 bool C_FrustumAABBIntersectionExact(const struct frustum *frustum, const struct aabb *aabb)
 {
     vec3_t aabb_axes[3] = {
@@ -90,6 +90,12 @@ enum volume_intersec_type C_FrustumPointIntersectionFast(const struct frustum *f
 enum volume_intersec_type C_FrustumAABBIntersectionFast (const struct frustum *frustum, const struct aabb *aabb);
 enum volume_intersec_type C_FrustumOBBIntersectionFast  (const struct frustum *frustum, const struct obb *obb);
 
+/* Batched test of 'count' boxes against the frustum. 'out_visible' is set to false 
+ * for each box that has all of its' corners behind one of the frustum planes. Unlike 
+ * C_FrustumOBBIntersectionFast, every plane is always checked. */
+void C_FrustumOBBsVisibleFast(const struct frustum *frustum, size_t count, 
+                              const struct obb *obbs, bool *out_visible);
+
 bool C_FrustumAABBIntersectionExact(const struct frustum *frustum, const struct aabb *aabb);
 bool C_FrustumOBBIntersectionExact(const struct frustum *frustum, const struct obb *obb);
 
@@ -63,9 +63,12 @@
 #define CONFIG_SETTINGS_FILENAME    "pf.conf"
 
 #define CONFIG_LOS_CACHE_SZ         (512)
-#define CONFIG_FLOW_CAHCE_SZ        (512)
+#define CONFIG_FLOW_CAHCE_SZ        (4096)
+/* Default memory budget of the flow field cache, in bytes */
+#define CONFIG_FLOW_CACHE_BUDGET    (8 * 1024 * 1024)
 #define CONFIG_MAPPING_CACHE_SZ     (512)
 #define CONFIG_GRID_PATH_CACHE_SZ   (8192)
+#define CONFIG_ROUTE_CACHE_SZ       (64)
 
 #define CONFIG_FRAME_STEP_HOTKEY    (SDL_SCANCODE_SPACE)
 
@@ -171,6 +171,14 @@ void Entity_FaceTowards(struct entity *ent, vec2_t point)
 
     quat_t rot;
     PFM_Quat_FromRotMat(&rotmat, &rot);
+    Entity_SetRot(ent, rot);
+}
+
+void Entity_SetRot(struct entity *ent, quat_t rot)
+{
     ent->rotation = rot;
+    if(ent->flags & ENTITY_FLAG_STATIC) {
+        G_UpdateBounds(ent);
+    }
 }
 
@@ -97,7 +97,7 @@ struct ent_anim_rstate{
     bool            translucent;
     size_t          njoints;
     const mat4x4_t *inv_bind_pose; /* static, use shallow copy */
-    mat4x4_t        curr_pose[MAX_JOINTS];
+    const mat4x4_t *curr_pose;     /* static, shared by all entities on the same clip frame */
 };
 
 struct ent_vis_state{
@@ -118,5 +118,7 @@ void     Entity_SetNextUID(uint32_t uid);
 void     Entity_CurrentOBB(const struct entity *ent, struct obb *out, bool identity);
 vec3_t   Entity_TopCenterPointWS(const struct entity *ent);
 void     Entity_FaceTowards(struct entity *ent, vec2_t point);
+/* Changes the entity's orientation, keeping any cached bounds in sync */
+void     Entity_SetRot(struct entity *ent, quat_t rot);
 
 #endif
@@ -43,6 +43,8 @@
 #include "game/public/game.h"
 
 #include <assert.h>
+#include <string.h>
+#include <SDL.h>
 
 
 enum handler_type{
@@ -58,6 +60,7 @@ struct handler_desc{
     }handler;
     void          *user_arg;
     int            simmask;    /* Specifies during which simulation states the handler gets invoked */
+    bool           tombstone;  /* Set when the handler is unregistered during a dispatch of its' event */
 };
 
 struct event{
@@ -72,11 +75,23 @@ struct event{
  * entity ID, we will assume entity IDs will never reach this high.
  */
 #define GLOBAL_ID (~((uint32_t)0))
+/* Likewise, used as the receiver of the events sent by the dispatch benchmark */
+#define BENCH_ID  (~((uint32_t)0) - 1)
 
 VEC_TYPE(hd, struct handler_desc)
 VEC_IMPL(static inline, hd, struct handler_desc)
 
-KHASH_MAP_INIT_INT64(handler_desc, vec_hd_t)
+struct handler_list{
+    vec_hd_t handlers;
+    /* The number of dispatches of this event that are currently in progress. 
+     * Handlers can trigger nested dispatches with 'E_Global_NotifyImmediate'. 
+     * While this is non-zero, handlers are not removed from the vector, only 
+     * marked as tombstones. */
+    int      depth;
+    bool     has_tombstones;
+};
+
+KHASH_MAP_INIT_INT64(handler_desc, struct handler_list)
 
 QUEUE_TYPE(event, struct event)
 QUEUE_IMPL(static, event, struct event)
@@ -88,6 +103,9 @@ QUEUE_IMPL(static, event, struct event)
 static khash_t(handler_desc) *s_event_handler_table;
 static queue(event)           s_event_queues[2];
 static int                    s_front_queue_idx = 0;
+/* Incremented whenever the layout of the handler table changes, invalidating 
+ * any iterators into it. */
+static uint32_t               s_table_gen = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -109,33 +127,97 @@ static uint64_t e_key(uint32_t ent_id, enum eventtype event)
     return (((uint64_t)ent_id) << 32) | (uint64_t)event;
 }
 
+static int e_indexof_live(const vec_hd_t *vec, const struct handler_desc *desc)
+{
+    for(int i = 0; i < vec_size(vec); i++) {
+
+        const struct handler_desc *curr = &vec_AT(vec, i);
+        if(curr->tombstone)
+            continue;
+        if(handlers_equal(curr, desc))
+            return i;
+    }
+    return -1;
+}
+
+static void e_release_handler(struct handler_desc *hd)
+{
+    if(hd->type != HANDLER_TYPE_SCRIPT)
+        return;
+
+    S_Release(hd->handler.as_script_callable);
+    S_Release(hd->user_arg); 
+}
+
+/* Remove the handler at 'idx', or just mark it as a tombstone if the event 
+ * is being dispatched right now. Since the dispatch is done by index, the 
+ * order of the remaining handlers must be preserved in the former case. 
+ */
+static void e_remove_handler(struct handler_list *list, int idx)
+{
+    struct handler_desc *hd = &vec_AT(&list->handlers, idx);
+    e_release_handler(hd);
+
+    if(list->depth > 0) {
+        hd->tombstone = true;
+        list->has_tombstones = true;
+        return;
+    }
+
+    memmove(&vec_AT(&list->handlers, idx), &vec_AT(&list->handlers, idx + 1),
+        (vec_size(&list->handlers) - idx - 1) * sizeof(struct handler_desc));
+    vec_size(&list->handlers)--;
+}
+
+static void e_purge_tombstones(struct handler_list *list)
+{
+    assert(list->depth == 0);
+
+    size_t nlive = 0;
+    for(int i = 0; i < vec_size(&list->handlers); i++) {
+
+        struct handler_desc curr = vec_AT(&list->handlers, i);
+        if(curr.tombstone)
+            continue;
+        vec_AT(&list->handlers, nlive++) = curr;
+    }
+
+    vec_size(&list->handlers) = nlive;
+    list->has_tombstones = false;
+}
+
 static bool e_register_handler(uint64_t key, struct handler_desc *desc)
 {
+    desc->tombstone = false;
+
     khiter_t k;
     k = kh_get(handler_desc, s_event_handler_table, key);
 
     if(k == kh_end(s_event_handler_table)) {
 
-        vec_hd_t newv;
-        vec_hd_init(&newv);
-        vec_hd_push(&newv, *desc);
+        struct handler_list newl = (struct handler_list){0};
+        vec_hd_init(&newl.handlers);
+        if(!vec_hd_push(&newl.handlers, *desc)) {
+            vec_hd_destroy(&newl.handlers);
+            return false;
+        }
 
         int ret;
         k = kh_put(handler_desc, s_event_handler_table, key, &ret);
         assert(ret == 1 || ret == 2);
-        kh_value(s_event_handler_table, k) = newv;
+        kh_value(s_event_handler_table, k) = newl;
+        s_table_gen++;
 
     }else{
     
-        vec_hd_t vec = kh_value(s_event_handler_table, k);
+        struct handler_list *list = &kh_value(s_event_handler_table, k);
 
-        int idx;
-        vec_hd_indexof(&vec, *desc, handlers_equal, &idx);
-        if(idx != -1)
-            return false; /* Don't allow registering duplicate handlers for the same event */
+        /* Don't allow registering duplicate handlers for the same event */
+        if(e_indexof_live(&list->handlers, desc) != -1)
+            return false; 
 
-        vec_hd_push(&vec, *desc);
-        kh_value(s_event_handler_table, k) = vec;
+        if(!vec_hd_push(&list->handlers, *desc))
+            return false;
     }
 
     return true;
@@ -149,84 +231,97 @@ static bool e_unregister_handler(uint64_t key, struct handler_desc *desc)
     if(k == kh_end(s_event_handler_table))
         return false;
 
-    vec_hd_t vec = kh_value(s_event_handler_table, k);
-
-    int idx;
-    vec_hd_indexof(&vec, *desc, handlers_equal, &idx);
+    struct handler_list *list = &kh_value(s_event_handler_table, k);
+    int idx = e_indexof_live(&list->handlers, desc);
     if(idx == -1)
         return false;
-    struct handler_desc to_del = vec_AT(&vec, idx);
-
-    if(to_del.type == HANDLER_TYPE_SCRIPT) {
-
-        S_Release(to_del.handler.as_script_callable);
-        S_Release(to_del.user_arg); 
-    }
-
-    vec_hd_del(&vec, idx);
-    kh_value(s_event_handler_table, k) = vec;
 
+    e_remove_handler(list, idx);
     return true;
 }
 
-static void e_handle_event(struct event event)
+/* Run all the handlers for 'key' in the order that they were registered. Only
+ * the handlers present when the dispatch begins are considered. The ones that 
+ * get unregistered while the dispatch is in progress are tombstoned, so they 
+ * are guaranteed never to run and the indices of the others are stable. The 
+ * handler table can be rehashed by a handler, so the table slot is looked up 
+ * again when the table generation changes.
+ */
+static void e_dispatch(uint64_t key, const struct event *event)
 {
-    Sched_HandleEvent(event.type, event.arg, event.source);
+    khiter_t k = kh_get(handler_desc, s_event_handler_table, key);
+    if(k == kh_end(s_event_handler_table))
+        return;
 
-    uint64_t key = e_key(event.receiver_id, event.type);
-    enum simstate ss = G_GetSimState();
-    
-    /* The execution of an event handler can cause one or more event handlers 
-     * to be unregistered. We want to provide a guarantee that once an event 
-     * handler is unregistered, it will never be executed. So, keep fetching 
-     * the handlers vector from the table after every execution, in case it's
-     * been changed by the prior handler call.
-     */
-
-    vec_hd_t execd_handlers;
-    vec_hd_init(&execd_handlers);
-    bool ran; 
-
-    do{
-        ran = false;
-        khiter_t k = kh_get(handler_desc, s_event_handler_table, key);
-        if(k == kh_end(s_event_handler_table))
-            break; 
-
-        vec_hd_t vec = kh_value(s_event_handler_table, k);
-        for(int i = 0; i < vec_size(&vec); i++) {
-        
-            struct handler_desc *elem = &vec_AT(&vec, i);
-            int idx;
-            vec_hd_indexof(&execd_handlers, *elem, handlers_equal, &idx); 
-            if(idx != -1)
-                continue;
-            /* memoize any handlers that we've already ran */
-            vec_hd_push(&execd_handlers, *elem);
+    struct handler_list *list = &kh_value(s_event_handler_table, k);
+    const size_t nhandlers = vec_size(&list->handlers);
+    const enum simstate ss = G_GetSimState();
+    uint32_t gen = s_table_gen;
+    list->depth++;
 
-            if((elem->simmask & ss) == 0)
-                continue;
+    for(int i = 0; i < nhandlers; i++) {
 
-            if(elem->type == HANDLER_TYPE_ENGINE) {
-                elem->handler.as_function(elem->user_arg, event.arg);
-            }else if(elem->type == HANDLER_TYPE_SCRIPT) {
+        if(gen != s_table_gen) {
+            k = kh_get(handler_desc, s_event_handler_table, key);
+            assert(k != kh_end(s_event_handler_table));
+            list = &kh_value(s_event_handler_table, k);
+            gen = s_table_gen;
+        }
 
-                script_opaque_t script_arg = (event.source == ES_SCRIPT) 
-                    ? S_UnwrapIfWeakref(event.arg)
-                    : S_WrapEngineEventArg(event.type, event.arg);
-                assert(script_arg);
+        struct handler_desc elem = vec_AT(&list->handlers, i);
+        if(elem.tombstone)
+            continue;
+        if((elem.simmask & ss) == 0)
+            continue;
 
-                S_RunEventHandler(elem->handler.as_script_callable, S_UnwrapIfWeakref(elem->user_arg), script_arg);
-                S_Release(script_arg);
-            }
+        if(elem.type == HANDLER_TYPE_ENGINE) {
+            elem.handler.as_function(elem.user_arg, event->arg);
+        }else if(elem.type == HANDLER_TYPE_SCRIPT) {
 
-            ran = true;
-            break;
+            script_opaque_t script_arg = (event->source == ES_SCRIPT) 
+                ? S_UnwrapIfWeakref(event->arg)
+                : S_WrapEngineEventArg(event->type, event->arg);
+            assert(script_arg);
+
+            S_RunEventHandler(elem.handler.as_script_callable, S_UnwrapIfWeakref(elem.user_arg), script_arg);
+            S_Release(script_arg);
         }
-    
-    }while(ran);
+    }
+
+    if(gen != s_table_gen) {
+        k = kh_get(handler_desc, s_event_handler_table, key);
+        assert(k != kh_end(s_event_handler_table));
+        list = &kh_value(s_event_handler_table, k);
+    }
+
+    if(--list->depth == 0 && list->has_tombstones)
+        e_purge_tombstones(list);
+}
+
+static void e_bench_handler(void *user, void *event)
+{
+    size_t *ncalls = user;
+    (*ncalls)++;
+}
+
+static void e_bench_churn_handler(void *user, void *event)
+{
+    struct handler_desc hd = (struct handler_desc){
+        .type = HANDLER_TYPE_ENGINE,
+        .handler.as_function = e_bench_handler,
+    };
+    e_unregister_handler(e_key(BENCH_ID, EVENT_UPDATE_START), &hd);
+}
 
-    vec_hd_destroy(&execd_handlers);
+static double e_bench_elapsed_ms(uint64_t begin)
+{
+    return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void e_handle_event(struct event event)
+{
+    Sched_HandleEvent(event.type, event.arg, event.source);
+    e_dispatch(e_key(event.receiver_id, event.type), &event);
 
     if(event.source == ES_SCRIPT)
         S_Release(event.arg);
@@ -265,8 +360,8 @@ void E_Shutdown(void)
         if(!kh_exist(s_event_handler_table, k))
             continue; 
 
-        vec_hd_t vec = kh_value(s_event_handler_table, k);
-        vec_hd_destroy(&vec);
+        struct handler_list *list = &kh_value(s_event_handler_table, k);
+        vec_hd_destroy(&list->handlers);
     }
 
     kh_destroy(handler_desc, s_event_handler_table);
@@ -306,32 +401,28 @@ void E_DeleteScriptHandlers(void)
     uint64_t keys_to_del[kh_size(s_event_handler_table)];
     size_t ntodel = 0;
 
-    uint64_t key;
-    vec_hd_t curr;
+    for(khiter_t k = kh_begin(s_event_handler_table); k != kh_end(s_event_handler_table); ++k) {
 
-    kh_foreach(s_event_handler_table, key, curr, {
+        if(!kh_exist(s_event_handler_table, k))
+            continue;
+
+        struct handler_list *list = &kh_value(s_event_handler_table, k);
 
         /* iterate backwards to delete while iterating */
-        for(int i = vec_size(&curr)-1; i >= 0; i--) {
+        for(int i = vec_size(&list->handlers)-1; i >= 0; i--) {
 
-            struct handler_desc hd = vec_AT(&curr, i);
-            if(hd.type == HANDLER_TYPE_ENGINE)
+            struct handler_desc *hd = &vec_AT(&list->handlers, i);
+            if(hd->type == HANDLER_TYPE_ENGINE || hd->tombstone)
                 continue;
-
-            S_Release(hd.handler.as_script_callable);
-            S_Release(hd.user_arg); 
-            vec_hd_del(&curr, i);
+            e_remove_handler(list, i);
         }
 
-        khiter_t k = kh_get(handler_desc, s_event_handler_table, key);
-        assert(k != kh_end(s_event_handler_table));
-        kh_value(s_event_handler_table, k) = curr;
-
-        if(vec_size(&curr) == 0) {
-            keys_to_del[ntodel++] = key;
-            vec_hd_destroy(&curr);
+        if(vec_size(&list->handlers) == 0) {
+            assert(list->depth == 0);
+            keys_to_del[ntodel++] = kh_key(s_event_handler_table, k);
+            vec_hd_destroy(&list->handlers);
         }
-    });
+    }
     
     for(int i = 0; i < ntodel; i++) {
 
@@ -339,21 +430,23 @@ void E_DeleteScriptHandlers(void)
         assert(k != kh_end(s_event_handler_table));
         kh_del(handler_desc, s_event_handler_table, k);
     }
+    if(ntodel)
+        s_table_gen++;
 }
 
 size_t E_GetScriptHandlers(size_t max_out, struct script_handler *out)
 {
     size_t ret = 0;
     uint64_t key;
-    vec_hd_t curr;
+    struct handler_list curr;
 
     kh_foreach(s_event_handler_table, key, curr, {
 
-        for(int i = 0; i < vec_size(&curr); i++) {
+        for(int i = 0; i < vec_size(&curr.handlers); i++) {
 
             (void)key;
-            struct handler_desc hd = vec_AT(&curr, i);
-            if(hd.type == HANDLER_TYPE_ENGINE)
+            struct handler_desc hd = vec_AT(&curr.handlers, i);
+            if(hd.type == HANDLER_TYPE_ENGINE || hd.tombstone)
                 continue;
 
             if(ret == max_out)
@@ -373,6 +466,70 @@ size_t E_GetScriptHandlers(size_t max_out, struct script_handler *out)
     return ret;
 }
 
+/* Time the dispatch of 'nevents' events to a private receiver with 'nhandlers'
+ * engine handlers. In the 'churn' phase, the first handler unregisters another 
+ * one during every dispatch, which is then registered again after it.
+ */
+bool E_BenchDispatch(size_t nhandlers, size_t nevents, struct event_bench_result *out)
+{
+    const uint64_t key = e_key(BENCH_ID, EVENT_UPDATE_START);
+    const int simmask = G_RUNNING | G_PAUSED_FULL | G_PAUSED_UI_RUNNING;
+    const struct event event = (struct event){EVENT_UPDATE_START, NULL, ES_ENGINE, BENCH_ID};
+    bool ret = false;
+
+    memset(out, 0, sizeof(*out));
+    struct handler_desc hd = (struct handler_desc){
+        .type = HANDLER_TYPE_ENGINE,
+        .handler.as_function = e_bench_handler,
+        .user_arg = &out->ncalls,
+        .simmask = simmask,
+    };
+    struct handler_desc churn = (struct handler_desc){
+        .type = HANDLER_TYPE_ENGINE,
+        .handler.as_function = e_bench_churn_handler,
+        .simmask = simmask,
+    };
+
+    if(kh_get(handler_desc, s_event_handler_table, key) != kh_end(s_event_handler_table))
+        return false;
+    if(!e_register_handler(key, &churn))
+        return false;
+
+    /* The handlers share the function, so they are added directly to bypass 
+     * the check for duplicates. The churn handler is skipped during the first
+     * phase by marking it as a tombstone. */
+    khiter_t k = kh_get(handler_desc, s_event_handler_table, key);
+    struct handler_list *list = &kh_value(s_event_handler_table, k);
+    vec_AT(&list->handlers, 0).tombstone = true;
+
+    for(int i = 0; i < nhandlers; i++) {
+        if(!vec_hd_push(&list->handlers, hd))
+            goto out;
+    }
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(int i = 0; i < nevents; i++) {
+        e_dispatch(key, &event);
+    }
+    out->dispatch_ms = e_bench_elapsed_ms(begin);
+
+    vec_AT(&list->handlers, 0).tombstone = false;
+
+    begin = SDL_GetPerformanceCounter();
+    for(int i = 0; i < nevents; i++) {
+        e_dispatch(key, &event);
+        vec_hd_push(&list->handlers, hd);
+    }
+    out->churn_ms = e_bench_elapsed_ms(begin);
+    ret = true;
+
+out:
+    vec_hd_destroy(&list->handlers);
+    kh_del(handler_desc, s_event_handler_table, k);
+    s_table_gen++;
+    return ret;
+}
+
 /*
  * Global Events
  */
@@ -112,6 +112,12 @@ struct script_handler{
     script_opaque_t arg;
 };
 
+struct event_bench_result{
+    double dispatch_ms;
+    double churn_ms;
+    size_t ncalls;
+};
+
 /*###########################################################################*/
 /* EVENT GENERAL                                                             */
 /*###########################################################################*/
@@ -122,6 +128,7 @@ void   E_Shutdown(void);
 void   E_DeleteScriptHandlers(void);
 size_t E_GetScriptHandlers(size_t max_out, struct script_handler *out);
 void   E_ClearPendingEvents(void);
+bool   E_BenchDispatch(size_t nhandlers, size_t nevents, struct event_bench_result *out);
 
 /*###########################################################################*/
 /* EVENT GLOBAL                                                              */
@@ -101,6 +101,12 @@ struct saved_ctx{
 /*****************************************************************************/
 
 static struct saved_ctx s_debug_saved;
+/* The entity whose HRVOs are saved is chosen on the main thread at
+ * the start of the tick, so that velocities may then be computed 
+ * concurrently with only a single one of them touching the debug state.
+ */
+static bool             s_debug_save;
+static uint32_t         s_debug_uid;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -395,20 +401,7 @@ static void remove_furthest(vec2_t xz_pos, vec_cp_ent_t *dyn_inout, vec_cp_ent_t
 /* Save the combined HRVO of the first selected entity for debug rendering */
 static bool should_save_debug(uint32_t ent_uid)
 {
-    struct sval setting;
-    ss_e status = Settings_Get("pf.debug.show_first_sel_combined_hrvo", &setting);
-    assert(status == SS_OKAY);
-
-    if(!setting.as_bool)
-        return false;
-
-    enum selection_type seltype;
-    const vec_pentity_t *sel = G_Sel_Get(&seltype);
-
-    if(vec_size(sel) == 0)
-        return false; 
-
-    return true;
+    return s_debug_save && (ent_uid == s_debug_uid);
 }
 
 static void on_render_3d(void *user, void *event)
@@ -585,7 +578,9 @@ static bool clearpath_new_velocity(struct cp_ent cpent,
     PFM_Vec2_Add(&cpent.xz_pos, &ent_des_v, &des_v_ws);
     if(!inside_pcr(rays, n_rays, des_v_ws)) {
 
-        s_debug_saved.des_v_in_pcr = false;
+        if(should_save_debug(ent_uid)) {
+            s_debug_saved.des_v_in_pcr = false;
+        }
         *out = ent_des_v;
         return true;
     }
@@ -642,6 +637,27 @@ void G_ClearPath_Shutdown(void)
     vec_vec2_destroy(&s_debug_saved.xpoints);
 }
 
+void G_ClearPath_BeginTick(void)
+{
+    s_debug_save = false;
+
+    struct sval setting;
+    ss_e status = Settings_Get("pf.debug.show_first_sel_combined_hrvo", &setting);
+    assert(status == SS_OKAY);
+
+    if(!setting.as_bool)
+        return;
+
+    enum selection_type seltype;
+    const vec_pentity_t *sel = G_Sel_Get(&seltype);
+
+    if(vec_size(sel) == 0)
+        return; 
+
+    s_debug_save = true;
+    s_debug_uid = vec_AT(sel, 0)->uid;
+}
+
 vec2_t G_ClearPath_NewVelocity(struct cp_ent cpent,
                                uint32_t ent_uid,
                                vec2_t ent_des_v,
@@ -59,6 +59,10 @@ VEC_IMPL(static inline, cp_ent, struct cp_ent)
 
 void G_ClearPath_Init(const struct map *map);
 void G_ClearPath_Shutdown(void);
+/* Must be called on the main thread before computing the velocities 
+ * for a tick. Afterwards, G_ClearPath_NewVelocity may be invoked from 
+ * multiple threads at once. */
+void G_ClearPath_BeginTick(void);
 
 vec2_t G_ClearPath_NewVelocity(struct cp_ent ent,
                                uint32_t ent_uid,
@@ -37,6 +37,7 @@
 #include "game_private.h"
 #include "movement.h"
 #include "building.h"
+#include "position.h"
 #include "public/game.h"
 #include "../event.h"
 #include "../entity.h"
@@ -166,13 +167,13 @@ static void dying_remove(const struct entity *ent)
     vec_pentity_del(&s_dying_ents, idx);
 }
 
-static bool enemies(const struct entity *a, const struct entity *b)
+static bool enemies(int faction_a, int faction_b)
 {
-    if(a->faction_id == b->faction_id)
+    if(faction_a == faction_b)
         return false;
 
     enum diplomacy_state ds;
-    bool result = G_GetDiplomacyState(a->faction_id, b->faction_id, &ds);
+    bool result = G_GetDiplomacyState(faction_a, faction_b, &ds);
 
     assert(result);
     return (ds == DIPLOMACY_STATE_WAR);
@@ -192,13 +193,21 @@ static struct entity *closest_enemy_in_range(const struct entity *ent)
     float min_dist = FLT_MAX;
     struct entity *ret = NULL;
 
-    struct entity *near_ents[128];
-    int num_near = G_Pos_EntsInCircle(G_Pos_GetXZ(ent->uid), 
-        ENEMY_TARGET_ACQUISITION_RANGE, near_ents, ARR_SIZE(near_ents));
+    const struct pos_store *store = G_Pos_Store();
+    vec2_t xz_pos = G_Pos_GetXZ(ent->uid);
+
+    uint32_t near_slots[128];
+    int num_near = G_Pos_SlotsInCircle(xz_pos, ENEMY_TARGET_ACQUISITION_RANGE, 
+        near_slots, ARR_SIZE(near_slots));
 
     for(int i = 0; i < num_near; i++) {
 
-        struct entity *curr = near_ents[i];
+        /* Filter out our own faction's entities without having to touch them */
+        uint32_t slot = near_slots[i];
+        if(store->faction[slot] == ent->faction_id)
+            continue;
+
+        struct entity *curr = store->ents[slot];
         if(curr == ent)
             continue;
         if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
@@ -207,7 +216,7 @@ static struct entity *closest_enemy_in_range(const struct entity *ent)
             continue;
         if((curr->flags & ENTITY_FLAG_BUILDING) && !G_Building_IsFounded(curr))
             continue;
-        if(!enemies(ent, curr))
+        if(!enemies(ent->faction_id, store->faction[slot]))
             continue;
 
         struct combatstate *cs = combatstate_get(curr->uid);
@@ -215,7 +224,11 @@ static struct entity *closest_enemy_in_range(const struct entity *ent)
         if(cs->state == STATE_DEATH_ANIM_PLAYING)
             continue;
    
-        float dist = ents_distance(ent, curr);
+        vec2_t delta;
+        vec2_t curr_xz_pos = (vec2_t){store->pos[slot].x, store->pos[slot].z};
+        PFM_Vec2_Sub(&xz_pos, &curr_xz_pos, &delta);
+
+        float dist = PFM_Vec2_Len(&delta) - ent->selection_radius - store->radius[slot];
         if(dist < min_dist) {
             min_dist = dist; 
             ret = curr;
@@ -245,7 +258,7 @@ static void entity_turn_to_target(struct entity *ent, const struct entity *targe
     vec2_t ent_to_target;
     PFM_Vec2_Sub(&tar_pos_xz, &ent_pos_xz, &ent_to_target);
     PFM_Vec2_Normal(&ent_to_target, &ent_to_target);
-    ent->rotation = quat_from_vec(ent_to_target);
+    Entity_SetRot(ent, quat_from_vec(ent_to_target));
 }
 
 static void on_death_anim_finish(void *user, void *event)
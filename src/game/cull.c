@@ -0,0 +1,263 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "cull.h"
+#include "../entity.h"
+#include "../collision.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
+#include "../map/public/tile.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+
+#define BIN_DIM_X   (TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE)
+#define BIN_DIM_Z   (TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE)
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
+
+struct bin_ent{
+    struct entity *ent;
+    struct obb     obb;
+};
+
+VEC_TYPE(bent, struct bin_ent)
+VEC_IMPL(static inline, bent, struct bin_ent)
+
+struct bin{
+    struct aabb  bounds;
+    vec_bent_t   ents;
+};
+
+KHASH_MAP_INIT_INT(bin, struct bin*)
+KHASH_MAP_INIT_INT(key, uint32_t)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* Maps a packed (row, column) chunk coordinate to the bin for that chunk */
+static khash_t(bin) *s_bins;
+/* Maps an entity UID to the key of the bin holding it */
+static khash_t(key) *s_ent_bin;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t bin_key(const struct obb *obb)
+{
+    int r = floor(obb->center.z / BIN_DIM_Z);
+    int c = floor(obb->center.x / BIN_DIM_X);
+    return (((uint32_t)(uint16_t)r) << 16) | ((uint32_t)(uint16_t)c);
+}
+
+static struct aabb empty_bounds(void)
+{
+    return (struct aabb){
+        .x_min = FLT_MAX, .x_max = -FLT_MAX,
+        .y_min = FLT_MAX, .y_max = -FLT_MAX,
+        .z_min = FLT_MAX, .z_max = -FLT_MAX,
+    };
+}
+
+static void bounds_add_obb(struct aabb *bounds, const struct obb *obb)
+{
+    for(int i = 0; i < ARR_SIZE(obb->corners); i++) {
+
+        const vec3_t *c = &obb->corners[i];
+        bounds->x_min = MIN(bounds->x_min, c->x);
+        bounds->x_max = MAX(bounds->x_max, c->x);
+        bounds->y_min = MIN(bounds->y_min, c->y);
+        bounds->y_max = MAX(bounds->y_max, c->y);
+        bounds->z_min = MIN(bounds->z_min, c->z);
+        bounds->z_max = MAX(bounds->z_max, c->z);
+    }
+}
+
+static struct bin *bin_get(uint32_t key)
+{
+    khiter_t k = kh_get(bin, s_bins, key);
+    if(k != kh_end(s_bins))
+        return kh_val(s_bins, k);
+
+    struct bin *ret = malloc(sizeof(struct bin));
+    if(!ret)
+        return NULL;
+
+    int status;
+    k = kh_put(bin, s_bins, key, &status);
+    if(status == -1) {
+        free(ret);
+        return NULL;
+    }
+
+    ret->bounds = empty_bounds();
+    vec_bent_init(&ret->ents);
+    kh_val(s_bins, k) = ret;
+    return ret;
+}
+
+static void bin_remove(struct bin *bin, uint32_t uid)
+{
+    for(int i = 0; i < vec_size(&bin->ents); i++) {
+
+        if(vec_AT(&bin->ents, i).ent->uid != uid)
+            continue;
+
+        vec_bent_del(&bin->ents, i);
+        break;
+    }
+
+    /* The bounds can only shrink, so they are rebuilt from the remaining entities */
+    bin->bounds = empty_bounds();
+    for(int i = 0; i < vec_size(&bin->ents); i++) {
+        bounds_add_obb(&bin->bounds, &vec_AT(&bin->ents, i).obb);
+    }
+}
+
+static void bins_free(void)
+{
+    struct bin *curr;
+    kh_foreach_value(s_bins, curr, {
+        vec_bent_destroy(&curr->ents);
+        free(curr);
+    });
+    kh_clear(bin, s_bins);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Cull_Init(void)
+{
+    s_bins = kh_init(bin);
+    if(!s_bins)
+        goto fail_bins;
+
+    s_ent_bin = kh_init(key);
+    if(!s_ent_bin)
+        goto fail_ent_bin;
+
+    return true;
+
+fail_ent_bin:
+    kh_destroy(bin, s_bins);
+fail_bins:
+    return false;
+}
+
+void G_Cull_Shutdown(void)
+{
+    bins_free();
+    kh_destroy(key, s_ent_bin);
+    kh_destroy(bin, s_bins);
+}
+
+void G_Cull_Clear(void)
+{
+    bins_free();
+    kh_clear(key, s_ent_bin);
+}
+
+bool G_Cull_AddStatic(const struct entity *ent)
+{
+    G_Cull_RemoveStatic(ent->uid);
+
+    struct bin_ent bent = (struct bin_ent){ .ent = (struct entity*)ent };
+    Entity_CurrentOBB(ent, &bent.obb, false);
+
+    uint32_t key = bin_key(&bent.obb);
+    struct bin *bin = bin_get(key);
+    if(!bin)
+        return false;
+
+    int status;
+    khiter_t k = kh_put(key, s_ent_bin, ent->uid, &status);
+    if(status == -1)
+        return false;
+
+    if(!vec_bent_push(&bin->ents, bent)) {
+        kh_del(key, s_ent_bin, k);
+        return false;
+    }
+
+    kh_val(s_ent_bin, k) = key;
+    bounds_add_obb(&bin->bounds, &bent.obb);
+    return true;
+}
+
+void G_Cull_RemoveStatic(uint32_t uid)
+{
+    khiter_t k = kh_get(key, s_ent_bin, uid);
+    if(k == kh_end(s_ent_bin))
+        return;
+
+    uint32_t key = kh_val(s_ent_bin, k);
+    kh_del(key, s_ent_bin, k);
+
+    khiter_t bk = kh_get(bin, s_bins, key);
+    assert(bk != kh_end(s_bins));
+    bin_remove(kh_val(s_bins, bk), uid);
+}
+
+void G_Cull_StaticCandidates(const struct frustum *a, const struct frustum *b,
+                             vec_pentity_t *out_ents, vec_obb_t *out_obbs)
+{
+    struct bin *curr;
+    kh_foreach_value(s_bins, curr, {
+
+        if(vec_size(&curr->ents) == 0)
+            continue;
+
+        if(C_FrustumAABBIntersectionFast(a, &curr->bounds) == VOLUME_INTERSEC_OUTSIDE
+        && C_FrustumAABBIntersectionFast(b, &curr->bounds) == VOLUME_INTERSEC_OUTSIDE)
+            continue;
+
+        for(int i = 0; i < vec_size(&curr->ents); i++) {
+
+            const struct bin_ent *bent = &vec_AT(&curr->ents, i);
+            vec_pentity_push(out_ents, bent->ent);
+            vec_obb_push(out_obbs, bent->obb);
+        }
+    });
+}
+
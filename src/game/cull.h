@@ -0,0 +1,69 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#ifndef CULL_H
+#define CULL_H
+
+#include "public/game.h"
+#include "selection.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct entity;
+struct frustum;
+
+/* Static, non-animated entities never change their bounds on their own, 
+ * so their OBBs are cached and they are binned by the map chunk holding 
+ * their center. Each bin tracks the combined bounds of its' entities, 
+ * allowing whole chunks to be rejected with a single frustum test. 
+ */
+
+bool G_Cull_Init(void);
+void G_Cull_Shutdown(void);
+void G_Cull_Clear(void);
+
+/* Cache the current bounds of the entity, moving it to a new bin if needed */
+bool G_Cull_AddStatic(const struct entity *ent);
+void G_Cull_RemoveStatic(uint32_t uid);
+
+/* Append all the entities (and their cached OBBs) from the bins that intersect 
+ * either of the two frusta. */
+void G_Cull_StaticCandidates(const struct frustum *a, const struct frustum *b,
+                             vec_pentity_t *out_ents, vec_obb_t *out_obbs);
+
+#endif
+
@@ -51,12 +51,19 @@
 #include <assert.h>
 #include <SDL.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 #define MIN(a, b)               ((a) < (b) ? (a) : (b))
 #define MAX(a, b)               ((a) > (b) ? (a) : (b))
 #define CLAMP(a, min, max)      (MIN(MAX((a), (min)), (max)))
 #define ARR_SIZE(a)             (sizeof(a)/sizeof(a[0]))
-#define FAC_STATE(val, fac_id)  (((val) >> ((fac_id) * 2)) & 0x3)
+#define BITSET_WORDS(n)         (((n) + 63) / 64)
+#define BIT_TEST(set, i)        (!!((set)[(i) / 64] & ((uint64_t)1 << ((i) % 64))))
+#define BIT_SET(set, i)         ((set)[(i) / 64] |= ((uint64_t)1 << ((i) % 64)))
+#define BIT_CLEAR(set, i)       ((set)[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
 
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
@@ -70,45 +77,68 @@ enum fog_state{
     STATE_VISIBLE,
 };
 
+struct stencil_row{
+    int16_t dr, dc_min, dc_max;
+};
+
+/* The set of tiles that is seen from a tile on flat terrain with a 
+ * particular vision radius, given as row spans relative to the origin tile. */
+struct vis_stencil{
+    size_t             nrows;
+    struct stencil_row rows[];
+};
+
+/* A set of bits within a single word of a bitplane */
+struct word_mask{
+    size_t   idx;
+    uint64_t bits;
+};
+
 PQUEUE_TYPE(td, struct tile_desc)
 PQUEUE_IMPL(static, td, struct tile_desc)
 
 KHASH_SET_INIT_INT(uid)
+KHASH_MAP_INIT_INT(stencil, struct vis_stencil*)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static const struct map *s_map;
-/* Holds a 32-bit value for every tile of the map. The chunks are stored in row-major
- * order. Within a chunk, the tiles are in row-major order. Each 32-bit value encodes
- * a 2-bit faction state for up to 16 factions. */
-static uint32_t         *s_fog_state;
+/* One bitplane per faction, with a bit for every tile of the map. The chunks are 
+ * stored in row-major order. Within a chunk, the tiles are in row-major order. A 
+ * visible tile is always explored as well. */
+static uint64_t         *s_visible[MAX_FACTIONS];
+static uint64_t         *s_explored[MAX_FACTIONS];
 /* How many units of a faction currently 'see' every tile. */
 static uint8_t          *s_vision_refcnts[MAX_FACTIONS];
 /* Cache all the entities that have been explored by the player, for faster queries */
 static khash_t(uid)     *s_explored_cache;
 static bool              s_enabled = true;
+/* The combined player visibility state of every tile, as it was last sent to 
+ * the render thread. Has the same layout as the bitplanes. */
+static unsigned char    *s_player_vis;
+/* One bit per chunk, set when the state of any of the chunk's tiles changes. 
+ * Only the dirty chunks are re-examined when updating the player visibility. */
+static uint64_t         *s_dirty_chunks;
+/* Set when the whole player visibility buffer must be re-computed and sent, 
+ * ex. after loading a session or toggling the fog */
+static bool              s_full_rebuild;
+static uint16_t          s_last_player_mask;
+/* Vision stencils keyed by the bits of the vision radius */
+static khash_t(stencil) *s_stencils;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool fog_any_matches(uint32_t val, enum fog_state state)
-{
-    for(;val; val >>= 2) {
-        if((val & 0x3) == state)
-            return true;
-    }
-    return false;
-}
-
-static void fog_set_state(uint32_t *inout_tileval, int faction_id, enum fog_state state)
+static enum fog_state fog_state(int faction_id, size_t idx)
 {
-    assert(state >= 0 && state < 4);
-    uint32_t val = *inout_tileval & ~(0x3 << faction_id * 2);
-    val |= (state << (faction_id * 2));
-    *inout_tileval = val;
+    if(BIT_TEST(s_visible[faction_id], idx))
+        return STATE_VISIBLE;
+    if(BIT_TEST(s_explored[faction_id], idx))
+        return STATE_IN_FOG;
+    return STATE_UNEXPLORED;
 }
 
 static int td_index(struct tile_desc td)
@@ -121,18 +151,70 @@ static int td_index(struct tile_desc td)
         + (td.tile_r * res.tile_w + td.tile_c);
 }
 
-static void update_tile(int faction_id, struct tile_desc td, int delta)
+static void mark_dirty(struct tile_desc td)
 {
-    uint8_t old = s_vision_refcnts[faction_id][td_index(td)];
-    uint8_t new = old + delta;
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    int chunk_idx = td.chunk_r * res.chunk_w + td.chunk_c;
+    BIT_SET(s_dirty_chunks, chunk_idx);
+}
 
-    if(new) {
-        fog_set_state(s_fog_state + td_index(td), faction_id, STATE_VISIBLE);
-    }else{
-        fog_set_state(s_fog_state + td_index(td), faction_id, STATE_IN_FOG);
+/* Update 'len' consecutive tiles, starting at tile index 'begin'. The visibility
+ * of the whole span is set with word-wide operations when vision is added. When 
+ * it is removed, only the tiles whose refcount reaches zero are cleared.
+ */
+static void update_span(int faction_id, size_t begin, size_t len, int delta)
+{
+    uint8_t *refcnts = s_vision_refcnts[faction_id] + begin;
+    for(int i = 0; i < len; i++) {
+        refcnts[i] += delta;
     }
 
-    s_vision_refcnts[faction_id][td_index(td)] = new;
+    uint64_t *visible = s_visible[faction_id];
+    uint64_t *explored = s_explored[faction_id];
+    size_t end = begin + len;
+
+    while(begin < end) {
+
+        size_t word = begin / 64;
+        size_t lo = begin % 64;
+        size_t hi = MIN(64, lo + (end - begin));
+        uint64_t mask = (hi - lo == 64) ? ~(uint64_t)0 
+                      : (((uint64_t)1 << (hi - lo)) - 1) << lo;
+
+        if(delta > 0) {
+            visible[word] |= mask;
+            explored[word] |= mask;
+        }else{
+            uint64_t zero = 0;
+            for(size_t b = lo; b < hi; b++) {
+                if(s_vision_refcnts[faction_id][word * 64 + b] == 0)
+                    zero |= ((uint64_t)1 << b);
+            }
+            visible[word] &= ~zero;
+        }
+        begin += hi - lo;
+    }
+}
+
+/* Update 'len' consecutive tiles of the same map row, starting at 'start'. The 
+ * row is split into one span per chunk that it passes through. */
+static void update_row(int faction_id, struct tile_desc start, int len, int delta)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    while(len > 0) {
+
+        int n = MIN(len, res.tile_w - start.tile_c);
+        mark_dirty(start);
+        update_span(faction_id, td_index(start), n, delta);
+
+        len -= n;
+        if(len > 0 && !M_Tile_RelativeDesc(res, &start, n, 0))
+            break;
+    }
 }
 
 static size_t neighbours(struct tile_desc curr, struct tile_desc *out)
@@ -265,6 +347,104 @@ void td_delta(struct tile_desc a, struct tile_desc b, int *out_dr, int *out_dc)
     *out_dc = bc - ac;
 }
 
+static uint32_t radius_key(float radius)
+{
+    uint32_t ret;
+    memcpy(&ret, &radius, sizeof(ret));
+    return ret;
+}
+
+static struct vis_stencil *fog_stencil_for_radius(float radius)
+{
+    uint32_t key = radius_key(radius);
+    khiter_t k = kh_get(stencil, s_stencils, key);
+    if(k != kh_end(s_stencils))
+        return kh_val(s_stencils, k);
+
+    const int tile_x_radius = ceil(radius / X_COORDS_PER_TILE);
+    const int tile_z_radius = ceil(radius / Z_COORDS_PER_TILE);
+    const size_t maxrows = 2 * tile_z_radius + 1;
+
+    struct vis_stencil *ret = malloc(sizeof(struct vis_stencil) + maxrows * sizeof(struct stencil_row));
+    if(!ret)
+        return NULL;
+    ret->nrows = 0;
+
+    /* The area within the radius is convex and symmetric, so every row is 
+     * a single span that is centered on the origin column. */
+    for(int dr = -tile_z_radius; dr <= tile_z_radius; dr++) {
+
+        int dc = 0;
+        while(true) {
+            vec2_t delta = (vec2_t){(dc + 1) * X_COORDS_PER_TILE, dr * Z_COORDS_PER_TILE};
+            if(dc + 1 > tile_x_radius || PFM_Vec2_Len(&delta) > radius)
+                break;
+            dc++;
+        }
+
+        vec2_t delta = (vec2_t){0.0f, dr * Z_COORDS_PER_TILE};
+        if(PFM_Vec2_Len(&delta) > radius)
+            continue;
+        ret->rows[ret->nrows++] = (struct stencil_row){dr, -dc, dc};
+    }
+
+    int status;
+    k = kh_put(stencil, s_stencils, key, &status);
+    if(status == -1) {
+        free(ret);
+        return NULL;
+    }
+    kh_val(s_stencils, k) = ret;
+    return ret;
+}
+
+/* When no tile within the vision radius is high enough to block the line of 
+ * sight, the flood fill reaches every tile in the radius. In that case, the 
+ * update is done by applying the precomputed stencil instead. Returns false 
+ * if the terrain is not flat enough for the stencil to be used.
+ */
+static bool fog_update_visible_flat(int faction_id, struct tile_desc origin, 
+                                    int origin_height, float radius, int delta)
+{
+    const struct vis_stencil *stencil = fog_stencil_for_radius(radius);
+    if(!stencil)
+        return false;
+
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    const int map_tiles_w = res.chunk_w * res.tile_w;
+    const int origin_c = origin.chunk_c * res.tile_w + origin.tile_c;
+
+    struct tile_desc starts[stencil->nrows];
+    int lens[stencil->nrows];
+
+    for(int i = 0; i < stencil->nrows; i++) {
+
+        const struct stencil_row *row = &stencil->rows[i];
+        int dc_min = MAX(row->dc_min, -origin_c);
+        int dc_max = MIN(row->dc_max, map_tiles_w - 1 - origin_c);
+
+        lens[i] = 0;
+        starts[i] = origin;
+        if(!M_Tile_RelativeDesc(res, &starts[i], dc_min, row->dr))
+            continue;
+
+        struct tile_desc curr = starts[i];
+        for(int dc = dc_min; dc <= dc_max; dc++) {
+            if(td_los_blocked(curr, origin_height))
+                return false;
+            M_Tile_RelativeDesc(res, &curr, 1, 0);
+        }
+        lens[i] = dc_max - dc_min + 1;
+    }
+
+    for(int i = 0; i < stencil->nrows; i++) {
+        update_row(faction_id, starts[i], lens[i], delta);
+    }
+    return true;
+}
+
 static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int delta)
 {
     if(radius == 0.0f)
@@ -281,6 +461,9 @@ static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int
     M_TileForDesc(s_map, origin, &tile);
     int origin_height = M_Tile_BaseHeight(tile);
 
+    if(fog_update_visible_flat(faction_id, origin, origin_height, radius, delta))
+        return;
+
     const int tile_x_radius = ceil(radius / X_COORDS_PER_TILE);
     const int tile_z_radius = ceil(radius / Z_COORDS_PER_TILE);
     assert(tile_x_radius && tile_z_radius);
@@ -295,12 +478,17 @@ static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int
     bool visited[2 * tile_x_radius  + 1][2 * tile_z_radius + 1];
     memset(visited, 0, sizeof(visited));
 
+    /* The tiles reached by the flood, in row-major order, so that they can be 
+     * updated a row span at a time once the flood is done. */
+    bool seen[2 * tile_z_radius + 1][2 * tile_x_radius + 1];
+    memset(seen, 0, sizeof(seen));
+
     pq_td_t frontier;
     pq_td_init(&frontier);
 
     pq_td_push(&frontier, 0.0f, origin);
     visited[tile_x_radius][tile_z_radius] = true;
-    update_tile(faction_id, origin, delta);
+    seen[tile_z_radius][tile_x_radius] = true;
 
     while(pq_size(&frontier) > 0) {
 
@@ -339,43 +527,233 @@ static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int
             if(td_los_blocked(neighbs[i], origin_height))
                 continue;
 
-            update_tile(faction_id, neighbs[i], delta);
+            seen[tile_z_radius + dr][tile_x_radius + dc] = true;
             pq_td_push(&frontier, PFM_Vec2_Len(&origin_delta), neighbs[i]);
         }
     }
 
     pq_td_destroy(&frontier);
+
+    for(int dr = -tile_z_radius; dr <= tile_z_radius; dr++) {
+    for(int dc = -tile_x_radius; dc <= tile_x_radius; dc++) {
+
+        if(!seen[tile_z_radius + dr][tile_x_radius + dc])
+            continue;
+
+        int len = 1;
+        while(dc + len <= tile_x_radius && seen[tile_z_radius + dr][tile_x_radius + dc + len])
+            len++;
+
+        struct tile_desc start = origin;
+        status = M_Tile_RelativeDesc(res, &start, dc, dr);
+        assert(status);
+        update_row(faction_id, start, len, delta);
+        dc += len;
+    }}
 }
 
-static bool fog_obj_matches(uint16_t fac_mask, const struct obb *obj, enum fog_state *states, size_t nstates)
+/* Test if any of the tiles under the object are explored (or visible) by any of 
+ * the factions in the mask. The tiles are first merged into per-word bitmasks so 
+ * that every faction's bitplane is tested a whole word at a time. */
+static bool fog_obj_matches(uint16_t fac_mask, const struct obb *obj, bool explored)
 {
     vec3_t pos = M_GetPos(s_map);
     struct map_resolution res;
     M_GetResolution(s_map, &res);
 
-    uint32_t facstate_mask = 0;
-    for(int i = 0; fac_mask; fac_mask >>= 1, i++) {
-        if(fac_mask & 0x1) {
-            facstate_mask |= (0x3 << (i * 2));
-        }
-    }
-
     struct tile_desc tds[2048];
     size_t ntiles = M_Tile_AllUnderObj(pos, res, obj, tds, ARR_SIZE(tds));
 
+    struct word_mask words[ARR_SIZE(tds)];
+    size_t nwords = 0;
+
     for(int i = 0; i < ntiles; i++) {
 
-        int idx = td_index(tds[i]);
-        uint32_t fac_state = s_fog_state[idx] & facstate_mask;
+        size_t idx = td_index(tds[i]);
+        uint64_t bit = ((uint64_t)1 << (idx % 64));
+
+        if(nwords && words[nwords - 1].idx == idx / 64) {
+            words[nwords - 1].bits |= bit;
+        }else{
+            words[nwords++] = (struct word_mask){idx / 64, bit};
+        }
+    }
 
-        for(int j = 0; j < nstates; j++) {
-            if(fog_any_matches(fac_state, states[j]))
+    uint64_t **planes = explored ? s_explored : s_visible;
+    for(int i = 0; fac_mask; fac_mask >>= 1, i++) {
+
+        if(!(fac_mask & 0x1))
+            continue;
+
+        const uint64_t *plane = planes[i];
+        for(int j = 0; j < nwords; j++) {
+            if(plane[words[j].idx] & words[j].bits)
                 return true;
         }
     }
     return false;
 }
 
+/* Expand a word of the combined visible and explored bits into one byte per
+ * tile. Since a visible tile is always explored, the state of every tile is 
+ * just (explored + visible). */
+static void fog_expand_word(uint64_t vis, uint64_t exp, unsigned char *out)
+{
+#if defined(__SSE2__)
+    const __m128i bitsel = _mm_set_epi8(
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m128i one = _mm_set1_epi8(1);
+
+    for(int i = 0; i < 4; i++) {
+
+        uint16_t v = vis >> (i * 16);
+        uint16_t e = exp >> (i * 16);
+
+        __m128i vb = _mm_unpacklo_epi64(_mm_set1_epi8(v & 0xff), _mm_set1_epi8(v >> 8));
+        __m128i eb = _mm_unpacklo_epi64(_mm_set1_epi8(e & 0xff), _mm_set1_epi8(e >> 8));
+
+        vb = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(vb, bitsel), bitsel), one);
+        eb = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(eb, bitsel), bitsel), one);
+        _mm_storeu_si128((__m128i*)(out + i * 16), _mm_add_epi8(vb, eb));
+    }
+#else
+    for(int i = 0; i < 64; i++) {
+        out[i] = ((exp >> i) & 0x1) + ((vis >> i) & 0x1);
+    }
+#endif
+}
+
+/* Reduce the per-faction states of 'n' tiles, starting at tile index 'begin', 
+ * to a single combined state of all the factions in 'player_facs': the tile is 
+ * visible if any of the factions sees it and explored if any of the factions 
+ * has explored it. The bitplanes are combined a word at a time.
+ */
+static void fog_player_state(size_t begin, size_t n, unsigned char *out, uint16_t player_facs)
+{
+    size_t end = begin + n;
+
+    while(begin < end) {
+
+        size_t word = begin / 64;
+        size_t lo = begin % 64;
+        size_t hi = MIN(64, lo + (end - begin));
+
+        uint64_t vis = 0, exp = 0;
+        uint16_t facs = player_facs;
+        for(int i = 0; facs; facs >>= 1, i++) {
+            if(!(facs & 0x1))
+                continue;
+            vis |= s_visible[i][word];
+            exp |= s_explored[i][word];
+        }
+
+        if(lo == 0 && hi == 64) {
+            fog_expand_word(vis, exp, out);
+        }else{
+            for(size_t b = lo; b < hi; b++) {
+                out[b - lo] = ((exp >> b) & 0x1) + ((vis >> b) & 0x1);
+            }
+        }
+
+        out += hi - lo;
+        begin += hi - lo;
+    }
+}
+
+static void fog_submit_full(void)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+    size_t size = res.chunk_h * res.tile_h * res.chunk_w * res.tile_w;
+
+    unsigned char *visbuff = stalloc(&G_GetSimWS()->args, size);
+    memcpy(visbuff, s_player_vis, size);
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_MapUpdateFog,
+        .nargs = 2,
+        .args = {
+            visbuff,
+            R_PushArg(&size, sizeof(size)),
+        },
+    });
+}
+
+/* Re-compute the player state of the dirty chunks only and send the chunks that
+ * actually changed to the render thread as a list of [begin, end) tile ranges. 
+ * Since the tiles of a chunk are contiguous in the buffer, adjacent changed 
+ * chunks get merged into a single range.
+ */
+static void fog_submit_delta(uint16_t player_facs)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    const size_t nchunks = res.chunk_w * res.chunk_h;
+    const size_t tiles_per_chunk = res.tile_w * res.tile_h;
+    unsigned char chunk_vis[tiles_per_chunk];
+
+    size_t nranges = 0;
+    size_t *ranges = stalloc(&G_GetSimWS()->args, sizeof(size_t) * 2 * nchunks);
+
+    for(int w = 0; w < BITSET_WORDS(nchunks); w++) {
+
+        uint64_t word = s_dirty_chunks[w];
+        if(!word)
+            continue;
+        s_dirty_chunks[w] = 0;
+
+        for(int b = 0; b < 64; b++) {
+
+            if(!(word & ((uint64_t)1 << b)))
+                continue;
+
+            size_t begin = (w * 64 + b) * tiles_per_chunk;
+            fog_player_state(begin, tiles_per_chunk, chunk_vis, player_facs);
+
+            if(!memcmp(chunk_vis, s_player_vis + begin, tiles_per_chunk))
+                continue;
+            memcpy(s_player_vis + begin, chunk_vis, tiles_per_chunk);
+
+            if(nranges && ranges[(nranges - 1) * 2 + 1] == begin) {
+                ranges[(nranges - 1) * 2 + 1] += tiles_per_chunk;
+            }else{
+                ranges[nranges * 2 + 0] = begin;
+                ranges[nranges * 2 + 1] = begin + tiles_per_chunk;
+                nranges++;
+            }
+        }
+    }
+
+    /* The render thread keeps streaming the last state it received */
+    if(!nranges)
+        return;
+
+    size_t size = 0;
+    for(int i = 0; i < nranges; i++) {
+        size += ranges[i * 2 + 1] - ranges[i * 2];
+    }
+
+    unsigned char *data = stalloc(&G_GetSimWS()->args, size);
+    unsigned char *cursor = data;
+    for(int i = 0; i < nranges; i++) {
+        size_t len = ranges[i * 2 + 1] - ranges[i * 2];
+        memcpy(cursor, s_player_vis + ranges[i * 2], len);
+        cursor += len;
+    }
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_MapUpdateFogRanges,
+        .nargs = 3,
+        .args = {
+            ranges,
+            R_PushArg(&nranges, sizeof(nranges)),
+            data,
+        },
+    });
+}
+
 static void on_render_3d(void *user, void *event)
 {
     const struct camera *cam = G_GetActiveCamera();
@@ -403,43 +781,79 @@ bool G_Fog_Init(const struct map *map)
     M_GetResolution(map, &res);
     const size_t ntiles = res.chunk_w * res.chunk_h * res.tile_w * res.tile_h;
 
-    s_fog_state = calloc(sizeof(s_fog_state[0]), ntiles);
-    if(!s_fog_state)
-        goto fail;
-
     for(int i = 0; i < MAX_FACTIONS; i++) {
         s_vision_refcnts[i] = calloc(sizeof(s_vision_refcnts[0]), ntiles);
         if(!s_vision_refcnts[i])
             goto fail;
+        s_visible[i] = calloc(sizeof(uint64_t), BITSET_WORDS(ntiles));
+        if(!s_visible[i])
+            goto fail;
+        s_explored[i] = calloc(sizeof(uint64_t), BITSET_WORDS(ntiles));
+        if(!s_explored[i])
+            goto fail;
     }
 
     s_explored_cache = kh_init(uid);
     if(!s_explored_cache)
         goto fail;
 
+    s_stencils = kh_init(stencil);
+    if(!s_stencils)
+        goto fail;
+
+    s_player_vis = calloc(1, ntiles);
+    if(!s_player_vis)
+        goto fail;
+
+    s_dirty_chunks = calloc(sizeof(uint64_t), BITSET_WORDS(res.chunk_w * res.chunk_h));
+    if(!s_dirty_chunks)
+        goto fail;
+
+    s_full_rebuild = true;
     s_map = map;
     E_Global_Register(EVENT_RENDER_3D_POST, on_render_3d, NULL, G_RUNNING | G_PAUSED_UI_RUNNING | G_PAUSED_FULL);
     return true;
 
 fail:
+    free(s_player_vis);
+    s_player_vis = NULL;
+    kh_destroy(stencil, s_stencils);
+    s_stencils = NULL;
     kh_destroy(uid, s_explored_cache);
-    free(s_fog_state);
+    s_explored_cache = NULL;
     for(int i = 0; i < MAX_FACTIONS; i++) {
         free(s_vision_refcnts[i]);
+        free(s_visible[i]);
+        free(s_explored[i]);
     }
+    memset(s_vision_refcnts, 0, sizeof(s_vision_refcnts));
+    memset(s_visible, 0, sizeof(s_visible));
+    memset(s_explored, 0, sizeof(s_explored));
     return false;
 }
 
 void G_Fog_Shutdown(void)
 {
     E_Global_Unregister(EVENT_RENDER_3D_POST, on_render_3d);
+
+    struct vis_stencil *stencil;
+    kh_foreach_value(s_stencils, stencil, {
+        free(stencil);
+    });
+    kh_destroy(stencil, s_stencils);
     kh_destroy(uid, s_explored_cache);
-    free(s_fog_state);
-    s_fog_state = NULL;
+    free(s_player_vis);
+    s_player_vis = NULL;
+    free(s_dirty_chunks);
+    s_dirty_chunks = NULL;
     for(int i = 0; i < MAX_FACTIONS; i++) {
         free(s_vision_refcnts[i]);
+        free(s_visible[i]);
+        free(s_explored[i]);
     }
     memset(s_vision_refcnts, 0, sizeof(s_vision_refcnts));
+    memset(s_visible, 0, sizeof(s_visible));
+    memset(s_explored, 0, sizeof(s_explored));
     s_map = NULL;
 }
 
@@ -453,6 +867,22 @@ void G_Fog_RemoveVision(vec2_t xz_pos, int faction_id, float radius)
     fog_update_visible(faction_id, xz_pos, radius, -1);
 }
 
+void G_Fog_MoveVision(vec2_t old_xz_pos, vec2_t new_xz_pos, int faction_id, float radius)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    /* The visible area only depends on the tile that the viewer is on */
+    struct tile_desc old_td, new_td;
+    if(M_Tile_DescForPoint2D(res, M_GetPos(s_map), old_xz_pos, &old_td)
+    && M_Tile_DescForPoint2D(res, M_GetPos(s_map), new_xz_pos, &new_td)
+    && 0 == memcmp(&old_td, &new_td, sizeof(struct tile_desc)))
+        return;
+
+    G_Fog_RemoveVision(old_xz_pos, faction_id, radius);
+    G_Fog_AddVision(new_xz_pos, faction_id, radius);
+}
+
 void G_Fog_UpdateVisionRange(vec2_t xz_pos, int faction_id, float old, float new)
 {
     G_Fog_RemoveVision(xz_pos, faction_id, old);
@@ -468,7 +898,7 @@ bool G_Fog_Visible(int faction_id, vec2_t xz_pos)
     if(!M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &td))
         return false;
 
-    return (FAC_STATE(s_fog_state[td_index(td)], faction_id) == STATE_VISIBLE);
+    return BIT_TEST(s_visible[faction_id], td_index(td));
 }
 
 bool G_Fog_PlayerVisible(vec2_t xz_pos)
@@ -482,12 +912,12 @@ bool G_Fog_PlayerVisible(vec2_t xz_pos)
 
     bool controllable[MAX_FACTIONS];
     uint16_t facs = G_GetFactions(NULL, NULL, controllable);
-    uint32_t fs = s_fog_state[td_index(td)];
+    int idx = td_index(td);
 
     for(int i = 0; facs; facs >>= 1, i++) {
         if(!(facs & 0x1) || !controllable[i])
             continue;
-        if(FAC_STATE(fs, i) == STATE_VISIBLE)
+        if(BIT_TEST(s_visible[i], idx))
             return true;
     }
     return false;
@@ -502,7 +932,7 @@ bool G_Fog_Explored(int faction_id, vec2_t xz_pos)
     if(!M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &td))
         return false;
 
-    return (FAC_STATE(s_fog_state[td_index(td)], faction_id) != STATE_UNEXPLORED);
+    return BIT_TEST(s_explored[faction_id], td_index(td));
 }
 
 bool G_Fog_PlayerExplored(vec2_t xz_pos)
@@ -516,12 +946,12 @@ bool G_Fog_PlayerExplored(vec2_t xz_pos)
 
     bool controllable[MAX_FACTIONS];
     uint16_t facs = G_GetFactions(NULL, NULL, controllable);
-    uint32_t fs = s_fog_state[td_index(td)];
+    int idx = td_index(td);
 
     for(int i = 0; facs; facs >>= 1, i++) {
         if(!(facs & 0x1) || !controllable[i])
             continue;
-        if(FAC_STATE(fs, i) != STATE_UNEXPLORED)
+        if(BIT_TEST(s_explored[i], idx))
             return true;
     }
     return false;
@@ -555,7 +985,7 @@ void G_Fog_RenderChunkVisibility(int faction_id, int chunk_r, int chunk_c, mat4x
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
 
         struct tile_desc curr = (struct tile_desc){chunk_r, chunk_c, r, c};
-        enum fog_state state = FAC_STATE(s_fog_state[td_index(curr)], faction_id);
+        enum fog_state state = fog_state(faction_id, td_index(curr));
         *colors_base++ = state == STATE_UNEXPLORED ? (vec3_t){0.0f, 0.0f, 0.0f}
                        : state == STATE_IN_FOG     ? (vec3_t){1.0f, 1.0f, 0.0f}
                        : state == STATE_VISIBLE    ? (vec3_t){0.0f, 1.0f, 0.0f}
@@ -584,51 +1014,37 @@ void G_Fog_UpdateVisionState(void)
     bool controllable[MAX_FACTIONS];
     uint16_t facs = G_GetFactions(NULL, NULL, controllable);
 
-    uint32_t player_mask = 0;
+    uint16_t player_facs = 0;
     for(int i = 0; facs; facs >>= 1, i++) {
         if((facs & 0x1) && controllable[i])
-            player_mask |= (0x3 << (i * 2));
+            player_facs |= (0x1 << i);
     }
 
     struct map_resolution res;
     M_GetResolution(s_map, &res);
-
     size_t size = res.chunk_h * res.tile_h * res.chunk_w * res.tile_w;
-    unsigned char *visbuff = stalloc(&G_GetSimWS()->args, size);
 
     if(!s_enabled) {
-        memset(visbuff, STATE_VISIBLE, size);
-        goto submit;
+        if(s_full_rebuild) {
+            memset(s_player_vis, STATE_VISIBLE, size);
+            fog_submit_full();
+            s_full_rebuild = false;
+        }
+        return;
     }
 
-    for(int cr = 0; cr < res.chunk_h; cr++) {
-    for(int cc = 0; cc < res.chunk_w; cc++) {
-
-        for(int tr = 0; tr < res.tile_h; tr++) {
-        for(int tc = 0; tc < res.tile_w; tc++) {
+    if(s_full_rebuild || player_facs != s_last_player_mask) {
 
-            struct tile_desc td = (struct tile_desc){cr, cc, tr, tc};
-            int idx = td_index(td);
-            uint32_t player_state = s_fog_state[idx] & player_mask;
+        fog_player_state(0, size, s_player_vis, player_facs);
+        memset(s_dirty_chunks, 0, sizeof(uint64_t) * BITSET_WORDS(res.chunk_w * res.chunk_h));
+        fog_submit_full();
 
-            if(!player_state)
-                visbuff[idx] = STATE_UNEXPLORED;
-            else if(fog_any_matches(player_state, STATE_VISIBLE))
-                visbuff[idx] = STATE_VISIBLE;
-            else
-                visbuff[idx] = STATE_IN_FOG;
-        }}
-    }}
+        s_full_rebuild = false;
+        s_last_player_mask = player_facs;
+        return;
+    }
 
-submit:
-    R_PushCmd((struct rcmd){
-        .func = R_GL_MapUpdateFog,
-        .nargs = 2,
-        .args = {
-            visbuff,
-            R_PushArg(&size, sizeof(size)),
-        },
-    });
+    fog_submit_delta(player_facs);
 }
 
 bool G_Fog_ObjExplored(uint16_t fac_mask, uint32_t uid, const struct obb *obb)
@@ -640,8 +1056,7 @@ bool G_Fog_ObjExplored(uint16_t fac_mask, uint32_t uid, const struct obb *obb)
     if(k != kh_end(s_explored_cache))
         return true;
 
-    enum fog_state states[] = {STATE_IN_FOG, STATE_VISIBLE};
-    bool result = fog_obj_matches(fac_mask, obb, states, ARR_SIZE(states));
+    bool result = fog_obj_matches(fac_mask, obb, true);
 
     if(result) {
         int status;
@@ -656,8 +1071,7 @@ bool G_Fog_ObjVisible(uint16_t fac_mask, const struct obb *obb)
     if(!s_enabled)
         return true;
 
-    enum fog_state states[] = {STATE_VISIBLE};
-    return fog_obj_matches(fac_mask, obb, states, ARR_SIZE(states));
+    return fog_obj_matches(fac_mask, obb, false);
 }
 
 void G_Fog_ClearExploredCache(void)
@@ -685,13 +1099,14 @@ bool G_Fog_SaveState(struct SDL_RWops *stream)
 
     for(int i = 0; i < ntiles; i++) {
 
-        uint32_t fs = s_fog_state[i];
+        /* Keep the one-value-per-tile format with a 2-bit state for every 
+         * faction. The visible tiles are saved as being in the fog. */
+        uint32_t fs = 0;
         for(int j = 0; j < MAX_FACTIONS; j++) {
-            enum fog_state curr = (fs >> (j * 2)) & 0x3;
+            enum fog_state curr = fog_state(j, i);
             if(curr == STATE_VISIBLE) {
                 curr = STATE_IN_FOG;
             }
-            fs = fs & ~(0x3 << (j * 2));
             fs = fs | (curr << (j * 2));
         }
 
@@ -721,19 +1136,36 @@ bool G_Fog_LoadState(struct SDL_RWops *stream)
     
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
-        s_fog_state[i] = attr.val.as_int;
+        uint32_t fs = attr.val.as_int;
+
+        for(int j = 0; j < MAX_FACTIONS; j++) {
+
+            enum fog_state curr = (fs >> (j * 2)) & 0x3;
+            if(curr != STATE_UNEXPLORED)
+                BIT_SET(s_explored[j], i);
+            else
+                BIT_CLEAR(s_explored[j], i);
+
+            if(curr == STATE_VISIBLE)
+                BIT_SET(s_visible[j], i);
+            else
+                BIT_CLEAR(s_visible[j], i);
+        }
     }
 
+    s_full_rebuild = true;
     return true;
 }
 
 void G_Fog_Enable(void)
 {
+    s_full_rebuild |= !s_enabled;
     s_enabled = true;
 }
 
 void G_Fog_Disable(void)
 {
+    s_full_rebuild |= s_enabled;
     s_enabled = false;
 }
 
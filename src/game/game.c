@@ -45,6 +45,7 @@
 #include "fog_of_war.h"
 #include "building.h"
 #include "builder.h"
+#include "cull.h"
 #include "../render/public/render.h"
 #include "../render/public/render_ctrl.h"
 #include "../anim/public/anim.h"
@@ -71,6 +72,7 @@
 #define CAM_SPEED           0.20f
 #define CAM_SENS            0.05f
 #define MAX_VIS_RANGE       150.0f
+#define CULL_BATCH_SIZE     (256)
 
 #define MIN(a, b)           ((a) < (b) ? (a) : (b))
 #define MAX(a, b)           ((a) > (b) ? (a) : (b))
@@ -187,7 +189,7 @@ static void g_shadow_pass(struct render_input *in)
             .nargs = 4,
             .args = {
                 (void*)curr->inv_bind_pose, 
-                R_PushArg(curr->curr_pose, sizeof(curr->curr_pose)),
+                (void*)curr->curr_pose,
                 R_PushArg(&normal, sizeof(normal)),
                 R_PushArg(&curr->njoints, sizeof(curr->njoints)),
             },
@@ -248,7 +250,7 @@ static void g_draw_pass(struct render_input *in)
             .nargs = 4,
             .args = {
                 (void*)curr->inv_bind_pose, 
-                R_PushArg(curr->curr_pose, sizeof(curr->curr_pose)),
+                (void*)curr->curr_pose,
                 R_PushArg(&normal, sizeof(normal)),
                 R_PushArg(&curr->njoints, sizeof(curr->njoints)),
             },
@@ -324,36 +326,85 @@ static void g_render_healthbars(void)
     PERF_RETURN_VOID();
 }
 
-static void g_sort_stat_list(vec_rstat_t *inout)
+/* LSD radix sort of the entries by key, 8 bits at a time. The histograms for
+ * all the digits are built in a single pass and digits which are the same for
+ * all the keys are skipped. 'tmp' must be large enough to hold 'n' entries. 
+ */
+static void g_radix_sort(struct draw_key *inout, struct draw_key *tmp, size_t n)
 {
-    int i = 1;
-    while(i < vec_size(inout)) {
-        int j = i;
-        while(j > 0 && vec_AT(inout, j - 1).translucent && !vec_AT(inout, j).translucent) {
+    size_t counts[8][256] = {0};
+    for(size_t i = 0; i < n; i++) {
+        for(int d = 0; d < 8; d++) {
+            counts[d][(inout[i].key >> (d * 8)) & 0xff]++;
+        }
+    }
+
+    struct draw_key *src = inout, *dst = tmp;
+    for(int d = 0; d < 8; d++) {
 
-            struct ent_stat_rstate tmp = vec_AT(inout, j - 1);
-            vec_AT(inout, j - 1) = vec_AT(inout, j);
-            vec_AT(inout, j) = tmp;
-            j--;
+        if(n == 0 || counts[d][(src[0].key >> (d * 8)) & 0xff] == n)
+            continue;
+
+        size_t offsets[256];
+        size_t sum = 0;
+        for(int b = 0; b < 256; b++) {
+            offsets[b] = sum;
+            sum += counts[d][b];
         }
-        i++;
+
+        for(size_t i = 0; i < n; i++) {
+            dst[offsets[(src[i].key >> (d * 8)) & 0xff]++] = src[i];
+        }
+
+        struct draw_key *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if(src != inout) {
+        memcpy(inout, src, n * sizeof(struct draw_key));
     }
 }
 
-static void g_sort_anim_list(vec_ranim_t *inout)
+static bool g_sort_draw_keys(vec_dkey_t *keys)
 {
-    int i = 1;
-    while(i < vec_size(inout)) {
-        int j = i;
-        while(j > 0 && vec_AT(inout, j - 1).translucent && !vec_AT(inout, j).translucent) {
+    if(!vec_dkey_resize(&s_gs.draw_keys_tmp, vec_size(keys)))
+        return false;
 
-            struct ent_anim_rstate tmp = vec_AT(inout, j - 1);
-            vec_AT(inout, j - 1) = vec_AT(inout, j);
-            vec_AT(inout, j) = tmp;
-            j--;
-        }
-        i++;
+    g_radix_sort(keys->array, s_gs.draw_keys_tmp.array, vec_size(keys));
+    return true;
+}
+
+static void g_sort_stat_list(vec_rstat_t *inout, vec_dkey_t *keys)
+{
+    assert(vec_size(inout) == vec_size(keys));
+    vec_rstat_t *sorted = &s_gs.rstat_tmp;
+
+    if(!g_sort_draw_keys(keys))
+        return;
+    if(!vec_rstat_resize(sorted, vec_size(inout)))
+        return;
+
+    for(int i = 0; i < vec_size(keys); i++) {
+        sorted->array[i] = vec_AT(inout, vec_AT(keys, i).idx);
     }
+    memcpy(inout->array, sorted->array, vec_size(inout) * sizeof(struct ent_stat_rstate));
+}
+
+static void g_sort_anim_list(vec_ranim_t *inout, vec_dkey_t *keys)
+{
+    assert(vec_size(inout) == vec_size(keys));
+    vec_ranim_t *sorted = &s_gs.ranim_tmp;
+
+    if(!g_sort_draw_keys(keys))
+        return;
+    if(!vec_ranim_resize(sorted, vec_size(inout)))
+        return;
+
+    for(int i = 0; i < vec_size(keys); i++) {
+        sorted->array[i] = vec_AT(inout, vec_AT(keys, i).idx);
+    }
+    memcpy(inout->array, sorted->array, vec_size(inout) * sizeof(struct ent_anim_rstate));
 }
 
 static void g_make_draw_list(vec_pentity_t ents, vec_rstat_t *out_stat, vec_ranim_t *out_anim)
@@ -363,6 +414,10 @@ static void g_make_draw_list(vec_pentity_t ents, vec_rstat_t *out_stat, vec_rani
         M_GetResolution(s_gs.map, &res);
     }
 
+    vec3_t cam_pos = Camera_GetPos(s_gs.active_cam);
+    vec_dkey_reset(&s_gs.stat_keys);
+    vec_dkey_reset(&s_gs.anim_keys);
+
     for(int i = 0; i < vec_size(&ents); i++) {
 
         const struct entity *curr = vec_AT(&ents, i);
@@ -373,15 +428,28 @@ static void g_make_draw_list(vec_pentity_t ents, vec_rstat_t *out_stat, vec_rani
         mat4x4_t model;
         Entity_ModelMatrix(curr, &model);
 
+        vec3_t delta, ent_pos = (vec3_t){model.cols[3][0], model.cols[3][1], model.cols[3][2]};
+        PFM_Vec3_Sub(&ent_pos, &cam_pos, &delta);
+        float depth = PFM_Vec3_Len(&delta);
+        bool translucent = curr->flags & ENTITY_FLAG_TRANSLUCENT;
+
         if(curr->flags & ENTITY_FLAG_ANIMATED) {
         
             struct ent_anim_rstate rstate = (struct ent_anim_rstate){
                 .render_private = curr->render_private, 
                 .model = model,
-                .translucent = curr->flags & ENTITY_FLAG_TRANSLUCENT
+                .translucent = translucent
+            };
+            A_GetRenderState(curr, &rstate.njoints, &rstate.curr_pose, &rstate.inv_bind_pose);
+
+            struct draw_key dkey = (struct draw_key){
+                .key = R_DrawSortKey(curr->render_private, translucent, NULL, depth),
+                .idx = vec_size(out_anim)
             };
-            A_GetRenderState(curr, &rstate.njoints, rstate.curr_pose, &rstate.inv_bind_pose);
-            vec_ranim_push(out_anim, rstate);
+            if(!vec_ranim_push(out_anim, rstate))
+                continue;
+            if(!vec_dkey_push(&s_gs.anim_keys, dkey))
+                vec_ranim_pop(out_anim);
         }else{
         
             struct tile_desc td = {0};
@@ -392,15 +460,23 @@ static void g_make_draw_list(vec_pentity_t ents, vec_rstat_t *out_stat, vec_rani
             struct ent_stat_rstate rstate = (struct ent_stat_rstate){
                 .render_private = curr->render_private, 
                 .model = model,
-                .translucent = curr->flags & ENTITY_FLAG_TRANSLUCENT,
+                .translucent = translucent,
                 .td = td
             };
-            vec_rstat_push(out_stat, rstate);
+
+            struct draw_key dkey = (struct draw_key){
+                .key = R_DrawSortKey(curr->render_private, translucent, &td, depth),
+                .idx = vec_size(out_stat)
+            };
+            if(!vec_rstat_push(out_stat, rstate))
+                continue;
+            if(!vec_dkey_push(&s_gs.stat_keys, dkey))
+                vec_rstat_pop(out_stat);
         }
     }
 
-    g_sort_stat_list(out_stat);
-    g_sort_anim_list(out_anim);
+    g_sort_stat_list(out_stat, &s_gs.stat_keys);
+    g_sort_anim_list(out_anim, &s_gs.anim_keys);
 }
 
 static void g_create_render_input(struct render_input *out)
@@ -472,6 +548,13 @@ static bool fac_vision_validate(const struct sval *new_val)
     return (new_val->as_int >= -1 && new_val->as_int <= MAX_FACTIONS);
 }
 
+static bool spatial_index_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= POS_INDEX_QUADTREE && new_val->as_int <= POS_INDEX_GRID);
+}
+
 static bool faction_id_validate(const struct sval *new_val)
 {
     if(new_val->type != ST_TYPE_INT)
@@ -660,6 +743,13 @@ bool G_Init(void)
     vec_pentity_init(&s_gs.visible);
     vec_pentity_init(&s_gs.light_visible);
     vec_obb_init(&s_gs.visible_obbs);
+    vec_pentity_init(&s_gs.candidates);
+    vec_obb_init(&s_gs.candidate_obbs);
+    vec_dkey_init(&s_gs.stat_keys);
+    vec_dkey_init(&s_gs.anim_keys);
+    vec_dkey_init(&s_gs.draw_keys_tmp);
+    vec_rstat_init(&s_gs.rstat_tmp);
+    vec_ranim_init(&s_gs.ranim_tmp);
     vec_pentity_init(&s_gs.deleted);
 
     s_gs.active = kh_init(entity);
@@ -670,6 +760,13 @@ bool G_Init(void)
     if(!s_gs.dynamic)
         goto fail_dynamic;
 
+    s_gs.unbinned = kh_init(entity);
+    if(!s_gs.unbinned)
+        goto fail_unbinned;
+
+    if(!G_Cull_Init())
+        goto fail_cull;
+
     if(!g_init_camera())
         goto fail_cam; 
 
@@ -702,6 +799,18 @@ bool G_Init(void)
     });
     assert(status == SS_OKAY);
 
+    status = Settings_Create((struct setting){
+        .name = "pf.game.spatial_index",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = POS_INDEX_QUADTREE /* takes effect on the next map load */
+        },
+        .prio = 0,
+        .validate = spatial_index_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
     status = Settings_Create((struct setting){
         .name = "pf.game.fog_of_war_enabled",
         .val = (struct sval) {
@@ -849,6 +958,10 @@ bool G_Init(void)
 fail_ws:
     Camera_Free(s_gs.active_cam);
 fail_cam:
+    G_Cull_Shutdown();
+fail_cull:
+    kh_destroy(entity, s_gs.unbinned);
+fail_unbinned:
     kh_destroy(entity, s_gs.dynamic);
 fail_dynamic:
     kh_destroy(entity, s_gs.active);
@@ -892,6 +1005,15 @@ bool G_LoadMap(SDL_RWops *stream, bool update_navgrid)
     PERF_RETURN(true);
 }
 
+bool G_SaveMap(SDL_RWops *stream, bool bake_nav)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_gs.map)
+        return false;
+    return M_AL_WritePFMap(s_gs.map, stream, bake_nav);
+}
+
 void G_ClearState(void)
 {
     PERF_ENTER();
@@ -911,6 +1033,8 @@ void G_ClearState(void)
 
     kh_clear(entity, s_gs.active);
     kh_clear(entity, s_gs.dynamic);
+    kh_clear(entity, s_gs.unbinned);
+    G_Cull_Clear();
     vec_pentity_reset(&s_gs.visible);
     vec_pentity_reset(&s_gs.light_visible);
     vec_obb_reset(&s_gs.visible_obbs);
@@ -1028,6 +1152,15 @@ bool G_PointInsideMap(vec2_t xz)
     return M_PointInsideMap(s_gs.map, xz);
 }
 
+bool G_BenchNavFields(size_t niters, struct nav_bench_result *out)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_gs.map)
+        return false;
+    return M_NavBenchFields(s_gs.map, niters, out);
+}
+
 void G_BakeNavDataForScene(void)
 {
     PERF_ENTER();
@@ -1084,9 +1217,18 @@ void G_Shutdown(void)
 
     kh_destroy(entity, s_gs.active);
     kh_destroy(entity, s_gs.dynamic);
+    kh_destroy(entity, s_gs.unbinned);
+    G_Cull_Shutdown();
     vec_pentity_destroy(&s_gs.light_visible);
     vec_pentity_destroy(&s_gs.visible);
     vec_obb_destroy(&s_gs.visible_obbs);
+    vec_pentity_destroy(&s_gs.candidates);
+    vec_obb_destroy(&s_gs.candidate_obbs);
+    vec_dkey_destroy(&s_gs.stat_keys);
+    vec_dkey_destroy(&s_gs.anim_keys);
+    vec_dkey_destroy(&s_gs.draw_keys_tmp);
+    vec_rstat_destroy(&s_gs.rstat_tmp);
+    vec_ranim_destroy(&s_gs.ranim_tmp);
     vec_pentity_destroy(&s_gs.deleted);
 }
 
@@ -1115,33 +1257,55 @@ void G_Update(void)
 
     uint16_t pm = g_player_mask();
 
+    vec_pentity_reset(&s_gs.candidates);
+    vec_obb_reset(&s_gs.candidate_obbs);
+
     uint32_t key;
     struct entity *curr;
     (void)key;
 
-    kh_foreach(s_gs.active, key, curr, {
+    kh_foreach(s_gs.unbinned, key, curr, {
 
         if(s_gs.ss == G_RUNNING && curr->flags & ENTITY_FLAG_ANIMATED)
             A_Update(curr);
 
-        bool vis = false;
         struct obb obb;
         Entity_CurrentOBB(curr, &obb, false);
 
+        vec_pentity_push(&s_gs.candidates, curr);
+        vec_obb_push(&s_gs.candidate_obbs, obb);
+    });
+
+    G_Cull_StaticCandidates(&cam_frust, &light_frust, &s_gs.candidates, &s_gs.candidate_obbs);
+    assert(vec_size(&s_gs.candidates) == vec_size(&s_gs.candidate_obbs));
+
+    for(size_t base = 0; base < vec_size(&s_gs.candidates); base += CULL_BATCH_SIZE) {
+
+        size_t nents = MIN(CULL_BATCH_SIZE, vec_size(&s_gs.candidates) - base);
+        const struct obb *obbs = &vec_AT(&s_gs.candidate_obbs, base);
+
         /* Note that there may be some false positives due to using the fast frustum cull. */
-        if(C_FrustumOBBIntersectionFast(&cam_frust, &obb) != VOLUME_INTERSEC_OUTSIDE
-        && (vis = g_ent_visible(pm, curr, &obb))) {
+        bool cam_vis[CULL_BATCH_SIZE], light_vis[CULL_BATCH_SIZE];
+        C_FrustumOBBsVisibleFast(&cam_frust, nents, obbs, cam_vis);
+        C_FrustumOBBsVisibleFast(&light_frust, nents, obbs, light_vis);
 
-            vec_pentity_push(&s_gs.visible, curr);
-            vec_obb_push(&s_gs.visible_obbs, obb);
-        }
+        for(int i = 0; i < nents; i++) {
+
+            bool vis = false;
+            curr = vec_AT(&s_gs.candidates, base + i);
 
-        if(C_FrustumOBBIntersectionFast(&light_frust, &obb) != VOLUME_INTERSEC_OUTSIDE 
-        && (vis || (curr->flags & ENTITY_FLAG_STATIC))) {
+            if(cam_vis[i] && (vis = g_ent_visible(pm, curr, &obbs[i]))) {
 
-            vec_pentity_push(&s_gs.light_visible, curr);
+                vec_pentity_push(&s_gs.visible, curr);
+                vec_obb_push(&s_gs.visible_obbs, obbs[i]);
+            }
+
+            if(light_vis[i] && (vis || (curr->flags & ENTITY_FLAG_STATIC))) {
+
+                vec_pentity_push(&s_gs.light_visible, curr);
+            }
         }
-    });
+    }
 
     G_Sel_Update(s_gs.active_cam, &s_gs.visible, &s_gs.visible_obbs);
 
@@ -1269,6 +1433,8 @@ bool G_AddEntity(struct entity *ent, vec3_t pos)
 
         G_Move_AddEntity(ent);
     }
+
+    G_UpdateBounds(ent);
     return true;
 }
 
@@ -1290,6 +1456,11 @@ bool G_RemoveEntity(struct entity *ent)
         kh_del(entity, s_gs.dynamic, k);
     }
 
+    k = kh_get(entity, s_gs.unbinned, ent->uid);
+    if(k != kh_end(s_gs.unbinned))
+        kh_del(entity, s_gs.unbinned, k);
+    G_Cull_RemoveStatic(ent->uid);
+
     G_Move_RemoveEntity(ent);
     G_Combat_RemoveEntity(ent);
     G_Building_RemoveEntity(ent);
@@ -1333,6 +1504,35 @@ void G_SetStatic(struct entity *ent, bool on)
         G_Move_AddEntity(ent);
         ent->flags &= ~ENTITY_FLAG_STATIC;
     }
+
+    G_UpdateBounds(ent);
+}
+
+void G_UpdateBounds(const struct entity *ent)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(kh_get(entity, s_gs.active, ent->uid) == kh_end(s_gs.active))
+        return;
+
+    khiter_t k = kh_get(entity, s_gs.unbinned, ent->uid);
+    bool binnable = (ent->flags & (ENTITY_FLAG_STATIC | ENTITY_FLAG_ANIMATED)) == ENTITY_FLAG_STATIC;
+
+    if(binnable && G_Cull_AddStatic(ent)) {
+
+        if(k != kh_end(s_gs.unbinned))
+            kh_del(entity, s_gs.unbinned, k);
+        return;
+    }
+
+    G_Cull_RemoveStatic(ent->uid);
+    if(k != kh_end(s_gs.unbinned))
+        return;
+
+    int ret;
+    k = kh_put(entity, s_gs.unbinned, ent->uid, &ret);
+    assert(ret != -1 && ret != 0);
+    kh_value(s_gs.unbinned, k) = (struct entity*)ent;
 }
 
 void G_SafeFree(struct entity *ent)
@@ -1634,6 +1834,8 @@ void G_Zombiefy(struct entity *ent)
     ent->flags |= ENTITY_FLAG_INVISIBLE;
     ent->flags |= ENTITY_FLAG_STATIC;
     ent->flags |= ENTITY_FLAG_ZOMBIE;
+
+    G_UpdateBounds(ent);
 }
 
 struct entity *G_EntityForUID(uint32_t uid)
@@ -1666,7 +1868,7 @@ void G_SwapBuffers(void)
     int render_idx = (sim_idx + 1) % 2;
 
     if(s_gs.map)
-        M_AL_ShallowCopy((struct map*)s_gs.prev_tick_map, s_gs.map);
+        M_AL_UpdateShallowCopy((struct map*)s_gs.prev_tick_map, s_gs.map);
 
     for(int i = 0; i < vec_size(&s_gs.deleted); i++) {
 
@@ -1715,7 +1917,7 @@ bool G_SaveGlobalState(SDL_RWops *stream)
     };
     CHK_TRUE_RET(Attr_Write(stream, &hasmap, "has_map"));
 
-    if(hasmap.val.as_bool && !M_AL_WritePFMap(s_gs.map, stream))
+    if(hasmap.val.as_bool && !M_AL_WritePFMap(s_gs.map, stream, false))
         return false;
 
     if(hasmap.val.as_bool) {
@@ -39,12 +39,21 @@
 #include "public/game.h"
 #include "../lib/public/vec.h"
 #include "../render/public/render_ctrl.h"
+#include "../entity.h"
 #include "faction.h"
 #include "selection.h"
 
 #include <stdint.h>
 
 
+struct draw_key{
+    uint64_t key;
+    uint32_t idx;
+};
+
+VEC_TYPE(dkey, struct draw_key)
+VEC_IMPL(static inline, dkey, struct draw_key)
+
 struct gamestate{
     enum simstate           ss;
     /*-------------------------------------------------------------------------
@@ -89,6 +98,13 @@ struct gamestate{
      *-------------------------------------------------------------------------
      */
     khash_t(entity)        *dynamic;
+    /*-------------------------------------------------------------------------
+     * Up-to-date set of all entities whose bounds have to be computed every
+     * frame (Subset of 'active' set). The rest are static, non-animated 
+     * entities, which are culled a chunk at a time by the 'cull' module.
+     *-------------------------------------------------------------------------
+     */
+    khash_t(entity)        *unbinned;
     /*-------------------------------------------------------------------------
      * The set of entities potentially visible by the active camera. Updated
      * every frame.
@@ -106,6 +122,23 @@ struct gamestate{
      *-------------------------------------------------------------------------
      */
     vec_obb_t               visible_obbs;
+    /*-------------------------------------------------------------------------
+     * Scratch buffers holding the entities (and their OBBs) that passed the
+     * broadphase and need to be tested against the frusta individually.
+     *-------------------------------------------------------------------------
+     */
+    vec_pentity_t           candidates;
+    vec_obb_t               candidate_obbs;
+    /*-------------------------------------------------------------------------
+     * Scratch buffers for sorting the draw lists. Each draw list entry gets
+     * a key (see R_DrawSortKey) holding the index of the entry.
+     *-------------------------------------------------------------------------
+     */
+    vec_dkey_t              stat_keys;
+    vec_dkey_t              anim_keys;
+    vec_dkey_t              draw_keys_tmp;
+    vec_rstat_t             rstat_tmp;
+    vec_ranim_t             ranim_tmp;
     /*-------------------------------------------------------------------------
      * The state of the factions in the current game. 'factions_allocd' has a 
      * set bit for every faction index that's 'allocated'. Clear bits are 'free'.
@@ -37,6 +37,7 @@
 #include "game_private.h"
 #include "combat.h"
 #include "clearpath.h"
+#include "position.h"
 #include "public/game.h"
 #include "../config.h"
 #include "../camera.h"
@@ -48,6 +49,7 @@
 #include "../settings.h"
 #include "../ui.h"
 #include "../perf.h"
+#include "../sched.h"
 #include "../script/public/script.h"
 #include "../render/public/render.h"
 #include "../map/public/map.h"
@@ -84,6 +86,7 @@
     }while(0)
 
 #define VEL_HIST_LEN (14)
+#define MOVE_JOB_SZ  (32)
 
 enum arrival_state{
     /* Entity is moving towards the flock's destination point */
@@ -134,6 +137,36 @@ struct flock{
 VEC_TYPE(flock, struct flock)
 VEC_IMPL(static inline, flock, struct flock)
 
+struct near_ent{
+    struct entity *ent;
+    vec2_t         xz_pos;
+    vec2_t         xz_vel;
+    float          radius;
+};
+
+VEC_TYPE(near_ent, struct near_ent)
+VEC_IMPL(static inline, near_ent, struct near_ent)
+
+/* The state needed to compute the new velocity of a single moving entity. 
+ * It is captured on the main thread at the start of the movement tick, 
+ * after which the new velocities of all the entities can be computed in 
+ * parallel without touching the position or navigation state. The 'near' 
+ * ranges index into the tick's snapshot of neighbouring entities. 
+ */
+struct move_work{
+    struct entity      *ent;
+    struct movestate   *ms;
+    const struct flock *flock;
+    vec2_t              xz_pos;
+    bool                dest_los;
+    size_t              flock_base, flock_count;
+    size_t              sep_base, sep_count;
+    size_t              cp_base, cp_count;
+};
+
+VEC_TYPE(work, struct move_work)
+VEC_IMPL(static inline, work, struct move_work)
+
 /* Parameters controlling steering/flocking behaviours */
 #define SEPARATION_FORCE_SCALE          (0.6f)
 #define MOVE_ARRIVE_FORCE_SCALE         (0.5f)
@@ -160,6 +193,9 @@ static bool                    s_move_on_lclick = false;
 static vec_pentity_t           s_move_markers;
 static vec_flock_t             s_flocks;
 static khash_t(state)         *s_entity_state_table;
+/* Snapshot of the current movement tick */
+static vec_work_t              s_move_work;
+static vec_near_ent_t          s_near_ents;
 
 /* Store the most recently issued move command location for debug rendering */
 static bool                    s_last_cmd_dest_valid = false;
@@ -294,6 +330,7 @@ static void entity_finish_moving(const struct entity *ent, enum arrival_state ne
     ms->state = newstate;
     ms->velocity = (vec2_t){0.0f, 0.0f};
     ms->vnew = (vec2_t){0.0f, 0.0f};
+    G_Pos_UpdateVelocity(ent->uid, ms->velocity);
 
     entity_block(ent);
     assert(ent_still(ms));
@@ -708,17 +745,18 @@ static vec2_t seek_force(const struct entity *ent, vec2_t target_xz)
  * When not within line of sight of the destination, this will steer the entity along the 
  * flow field.
  */
-static vec2_t arrive_force(const struct entity *ent, dest_id_t dest_id, vec2_t target_xz)
+static vec2_t arrive_force(const struct move_work *work, vec2_t target_xz)
 {
+    const struct entity *ent = work->ent;
     assert(0 == (ent->flags & ENTITY_FLAG_STATIC));
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = G_Pos_GetXZ(ent->uid);
+    vec2_t pos_xz = work->xz_pos;
     float distance;
 
-    struct movestate *ms = movestate_get(ent);
+    struct movestate *ms = work->ms;
     assert(ms);
 
-    if(M_NavHasDestLOS(s_map, dest_id, pos_xz)) {
+    if(work->dest_los) {
 
         PFM_Vec2_Sub(&target_xz, &pos_xz, &desired_velocity);
         distance = PFM_Vec2_Len(&desired_velocity);
@@ -787,23 +825,20 @@ static vec2_t alignment_force(const struct entity *ent, const struct flock *floc
 
 /* Cohesion is a behaviour that causes agents to steer towards the center of mass of nearby agents.
  */
-static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock)
+static vec2_t cohesion_force(const struct move_work *work)
 {
     vec2_t COM = (vec2_t){0.0f};
     size_t neighbour_count = 0;
-    vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
+    vec2_t ent_xz_pos = work->xz_pos;
 
-    uint32_t key;
-    struct entity *curr;
-    (void)key;
+    for(int i = 0; i < work->flock_count; i++) {
 
-    kh_foreach(flock->ents, key, curr, {
-
-        if(curr == ent)
+        const struct near_ent *curr = &vec_AT(&s_near_ents, work->flock_base + i);
+        if(curr->ent == work->ent)
             continue;
 
         vec2_t diff;
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
+        vec2_t curr_xz_pos = curr->xz_pos;
         PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
 
         float t = (PFM_Vec2_Len(&diff) - COHESION_NEIGHBOUR_RADIUS*0.75) / COHESION_NEIGHBOUR_RADIUS;
@@ -812,7 +847,7 @@ static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock
         PFM_Vec2_Scale(&curr_xz_pos, scale, &curr_xz_pos);
         PFM_Vec2_Add(&COM, &curr_xz_pos, &COM);
         neighbour_count++;
-    });
+    }
 
     if(0 == neighbour_count)
         return (vec2_t){0.0f};
@@ -826,26 +861,26 @@ static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock
 
 /* Separation is a behaviour that causes agents to steer away from nearby agents.
  */
-static vec2_t separation_force(const struct entity *ent, float buffer_dist)
+static vec2_t separation_force(const struct move_work *work, float buffer_dist)
 {
+    const struct entity *ent = work->ent;
     vec2_t ret = (vec2_t){0.0f};
-    struct entity *near_ents[128];
-    int num_near = G_Pos_EntsInCircle(G_Pos_GetXZ(ent->uid), 
-        SEPARATION_NEIGHB_RADIUS, near_ents, ARR_SIZE(near_ents));
+    int num_near = work->sep_count;
 
     for(int i = 0; i < num_near; i++) {
 
-        struct entity *curr = near_ents[i];
+        const struct near_ent *nent = &vec_AT(&s_near_ents, work->sep_base + i);
+        const struct entity *curr = nent->ent;
         if(curr == ent)
             continue;
         if(curr->flags & ENTITY_FLAG_STATIC)
             continue;
 
         vec2_t diff;
-        vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
+        vec2_t ent_xz_pos = work->xz_pos;
+        vec2_t curr_xz_pos = nent->xz_pos;
 
-        float radius = ent->selection_radius + curr->selection_radius + buffer_dist;
+        float radius = ent->selection_radius + nent->radius + buffer_dist;
         PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
 
         /* Exponential decay with y=1 when diff = radius*0.85 
@@ -867,14 +902,14 @@ static vec2_t separation_force(const struct entity *ent, float buffer_dist)
     return ret;
 }
 
-static vec2_t point_seek_total_force(const struct entity *ent, const struct flock *flock)
+static vec2_t point_seek_total_force(const struct move_work *work)
 {
-    struct movestate *ms = movestate_get(ent);
+    struct movestate *ms = work->ms;
     assert(ms);
 
-    vec2_t arrive = arrive_force(ent, flock->dest_id, flock->target_xz);
-    vec2_t cohesion = cohesion_force(ent, flock);
-    vec2_t separation = separation_force(ent, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force(work, work->flock->target_xz);
+    vec2_t cohesion = cohesion_force(work);
+    vec2_t separation = separation_force(work, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&cohesion,   MOVE_COHESION_FORCE_SCALE, &cohesion);
@@ -891,13 +926,13 @@ static vec2_t point_seek_total_force(const struct entity *ent, const struct floc
     return ret;
 }
 
-static vec2_t enemy_seek_total_force(const struct entity *ent)
+static vec2_t enemy_seek_total_force(const struct move_work *work)
 {
-    struct movestate *ms = movestate_get(ent);
+    struct movestate *ms = work->ms;
     assert(ms);
 
-    vec2_t arrive = arrive_force(ent, DEST_ID_INVALID, (vec2_t){0.0f, 0.0f});
-    vec2_t separation = separation_force(ent, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force(work, (vec2_t){0.0f, 0.0f});
+    vec2_t separation = separation_force(work, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&separation, SEPARATION_FORCE_SCALE,    &separation);
@@ -921,14 +956,15 @@ static vec2_t new_pos_for_vel(const struct entity *ent, vec2_t velocity)
 
 /* Nullify the components of the force which would guide
  * the entity towards an impassable tile. */
-static void nullify_impass_components(const struct entity *ent, vec2_t *inout_force)
+static void nullify_impass_components(const struct move_work *work, vec2_t *inout_force)
 {
     vec2_t nt_dims = N_TileDims();
+    vec2_t pos = work->xz_pos;
 
-    vec2_t left =  (vec2_t){G_Pos_Get(ent->uid).x + nt_dims.x, G_Pos_Get(ent->uid).z};
-    vec2_t right = (vec2_t){G_Pos_Get(ent->uid).x - nt_dims.x, G_Pos_Get(ent->uid).z};
-    vec2_t top =   (vec2_t){G_Pos_Get(ent->uid).x, G_Pos_Get(ent->uid).z + nt_dims.z};
-    vec2_t bot =   (vec2_t){G_Pos_Get(ent->uid).x, G_Pos_Get(ent->uid).z - nt_dims.z};
+    vec2_t left =  (vec2_t){pos.x + nt_dims.x, pos.z};
+    vec2_t right = (vec2_t){pos.x - nt_dims.x, pos.z};
+    vec2_t top =   (vec2_t){pos.x, pos.z + nt_dims.z};
+    vec2_t bot =   (vec2_t){pos.x, pos.z - nt_dims.z};
 
     if((inout_force->x > 0 && !M_NavPositionPathable(s_map, left))
     || (inout_force->x < 0 && !M_NavPositionPathable(s_map, right)))
@@ -939,21 +975,22 @@ static void nullify_impass_components(const struct entity *ent, vec2_t *inout_fo
         inout_force->z = 0.0f;
 }
 
-static vec2_t point_seek_vpref(const struct entity *ent, const struct flock *flock)
+static vec2_t point_seek_vpref(const struct move_work *work)
 {
-    struct movestate *ms = movestate_get(ent);
+    const struct entity *ent = work->ent;
+    struct movestate *ms = work->ms;
     assert(ms);
 
     vec2_t steer_force;
     for(int prio = 0; prio < 3; prio++) {
 
         switch(prio) {
-        case 0: steer_force = point_seek_total_force(ent, flock); break;
-        case 1: steer_force = separation_force(ent, SEPARATION_BUFFER_DIST); break;
-        case 2: steer_force = arrive_force(ent, flock->dest_id, flock->target_xz); break;
+        case 0: steer_force = point_seek_total_force(work); break;
+        case 1: steer_force = separation_force(work, SEPARATION_BUFFER_DIST); break;
+        case 2: steer_force = arrive_force(work, work->flock->target_xz); break;
         }
 
-        nullify_impass_components(ent, &steer_force);
+        nullify_impass_components(work, &steer_force);
         if(PFM_Vec2_Len(&steer_force) > MAX_FORCE * 0.01)
             break;
     }
@@ -967,12 +1004,13 @@ static vec2_t point_seek_vpref(const struct entity *ent, const struct flock *flo
     return new_vel;
 }
 
-static vec2_t enemy_seek_vpref(const struct entity *ent)
+static vec2_t enemy_seek_vpref(const struct move_work *work)
 {
-    struct movestate *ms = movestate_get(ent);
+    const struct entity *ent = work->ent;
+    struct movestate *ms = work->ms;
     assert(ms);
 
-    vec2_t steer_force = enemy_seek_total_force(ent);
+    vec2_t steer_force = enemy_seek_total_force(work);
 
     vec2_t accel, new_vel; 
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
@@ -1041,6 +1079,7 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
         vec3_t new_pos = (vec3_t){new_pos_xz.x, M_HeightAtPoint(s_map, new_pos_xz), new_pos_xz.z};
         G_Pos_Set(ent, new_pos);
         ms->velocity = new_vel;
+        G_Pos_UpdateVelocity(ent->uid, ms->velocity);
 
         /* Use a weighted average of past velocities ot set the entity's orientation. This means that 
          * the entity's visible orientation lags behind its' true orientation slightly. However, this 
@@ -1048,10 +1087,11 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
          */
         vec2_t wma = vel_wma(ms);
         if(PFM_Vec2_Len(&wma) > EPSILON) {
-            ent->rotation = dir_quat_from_velocity(wma);
+            Entity_SetRot(ent, dir_quat_from_velocity(wma));
         }
     }else{
         ms->velocity = (vec2_t){0.0f, 0.0f}; 
+        G_Pos_UpdateVelocity(ent->uid, ms->velocity);
     }
 
     /* If the entity's current position isn't pathable, simply keep it 'stuck' there in
@@ -1174,7 +1214,7 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
     }
 }
 
-static void find_neighbours(const struct entity *ent,
+static void find_neighbours(const struct move_work *work,
                             vec_cp_ent_t *out_dyn,
                             vec_cp_ent_t *out_stat)
 {
@@ -1185,12 +1225,11 @@ static void find_neighbours(const struct entity *ent,
      * meaning they will not perform collision avoidance maneuvers of
      * their own. */
 
-    struct entity *near_ents[512];
-    int num_near = G_Pos_EntsInCircle(G_Pos_GetXZ(ent->uid), 
-        CLEARPATH_NEIGHBOUR_RADIUS, near_ents, ARR_SIZE(near_ents));
+    const struct entity *ent = work->ent;
 
-    for(int i = 0; i < num_near; i++) {
-        struct entity *curr = near_ents[i];
+    for(int i = 0; i < work->cp_count; i++) {
+        const struct near_ent *nent = &vec_AT(&s_near_ents, work->cp_base + i);
+        const struct entity *curr = nent->ent;
 
         if(curr->uid == ent->uid)
             continue;
@@ -1198,17 +1237,16 @@ static void find_neighbours(const struct entity *ent,
         if(curr->flags & ENTITY_FLAG_STATIC)
             continue;
 
-        if(curr->selection_radius == 0.0f)
+        if(nent->radius == 0.0f)
             continue;
 
         struct movestate *ms = movestate_get(curr);
         assert(ms);
 
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
         struct cp_ent newdesc = (struct cp_ent) {
-            .xz_pos = curr_xz_pos,
-            .xz_vel = ms->velocity,
-            .radius = curr->selection_radius
+            .xz_pos = nent->xz_pos,
+            .xz_vel = nent->xz_vel,
+            .radius = nent->radius
         };
 
         if(ent_still(ms))
@@ -1248,18 +1286,54 @@ static void disband_empty_flocks(void)
     }
 }
 
-static void on_20hz_tick(void *user, void *event)
+static struct near_ent near_ent_for_slot(const struct pos_store *store, uint32_t slot)
 {
-    PERF_ENTER();
+    return (struct near_ent) {
+        .ent = store->ents[slot],
+        .xz_pos = (vec2_t){store->pos[slot].x, store->pos[slot].z},
+        .xz_vel = store->vel[slot],
+        .radius = store->radius[slot],
+    };
+}
 
-    vec_cp_ent_t dyn, stat;
-    vec_cp_ent_init(&dyn);
-    vec_cp_ent_init(&stat);
+static size_t snapshot_near_ents(vec2_t xz_pos, float radius, uint32_t *buff, size_t maxout)
+{
+    const struct pos_store *store = G_Pos_Store();
+    int num_near = G_Pos_SlotsInCircle(xz_pos, radius, buff, maxout);
+    for(int i = 0; i < num_near; i++) {
+        vec_near_ent_push(&s_near_ents, near_ent_for_slot(store, buff[i]));
+    }
+    return num_near;
+}
 
+/* Query all the state that's not safe to touch from outside the main 
+ * thread for every moving entity. This includes computing the desired 
+ * velocities, which may fill the navigation caches. 
+ */
+static void take_move_snapshot(void)
+{
     uint32_t key;
     struct entity *curr;
+    (void)key;
 
-    disband_empty_flocks();
+    vec_work_reset(&s_move_work);
+    vec_near_ent_reset(&s_near_ents);
+
+    const size_t nflocks = vec_size(&s_flocks);
+    size_t flock_base[nflocks + 1];
+    size_t flock_count[nflocks + 1];
+
+    for(int i = 0; i < nflocks; i++) {
+
+        flock_base[i] = vec_size(&s_near_ents);
+        kh_foreach(vec_AT(&s_flocks, i).ents, key, curr, {
+            vec_near_ent_push(&s_near_ents, (struct near_ent){
+                .ent = curr,
+                .xz_pos = G_Pos_GetXZ(curr->uid)
+            });
+        });
+        flock_count[i] = vec_size(&s_near_ents) - flock_base[i];
+    }
 
     kh_foreach(G_GetDynamicEntsSet(), key, curr, {
 
@@ -1270,31 +1344,83 @@ static void on_20hz_tick(void *user, void *event)
             continue;
 
         struct flock *flock = flock_for_ent(curr);
-        vec2_t vpref = (vec2_t){-1,-1};
         ms->vdes = ent_desired_velocity(curr);
 
+        struct move_work work = (struct move_work) {
+            .ent = curr,
+            .ms = ms,
+            .flock = flock,
+            .xz_pos = G_Pos_GetXZ(curr->uid),
+        };
+
         switch(ms->state) {
         case STATE_SEEK_ENEMIES: 
             assert(!flock);
-            vpref = enemy_seek_vpref(curr);
+            work.dest_los = M_NavHasDestLOS(s_map, DEST_ID_INVALID, work.xz_pos);
             break;
         default:
             assert(flock);
-            vpref = point_seek_vpref(curr, flock);
+            work.dest_los = M_NavHasDestLOS(s_map, flock->dest_id, work.xz_pos);
+            work.flock_base = flock_base[flock - &vec_AT(&s_flocks, 0)];
+            work.flock_count = flock_count[flock - &vec_AT(&s_flocks, 0)];
+        }
+
+        uint32_t sep_ents[128];
+        work.sep_base = vec_size(&s_near_ents);
+        work.sep_count = snapshot_near_ents(work.xz_pos, SEPARATION_NEIGHB_RADIUS, 
+            sep_ents, ARR_SIZE(sep_ents));
+
+        uint32_t cp_ents[512];
+        work.cp_base = vec_size(&s_near_ents);
+        work.cp_count = snapshot_near_ents(work.xz_pos, CLEARPATH_NEIGHBOUR_RADIUS, 
+            cp_ents, ARR_SIZE(cp_ents));
+
+        vec_work_push(&s_move_work, work);
+    });
+}
+
+/* Compute the new velocities for a contiguous range of the snapshotted 
+ * entities. Only the snapshot and the entities' own movestates are 
+ * written to, so this may be run concurrently for different ranges.
+ */
+static void compute_velocities(void *arg, size_t idx)
+{
+    PERF_ENTER();
+
+    size_t begin = idx * MOVE_JOB_SZ;
+    size_t end = MIN(begin + MOVE_JOB_SZ, vec_size(&s_move_work));
+
+    vec_cp_ent_t dyn, stat;
+    vec_cp_ent_init(&dyn);
+    vec_cp_ent_init(&stat);
+
+    for(size_t i = begin; i < end; i++) {
+
+        const struct move_work *work = &vec_AT(&s_move_work, i);
+        struct entity *curr = work->ent;
+        struct movestate *ms = work->ms;
+        vec2_t vpref = (vec2_t){-1,-1};
+
+        switch(ms->state) {
+        case STATE_SEEK_ENEMIES: 
+            vpref = enemy_seek_vpref(work);
+            break;
+        default:
+            vpref = point_seek_vpref(work);
         }
         assert(vpref.x != -1 || vpref.z != -1);
 
         struct cp_ent curr_cp = (struct cp_ent) {
-            .xz_pos = G_Pos_GetXZ(curr->uid),
+            .xz_pos = work->xz_pos,
             .xz_vel = ms->velocity,
             .radius = curr->selection_radius,
         };
 
         vec_cp_ent_reset(&dyn);
         vec_cp_ent_reset(&stat);
-        find_neighbours(curr, &dyn, &stat);
+        find_neighbours(work, &dyn, &stat);
 
-        ms->vnew = G_ClearPath_NewVelocity(curr_cp, key, vpref, dyn, stat);
+        ms->vnew = G_ClearPath_NewVelocity(curr_cp, curr->uid, vpref, dyn, stat);
         update_vel_hist(ms, ms->vnew);
 
         vec2_t vel_diff;
@@ -1302,7 +1428,33 @@ static void on_20hz_tick(void *user, void *event)
 
         PFM_Vec2_Add(&ms->velocity, &vel_diff, &ms->vnew);
         vec2_truncate(&ms->vnew, curr->max_speed / MOVE_TICK_RES);
-    });
+    }
+
+    vec_cp_ent_destroy(&dyn);
+    vec_cp_ent_destroy(&stat);
+
+    PERF_RETURN_VOID();
+}
+
+static void on_20hz_tick(void *user, void *event)
+{
+    PERF_ENTER();
+
+    uint32_t key;
+    struct entity *curr;
+    (void)key;
+
+    disband_empty_flocks();
+    G_ClearPath_BeginTick();
+    take_move_snapshot();
+
+    /* The velocity computations only read the snapshot and the movestates 
+     * of other entities, which are not modified until the commit pass. As 
+     * such, the results don't depend on how the work is split between the
+     * threads. 
+     */
+    size_t nwork = vec_size(&s_move_work);
+    Sched_RunParallel(compute_velocities, NULL, (nwork + MOVE_JOB_SZ - 1) / MOVE_JOB_SZ);
 
     kh_foreach(G_GetDynamicEntsSet(), key, curr, {
     
@@ -1312,9 +1464,6 @@ static void on_20hz_tick(void *user, void *event)
         entity_update(curr, ms->vnew);
     });
 
-    vec_cp_ent_destroy(&dyn);
-    vec_cp_ent_destroy(&stat);
-
     PERF_RETURN_VOID();
 }
 
@@ -1330,6 +1479,8 @@ bool G_Move_Init(const struct map *map)
     }
     vec_pentity_init(&s_move_markers);
     vec_flock_init(&s_flocks);
+    vec_work_init(&s_move_work);
+    vec_near_ent_init(&s_near_ents);
 
     E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mousedown, NULL, G_RUNNING);
     E_Global_Register(EVENT_RENDER_3D_POST, on_render_3d, NULL, G_RUNNING | G_PAUSED_FULL | G_PAUSED_UI_RUNNING);
@@ -1355,6 +1506,8 @@ void G_Move_Shutdown(void)
         G_SafeFree(vec_AT(&s_move_markers, i));
     }
 
+    vec_near_ent_destroy(&s_near_ents);
+    vec_work_destroy(&s_move_work);
     vec_flock_destroy(&s_flocks);
     vec_pentity_destroy(&s_move_markers);
     kh_destroy(state, s_entity_state_table);
@@ -1374,6 +1527,7 @@ void G_Move_AddEntity(const struct entity *ent)
     khiter_t k = kh_put(state, s_entity_state_table, ent->uid, &ret);
     assert(ret != -1 && ret != 0);
     kh_value(s_entity_state_table, k) = new_ms;
+    G_Pos_UpdateVelocity(ent->uid, new_ms.velocity);
 
     entity_block(ent);
 }
@@ -1742,6 +1896,7 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_VEC2);
         ms->velocity = attr.val.as_vec2;
+        G_Pos_UpdateVelocity(uid, ms->velocity);
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_BOOL);
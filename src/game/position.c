@@ -32,41 +32,89 @@
  *  statement from your version.
  *
  */
-
 #include "game_private.h"
 #include "movement.h"
 #include "fog_of_war.h"
+#include "position.h"
 #include "public/game.h"
 #include "../main.h"
 #include "../pf_math.h"
 #include "../perf.h"
+#include "../settings.h"
 #include "../lib/public/quadtree.h"
 #include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
 #include "../map/public/map.h"
 #include "../map/public/tile.h"
 
 #include <assert.h>
 #include <float.h>
+#include <SDL.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
 
 
 QUADTREE_TYPE(ent, uint32_t)
 QUADTREE_PROTOTYPES(static, ent, uint32_t)
 QUADTREE_IMPL(static, ent, uint32_t)
 
-KHASH_MAP_INIT_INT(pos, vec3_t)
+KHASH_MAP_INIT_INT(slot, uint32_t)
+
+VEC_TYPE(slot, uint32_t)
+VEC_IMPL(static inline, slot, uint32_t)
+
+struct grid_ent{
+    uint32_t slot;
+    float    x, z;
+};
+
+VEC_TYPE(gent, struct grid_ent)
+VEC_IMPL(static inline, gent, struct grid_ent)
 
 #define POSBUF_INIT_SIZE (16384)
 #define MAX_SEARCH_ENTS  (8192)
+#define GRID_CELL_SZ     (2 * X_COORDS_PER_TILE)
 #define MAX(a, b)        ((a) < (b) ? (a) : (b))
+#define CLAMP(a, lo, hi) ((a) < (lo) ? (lo) : (a) > (hi) ? (hi) : (a))
 #define ARR_SIZE(a)      (sizeof(a)/sizeof(a[0]))
 
+/* A uniform grid of fixed-size cells, each holding a contiguous array 
+ * of the entities inside of it. Positions outside of the bounds are 
+ * clamped to the edge cells. The cell of every slot and its' index 
+ * within the cell are tracked, so that moving and removing entities
+ * are constant-time operations.
+ */
+struct pos_grid{
+    int         ncols, nrows;
+    vec_gent_t *cells;
+    size_t      nrecs;
+    size_t      capacity;
+    uint32_t   *cell_of;
+    uint32_t   *idx_in_cell;
+};
+
+/* The spatial index holding the slots of the positioned entities */
+struct pos_index{
+    enum pos_index_type type;
+    float               xmin, xmax;
+    float               zmin, zmax;
+    qt_ent_t            qt;
+    struct pos_grid     grid;
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static khash_t(pos) *s_postable;
-/* The quadtree is always synchronized with the postable, at function call boundaries */
-static qt_ent_t      s_postree;
+/* Maps an entity UID to its' slot in the store */
+static khash_t(slot)      *s_slottable;
+/* Slots below the high-water mark that have been freed up */
+static vec_slot_t          s_free_slots;
+static size_t              s_capacity;
+static struct pos_store    s_store;
+/* The index is always synchronized with the store, at function call boundaries */
+static struct pos_index    s_index;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -77,6 +125,341 @@ static bool any_ent(const struct entity *ent, void *arg)
     return true;
 }
 
+static bool store_reserve(size_t cap)
+{
+    if(cap <= s_capacity)
+        return true;
+
+    size_t newcap = s_capacity ? s_capacity : POSBUF_INIT_SIZE;
+    while(newcap < cap)
+        newcap *= 2;
+
+    vec3_t *pos = realloc(s_store.pos, newcap * sizeof(*pos));
+    if(!pos)
+        return false;
+    s_store.pos = pos;
+
+    vec2_t *vel = realloc(s_store.vel, newcap * sizeof(*vel));
+    if(!vel)
+        return false;
+    s_store.vel = vel;
+
+    float *radius = realloc(s_store.radius, newcap * sizeof(*radius));
+    if(!radius)
+        return false;
+    s_store.radius = radius;
+
+    int *faction = realloc(s_store.faction, newcap * sizeof(*faction));
+    if(!faction)
+        return false;
+    s_store.faction = faction;
+
+    struct entity **ents = realloc(s_store.ents, newcap * sizeof(*ents));
+    if(!ents)
+        return false;
+    s_store.ents = ents;
+
+    s_capacity = newcap;
+    return true;
+}
+
+static void store_destroy(void)
+{
+    free(s_store.pos);
+    free(s_store.vel);
+    free(s_store.radius);
+    free(s_store.faction);
+    free(s_store.ents);
+    memset(&s_store, 0, sizeof(s_store));
+    s_capacity = 0;
+}
+
+static bool store_alloc(uint32_t *out)
+{
+    if(vec_size(&s_free_slots) > 0) {
+        *out = vec_slot_pop(&s_free_slots);
+        return true;
+    }
+    if(!store_reserve(s_store.nslots + 1))
+        return false;
+    *out = s_store.nslots++;
+    return true;
+}
+
+static float bench_rand(uint32_t *state, float min, float max)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return min + (max - min) * ((*state >> 8) / (float)(1 << 24));
+}
+
+static double bench_elapsed_ms(uint64_t begin)
+{
+    return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static bool slot_for_uid(uint32_t uid, uint32_t *out)
+{
+    khiter_t k = kh_get(slot, s_slottable, uid);
+    if(k == kh_end(s_slottable))
+        return false;
+    *out = kh_val(s_slottable, k);
+    return true;
+}
+
+static int grid_col(const struct pos_index *index, float x)
+{
+    int col = (x - index->xmin) / GRID_CELL_SZ;
+    return CLAMP(col, 0, index->grid.ncols - 1);
+}
+
+static int grid_row(const struct pos_index *index, float z)
+{
+    int row = (z - index->zmin) / GRID_CELL_SZ;
+    return CLAMP(row, 0, index->grid.nrows - 1);
+}
+
+static uint32_t grid_cell(const struct pos_index *index, float x, float z)
+{
+    return grid_row(index, z) * index->grid.ncols + grid_col(index, x);
+}
+
+static bool grid_reserve(struct pos_grid *grid, size_t cap)
+{
+    if(cap <= grid->capacity)
+        return true;
+
+    size_t newcap = grid->capacity ? grid->capacity : POSBUF_INIT_SIZE;
+    while(newcap < cap)
+        newcap *= 2;
+
+    uint32_t *cell_of = realloc(grid->cell_of, newcap * sizeof(*cell_of));
+    if(!cell_of)
+        return false;
+    grid->cell_of = cell_of;
+
+    uint32_t *idx_in_cell = realloc(grid->idx_in_cell, newcap * sizeof(*idx_in_cell));
+    if(!idx_in_cell)
+        return false;
+    grid->idx_in_cell = idx_in_cell;
+
+    grid->capacity = newcap;
+    return true;
+}
+
+static bool grid_insert(struct pos_index *index, uint32_t slot, float x, float z)
+{
+    struct pos_grid *grid = &index->grid;
+    if(!grid_reserve(grid, slot + 1))
+        return false;
+
+    uint32_t cell = grid_cell(index, x, z);
+    if(!vec_gent_push(&grid->cells[cell], (struct grid_ent){slot, x, z}))
+        return false;
+
+    grid->cell_of[slot] = cell;
+    grid->idx_in_cell[slot] = vec_size(&grid->cells[cell]) - 1;
+    grid->nrecs++;
+    return true;
+}
+
+static void grid_delete(struct pos_index *index, uint32_t slot)
+{
+    struct pos_grid *grid = &index->grid;
+    assert(slot < grid->capacity);
+
+    vec_gent_t *cell = &grid->cells[grid->cell_of[slot]];
+    uint32_t idx = grid->idx_in_cell[slot];
+    assert(vec_AT(cell, idx).slot == slot);
+
+    struct grid_ent last = vec_gent_pop(cell);
+    if(last.slot != slot) {
+        vec_AT(cell, idx) = last;
+        grid->idx_in_cell[last.slot] = idx;
+    }
+    grid->nrecs--;
+}
+
+static bool grid_move(struct pos_index *index, uint32_t slot, float x, float z)
+{
+    struct pos_grid *grid = &index->grid;
+    uint32_t cell = grid_cell(index, x, z);
+
+    if(cell == grid->cell_of[slot]) {
+        struct grid_ent *ent = &vec_AT(&grid->cells[cell], grid->idx_in_cell[slot]);
+        ent->x = x;
+        ent->z = z;
+        return true;
+    }
+
+    grid_delete(index, slot);
+    return grid_insert(index, slot, x, z);
+}
+
+static int grid_query(const struct pos_index *index, float xmin, float xmax, float zmin, float zmax, 
+                      bool circle, float x, float z, float range, uint32_t *out, int maxout)
+{
+    const struct pos_grid *grid = &index->grid;
+    int cmin = grid_col(index, xmin), cmax = grid_col(index, xmax);
+    int rmin = grid_row(index, zmin), rmax = grid_row(index, zmax);
+    int ret = 0;
+
+    for(int r = rmin; r <= rmax; r++) {
+    for(int c = cmin; c <= cmax; c++) {
+
+        const vec_gent_t *cell = &grid->cells[r * grid->ncols + c];
+        for(int i = 0; i < vec_size(cell); i++) {
+
+            const struct grid_ent *curr = &vec_AT(cell, i);
+            if(circle) {
+                float dx = curr->x - x, dz = curr->z - z;
+                if(dx * dx + dz * dz > range * range)
+                    continue;
+            }else if(curr->x < xmin || curr->x > xmax || curr->z < zmin || curr->z > zmax) {
+                continue;
+            }
+
+            if(ret == maxout)
+                return ret;
+            out[ret++] = curr->slot;
+        }
+    }}
+    return ret;
+}
+
+static bool index_init(struct pos_index *index, enum pos_index_type type,
+                       float xmin, float xmax, float zmin, float zmax)
+{
+    memset(index, 0, sizeof(*index));
+    index->type = type;
+    index->xmin = xmin;
+    index->xmax = xmax;
+    index->zmin = zmin;
+    index->zmax = zmax;
+
+    switch(type) {
+    case POS_INDEX_QUADTREE:
+        qt_ent_init(&index->qt, xmin, xmax, zmin, zmax);
+        if(!qt_ent_reserve(&index->qt, POSBUF_INIT_SIZE)) {
+            qt_ent_destroy(&index->qt);
+            return false;
+        }
+        return true;
+    case POS_INDEX_GRID: {
+        struct pos_grid *grid = &index->grid;
+        grid->ncols = ceil((xmax - xmin) / GRID_CELL_SZ);
+        grid->nrows = ceil((zmax - zmin) / GRID_CELL_SZ);
+        grid->ncols = grid->ncols > 0 ? grid->ncols : 1;
+        grid->nrows = grid->nrows > 0 ? grid->nrows : 1;
+
+        grid->cells = malloc(grid->ncols * grid->nrows * sizeof(vec_gent_t));
+        if(!grid->cells)
+            return false;
+        for(int i = 0; i < grid->ncols * grid->nrows; i++)
+            vec_gent_init(&grid->cells[i]);
+
+        if(!grid_reserve(grid, POSBUF_INIT_SIZE)) {
+            free(grid->cells);
+            return false;
+        }
+        return true;
+    }
+    default: 
+        assert(0);
+        return false;
+    }
+}
+
+static void index_destroy(struct pos_index *index)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE:
+        qt_ent_destroy(&index->qt);
+        break;
+    case POS_INDEX_GRID:
+        for(int i = 0; i < index->grid.ncols * index->grid.nrows; i++)
+            vec_gent_destroy(&index->grid.cells[i]);
+        free(index->grid.cells);
+        free(index->grid.cell_of);
+        free(index->grid.idx_in_cell);
+        break;
+    default: assert(0);
+    }
+}
+
+static size_t index_nrecs(const struct pos_index *index)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE:    return index->qt.nrecs;
+    case POS_INDEX_GRID:        return index->grid.nrecs;
+    default: assert(0);         return 0;
+    }
+}
+
+static bool index_insert(struct pos_index *index, uint32_t slot, float x, float z)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE:    return qt_ent_insert(&index->qt, x, z, slot);
+    case POS_INDEX_GRID:        return grid_insert(index, slot, x, z);
+    default: assert(0);         return false;
+    }
+}
+
+static void index_delete(struct pos_index *index, uint32_t slot, float x, float z)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE: {
+        bool ret = qt_ent_delete(&index->qt, x, z, slot);
+        assert(ret);
+        break;
+    }
+    case POS_INDEX_GRID:
+        grid_delete(index, slot);
+        break;
+    default: assert(0);
+    }
+}
+
+static bool index_move(struct pos_index *index, uint32_t slot, 
+                       float oldx, float oldz, float x, float z)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE:
+        index_delete(index, slot, oldx, oldz);
+        return qt_ent_insert(&index->qt, x, z, slot);
+    case POS_INDEX_GRID:        
+        return grid_move(index, slot, x, z);
+    default: assert(0);         
+        return false;
+    }
+}
+
+static int index_inrange_circle(struct pos_index *index, float x, float z, float range,
+                                uint32_t *out, int maxout)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE:    
+        return qt_ent_inrange_circle(&index->qt, x, z, range, out, maxout);
+    case POS_INDEX_GRID:        
+        return grid_query(index, x - range, x + range, z - range, z + range, 
+            true, x, z, range, out, maxout);
+    default: assert(0);         
+        return 0;
+    }
+}
+
+static int index_inrange_rect(struct pos_index *index, float xmin, float xmax, 
+                              float zmin, float zmax, uint32_t *out, int maxout)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE:    
+        return qt_ent_inrange_rect(&index->qt, xmin, xmax, zmin, zmax, out, maxout);
+    case POS_INDEX_GRID:        
+        return grid_query(index, xmin, xmax, zmin, zmax, false, 0.0f, 0.0f, 0.0f, out, maxout);
+    default: assert(0);         
+        return 0;
+    }
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -85,35 +468,52 @@ bool G_Pos_Set(const struct entity *ent, vec3_t pos)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    khiter_t k = kh_get(pos, s_postable, ent->uid);
-    bool overwrite = (k != kh_end(s_postable));
+    uint32_t slot;
+    bool overwrite = slot_for_uid(ent->uid, &slot);
+    vec3_t old_pos = pos;
 
     if(overwrite) {
-        vec3_t old_pos = kh_val(s_postable, k);
-        bool ret = qt_ent_delete(&s_postree, old_pos.x, old_pos.z, ent->uid);
-        assert(ret);
-
-        G_Fog_RemoveVision((vec2_t){old_pos.x, old_pos.z}, ent->faction_id, ent->vision_range);
-    }
+        old_pos = s_store.pos[slot];
+        if(!index_move(&s_index, slot, old_pos.x, old_pos.z, pos.x, pos.z))
+            return false;
+    }else{
 
-    if(!qt_ent_insert(&s_postree, pos.x, pos.z, ent->uid))
-        return false;
+        if(!store_alloc(&slot))
+            return false;
 
-    if(!overwrite) {
         int ret;
-        kh_put(pos, s_postable, ent->uid, &ret); 
+        khiter_t k = kh_put(slot, s_slottable, ent->uid, &ret); 
         if(ret == -1) {
-            qt_ent_delete(&s_postree, pos.x, pos.z, ent->uid);
+            vec_slot_push(&s_free_slots, slot);
+            return false;
+        }
+        kh_val(s_slottable, k) = slot;
+        s_store.vel[slot] = (vec2_t){0.0f, 0.0f};
+
+        if(!index_insert(&s_index, slot, pos.x, pos.z)) {
+            kh_del(slot, s_slottable, k);
+            vec_slot_push(&s_free_slots, slot);
             return false;
         }
-        k = kh_get(pos, s_postable, ent->uid);
     }
 
-    kh_val(s_postable, k) = pos;
-    assert(kh_size(s_postable) == s_postree.nrecs);
+    s_store.pos[slot] = pos;
+    s_store.radius[slot] = ent->selection_radius;
+    s_store.faction[slot] = ent->faction_id;
+    s_store.ents[slot] = (struct entity*)ent;
+    assert(kh_size(s_slottable) == index_nrecs(&s_index));
 
     G_Move_UpdatePos(ent, (vec2_t){pos.x, pos.z});
-    G_Fog_AddVision((vec2_t){pos.x, pos.z}, ent->faction_id, ent->vision_range);
+    if(overwrite) {
+        G_Fog_MoveVision((vec2_t){old_pos.x, old_pos.z}, (vec2_t){pos.x, pos.z}, 
+            ent->faction_id, ent->vision_range);
+    }else{
+        G_Fog_AddVision((vec2_t){pos.x, pos.z}, ent->faction_id, ent->vision_range);
+    }
+
+    if(ent->flags & ENTITY_FLAG_STATIC) {
+        G_UpdateBounds(ent);
+    }
     return true; 
 }
 
@@ -121,44 +521,82 @@ vec3_t G_Pos_Get(uint32_t uid)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    khiter_t k = kh_get(pos, s_postable, uid);
-    assert(k != kh_end(s_postable));
-    return kh_val(s_postable, k);
+    uint32_t slot;
+    bool found = slot_for_uid(uid, &slot);
+    assert(found);
+    return s_store.pos[slot];
 }
 
 vec2_t G_Pos_GetXZ(uint32_t uid)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    khiter_t k = kh_get(pos, s_postable, uid);
-    assert(k != kh_end(s_postable));
-    vec3_t pos = kh_val(s_postable, k);
+    uint32_t slot;
+    bool found = slot_for_uid(uid, &slot);
+    assert(found);
+    vec3_t pos = s_store.pos[slot];
     return (vec2_t){pos.x, pos.z};
 }
 
+void G_Pos_UpdateRadius(uint32_t uid, float radius)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    uint32_t slot;
+    if(!slot_for_uid(uid, &slot))
+        return;
+    s_store.radius[slot] = radius;
+}
+
+void G_Pos_UpdateFaction(uint32_t uid, int faction_id)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    uint32_t slot;
+    if(!slot_for_uid(uid, &slot))
+        return;
+    s_store.faction[slot] = faction_id;
+}
+
+void G_Pos_UpdateVelocity(uint32_t uid, vec2_t vel)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    uint32_t slot;
+    if(!slot_for_uid(uid, &slot))
+        return;
+    s_store.vel[slot] = vel;
+}
+
 void G_Pos_Delete(uint32_t uid)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    khiter_t k = kh_get(pos, s_postable, uid);
-    assert(k != kh_end(s_postable));
+    khiter_t k = kh_get(slot, s_slottable, uid);
+    assert(k != kh_end(s_slottable));
+
+    uint32_t slot = kh_val(s_slottable, k);
+    vec3_t pos = s_store.pos[slot];
+    kh_del(slot, s_slottable, k);
 
-    vec3_t pos = kh_val(s_postable, k);
-    kh_del(pos, s_postable, k);
+    index_delete(&s_index, slot, pos.x, pos.z);
+    assert(kh_size(s_slottable) == index_nrecs(&s_index));
 
-    bool ret = qt_ent_delete(&s_postree, pos.x, pos.z, uid);
-    assert(ret);
-    assert(kh_size(s_postable) == s_postree.nrecs);
+    s_store.ents[slot] = NULL;
+    vec_slot_push(&s_free_slots, slot);
 }
 
 bool G_Pos_Init(const struct map *map)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    if(NULL == (s_postable = kh_init(pos)))
-        return false;
-    if(kh_resize(pos, s_postable, POSBUF_INIT_SIZE) < 0)
-        return false;
+    if(NULL == (s_slottable = kh_init(slot)))
+        goto fail_table;
+    if(kh_resize(slot, s_slottable, POSBUF_INIT_SIZE) < 0)
+        goto fail_store;
+    if(!store_reserve(POSBUF_INIT_SIZE))
+        goto fail_store;
+    vec_slot_init(&s_free_slots);
 
     struct map_resolution res;
     M_GetResolution(map, &res);
@@ -170,21 +608,47 @@ bool G_Pos_Init(const struct map *map)
     float zmin = center.z - (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
     float zmax = center.z + (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
 
-    qt_ent_init(&s_postree, xmin, xmax, zmin, zmax);
-    if(!qt_ent_reserve(&s_postree, POSBUF_INIT_SIZE)) {
-        kh_destroy(pos, s_postable);
-        return false;
-    }
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.spatial_index", &setting);
+    assert(status == SS_OKAY);
+
+    if(!index_init(&s_index, setting.as_int, xmin, xmax, zmin, zmax))
+        goto fail_index;
 
     return true;
+
+fail_index:
+    vec_slot_destroy(&s_free_slots);
+fail_store:
+    store_destroy();
+    kh_destroy(slot, s_slottable);
+fail_table:
+    return false;
 }
 
 void G_Pos_Shutdown(void)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    kh_destroy(pos, s_postable);
-    qt_ent_destroy(&s_postree);
+    kh_destroy(slot, s_slottable);
+    s_slottable = NULL;
+    vec_slot_destroy(&s_free_slots);
+    store_destroy();
+    index_destroy(&s_index);
+}
+
+const struct pos_store *G_Pos_Store(void)
+{
+    return &s_store;
+}
+
+int G_Pos_SlotsInCircle(vec2_t xz_point, float range, uint32_t *out, size_t maxout)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    int ret = index_inrange_circle(&s_index, xz_point.x, xz_point.z, range, out, maxout);
+    PERF_RETURN(ret);
 }
 
 int G_Pos_EntsInRect(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout)
@@ -202,18 +666,15 @@ int G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, struct entity **out,
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
 
-    uint32_t ent_ids[maxout];
-    const khash_t(entity) *ents = G_GetAllEntsSet();
-
-    int ntotal = qt_ent_inrange_rect(&s_postree, 
-        xz_min.x, xz_max.x, xz_min.z, xz_max.z, ent_ids, maxout);
+    uint32_t slots[maxout];
+    int ntotal = index_inrange_rect(&s_index, 
+        xz_min.x, xz_max.x, xz_min.z, xz_max.z, slots, maxout);
     int ret = 0;
 
     for(int i = 0; i < ntotal; i++) {
 
-        khiter_t k = kh_get(entity, ents, ent_ids[i]);
-        assert(k != kh_end(s_postable));
-        struct entity *curr = kh_val(ents, k);
+        struct entity *curr = s_store.ents[slots[i]];
+        assert(curr);
 
         if(!predicate(curr, arg))
             continue;
@@ -238,20 +699,15 @@ int G_Pos_EntsInCircleWithPred(vec2_t xz_point, float range, struct entity **out
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
 
-    uint32_t ent_ids[maxout];
-    const khash_t(entity) *ents = G_GetAllEntsSet();
-    for(int i = 0; i < maxout; i++)
-        ent_ids[i] = (uint32_t)-1;
-
-    int ntotal = qt_ent_inrange_circle(&s_postree, 
-        xz_point.x, xz_point.z, range, ent_ids, maxout);
+    uint32_t slots[maxout];
+    int ntotal = index_inrange_circle(&s_index, 
+        xz_point.x, xz_point.z, range, slots, maxout);
     int ret = 0;
 
     for(int i = 0; i < ntotal; i++) {
-        assert(ent_ids[i] != (uint32_t)-1);
-        khiter_t k = kh_get(entity, ents, ent_ids[i]);
-        assert(k != kh_end(s_postable));
-        struct entity *curr = kh_val(ents, k);
+
+        struct entity *curr = s_store.ents[slots[i]];
+        assert(curr);
 
         if(!predicate(curr, arg))
             continue;
@@ -261,6 +717,69 @@ int G_Pos_EntsInCircleWithPred(vec2_t xz_point, float range, struct entity **out
     PERF_RETURN(ret);
 }
 
+/* Time the spatial index operations performed for RTS-style workloads on 
+ * a private index with the same bounds as the current map's: insertion of 
+ * 'nents' randomly-placed entities, followed by 'niters' rounds of moving 
+ * every entity a short distance and querying its' immediate neighbourhood. 
+ */
+bool G_Pos_BenchIndex(enum pos_index_type type, size_t nents, size_t niters, 
+                      struct pos_bench_result *out)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_slottable)
+        return false;
+
+    struct pos_index index;
+    if(!index_init(&index, type, s_index.xmin, s_index.xmax, s_index.zmin, s_index.zmax))
+        return false;
+
+    vec2_t *pos = malloc(nents * sizeof(vec2_t));
+    if(!pos) {
+        index_destroy(&index);
+        return false;
+    }
+
+    uint32_t seed = 0x1234567;
+    uint32_t slots[512];
+    memset(out, 0, sizeof(*out));
+
+    for(int i = 0; i < nents; i++) {
+        pos[i].x = bench_rand(&seed, index.xmin, index.xmax);
+        pos[i].z = bench_rand(&seed, index.zmin, index.zmax);
+    }
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(int i = 0; i < nents; i++) {
+        index_insert(&index, i, pos[i].x, pos[i].z);
+    }
+    out->insert_ms = bench_elapsed_ms(begin);
+
+    for(int iter = 0; iter < niters; iter++) {
+
+        begin = SDL_GetPerformanceCounter();
+        for(int i = 0; i < nents; i++) {
+
+            vec2_t old = pos[i];
+            pos[i].x = CLAMP(old.x + bench_rand(&seed, -1.0f, 1.0f), index.xmin, index.xmax);
+            pos[i].z = CLAMP(old.z + bench_rand(&seed, -1.0f, 1.0f), index.zmin, index.zmax);
+            index_move(&index, i, old.x, old.z, pos[i].x, pos[i].z);
+        }
+        out->move_ms += bench_elapsed_ms(begin);
+
+        begin = SDL_GetPerformanceCounter();
+        for(int i = 0; i < nents; i++) {
+            out->nresults += index_inrange_circle(&index, pos[i].x, pos[i].z, 
+                10.0f, slots, ARR_SIZE(slots));
+        }
+        out->query_ms += bench_elapsed_ms(begin);
+    }
+
+    free(pos);
+    index_destroy(&index);
+    return true;
+}
+
 struct entity *G_Pos_NearestWithPred(vec2_t xz_point, 
                                      bool (*predicate)(const struct entity *ent, void *arg), 
                                      void *arg)
@@ -268,26 +787,25 @@ struct entity *G_Pos_NearestWithPred(vec2_t xz_point,
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
 
-    uint32_t ent_ids[MAX_SEARCH_ENTS];
-    const khash_t(entity) *ents = G_GetAllEntsSet();
+    uint32_t slots[MAX_SEARCH_ENTS];
 
-    const float qt_len = MAX(s_postree.xmax - s_postree.xmin, s_postree.ymax - s_postree.ymin);
+    const float qt_len = MAX(s_index.xmax - s_index.xmin, s_index.zmax - s_index.zmin);
     float len = (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / 8.0f;
 
     while(len < qt_len) {
         float min_dist = FLT_MAX;
         struct entity *ret = NULL;
 
-        int num_cands = qt_ent_inrange_circle(&s_postree, xz_point.x, xz_point.z,
-            len, ent_ids, ARR_SIZE(ent_ids));
+        int num_cands = index_inrange_circle(&s_index, xz_point.x, xz_point.z,
+            len, slots, ARR_SIZE(slots));
 
         for(int i = 0; i < num_cands; i++) {
         
-            khiter_t k = kh_get(entity, ents, ent_ids[i]);
-            assert(k != kh_end(s_postable));
-            struct entity *curr = kh_val(ents, k);
+            struct entity *curr = s_store.ents[slots[i]];
+            assert(curr);
 
-            vec2_t delta, can_pos_xz = G_Pos_GetXZ(curr->uid);
+            vec3_t can_pos = s_store.pos[slots[i]];
+            vec2_t delta, can_pos_xz = (vec2_t){can_pos.x, can_pos.z};
             PFM_Vec2_Sub(&xz_point, &can_pos_xz, &delta);
 
             if(PFM_Vec2_Len(&delta) < min_dist && predicate(curr, arg)) {
@@ -36,11 +36,38 @@
 #ifndef POSITION_H
 #define POSITION_H
 
+#include "../pf_math.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 struct map;
+struct entity;
+
+/* Structure-of-arrays store of the hot per-entity attributes. Every 
+ * entity with a position owns a slot, which stays the same for as long 
+ * as the entity is positioned. Slots of removed entities have a NULL 
+ * entry in 'ents' and are recycled. All slots are below 'nslots'. 
+ */
+struct pos_store{
+    size_t          nslots;
+    vec3_t         *pos;
+    vec2_t         *vel;
+    float          *radius;
+    int            *faction;
+    struct entity **ents;
+};
 
 bool G_Pos_Init(const struct map *map);
 void G_Pos_Shutdown(void);
 void G_Pos_Delete(uint32_t uid);
+void G_Pos_UpdateVelocity(uint32_t uid, vec2_t vel);
+
+/* The store may be read directly, but is only updated via the G_Pos_* 
+ * functions. Pointers into it are invalidated by G_Pos_Set. */
+const struct pos_store *G_Pos_Store(void);
+int G_Pos_SlotsInCircle(vec2_t xz_point, float range, uint32_t *out, size_t maxout);
 
 #endif
 
@@ -101,6 +101,7 @@ struct render_input{
 
 bool   G_Init(void);
 bool   G_LoadMap(SDL_RWops *stream, bool update_navgrid);
+bool   G_SaveMap(SDL_RWops *stream, bool bake_nav);
 void   G_Shutdown(void);
 
 void   G_ClearState(void);
@@ -123,6 +124,7 @@ bool   G_SetMinimapResizeMask(int mask);
 bool   G_MouseOverMinimap(void);
 bool   G_MapHeightAtPoint(vec2_t xz, float *out_height);
 bool   G_PointInsideMap(vec2_t xz);
+bool   G_BenchNavFields(size_t niters, struct nav_bench_result *out);
 
 void   G_BakeNavDataForScene(void);
 
@@ -131,6 +133,10 @@ bool   G_RemoveEntity(struct entity *ent);
 void   G_StopEntity(const struct entity *ent);
 void   G_SetStatic(struct entity *ent, bool on);
 
+/* Must be called after directly changing the scale, rotation or flags of 
+ * an active entity, to refresh the bounds cached for culling it. */
+void   G_UpdateBounds(const struct entity *ent);
+
 /* Wrapper around AL_EntityFree to defer the call until the render thread 
  * (which owns some part of entity resources) finishes its' work. */
 void   G_SafeFree(struct entity *ent);
@@ -227,9 +233,23 @@ int   G_Combat_GetBaseDamage(const struct entity *ent);
 /* GAME POSITION                                                             */
 /*###########################################################################*/
 
+enum pos_index_type{
+    POS_INDEX_QUADTREE,
+    POS_INDEX_GRID,
+};
+
+struct pos_bench_result{
+    double insert_ms;
+    double move_ms;
+    double query_ms;
+    size_t nresults;
+};
+
 bool   G_Pos_Set(const struct entity *ent, vec3_t pos);
 vec3_t G_Pos_Get(uint32_t uid);
 vec2_t G_Pos_GetXZ(uint32_t uid);
+void   G_Pos_UpdateRadius(uint32_t uid, float radius);
+void   G_Pos_UpdateFaction(uint32_t uid, int faction_id);
 
 int    G_Pos_EntsInRect(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout);
 int    G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout,
@@ -238,6 +258,9 @@ int    G_Pos_EntsInCircle(vec2_t xz_point, float range, struct entity **out, siz
 int    G_Pos_EntsInCircleWithPred(vec2_t xz_point, float range, struct entity **out, size_t maxout,
                                   bool (*predicate)(const struct entity *ent, void *arg), void *arg);
 
+bool   G_Pos_BenchIndex(enum pos_index_type type, size_t nents, size_t niters, 
+                        struct pos_bench_result *out);
+
 struct entity *G_Pos_Nearest(vec2_t xz_point);
 struct entity *G_Pos_NearestWithPred(vec2_t xz_point, 
                                      bool (*predicate)(const struct entity *ent, void *arg), void *arg);
@@ -37,6 +37,7 @@
 #include "public/vec.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 VEC_TYPE(uchar, unsigned char)
@@ -44,7 +45,11 @@ VEC_IMPL(static inline, uchar, unsigned char)
 
 #define VEC(rwops)          ((vec_uchar_t*)((rwops)->hidden.unknown.data1))
 #define SEEK_IDX(rwops)     ((uintptr_t)((rwops)->hidden.unknown.data2))
+#define DST(rwops)          ((SDL_RWops*)((rwops)->hidden.unknown.data2))
 #define SDL_RWOPS_VEC       (0xffff)
+#define SDL_RWOPS_BUFF      (0xfffe)
+#define BUFF_FLUSH_SIZE     (64 * 1024)
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -75,22 +80,34 @@ static Sint64 rw_vec_seek(SDL_RWops *ctx, Sint64 offset, int whence)
     return SEEK_IDX(ctx);
 }
 
+static bool vec_reserve(vec_uchar_t *vec, size_t size)
+{
+    if(vec->capacity >= size)
+        return true;
+    return vec_uchar_resize(vec, MAX(size, MAX(vec->capacity * 2, 64)));
+}
+
 static size_t rw_vec_write(SDL_RWops *ctx, const void *ptr, size_t size, size_t num)
 {
     assert(ctx->type == SDL_RWOPS_VEC);
 
-    if(rw_vec_size(ctx) <= SEEK_IDX(ctx) + size * num
-    && !vec_uchar_resize(VEC(ctx), SEEK_IDX(ctx) + size * num)) {
-    
+    vec_uchar_t *vec = VEC(ctx);
+    size_t nbytes = size * num;
+    size_t end = SEEK_IDX(ctx) + nbytes;
+
+    if(!vec_reserve(vec, end)) {
         SDL_Error(SDL_EFWRITE);
         return 0;
     }
 
-    for(int i = 0; i < size * num; i++) {
-        vec_uchar_push(VEC(ctx), *((unsigned char*)ptr++));
-    }
+    /* Writing past the end leaves a zero-filled gap */
+    if(SEEK_IDX(ctx) > vec->size)
+        memset(vec->array + vec->size, 0, SEEK_IDX(ctx) - vec->size);
 
-    ctx->hidden.unknown.data2 = (void*)(SEEK_IDX(ctx) + size * num);
+    memcpy(vec->array + SEEK_IDX(ctx), ptr, nbytes);
+    vec->size = MAX(vec->size, end);
+
+    ctx->hidden.unknown.data2 = (void*)end;
     return num;
 }
 
@@ -117,6 +134,76 @@ static int rw_vec_close(SDL_RWops *ctx)
     return 0;
 }
 
+static int rw_buff_flush(SDL_RWops *ctx)
+{
+    vec_uchar_t *buff = VEC(ctx);
+    if(vec_size(buff) == 0)
+        return 0;
+
+    if(SDL_RWwrite(DST(ctx), buff->array, vec_size(buff), 1) != 1)
+        return -1;
+
+    vec_uchar_reset(buff);
+    return 0;
+}
+
+static Sint64 rw_buff_size(SDL_RWops *ctx)
+{
+    assert(ctx->type == SDL_RWOPS_BUFF);
+    if(rw_buff_flush(ctx))
+        return -1;
+    return SDL_RWsize(DST(ctx));
+}
+
+static Sint64 rw_buff_seek(SDL_RWops *ctx, Sint64 offset, int whence)
+{
+    assert(ctx->type == SDL_RWOPS_BUFF);
+    if(rw_buff_flush(ctx))
+        return -1;
+    return SDL_RWseek(DST(ctx), offset, whence);
+}
+
+static size_t rw_buff_write(SDL_RWops *ctx, const void *ptr, size_t size, size_t num)
+{
+    assert(ctx->type == SDL_RWOPS_BUFF);
+
+    vec_uchar_t *buff = VEC(ctx);
+    size_t nbytes = size * num;
+
+    if(vec_size(buff) + nbytes > BUFF_FLUSH_SIZE && rw_buff_flush(ctx))
+        return 0;
+
+    /* Large writes skip the buffer altogether */
+    if(nbytes >= BUFF_FLUSH_SIZE)
+        return SDL_RWwrite(DST(ctx), ptr, size, num);
+
+    if(!vec_reserve(buff, vec_size(buff) + nbytes)) {
+        SDL_Error(SDL_EFWRITE);
+        return 0;
+    }
+
+    memcpy(buff->array + buff->size, ptr, nbytes);
+    buff->size += nbytes;
+    return num;
+}
+
+static size_t rw_buff_read(SDL_RWops *ctx, void *ptr, size_t size, size_t num)
+{
+    assert(ctx->type == SDL_RWOPS_BUFF);
+    if(rw_buff_flush(ctx))
+        return 0;
+    return SDL_RWread(DST(ctx), ptr, size, num);
+}
+
+static int rw_buff_close(SDL_RWops *ctx)
+{
+    assert(ctx->type == SDL_RWOPS_BUFF);
+    int ret = rw_buff_flush(ctx);
+    vec_uchar_destroy(VEC(ctx));
+    free(ctx);
+    return ret;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -146,3 +233,23 @@ const char *PFSDL_VectorRWOpsRaw(SDL_RWops *ctx)
     return (const char*)VEC(ctx)->array;
 }
 
+SDL_RWops *PFSDL_BufferedWriteRWOps(SDL_RWops *dst)
+{
+    SDL_RWops *ret = malloc(sizeof(SDL_RWops) + sizeof(vec_uchar_t));
+    if(!ret)
+        return ret;
+
+    ret->size = rw_buff_size;
+    ret->seek = rw_buff_seek;
+    ret->read = rw_buff_read;
+    ret->write = rw_buff_write;
+    ret->close = rw_buff_close;
+    ret->type = SDL_RWOPS_BUFF;
+
+    ret->hidden.unknown.data1 = ret + 1;
+    vec_uchar_init(VEC(ret));
+    ret->hidden.unknown.data2 = dst;
+
+    return ret;
+}
+
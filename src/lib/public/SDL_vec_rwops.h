@@ -41,5 +41,10 @@
 SDL_RWops  *PFSDL_VectorRWOps(void);
 const char *PFSDL_VectorRWOpsRaw(SDL_RWops *ctx);
 
+/* Accumulates writes in memory and passes them on to 'dst' in large chunks. 
+ * Closing the returned stream flushes it, but does not close 'dst'. 
+ */
+SDL_RWops  *PFSDL_BufferedWriteRWOps(SDL_RWops *dst);
+
 #endif
 
@@ -105,9 +105,13 @@
     scope  bool  lru_##name##_get      (lru(name) *lru, uint64_t key, type *out);               \
     /* Returned pointer is invalidated when new entries are added; it should not be cached  */  \
     scope  const type *lru_##name##_at (lru(name) *lru, uint64_t key);                          \
+    /* Same as above, but without touching the entry's age */                                   \
+    scope  const type *lru_##name##_peek(lru(name) *lru, uint64_t key);                         \
     scope  bool  lru_##name##_contains (lru(name) *lru, uint64_t key);                          \
     scope  void  lru_##name##_put      (lru(name) *lru, uint64_t key, const type *in);          \
     scope  bool  lru_##name##_remove   (lru(name) *lru, uint64_t key);                          \
+    /* Evict the least recently used entry, if any, invoking the 'on_evict' hook */             \
+    scope  bool  lru_##name##_evict_oldest(lru(name) *lru);                                     \
 
 /***********************************************************************************************/
 
@@ -221,6 +225,16 @@
         return &mpn->entry;                                                                     \
     }                                                                                           \
                                                                                                 \
+    scope const type *lru_##name##_peek(lru(name) *lru, uint64_t key)                           \
+    {                                                                                           \
+        khiter_t k;                                                                             \
+        if((k = kh_get(name, lru->key_node_table, key)) == kh_end(lru->key_node_table))         \
+            return NULL;                                                                        \
+                                                                                                \
+        mp_ref_t ref = kh_val(lru->key_node_table, k);                                          \
+        return &mp_##name##_entry(&lru->node_pool, ref)->entry;                                 \
+    }                                                                                           \
+                                                                                                \
     scope bool lru_##name##_contains(lru(name) *lru, uint64_t key)                              \
     {                                                                                           \
         return (lru_##name##_at(lru, key) != NULL);                                             \
@@ -313,6 +327,17 @@
         --lru->used;                                                                            \
         kh_del(name, lru->key_node_table, k);                                                   \
         return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool lru_##name##_evict_oldest(lru(name) *lru)                                        \
+    {                                                                                           \
+        if(lru->used == 0)                                                                      \
+            return false;                                                                       \
+                                                                                                \
+        lru_node(name) *vict = mp_##name##_entry(&lru->node_pool, lru->ilru_tail);              \
+        if(lru->on_evict)                                                                       \
+            lru->on_evict(&vict->entry);                                                        \
+        return lru_##name##_remove(lru, vict->key);                                             \
     }                                                                                           \
 
 #endif
@@ -38,6 +38,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -124,11 +125,12 @@
     {                                                                                           \
         if(pqueue->size + 1 >= pqueue->capacity) {                                              \
                                                                                                 \
-            pqueue->capacity = pqueue->capacity ? pqueue->capacity * 2 : 32;                    \
-            pqueue->nodes = realloc(pqueue->nodes,                                              \
-                pqueue->capacity * sizeof(pq_##name##_node_t));                                 \
-            if(!pqueue->nodes)                                                                  \
+            size_t newcap = pqueue->capacity ? pqueue->capacity * 2 : 32;                       \
+            void *newnodes = realloc(pqueue->nodes, newcap * sizeof(pq_##name##_node_t));       \
+            if(!newnodes)                                                                       \
                 return false;                                                                   \
+            pqueue->nodes = newnodes;                                                           \
+            pqueue->capacity = newcap;                                                          \
         }                                                                                       \
                                                                                                 \
         int curr_idx = pqueue->size + 1;                                                        \
@@ -191,11 +193,11 @@
     {                                                                                           \
         if(pqueue->capacity < cap) {                                                            \
                                                                                                 \
-            pqueue->capacity = cap;                                                             \
-            pqueue->nodes = realloc(pqueue->nodes,                                              \
-                pqueue->capacity * sizeof(pq_##name##_node_t));                                 \
-            if(!pqueue->nodes)                                                                  \
+            void *newnodes = realloc(pqueue->nodes, cap * sizeof(pq_##name##_node_t));          \
+            if(!newnodes)                                                                       \
                 return false;                                                                   \
+            pqueue->nodes = newnodes;                                                           \
+            pqueue->capacity = cap;                                                             \
         }                                                                                       \
         return true;                                                                            \
     }                                                                                           \
@@ -208,5 +210,186 @@
         return true;                                                                            \
     }                                                                                           \
 
+/***********************************************************************************************/
+
+/* An indexed binary heap. Every element is identified by an integer key in the
+ * range [0, nkeys), which allows an O(1) membership test and an O(log n) 
+ * decrease-key operation. A key is present in the queue at most once.
+ */
+
+#define PQUEUE_INDEXED_TYPE(name, type)                                                         \
+                                                                                                \
+    typedef struct pqi_##name##_node_s {                                                        \
+        float priority;                                                                         \
+        int key;                                                                                \
+        type data;                                                                              \
+    } pqi_##name##_node_t;                                                                      \
+                                                                                                \
+    typedef struct pqi_##name##_s {                                                             \
+        pqi_##name##_node_t *nodes;                                                             \
+        /* Maps each key to its' node index in the heap, or 0 if absent */                      \
+        int *pos;                                                                               \
+        size_t nkeys;                                                                           \
+        size_t capacity;                                                                        \
+        size_t size;                                                                            \
+    } pqi_##name##_t;                                                                           \
+
+/***********************************************************************************************/
+
+#define pqi(name)                                                                               \
+    pqi_##name##_t                                                                              \
+
+/***********************************************************************************************/
+
+#define PQUEUE_INDEXED_PROTOTYPES(scope, name, type)                                            \
+                                                                                                \
+    static void _pqi_##name##_sift_up  (pqi(name) *pqueue, int idx);                            \
+    static void _pqi_##name##_sift_down(pqi(name) *pqueue, int idx);                            \
+    scope  bool  pqi_##name##_init     (pqi(name) *pqueue, size_t nkeys);                       \
+    scope  void  pqi_##name##_destroy  (pqi(name) *pqueue);                                     \
+    scope  bool  pqi_##name##_push     (pqi(name) *pqueue, float in_prio, int key, type in);    \
+    scope  bool  pqi_##name##_pop      (pqi(name) *pqueue, type *out);                          \
+    scope  bool  pqi_##name##_contains (pqi(name) *pqueue, int key);                            \
+    scope  bool  pqi_##name##_top_prio (pqi(name) *pqueue, float *out);                         \
+    scope  void  pqi_##name##_clear    (pqi(name) *pqueue);                                     \
+
+/***********************************************************************************************/
+
+#define PQUEUE_INDEXED_IMPL(scope, name, type)                                                  \
+                                                                                                \
+    static void _pqi_##name##_sift_up(pqi(name) *pqueue, int idx)                               \
+    {                                                                                           \
+        pqi_##name##_node_t node = pqueue->nodes[idx];                                          \
+        int parent_idx = idx / 2;                                                               \
+                                                                                                \
+        while(idx > 1 && pqueue->nodes[parent_idx].priority > node.priority) {                  \
+            pqueue->nodes[idx] = pqueue->nodes[parent_idx];                                     \
+            pqueue->pos[pqueue->nodes[idx].key] = idx;                                          \
+            idx = parent_idx;                                                                   \
+            parent_idx = parent_idx / 2;                                                        \
+        }                                                                                       \
+                                                                                                \
+        pqueue->nodes[idx] = node;                                                              \
+        pqueue->pos[node.key] = idx;                                                            \
+    }                                                                                           \
+                                                                                                \
+    static void _pqi_##name##_sift_down(pqi(name) *pqueue, int idx)                             \
+    {                                                                                           \
+        pqi_##name##_node_t node = pqueue->nodes[idx];                                          \
+                                                                                                \
+        while(true) {                                                                           \
+                                                                                                \
+            int target_idx = idx;                                                               \
+            float target_prio = node.priority;                                                  \
+            int left_child_idx = idx * 2;                                                       \
+            int right_child_idx = left_child_idx + 1;                                           \
+                                                                                                \
+            if(left_child_idx <= pqueue->size                                                   \
+            && pqueue->nodes[left_child_idx].priority < target_prio) {                          \
+                target_idx = left_child_idx;                                                    \
+                target_prio = pqueue->nodes[left_child_idx].priority;                           \
+            }                                                                                   \
+                                                                                                \
+            if(right_child_idx <= pqueue->size                                                  \
+            && pqueue->nodes[right_child_idx].priority < target_prio) {                         \
+                target_idx = right_child_idx;                                                   \
+            }                                                                                   \
+                                                                                                \
+            if(target_idx == idx)                                                               \
+                break;                                                                          \
+                                                                                                \
+            pqueue->nodes[idx] = pqueue->nodes[target_idx];                                     \
+            pqueue->pos[pqueue->nodes[idx].key] = idx;                                          \
+            idx = target_idx;                                                                   \
+        }                                                                                       \
+                                                                                                \
+        pqueue->nodes[idx] = node;                                                              \
+        pqueue->pos[node.key] = idx;                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool pqi_##name##_init(pqi(name) *pqueue, size_t nkeys)                               \
+    {                                                                                           \
+        pqueue->nodes = NULL;                                                                   \
+        pqueue->capacity = 0;                                                                   \
+        pqueue->size = 0;                                                                       \
+        pqueue->nkeys = nkeys;                                                                  \
+        pqueue->pos = calloc(nkeys, sizeof(int));                                               \
+        return (pqueue->pos != NULL);                                                           \
+    }                                                                                           \
+                                                                                                \
+    scope void pqi_##name##_destroy(pqi(name) *pqueue)                                          \
+    {                                                                                           \
+        free(pqueue->nodes);                                                                    \
+        free(pqueue->pos);                                                                      \
+    }                                                                                           \
+                                                                                                \
+    /* Inserts the key if it is not in the queue. Otherwise, lowers the                         \
+     * priority of the existing entry if the new priority is lower. */                          \
+    scope bool pqi_##name##_push(pqi(name) *pqueue, float in_prio, int key, type in)            \
+    {                                                                                           \
+        assert(key >= 0 && key < pqueue->nkeys);                                                \
+        int idx = pqueue->pos[key];                                                             \
+                                                                                                \
+        if(idx) {                                                                               \
+            if(pqueue->nodes[idx].priority <= in_prio)                                          \
+                return true;                                                                    \
+            pqueue->nodes[idx].priority = in_prio;                                              \
+            pqueue->nodes[idx].data = in;                                                       \
+            _pqi_##name##_sift_up(pqueue, idx);                                                 \
+            return true;                                                                        \
+        }                                                                                       \
+                                                                                                \
+        if(pqueue->size + 1 >= pqueue->capacity) {                                              \
+                                                                                                \
+            size_t new_cap = pqueue->capacity ? pqueue->capacity * 2 : 32;                      \
+            void *new_nodes = realloc(pqueue->nodes, new_cap * sizeof(pqi_##name##_node_t));    \
+            if(!new_nodes)                                                                      \
+                return false;                                                                   \
+            pqueue->nodes = new_nodes;                                                          \
+            pqueue->capacity = new_cap;                                                         \
+        }                                                                                       \
+                                                                                                \
+        idx = ++pqueue->size;                                                                   \
+        pqueue->nodes[idx] = (pqi_##name##_node_t){in_prio, key, in};                           \
+        _pqi_##name##_sift_up(pqueue, idx);                                                     \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool pqi_##name##_pop(pqi(name) *pqueue, type *out)                                   \
+    {                                                                                           \
+        if(pqueue->size == 0)                                                                   \
+            return false;                                                                       \
+                                                                                                \
+        *out = pqueue->nodes[1].data;                                                           \
+        pqueue->pos[pqueue->nodes[1].key] = 0;                                                  \
+                                                                                                \
+        if(--pqueue->size > 0) {                                                                \
+            pqueue->nodes[1] = pqueue->nodes[pqueue->size + 1];                                 \
+            _pqi_##name##_sift_down(pqueue, 1);                                                 \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool pqi_##name##_contains(pqi(name) *pqueue, int key)                                \
+    {                                                                                           \
+        assert(key >= 0 && key < pqueue->nkeys);                                                \
+        return (pqueue->pos[key] != 0);                                                         \
+    }                                                                                           \
+                                                                                                \
+    scope bool pqi_##name##_top_prio(pqi(name) *pqueue, float *out)                             \
+    {                                                                                           \
+        if(pqueue->size == 0)                                                                   \
+            return false;                                                                       \
+        *out = pqueue->nodes[1].priority;                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope void pqi_##name##_clear(pqi(name) *pqueue)                                            \
+    {                                                                                           \
+        for(int i = 1; i <= pqueue->size; i++)                                                  \
+            pqueue->pos[pqueue->nodes[i].key] = 0;                                              \
+        pqueue->size = 0;                                                                       \
+    }                                                                                           \
+
 #endif
 
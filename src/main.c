@@ -363,7 +363,6 @@ static bool engine_init(char **argv)
         SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | wf | extra_flags);
 
     s_loading_screen = engine_create_loading_screen();
-    stbi_set_flip_vertically_on_load(true);
 
     Engine_LoadingScreen();
 
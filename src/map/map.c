@@ -660,3 +660,8 @@ bool M_NavObjectBuildable(const struct map *map, const struct obb *obb)
     return N_ObjectBuildable(map->nav_private, map->pos, obb);
 }
 
+bool M_NavBenchFields(const struct map *map, size_t niters, struct nav_bench_result *out)
+{
+    return N_BenchFields(map->nav_private, map->pos, niters, out);
+}
+
@@ -42,12 +42,14 @@
 #include "../navigation/public/nav.h"
 #include "../game/public/game.h"
 #include "../lib/public/pf_string.h"
+#include "../lib/public/SDL_vec_rwops.h"
 #include "map_private.h"
 #include "../ui.h"
 
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <stddef.h>
 
 /* ASCII to integer - argument must be an ascii digit */
 #define A2I(_a) ((_a) - '0')
@@ -156,6 +158,117 @@ fail:
     return false;
 }
 
+/* Covers only the tile attributes that the navigation data is derived from */
+static uint64_t m_al_nav_checksum(const struct map *map)
+{
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ull;
+    #define HASH_INT(_val) do{ hash ^= (uint32_t)(_val); hash *= 0x100000001b3ull; }while(0)
+
+    HASH_INT(map->width);
+    HASH_INT(map->height);
+
+    size_t ntiles = TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT;
+    for(int i = 0; i < map->width * map->height; i++) {
+        for(int j = 0; j < ntiles; j++) {
+
+            const struct tile *tile = &map->chunks[i].tiles[j];
+            HASH_INT(tile->pathable);
+            HASH_INT(tile->type);
+            HASH_INT(tile->base_height);
+            HASH_INT(tile->ramp_height);
+        }
+    }
+
+    #undef HASH_INT
+    return hash;
+}
+
+/* The optional section holding the baked navigation data follows the chunks. 
+ * The stream is left untouched when it's absent. The data is skipped over when 
+ * it doesn't match the map, without allocating a buffer for it. */
+static bool m_al_read_nav_section(SDL_RWops *stream, const struct map *map, uint64_t checksum,
+                                  void **out_data, size_t *out_size)
+{
+    char line[MAX_LINE_LEN];
+    Sint64 pos = SDL_RWtell(stream);
+    unsigned long size;
+
+    *out_data = NULL;
+    *out_size = 0;
+
+    if(!AL_ReadLine(stream, line) || sscanf(line, "nav_data %lu", &size) != 1) {
+        SDL_RWseek(stream, pos, RW_SEEK_SET);
+        return true;
+    }
+
+    /* The size comes straight from the file - don't trust it any further 
+     * than the amount of data that is actually left in the stream */
+    Sint64 total = SDL_RWsize(stream);
+    if(total >= 0 && size > total - SDL_RWtell(stream))
+        return false;
+
+    size_t hdr_size = N_BakedHeaderSize();
+    if(size < hdr_size)
+        return (size == 0 || SDL_RWseek(stream, size, RW_SEEK_CUR) >= 0);
+
+    unsigned char hdr[hdr_size];
+    if(!SDL_RWread(stream, hdr, hdr_size, 1))
+        return false;
+
+    size_t max_size = N_BakedCheckHeader(map->width, map->height, checksum, hdr);
+    if(max_size == 0)
+        return (SDL_RWseek(stream, size - hdr_size, RW_SEEK_CUR) >= 0);
+    if(size > max_size)
+        return false;
+
+    unsigned char *data = malloc(size);
+    if(!data)
+        return false;
+
+    memcpy(data, hdr, hdr_size);
+    if(size > hdr_size && !SDL_RWread(stream, data + hdr_size, size - hdr_size, 1)) {
+        free(data);
+        return false;
+    }
+
+    *out_data = data;
+    *out_size = size;
+    return true;
+}
+
+static bool m_al_write_nav_section(const struct map *map, SDL_RWops *stream)
+{
+    bool ret = false;
+    char line[MAX_LINE_LEN];
+
+    const struct tile *chunk_tiles[map->width * map->height];
+    for(int r = 0; r < map->height; r++) {
+    for(int c = 0; c < map->width; c++) {
+        chunk_tiles[r * map->width + c] = map->chunks[r * map->width + c].tiles;
+    }}
+
+    /* The size has to be known up-front */
+    SDL_RWops *buff = PFSDL_VectorRWOps();
+    if(!buff)
+        goto fail_buff;
+
+    if(!N_WriteBaked(map->width, map->height, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 
+                     chunk_tiles, m_al_nav_checksum(map), buff))
+        goto fail_write;
+
+    size_t size = SDL_RWsize(buff);
+    pf_snprintf(line, sizeof(line), "nav_data %lu\n", (unsigned long)size);
+    CHK_TRUE(SDL_RWwrite(stream, line, strlen(line), 1), fail_write);
+    CHK_TRUE(SDL_RWwrite(stream, PFSDL_VectorRWOpsRaw(buff), size, 1), fail_write);
+    ret = true;
+
+fail_write:
+    SDL_RWclose(buff);
+fail_buff:
+    return ret;
+}
+
 static void m_al_patch_adjacency_info(struct map *map)
 {
     for(int r = 0; r < map->height; r++) {
@@ -251,12 +364,22 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
     char *unused_base = (char*)(map + 1);
     unused_base += num_chunks * sizeof(struct pfchunk);
 
+    map->dirty_chunks = (uint64_t*)unused_base;
+    memset(map->dirty_chunks, 0, DIRTY_WORDS(num_chunks) * sizeof(uint64_t));
+    unused_base += DIRTY_WORDS(num_chunks) * sizeof(uint64_t);
+
     for(int i = 0; i < num_chunks; i++) {
 
         if(!m_al_read_pfchunk(stream, map->chunks + i))
             return false;
     }
 
+    void *nav_data;
+    size_t nav_size;
+    uint64_t nav_checksum = m_al_nav_checksum(map);
+    if(!m_al_read_nav_section(stream, map, nav_checksum, &nav_data, &nav_size))
+        return false;
+
     for(int i = 0; i < num_chunks; i++) {
     
         map->chunks[i].render_private = (void*)unused_base;
@@ -267,12 +390,24 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
         if(!R_AL_InitPrivFromTiles(map, i / header->num_cols, i % header->num_cols,
                                    map->chunks[i].tiles, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT,
                                    map->chunks[i].render_private, basedir)) {
+            free(nav_data);
             return false;
         }
     }
 
     m_al_patch_adjacency_info(map);
 
+    /* Use the baked navigation data, as long as it's been built for these tiles */
+    map->nav_private = NULL;
+    if(nav_data && update_navgrid) {
+        map->nav_private = N_BuildFromBaked(map->width, map->height, 
+            nav_checksum, nav_data, nav_size);
+    }
+    free(nav_data);
+
+    if(map->nav_private)
+        return true;
+
     /* Build navigation grid */
     const struct tile *chunk_tiles[map->width * map->height];
 
@@ -295,7 +430,8 @@ size_t M_AL_BuffSizeFromHeader(const struct pfmap_hdr *header)
 
     return sizeof(struct map) + num_chunks * 
            (sizeof(struct pfchunk) + R_AL_PrivBuffSizeForChunk(
-                                     TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 0));
+                                     TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 0))
+         + DIRTY_WORDS(num_chunks) * sizeof(uint64_t);
 }
 
 bool M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, const struct tile *tile)
@@ -303,8 +439,10 @@ bool M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, const struct
     if(desc->chunk_r >= map->height || desc->chunk_c >= map->width)
         return false;
 
-    struct pfchunk *chunk = &map->chunks[desc->chunk_r * map->width + desc->chunk_c];
+    size_t chunk_idx = desc->chunk_r * map->width + desc->chunk_c;
+    struct pfchunk *chunk = &map->chunks[chunk_idx];
     chunk->tiles[desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c] = *tile;
+    map->dirty_chunks[chunk_idx / 64] |= ((uint64_t)1 << (chunk_idx % 64));
 
     struct map_resolution res;
     M_GetResolution(map, &res);
@@ -348,9 +486,37 @@ size_t M_AL_ShallowCopySize(size_t nrows, size_t ncols)
 void M_AL_ShallowCopy(struct map *dst, const struct map *src)
 {
     memcpy(dst, src, M_AL_ShallowCopySize(src->width, src->height));
+    dst->dirty_chunks = NULL;
+}
+
+void M_AL_UpdateShallowCopy(struct map *dst, struct map *src)
+{
+    assert(dst->width == src->width && dst->height == src->height);
+    assert(src->dirty_chunks);
+
+    /* The materials list and the chunks are the only large parts of the map 
+     * and neither changes from tick to tick unless a tile is edited. The 
+     * remaining header fields are cheap to copy wholesale. */
+    memcpy(dst, src, offsetof(struct map, num_mats));
+
+    size_t nchunks = src->width * src->height;
+    for(int w = 0; w < DIRTY_WORDS(nchunks); w++) {
+
+        uint64_t word = src->dirty_chunks[w];
+        if(!word)
+            continue;
+
+        for(int b = 0; b < 64; b++) {
+            if(!(word & ((uint64_t)1 << b)))
+                continue;
+            size_t idx = w * 64 + b;
+            memcpy(&dst->chunks[idx], &src->chunks[idx], sizeof(struct pfchunk));
+        }
+        src->dirty_chunks[w] = 0;
+    }
 }
 
-bool M_AL_WritePFMap(const struct map *map, SDL_RWops *stream)
+bool M_AL_WritePFMap(const struct map *map, SDL_RWops *stream, bool bake_nav)
 {
     char line[MAX_LINE_LEN];
 
@@ -390,6 +556,10 @@ bool M_AL_WritePFMap(const struct map *map, SDL_RWops *stream)
         }}
     }}
 
+    if(bake_nav) {
+        CHK_TRUE(m_al_write_nav_section(map, stream), fail);
+    }
+
     return true;
 
 fail:
@@ -39,6 +39,8 @@
 #include "pfchunk.h"
 #include "../pf_math.h"
 
+#include <stdint.h>
+
 #define MAX_NUM_MATS (256)
 
 
@@ -87,6 +89,14 @@ struct map{
      */
     size_t num_mats;
     char texnames[MAX_NUM_MATS][256];
+    /* ------------------------------------------------------------------------
+     * One bit per chunk, set when any of the chunk's tiles is modified. Only
+     * the dirty chunks are copied to the previous tick's snapshot of the map. 
+     * Points into the map's own buffer, right after the chunks array. 
+     * Snapshots do not track modifications and hold NULL here.
+     * ------------------------------------------------------------------------
+     */
+    uint64_t *dirty_chunks;
     /* ------------------------------------------------------------------------
      * The map chunks stored in row-major order. In total, there must be 
      * (width * height) number of chunks.
@@ -95,6 +105,8 @@ struct map{
     struct pfchunk chunks[];
 };
 
+#define DIRTY_WORDS(_nchunks) (((_nchunks) + 63) / 64)
+
 struct chunkpos{
     int r, c;
 };
@@ -324,6 +324,13 @@ bool     M_NavIsMaximallyClose(const struct map *map, vec2_t xz_pos,
 bool     M_NavObjAdjacentToStatic(const struct map *map, const struct entity *ent, 
                                   const struct obb *stat);
 
+/* ------------------------------------------------------------------------
+ * Times building the flow and LOS fields for every chunk of the map 
+ * 'niters' times.
+ * ------------------------------------------------------------------------
+ */
+bool     M_NavBenchFields(const struct map *map, size_t niters, struct nav_bench_result *out);
+
 /* ------------------------------------------------------------------------
  * Sets 'out' to pointer to 'struct tile' for the specified descriptor. 
  * Returns 'true' on success, 'false' on failure.
@@ -482,10 +489,20 @@ size_t M_AL_ShallowCopySize(size_t nrows, size_t ncols);
 void   M_AL_ShallowCopy(struct map *dst, const struct map *src);
 
 /* ------------------------------------------------------------------------
- * Write the map contents to the stream in PFMap format.
+ * Bring a shallow copy previously made with 'M_AL_ShallowCopy' up to date 
+ * with 'src'. Only the chunks that have been modified (via 'M_AL_UpdateTile')
+ * since the last update are copied. Clears the modified state of 'src'.
+ * ------------------------------------------------------------------------
+ */
+void   M_AL_UpdateShallowCopy(struct map *dst, struct map *src);
+
+/* ------------------------------------------------------------------------
+ * Write the map contents to the stream in PFMap format. With 'bake_nav', 
+ * the navigation data is appended in binary form, so that it doesn't have 
+ * to be rebuilt when the map is loaded.
  * ------------------------------------------------------------------------
  */
-bool   M_AL_WritePFMap(const struct map *map, SDL_RWops *stream);
+bool   M_AL_WritePFMap(const struct map *map, SDL_RWops *stream, bool bake_nav);
 
 
 
@@ -46,17 +46,17 @@
 #include <math.h>
 #include <float.h>
 
-PQUEUE_TYPE(coord, struct coord)
-PQUEUE_IMPL(static, coord, struct coord)
+PQUEUE_INDEXED_TYPE(coord, struct coord)
+PQUEUE_INDEXED_IMPL(static, coord, struct coord)
 
 PQUEUE_TYPE(portal, const struct portal*)
 PQUEUE_IMPL(static, portal, const struct portal*)
 
 KHASH_MAP_INIT_INT64(key_coord, struct coord)
-KHASH_MAP_INIT_INT64(key_portal, const struct portal*)
 KHASH_MAP_INIT_INT64(key_float, float)
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define GRID_KEY(coord) ((coord).r * FIELD_RES_C + (coord).c)
 #define kh_put_val(name, table, key, val)               \
     do{                                                 \
         int ret;                                        \
@@ -74,16 +74,6 @@ static uint64_t coord_to_key(struct coord c)
     return (((uint64_t)c.r) << 32) | (((uint64_t)c.c) & ~((uint32_t)0));
 }
 
-static uint64_t portal_to_key(const struct portal *p)
-{
-    return (((uint64_t)p->chunk.r & 0xffff)      << 48)
-         | (((uint64_t)p->chunk.c & 0xffff)      << 32)
-         | (((uint64_t)p->endpoints[0].r & 0xff) << 24)
-         | (((uint64_t)p->endpoints[0].c & 0xff) << 16)
-         | (((uint64_t)p->endpoints[1].r & 0xff) <<  8)
-         | (((uint64_t)p->endpoints[1].c & 0xff) <<  0);
-}
-
 static int neighbours_grid(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord coord, 
                            struct coord *out_neighbours, float *out_costs)
 {
@@ -119,23 +109,35 @@ static int neighbours_grid(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], s
     return ret;
 }
 
-static int neighbours_portal_graph(const struct portal *portal,
-                                   const struct portal **out_neighbours, float *out_costs)
+/* Returns all the nodes which have an (unblocked) edge leading to 'portal'. 
+ * This is the reverse of the portal graph, which is what gets walked when 
+ * searching outwards from the destination. 
+ */
+static int predecessors_portal_graph(const struct nav_private *priv, const struct portal *portal,
+                                     const struct portal **out_predecessors, float *out_costs)
 {
     int ret = 0;
+    const struct nav_chunk *chunk = &priv->chunks[portal->chunk.r * priv->width + portal->chunk.c];
 
-    for(int i = 0; i < portal->num_neighbours; i++) {
+    for(int i = 0; i < chunk->num_portals; i++) {
 
-        const struct edge *edge = &portal->edges[i];
-        if(edge->es == EDGE_STATE_BLOCKED)
-            continue;
+        const struct portal *curr = &chunk->portals[i];
+        for(int j = 0; j < curr->num_neighbours; j++) {
 
-        out_neighbours[ret] = edge->neighbour;
-        out_costs[ret] = edge->cost;
-        ret++;
+            const struct edge *edge = &curr->edges[j];
+            if(edge->neighbour != portal)
+                continue;
+            if(edge->es == EDGE_STATE_BLOCKED)
+                break;
+
+            out_predecessors[ret] = curr;
+            out_costs[ret] = edge->cost;
+            ret++;
+            break;
+        }
     }
 
-    out_neighbours[ret] = portal->connected;
+    out_predecessors[ret] = portal->connected;
     out_costs[ret] = 1;
     ret++;
 
@@ -143,6 +145,11 @@ static int neighbours_portal_graph(const struct portal *portal,
     return ret;
 }
 
+static const struct portal *portal_for_id(const struct nav_private *priv, uint32_t id)
+{
+    return &priv->chunks[id / MAX_PORTALS_PER_CHUNK].portals[id % MAX_PORTALS_PER_CHUNK];
+}
+
 static float heuristic(struct coord a, struct coord b)
 {
     /* Octile Distance:
@@ -194,23 +201,24 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
         PERF_RETURN(true);
     }
 
-    pq_coord_t          frontier;
+    pqi_coord_t         frontier;
     khash_t(key_coord) *came_from;
     khash_t(key_float) *running_cost;
     
-    pq_coord_init(&frontier);
+    if(!pqi_coord_init(&frontier, FIELD_RES_R * FIELD_RES_C))
+        goto fail_frontier;
     if(NULL == (came_from = kh_init(key_coord)))
         goto fail_came_from;
     if(NULL == (running_cost = kh_init(key_float)))
         goto fail_running_cost;
 
     kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
-    pq_coord_push(&frontier, 0.0f, start);
+    pqi_coord_push(&frontier, 0.0f, GRID_KEY(start), start);
 
     while(pq_size(&frontier) > 0) {
 
         struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+        pqi_coord_pop(&frontier, &curr);
 
         if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
             break;
@@ -231,7 +239,7 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
 
                 kh_put_val(key_float, running_cost, coord_to_key(*next), new_cost);
                 float priority = new_cost + heuristic(finish, *next);
-                pq_coord_push(&frontier, priority, *next);
+                pqi_coord_push(&frontier, priority, GRID_KEY(*next), *next);
                 kh_put_val(key_coord, came_from, coord_to_key(*next), curr);
             }
         }
@@ -265,7 +273,7 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
     assert(k != kh_end(running_cost));
     *out_cost = kh_value(running_cost, k);
 
-    pq_coord_destroy(&frontier);
+    pqi_coord_destroy(&frontier);
     kh_destroy(key_float, running_cost);
     kh_destroy(key_coord, came_from);
 
@@ -280,124 +288,196 @@ fail_find_path:
     gp.exists = false;
     N_FC_PutGridPath(start, finish, chunk, &gp);
 
-    pq_coord_destroy(&frontier);
     kh_destroy(key_float, running_cost);
 fail_running_cost:
     kh_destroy(key_coord, came_from);
 fail_came_from:
+    pqi_coord_destroy(&frontier);
+fail_frontier:
     PERF_RETURN(false);
 }
 
-bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *finish, 
-                           const struct nav_private *priv, 
-                           vec_portal_t *out_path, float *out_cost)
+uint32_t AStar_PortalID(const struct nav_private *priv, const struct portal *port)
+{
+    size_t chunk_idx = port->chunk.r * priv->width + port->chunk.c;
+    const struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+    return chunk_idx * MAX_PORTALS_PER_CHUNK + (port - chunk->portals);
+}
+
+bool AStar_RouteTreeBuild(const struct portal *finish, const struct nav_private *priv,
+                          struct portal_route_tree *out)
 {
     PERF_ENTER();
 
-    pq_portal_t          frontier;
-    khash_t(key_portal) *came_from;
-    khash_t(key_float)  *running_cost;
-    
-    pq_portal_init(&frontier);
-    if(NULL == (came_from = kh_init(key_portal)))
-        goto fail_came_from;
-    if(NULL == (running_cost = kh_init(key_float)))
-        goto fail_running_cost;
+    size_t nchunks = priv->width * priv->height;
+    size_t nportals = nchunks * MAX_PORTALS_PER_CHUNK;
+    size_t nwords = (nchunks + 31) / 32;
 
-    const struct nav_chunk *chunk = &priv->chunks[start_tile.chunk_r * priv->width + start_tile.chunk_c];
-    vec_coord_t path;
-    vec_coord_init(&path);
+    out->priv = priv;
+    out->dest = AStar_PortalID(priv, finish);
+    out->nportals = nportals;
 
-    /* Intitialize the frontier with all the portals in the source chunk that are 
-     * reachable from the source tile. */
-    for(int i = 0; i < chunk->num_portals; i++) {
+    if(NULL == (out->cost = malloc(nportals * sizeof(float))))
+        goto fail_cost;
+    if(NULL == (out->next = malloc(nportals * sizeof(int32_t))))
+        goto fail_next;
+    if(NULL == (out->chunks = calloc(nwords, sizeof(uint32_t))))
+        goto fail_chunks;
 
-        const struct portal *port = &chunk->portals[i];
-        struct coord tile_coord = (struct coord){start_tile.tile_r, start_tile.tile_c};
+    for(int i = 0; i < nportals; i++) {
+        out->cost[i] = FLT_MAX;
+        out->next[i] = -1;
+    }
 
-        if(N_PortalReachableFromTile(port, tile_coord, chunk)) {
+    pq_portal_t frontier;
+    pq_portal_init(&frontier);
 
-            float cost = chunk->portal_travel_costs[i][tile_coord.r][tile_coord.c];
-            if(cost != FLT_MAX) {
-            
-                kh_put_val(key_float, running_cost, portal_to_key(port), cost);
-                pq_portal_push(&frontier, cost, port);
-            }
-        }
-    }
-    vec_coord_destroy(&path);
+    /* Search outwards from the destination along the reversed edges. When 
+     * a node is settled, its cost is that of the cheapest route from it to 
+     * the destination, and 'next' is the first hop along that route. Every 
+     * route to the destination is recorded in a single pass, so the tree can 
+     * answer queries from any source, as well as any sub-route of a path. 
+     * No heuristic used - effectively Dijkstra's algorithm */
+    out->cost[out->dest] = 0.0f;
+    pq_portal_push(&frontier, 0.0f, finish);
 
     while(pq_size(&frontier) > 0) {
 
+        float prio;
         const struct portal *curr;
+        pq_portal_top_prio(&frontier, &prio);
         pq_portal_pop(&frontier, &curr);
 
-        if(curr == finish)
-            break;
+        uint32_t curr_id = AStar_PortalID(priv, curr);
+        if(prio > out->cost[curr_id])
+            continue;
 
-        const struct portal *neighbours[MAX_PORTALS_PER_CHUNK];
-        float neighbour_costs[MAX_PORTALS_PER_CHUNK];
-        int num_neighbours = neighbours_portal_graph(curr, neighbours, neighbour_costs);
+        size_t chunk_idx = curr_id / MAX_PORTALS_PER_CHUNK;
+        out->chunks[chunk_idx / 32] |= (((uint32_t)1) << (chunk_idx % 32));
 
-        for(int i = 0; i < num_neighbours; i++) {
+        const struct portal *predecessors[MAX_PORTALS_PER_CHUNK];
+        float predecessor_costs[MAX_PORTALS_PER_CHUNK];
+        int num_predecessors = predecessors_portal_graph(priv, curr, predecessors, predecessor_costs);
 
-            const struct portal *next = neighbours[i];
-            khiter_t k = kh_get(key_float, running_cost, portal_to_key(curr));
-            assert(k != kh_end(running_cost));
-            float new_cost = kh_value(running_cost, k) + neighbour_costs[i] + portal_node_penalty();
+        for(int i = 0; i < num_predecessors; i++) {
 
-            if((k = kh_get(key_float, running_cost, portal_to_key(next))) == kh_end(running_cost)
-            || new_cost < kh_value(running_cost, k)) {
+            uint32_t prev_id = AStar_PortalID(priv, predecessors[i]);
+            float new_cost = out->cost[curr_id] + predecessor_costs[i] + portal_node_penalty();
+
+            if(new_cost < out->cost[prev_id]) {
 
-                kh_put_val(key_float, running_cost, portal_to_key(next), new_cost);
-                /* No heuristic used - effectively Dijkstra's algorithm */
-                float priority = new_cost;
-                pq_portal_push(&frontier, priority, next);
-                kh_put_val(key_portal, came_from, portal_to_key(next), curr);
+                out->cost[prev_id] = new_cost;
+                out->next[prev_id] = curr_id;
+                pq_portal_push(&frontier, new_cost, predecessors[i]);
             }
         }
     }
-    
-    if(kh_get(key_portal, came_from, portal_to_key(finish)) == kh_end(came_from))
-        goto fail_find_path;
 
-    vec_portal_reset(out_path);
+    pq_portal_destroy(&frontier);
+    PERF_RETURN(true);
 
-    /* We have our path at this point. Walk backwards along the path to build a 
-     * vector of the nodes along the path. */
-    const struct portal *curr = finish;
-    while(true) {
+fail_chunks:
+    free(out->next);
+fail_next:
+    free(out->cost);
+fail_cost:
+    PERF_RETURN(false);
+}
 
-        vec_portal_push(out_path, (struct portal*)curr);
-        khiter_t k = kh_get(key_portal, came_from, portal_to_key(curr));
-        if(k == kh_end(came_from))
-            break;
-        curr = kh_value(came_from, k);
+void AStar_RouteTreeDestroy(struct portal_route_tree *tree)
+{
+    free(tree->cost);
+    free(tree->next);
+    free(tree->chunks);
+}
+
+bool AStar_RouteTreeUsesChunk(const struct portal_route_tree *tree, struct coord chunk)
+{
+    size_t chunk_idx = chunk.r * tree->priv->width + chunk.c;
+    return !!(tree->chunks[chunk_idx / 32] & (((uint32_t)1) << (chunk_idx % 32)));
+}
+
+bool AStar_RouteTreePath(const struct portal_route_tree *tree, size_t nsrc,
+                         const uint32_t *src_ids, const float *src_costs,
+                         vec_portal_t *out_path, float *out_cost)
+{
+    float best_cost = FLT_MAX;
+    int best = -1;
+
+    for(int i = 0; i < nsrc; i++) {
+
+        float cost = tree->cost[src_ids[i]];
+        if(cost == FLT_MAX)
+            continue;
+
+        cost += src_costs[i];
+        if(cost < best_cost) {
+            best_cost = cost;
+            best = src_ids[i];
+        }
     }
 
-    /* Reverse the path vector */
-    for(int i = 0, j = vec_size(out_path) - 1; i < j; i++, j--) {
-        struct portal *tmp = vec_AT(out_path, i);
-        vec_AT(out_path, i) = vec_AT(out_path, j);
-        vec_AT(out_path, j) = tmp;
+    if(best < 0)
+        return false;
+
+    vec_portal_reset(out_path);
+    for(int32_t curr = best; curr >= 0; curr = tree->next[curr]) {
+        vec_portal_push(out_path, (struct portal*)portal_for_id(tree->priv, curr));
     }
+    assert(AStar_PortalID(tree->priv, vec_AT(out_path, vec_size(out_path)-1)) == tree->dest);
 
-    khiter_t k = kh_get(key_float, running_cost, portal_to_key(finish));
-    assert(k != kh_end(running_cost));
-    *out_cost = kh_value(running_cost, k);
+    *out_cost = best_cost;
+    return true;
+}
 
-    pq_portal_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-    kh_destroy(key_portal, came_from);
+bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *finish, 
+                           const struct nav_private *priv, 
+                           vec_portal_t *out_path, float *out_cost)
+{
+    PERF_ENTER();
 
-    PERF_RETURN(true);
+    const struct nav_chunk *chunk = &priv->chunks[start_tile.chunk_r * priv->width + start_tile.chunk_c];
+    struct coord tile_coord = (struct coord){start_tile.tile_r, start_tile.tile_c};
 
-fail_find_path:
-    pq_portal_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-fail_running_cost:
-    kh_destroy(key_portal, came_from);
-fail_came_from:
-    PERF_RETURN(false);
+    uint32_t src_ids[MAX_PORTALS_PER_CHUNK];
+    float src_costs[MAX_PORTALS_PER_CHUNK];
+    size_t nsrc = 0;
+
+    /* Gather all the portals in the source chunk that are reachable from the 
+     * source tile. The destination itself is not a valid starting node - the 
+     * path must contain at least one hop. */
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        if(port == finish)
+            continue;
+
+        if(N_PortalReachableFromTile(port, tile_coord, chunk)) {
+
+            float cost = N_PortalTravelCost(chunk, i, tile_coord);
+            if(cost != FLT_MAX) {
+                src_ids[nsrc] = AStar_PortalID(priv, port);
+                src_costs[nsrc] = cost;
+                nsrc++;
+            }
+        }
+    }
+
+    if(nsrc == 0)
+        PERF_RETURN(false);
+
+    bool found;
+    uint32_t dst_id = AStar_PortalID(priv, finish);
+    if(N_FC_GetPortalRoute(priv, dst_id, nsrc, src_ids, src_costs, out_path, out_cost, &found))
+        PERF_RETURN(found);
+
+    struct portal_route_tree tree;
+    if(!AStar_RouteTreeBuild(finish, priv, &tree))
+        PERF_RETURN(false);
+
+    found = AStar_RouteTreePath(&tree, nsrc, src_ids, src_costs, out_path, out_cost);
+    /* The cache takes ownership of the tree */
+    N_FC_PutPortalRoute(dst_id, &tree);
+    PERF_RETURN(found);
 }
 
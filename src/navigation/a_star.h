@@ -50,6 +50,23 @@ VEC_IMPL(static inline, coord, struct coord)
 VEC_TYPE(portal, struct portal *)
 VEC_IMPL(static inline, portal, struct portal *)
 
+/* The cheapest routes from every node of the portal graph to a single 
+ * destination node. Nodes are indexed by their global portal ID.
+ */
+struct portal_route_tree{
+    const struct nav_private *priv;
+    uint32_t  dest;
+    size_t    nportals;
+    /* The cost of the cheapest route from the node to the destination, 
+     * or FLT_MAX if there is no route */
+    float    *cost;
+    /* The next node along the cheapest route, or -1 if there is none */
+    int32_t  *next;
+    /* Bitset of the chunks holding at least one node with a route to 
+     * the destination. Only changes to these chunks affect the tree. */
+    uint32_t *chunks;
+};
+
 
 /* ------------------------------------------------------------------------
  * Finds the shortest path in a rectangular cost field. Returns true if a 
@@ -64,12 +81,40 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
 /* ------------------------------------------------------------------------
  * Finds the shortest path between a tile and a node in a portal graph. Returns 
  * true if a path is found, false otherwise. If returning true, 'out_path' holds 
- * the portal nodes to be traversed, in order.
+ * the portal nodes to be traversed, in order. The route tree built for the
+ * destination is cached, so that subsequent queries towards the same node 
+ * don't need to search the graph.
  * ------------------------------------------------------------------------
  */
 bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *finish, 
                            const struct nav_private *priv, 
                            vec_portal_t *out_path, float *out_cost);
 
+/* ------------------------------------------------------------------------
+ * Returns a dense index for the portal, unique across the entire map.
+ * ------------------------------------------------------------------------
+ */
+uint32_t AStar_PortalID(const struct nav_private *priv, const struct portal *port);
+
+/* ------------------------------------------------------------------------
+ * Computes the cheapest routes from every portal to the 'finish' portal.
+ * The tree must be freed with 'AStar_RouteTreeDestroy'.
+ * ------------------------------------------------------------------------
+ */
+bool AStar_RouteTreeBuild(const struct portal *finish, const struct nav_private *priv,
+                          struct portal_route_tree *out);
+void AStar_RouteTreeDestroy(struct portal_route_tree *tree);
+bool AStar_RouteTreeUsesChunk(const struct portal_route_tree *tree, struct coord chunk);
+
+/* ------------------------------------------------------------------------
+ * Picks the cheapest route out of the 'nsrc' source portals, where 'src_costs'
+ * holds the cost of getting to each source. Returns false if none of the 
+ * sources have a route to the destination.
+ * ------------------------------------------------------------------------
+ */
+bool AStar_RouteTreePath(const struct portal_route_tree *tree, size_t nsrc,
+                         const uint32_t *src_ids, const float *src_costs,
+                         vec_portal_t *out_path, float *out_cost);
+
 #endif
 
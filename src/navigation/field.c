@@ -44,20 +44,31 @@
 #include <assert.h>
 #include <math.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 #define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
 #define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
 #define MAX_ENTS_PER_CHUNK  (4096)
 #define IDX(r, width, c)    ((r) * (width) + (c))
 
-PQUEUE_TYPE(coord, struct coord)
-PQUEUE_IMPL(static, coord, struct coord)
+PQUEUE_INDEXED_TYPE(coord, struct coord)
+PQUEUE_INDEXED_IMPL(static, coord, struct coord)
 
 struct box_xz{
     float x_min, x_max;
     float z_min, z_max;
 };
 
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static enum field_solver s_solver = FIELD_SOLVER_DIJKSTRA;
+
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
 /*****************************************************************************/
@@ -74,16 +85,32 @@ vec2_t g_flow_dir_lookup[9] = {
     [FD_SE]   = (vec2_t){ -1.0f / sqrt(2.0f),  1.0f / sqrt(2.0f) },
 };
 
+/* The (row, column) offset of the tile that each direction leads to */
+static const struct coord s_flow_dir_delta[9] = {
+    [FD_NONE] = { 0,  0},
+    [FD_NW]   = {-1, -1},
+    [FD_N]    = {-1,  0},
+    [FD_NE]   = {-1, +1},
+    [FD_W]    = { 0, -1},
+    [FD_E]    = { 0, +1},
+    [FD_SW]   = {+1, -1},
+    [FD_S]    = {+1,  0},
+    [FD_SE]   = {+1, +1},
+};
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static int compare_tiles(void *a, void *b)
+static bool frontier_init(pqi_coord_t *frontier)
+{
+    return pqi_coord_init(frontier, FIELD_RES_R * FIELD_RES_C);
+}
+
+/* Pushes the tile, or lowers its' priority if it's already in the frontier */
+static void frontier_push(pqi_coord_t *frontier, float cost, struct coord tile)
 {
-    //return memcmp(a, b, sizeof(struct coord));
-    struct coord *ac = a;
-    struct coord *bc = b;
-    return !((bc->r == ac->r) && (bc->c == ac->c));
+    pqi_coord_push(frontier, cost, tile.r * FIELD_RES_C + tile.c, tile);
 }
 
 static bool tile_passable(const struct nav_chunk *chunk, struct coord tile)
@@ -343,13 +370,13 @@ static void pad_wavefront(struct LOS_field *out_los)
     }}
 }
 
-static void build_integration_field(pq_coord_t *frontier, const struct nav_chunk *chunk, 
+static void build_integration_field(pqi_coord_t *frontier, const struct nav_chunk *chunk, 
                                     float inout[FIELD_RES_R][FIELD_RES_C])
 {
     while(pq_size(frontier) > 0) {
 
         struct coord curr;
-        pq_coord_pop(frontier, &curr);
+        pqi_coord_pop(frontier, &curr);
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
@@ -361,8 +388,7 @@ static void build_integration_field(pq_coord_t *frontier, const struct nav_chunk
             if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
 
                 inout[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(frontier, compare_tiles, neighbours[i]))
-                    pq_coord_push(frontier, total_cost, neighbours[i]);
+                frontier_push(frontier, total_cost, neighbours[i]);
             }
         }
     }
@@ -371,13 +397,13 @@ static void build_integration_field(pq_coord_t *frontier, const struct nav_chunk
 /* same as 'build_integration_field' but only impassable tiles 
  * will be added to the frontier 
  */
-static void build_integration_field_nonpass(pq_coord_t *frontier, const struct nav_chunk *chunk, 
+static void build_integration_field_nonpass(pqi_coord_t *frontier, const struct nav_chunk *chunk, 
                                             float inout[FIELD_RES_R][FIELD_RES_C])
 {
     while(pq_size(frontier) > 0) {
 
         struct coord curr;
-        pq_coord_pop(frontier, &curr);
+        pqi_coord_pop(frontier, &curr);
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
@@ -392,8 +418,7 @@ static void build_integration_field_nonpass(pq_coord_t *frontier, const struct n
             if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
 
                 inout[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(frontier, compare_tiles, neighbours[i]))
-                    pq_coord_push(frontier, total_cost, neighbours[i]);
+                frontier_push(frontier, total_cost, neighbours[i]);
             }
         }
     }
@@ -414,14 +439,245 @@ static void build_flow_field(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_f
 
         if(intf[r][c] == 0.0f) {
 
-            inout_flow->field[r][c].dir_idx = FD_NONE;
+            N_FlowSetDir(&inout_flow->dirs, r, c, FD_NONE);
             continue;
         }
 
-        inout_flow->field[r][c].dir_idx = flow_dir(intf, (struct coord){r, c});
+        N_FlowSetDir(&inout_flow->dirs, r, c, flow_dir(intf, (struct coord){r, c}));
+    }}
+}
+
+/* The cost of stepping onto each tile, or INFINITY for tiles that can't be entered */
+static void entry_costs(const struct nav_chunk *chunk, float out[FIELD_RES_R][FIELD_RES_C])
+{
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        out[r][c] = tile_passable(chunk, (struct coord){r, c}) ? chunk->cost_base[r][c] : INFINITY;
+    }}
+}
+
+#if defined(__SSE2__)
+
+/* Relax every tile against the tile above it (top to bottom) and then 
+ * against the tile below it (bottom to top). The tiles of a row are 
+ * independent of one another, so a whole row is relaxed at a time.
+ * Returns true if any tile's cost was lowered.
+ */
+static bool sweep_rows(float *field, const float *costs, int nrows, int ncols)
+{
+    assert(ncols % 4 == 0);
+    __m128 changed = _mm_setzero_ps();
+
+    for(int r = 1; r < nrows; r++) {
+        for(int c = 0; c < ncols; c += 4) {
+
+            __m128 prev = _mm_loadu_ps(field + (r - 1) * ncols + c);
+            __m128 curr = _mm_loadu_ps(field + r * ncols + c);
+            __m128 cost = _mm_loadu_ps(costs + r * ncols + c);
+            __m128 next = _mm_min_ps(curr, _mm_add_ps(prev, cost));
+
+            changed = _mm_or_ps(changed, _mm_cmplt_ps(next, curr));
+            _mm_storeu_ps(field + r * ncols + c, next);
+        }
+    }
+
+    for(int r = nrows - 2; r >= 0; r--) {
+        for(int c = 0; c < ncols; c += 4) {
+
+            __m128 prev = _mm_loadu_ps(field + (r + 1) * ncols + c);
+            __m128 curr = _mm_loadu_ps(field + r * ncols + c);
+            __m128 cost = _mm_loadu_ps(costs + r * ncols + c);
+            __m128 next = _mm_min_ps(curr, _mm_add_ps(prev, cost));
+
+            changed = _mm_or_ps(changed, _mm_cmplt_ps(next, curr));
+            _mm_storeu_ps(field + r * ncols + c, next);
+        }
+    }
+
+    return (_mm_movemask_ps(changed) != 0);
+}
+
+static void transpose(const float *in, float *out, int nrows, int ncols)
+{
+    assert(nrows % 4 == 0 && ncols % 4 == 0);
+
+    for(int r = 0; r < nrows; r += 4) {
+    for(int c = 0; c < ncols; c += 4) {
+
+        __m128 row0 = _mm_loadu_ps(in + (r + 0) * ncols + c);
+        __m128 row1 = _mm_loadu_ps(in + (r + 1) * ncols + c);
+        __m128 row2 = _mm_loadu_ps(in + (r + 2) * ncols + c);
+        __m128 row3 = _mm_loadu_ps(in + (r + 3) * ncols + c);
+
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+        _mm_storeu_ps(out + (c + 0) * nrows + r, row0);
+        _mm_storeu_ps(out + (c + 1) * nrows + r, row1);
+        _mm_storeu_ps(out + (c + 2) * nrows + r, row2);
+        _mm_storeu_ps(out + (c + 3) * nrows + r, row3);
     }}
 }
 
+static inline __m128 select_ps(__m128 a, __m128 b, __m128 mask)
+{
+    return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+/* Vectorized equivalent of calling 'flow_dir' for every tile */
+static void build_flow_field_sweep(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_field *inout_flow)
+{
+    /* Surround the field with a border of impassable tiles, so that the 
+     * neighbours of the edge tiles can be loaded without bounds checks. */
+    float padded[FIELD_RES_R + 2][FIELD_RES_C + 2];
+    for(int c = 0; c < FIELD_RES_C + 2; c++) {
+        padded[0][c] = INFINITY;
+        padded[FIELD_RES_R + 1][c] = INFINITY;
+    }
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        padded[r + 1][0] = INFINITY;
+        memcpy(&padded[r + 1][1], intf[r], sizeof(intf[r]));
+        padded[r + 1][FIELD_RES_C + 1] = INFINITY;
+    }
+
+    const __m128 inf = _mm_set1_ps(INFINITY);
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c += 4) {
+
+            __m128 n  = _mm_loadu_ps(&padded[r + 0][c + 1]);
+            __m128 s  = _mm_loadu_ps(&padded[r + 2][c + 1]);
+            __m128 w  = _mm_loadu_ps(&padded[r + 1][c + 0]);
+            __m128 e  = _mm_loadu_ps(&padded[r + 1][c + 2]);
+            __m128 nw = _mm_loadu_ps(&padded[r + 0][c + 0]);
+            __m128 ne = _mm_loadu_ps(&padded[r + 0][c + 2]);
+            __m128 sw = _mm_loadu_ps(&padded[r + 2][c + 0]);
+            __m128 se = _mm_loadu_ps(&padded[r + 2][c + 2]);
+
+            __m128 min = _mm_min_ps(_mm_min_ps(n, s), _mm_min_ps(w, e));
+
+            /* Diagonals only count when both side tiles are passable */
+            __m128 n_ok = _mm_cmplt_ps(n, inf);
+            __m128 s_ok = _mm_cmplt_ps(s, inf);
+            __m128 w_ok = _mm_cmplt_ps(w, inf);
+            __m128 e_ok = _mm_cmplt_ps(e, inf);
+
+            min = _mm_min_ps(min, select_ps(inf, nw, _mm_and_ps(n_ok, w_ok)));
+            min = _mm_min_ps(min, select_ps(inf, ne, _mm_and_ps(n_ok, e_ok)));
+            min = _mm_min_ps(min, select_ps(inf, sw, _mm_and_ps(s_ok, w_ok)));
+            min = _mm_min_ps(min, select_ps(inf, se, _mm_and_ps(s_ok, e_ok)));
+
+            /* Apply the directions from lowest to highest priority, so that
+             * the cardinal directions win ties in the same order as 'flow_dir' */
+            __m128 dir = _mm_set1_ps(FD_NONE);
+            dir = select_ps(dir, _mm_set1_ps(FD_SE), _mm_cmpeq_ps(se, min));
+            dir = select_ps(dir, _mm_set1_ps(FD_SW), _mm_cmpeq_ps(sw, min));
+            dir = select_ps(dir, _mm_set1_ps(FD_NE), _mm_cmpeq_ps(ne, min));
+            dir = select_ps(dir, _mm_set1_ps(FD_NW), _mm_cmpeq_ps(nw, min));
+            dir = select_ps(dir, _mm_set1_ps(FD_W),  _mm_cmpeq_ps(w,  min));
+            dir = select_ps(dir, _mm_set1_ps(FD_E),  _mm_cmpeq_ps(e,  min));
+            dir = select_ps(dir, _mm_set1_ps(FD_S),  _mm_cmpeq_ps(s,  min));
+            dir = select_ps(dir, _mm_set1_ps(FD_N),  _mm_cmpeq_ps(n,  min));
+
+            __m128 curr = _mm_loadu_ps(&intf[r][c]);
+            dir = select_ps(dir, _mm_set1_ps(FD_NONE), _mm_cmpeq_ps(curr, _mm_setzero_ps()));
+
+            int dirs[4];
+            _mm_storeu_si128((__m128i*)dirs, _mm_cvttps_epi32(dir));
+
+            /* Same as in 'build_flow_field', impassable tiles are left untouched */
+            for(int i = 0; i < 4; i++) {
+                if(intf[r][c + i] == INFINITY)
+                    continue;
+                N_FlowSetDir(&inout_flow->dirs, r, c + i, dirs[i]);
+            }
+        }
+    }
+}
+
+#else
+
+static bool sweep_rows(float *field, const float *costs, int nrows, int ncols)
+{
+    bool changed = false;
+
+    for(int r = 1; r < nrows; r++) {
+        for(int c = 0; c < ncols; c++) {
+
+            float next = field[(r - 1) * ncols + c] + costs[r * ncols + c];
+            if(next < field[r * ncols + c]) {
+                field[r * ncols + c] = next;
+                changed = true;
+            }
+        }
+    }
+
+    for(int r = nrows - 2; r >= 0; r--) {
+        for(int c = 0; c < ncols; c++) {
+
+            float next = field[(r + 1) * ncols + c] + costs[r * ncols + c];
+            if(next < field[r * ncols + c]) {
+                field[r * ncols + c] = next;
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
+
+static void transpose(const float *in, float *out, int nrows, int ncols)
+{
+    for(int r = 0; r < nrows; r++) {
+    for(int c = 0; c < ncols; c++) {
+        out[c * nrows + r] = in[r * ncols + c];
+    }}
+}
+
+static void build_flow_field_sweep(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_field *inout_flow)
+{
+    build_flow_field(intf, inout_flow);
+}
+
+#endif
+
+/* Computes the same integration field as 'build_integration_field' by repeatedly 
+ * relaxing the tiles along the columns and rows of the chunk until no tile's cost 
+ * changes. Each tile only depends on its' 4 neighbours, so whole rows can be processed 
+ * at once. The columns are processed as rows of the transposed field. All costs are 
+ * small integers, so the results are exact and independent of the processing order.
+ */
+static void build_integration_field_sweep(const struct nav_chunk *chunk, 
+                                          float inout[FIELD_RES_R][FIELD_RES_C])
+{
+    float costs[FIELD_RES_R][FIELD_RES_C];
+    float costs_t[FIELD_RES_C][FIELD_RES_R];
+    float field_t[FIELD_RES_C][FIELD_RES_R];
+
+    entry_costs(chunk, costs);
+    transpose(&costs[0][0], &costs_t[0][0], FIELD_RES_R, FIELD_RES_C);
+
+    bool changed;
+    do{
+        changed = sweep_rows(&inout[0][0], &costs[0][0], FIELD_RES_R, FIELD_RES_C);
+        transpose(&inout[0][0], &field_t[0][0], FIELD_RES_R, FIELD_RES_C);
+        changed |= sweep_rows(&field_t[0][0], &costs_t[0][0], FIELD_RES_C, FIELD_RES_R);
+        transpose(&field_t[0][0], &inout[0][0], FIELD_RES_C, FIELD_RES_R);
+    }while(changed);
+}
+
+static void build_fields(pqi_coord_t *frontier, const struct nav_chunk *chunk, 
+                         float intf[FIELD_RES_R][FIELD_RES_C], struct flow_field *inout_flow)
+{
+    if(s_solver == FIELD_SOLVER_SWEEP) {
+        build_integration_field_sweep(chunk, intf);
+        build_flow_field_sweep(intf, inout_flow);
+    }else{
+        build_integration_field(frontier, chunk, intf);
+        build_flow_field(intf, inout_flow);
+    }
+}
+
 static void fixup_portal_edges(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_field *inout_flow,
                                const struct portal *port)
 {
@@ -437,13 +693,13 @@ static void fixup_portal_edges(float intf[FIELD_RES_R][FIELD_RES_C], struct flow
         if(intf[r][c] == 0.0f) {
 
             if(up)
-                inout_flow->field[r][c].dir_idx = FD_N;
+                N_FlowSetDir(&inout_flow->dirs, r, c, FD_N);
             else if(down)
-                inout_flow->field[r][c].dir_idx = FD_S;
+                N_FlowSetDir(&inout_flow->dirs, r, c, FD_S);
             else if(left)
-                inout_flow->field[r][c].dir_idx = FD_W;
+                N_FlowSetDir(&inout_flow->dirs, r, c, FD_W);
             else if(right)
-                inout_flow->field[r][c].dir_idx = FD_E;
+                N_FlowSetDir(&inout_flow->dirs, r, c, FD_E);
             else
                 assert(0);
         }
@@ -812,6 +1068,16 @@ static size_t passable_frontier(const struct nav_chunk *chunk, struct coord star
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
+void N_FlowFieldSetSolver(enum field_solver solver)
+{
+    s_solver = solver;
+}
+
+enum field_solver N_FlowFieldGetSolver(void)
+{
+    return s_solver;
+}
+
 ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target)
 {
     if(target.type == TARGET_PORTAL) {
@@ -849,18 +1115,19 @@ void N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct f
     for(int r = 0; r < FIELD_RES_R; r++) {
         for(int c = 0; c < FIELD_RES_C; c++) {
 
-            out->field[r][c].dir_idx = FD_NONE;
+            N_FlowSetDir(&out->dirs, r, c, FD_NONE);
         }
     }
     out->chunk = chunk_coord;
 }
 
-void N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
+bool N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
                        struct field_target target, struct flow_field *inout_flow)
 {
     const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    pqi_coord_t frontier;
+    if(!frontier_init(&frontier))
+        return false;
 
     float integration_field[FIELD_RES_R][FIELD_RES_C];
     for(int r = 0; r < FIELD_RES_R; r++)
@@ -873,27 +1140,28 @@ void N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
     for(int i = 0; i < ninit; i++) {
 
         struct coord curr = init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
+        frontier_push(&frontier, 0.0f, curr);
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
     inout_flow->target = target;
-    build_integration_field(&frontier, chunk, integration_field);
-    build_flow_field(integration_field, inout_flow);
+    build_fields(&frontier, chunk, integration_field, inout_flow);
     fixup_field(target, integration_field, inout_flow, chunk);
 
-    pq_coord_destroy(&frontier);
+    pqi_coord_destroy(&frontier);
+    return true;
 }
 
-void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
+bool N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
                       const struct nav_private *priv, vec3_t map_pos, 
                       struct LOS_field *out_los, const struct LOS_field *prev_los)
 {
     out_los->chunk = chunk_coord;
     memset(out_los->field, 0x00, sizeof(out_los->field));
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    pqi_coord_t frontier;
+    if(!frontier_init(&frontier))
+        return false;
     const struct nav_chunk *chunk = &priv->chunks[chunk_coord.r * priv->width + chunk_coord.c];
 
     float integration_field[FIELD_RES_R][FIELD_RES_C];
@@ -904,7 +1172,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
     /* Case 1: LOS for the destination chunk */
     if(chunk_coord.r == target.chunk_r && chunk_coord.c == target.chunk_c) {
 
-        pq_coord_push(&frontier, 0.0f, (struct coord){target.tile_r, target.tile_c});
+        frontier_push(&frontier, 0.0f, (struct coord){target.tile_r, target.tile_c});
         integration_field[target.tile_r][target.tile_c] = 0.0f;
         assert(NULL == prev_los);
 
@@ -928,7 +1196,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 }
                 if(out_los->field[0][c].visible) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){0, c});
+                    frontier_push(&frontier, 0.0f, (struct coord){0, c});
                     integration_field[0][c] = 0.0f; 
                 }
             }
@@ -944,7 +1212,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 }
                 if(out_los->field[FIELD_RES_R-1][c].visible) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){FIELD_RES_R-1, c});
+                    frontier_push(&frontier, 0.0f, (struct coord){FIELD_RES_R-1, c});
                     integration_field[FIELD_RES_R-1][c] = 0.0f;
                 }
             }
@@ -960,7 +1228,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 }
                 if(out_los->field[r][0].visible) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){r, 0});
+                    frontier_push(&frontier, 0.0f, (struct coord){r, 0});
                     integration_field[r][0] = 0.0f;
                 }
             }
@@ -976,7 +1244,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 }
                 if(out_los->field[r][FIELD_RES_C-1].visible) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){r, FIELD_RES_C-1});
+                    frontier_push(&frontier, 0.0f, (struct coord){r, FIELD_RES_C-1});
                     integration_field[r][FIELD_RES_C-1] = 0.0f;
                 }
             }
@@ -988,7 +1256,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
     while(pq_size(&frontier) > 0) {
 
         struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+        pqi_coord_pop(&frontier, &curr);
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
@@ -1017,13 +1285,12 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 if(new_cost < integration_field[neighbours[i].r][neighbours[i].c]) {
 
                     integration_field[nr][nc] = new_cost;
-                    if(!pq_coord_contains(&frontier, compare_tiles, neighbours[i]))
-                        pq_coord_push(&frontier, new_cost, neighbours[i]);
+                    frontier_push(&frontier, new_cost, neighbours[i]);
                 }
             }
         }
     }
-    pq_coord_destroy(&frontier);
+    pqi_coord_destroy(&frontier);
 
     /* Add a single tile-wide padding of invisible tiles around the wavefront. This is 
      * because we want to be conservative and not mark any tiles visible from which we
@@ -1031,16 +1298,18 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
      * the ray going over impassable terrain. This is a nice property for the movement
      * code. */
     pad_wavefront(out_los);
+    return true;
 }
 
-void N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct coord start, 
+bool N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct coord start, 
                                         struct flow_field *inout_flow)
 {
     struct coord init_frontier[FIELD_RES_R * FIELD_RES_C];
     size_t ninit = passable_frontier(chunk, start, init_frontier, ARR_SIZE(init_frontier));
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    pqi_coord_t frontier;
+    if(!frontier_init(&frontier))
+        return false;
 
     float integration_field[FIELD_RES_R][FIELD_RES_C];
     for(int r = 0; r < FIELD_RES_R; r++)
@@ -1050,7 +1319,7 @@ void N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct co
     for(int i = 0; i < ninit; i++) {
 
         struct coord curr = init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
+        frontier_push(&frontier, 0.0f, curr);
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
@@ -1063,20 +1332,22 @@ void N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct co
             continue;
         if(integration_field[r][c] == 0.0f)
             continue;
-        inout_flow->field[r][c].dir_idx = flow_dir(integration_field, (struct coord){r, c});
+        N_FlowSetDir(&inout_flow->dirs, r, c, flow_dir(integration_field, (struct coord){r, c}));
     }}
 
-    pq_coord_destroy(&frontier);
+    pqi_coord_destroy(&frontier);
+    return true;
 }
 
-void N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_private *priv,
+bool N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_private *priv,
                                       struct flow_field *inout_flow)
 {
     struct coord chunk_coord = inout_flow->chunk;
     const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    pqi_coord_t frontier;
+    if(!frontier_init(&frontier))
+        return false;
 
     struct coord init_frontier[FIELD_RES_R * FIELD_RES_C];
     size_t ninit = initial_frontier(inout_flow->target, chunk, priv, false, init_frontier, ARR_SIZE(init_frontier));
@@ -1131,14 +1402,66 @@ void N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_priva
     for(int i = 0; i < new_ninit; i++) {
 
         struct coord curr = new_init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
+        frontier_push(&frontier, 0.0f, curr);
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
-    build_integration_field(&frontier, chunk, integration_field);
-    build_flow_field(integration_field, inout_flow);
+    build_fields(&frontier, chunk, integration_field, inout_flow);
     fixup_field(inout_flow->target, integration_field, inout_flow, chunk);
 
-    pq_coord_destroy(&frontier);
+    pqi_coord_destroy(&frontier);
+    return true;
+}
+
+bool N_FlowFieldAffected(const struct flow_dirs *dirs, const struct nav_chunk *chunk, 
+                         struct coord tile)
+{
+    /* A tile with no direction is either a target or a tile that the field 
+     * could not reach - a change to either could change the whole field. */
+    if(N_FlowDir(dirs, tile.r, tile.c) == FD_NONE)
+        return true;
+
+    /* A tile that became passable can only offer a shorter route. The existing
+     * directions still lead to the target, so the field can be kept. */
+    if(tile_passable(chunk, tile))
+        return false;
+
+    /* A tile that became impassable only matters if some neighbour's flow leads 
+     * onto it or cuts its corner. */
+    for(int dr = -1; dr <= 1; dr++) {
+    for(int dc = -1; dc <= 1; dc++) {
+
+        struct coord curr = (struct coord){tile.r + dr, tile.c + dc};
+        if(curr.r < 0 || curr.r >= FIELD_RES_R)
+            continue;
+        if(curr.c < 0 || curr.c >= FIELD_RES_C)
+            continue;
+        if(dr == 0 && dc == 0)
+            continue;
+
+        struct coord delta = s_flow_dir_delta[N_FlowDir(dirs, curr.r, curr.c)];
+        if(delta.r == 0 && delta.c == 0)
+            continue;
+
+        if(curr.r + delta.r == tile.r && curr.c + delta.c == tile.c)
+            return true;
+        if(delta.r && delta.c && curr.r + delta.r == tile.r && curr.c == tile.c)
+            return true;
+        if(delta.r && delta.c && curr.r == tile.r && curr.c + delta.c == tile.c)
+            return true;
+    }}
+    return false;
+}
+
+bool N_LOSFieldAffected(const struct LOS_field *los, struct coord tile)
+{
+    /* Tiles can only cast or lift a shadow where they border the visible region */
+    for(int r = MAX(tile.r - 1, 0); r <= MIN(tile.r + 1, FIELD_RES_R - 1); r++) {
+    for(int c = MAX(tile.c - 1, 0); c <= MIN(tile.c + 1, FIELD_RES_C - 1); c++) {
+
+        if(los->field[r][c].visible)
+            return true;
+    }}
+    return false;
 }
 
@@ -74,12 +74,24 @@ struct field_target{
     };
 };
 
+/* The directions are packed two per byte, the even column in the low nibble. 
+ * Use the 'N_FlowDir' and 'N_FlowSetDir' accessors. */
+struct flow_dirs{
+    uint8_t packed[FIELD_RES_R][FIELD_RES_C / 2];
+};
+
 struct flow_field{
     struct coord chunk;
     struct field_target target;
-    struct{
-        unsigned dir_idx : 4;
-    }field[FIELD_RES_R][FIELD_RES_C];
+    struct flow_dirs dirs;
+};
+
+enum field_solver{
+    /* Dijkstra's algorithm over the cost field */
+    FIELD_SOLVER_DIJKSTRA,
+    /* Iterative row/column sweeps, vectorized where supported. Produces 
+     * the same integration field as Dijkstra's algorithm. */
+    FIELD_SOLVER_SWEEP,
 };
 
 enum flow_dir{
@@ -96,9 +108,36 @@ enum flow_dir{
 
 extern vec2_t g_flow_dir_lookup[];
 
+static inline enum flow_dir N_FlowDir(const struct flow_dirs *dirs, int r, int c)
+{
+    return (dirs->packed[r][c >> 1] >> ((c & 1) << 2)) & 0xf;
+}
+
+static inline void N_FlowSetDir(struct flow_dirs *dirs, int r, int c, enum flow_dir dir)
+{
+    int shift = (c & 1) << 2;
+    uint8_t *byte = &dirs->packed[r][c >> 1];
+    *byte = (*byte & ~(0xf << shift)) | ((dir & 0xf) << shift);
+}
+
 ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target);
+
+/* ------------------------------------------------------------------------
+ * Select the algorithm used for computing the integration fields of the
+ * flow fields. Must not be called while fields are being built.
+ * ------------------------------------------------------------------------
+ */
+void    N_FlowFieldSetSolver(enum field_solver solver);
+enum field_solver N_FlowFieldGetSolver(void);
+
 void    N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct flow_field *out);
-void    N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
+/* ------------------------------------------------------------------------
+ * The following builders return false when the field could not be 
+ * computed (i.e. on allocation failure). In that case the output field 
+ * contents are undefined and it must not be cached or used for steering.
+ * ------------------------------------------------------------------------
+ */
+bool    N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
                           struct field_target target, struct flow_field *inout_flow);
 
 /* ------------------------------------------------------------------------
@@ -109,7 +148,7 @@ void    N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *pr
  * island (local_iid), the field will remain unchanged.
  * ------------------------------------------------------------------------
  */
-void    N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_private *priv,
+bool    N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_private *priv,
                                          struct flow_field *inout_flow);
 
 /* ------------------------------------------------------------------------
@@ -120,7 +159,7 @@ void    N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_pr
  * somehow end up on an impassable one.
  * ------------------------------------------------------------------------
  */
-void    N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct coord start, 
+bool    N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct coord start, 
                                            struct flow_field *inout_flow);
 
 /* ------------------------------------------------------------------------
@@ -133,9 +172,19 @@ void    N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct
  * NULL) and and moving backwards along the path back to the 'source' chunk.
  * ------------------------------------------------------------------------
  */
-void    N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
+bool    N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
                          const struct nav_private *priv, vec3_t map_pos, 
                          struct LOS_field *out_los, const struct LOS_field *prev_los);
 
+/* ------------------------------------------------------------------------
+ * Returns true if a change to the passability of 'tile' may change the
+ * field. This is conservative - fields for which it returns false are 
+ * guaranteed to still guide to the target.
+ * ------------------------------------------------------------------------
+ */
+bool    N_FlowFieldAffected(const struct flow_dirs *dirs, const struct nav_chunk *chunk, 
+                            struct coord tile);
+bool    N_LOSFieldAffected(const struct LOS_field *los, struct coord tile);
+
 #endif
 
@@ -39,17 +39,36 @@
 #include "../lib/public/vec.h"
 #include "../event.h"
 #include "../config.h"
+#include "../main.h"
 
 #include <assert.h>
+#include <stdlib.h>
+#include <SDL.h>
+
+
+/* Flow fields are stored by content, so that identical fields (for example, 
+ * fields of different paths leading towards the same portal) share a single 
+ * copy of the directions. */
+struct flow_blob{
+    uint64_t         hash;
+    int              refcount;
+    struct flow_dirs dirs;
+};
+
+struct flow_entry{
+    struct coord        chunk;
+    struct field_target target;
+    struct flow_blob   *blob;
+};
 
 
 LRU_CACHE_TYPE(los, struct LOS_field)
 LRU_CACHE_PROTOTYPES(static, los, struct LOS_field)
 LRU_CACHE_IMPL(static, los, struct LOS_field)
 
-LRU_CACHE_TYPE(flow, struct flow_field)
-LRU_CACHE_PROTOTYPES(static, flow, struct flow_field)
-LRU_CACHE_IMPL(static, flow, struct flow_field)
+LRU_CACHE_TYPE(flow, struct flow_entry)
+LRU_CACHE_PROTOTYPES(static, flow, struct flow_entry)
+LRU_CACHE_IMPL(static, flow, struct flow_entry)
 
 LRU_CACHE_TYPE(ffid, ff_id_t)
 LRU_CACHE_PROTOTYPES(static, ffid, ff_id_t)
@@ -59,11 +78,42 @@ LRU_CACHE_TYPE(grid_path, struct grid_path_desc)
 LRU_CACHE_PROTOTYPES(static, grid_path, struct grid_path_desc)
 LRU_CACHE_IMPL(static, grid_path, struct grid_path_desc)
 
+LRU_CACHE_TYPE(route, struct portal_route_tree)
+LRU_CACHE_PROTOTYPES(static, route, struct portal_route_tree)
+LRU_CACHE_IMPL(static, route, struct portal_route_tree)
+
 VEC_TYPE(id, uint64_t)
 VEC_PROTOTYPES(static, id, uint64_t)
 VEC_IMPL(static, id, uint64_t)
 
 KHASH_MAP_INIT_INT64(idvec, vec_id_t)
+KHASH_MAP_INIT_INT64(ffblob, struct flow_blob*)
+
+struct pending_los{
+    dest_id_t        id;
+    struct coord     chunk;
+    struct LOS_field lf;
+};
+
+struct pending_flow{
+    ff_id_t           id;
+    struct flow_field ff;
+};
+
+struct pending_ffid{
+    dest_id_t    id;
+    struct coord chunk;
+    ff_id_t      ffid;
+};
+
+VEC_TYPE(plos, struct pending_los)
+VEC_IMPL(static inline, plos, struct pending_los)
+
+VEC_TYPE(pflow, struct pending_flow)
+VEC_IMPL(static inline, pflow, struct pending_flow)
+
+VEC_TYPE(pffid, struct pending_ffid)
+VEC_IMPL(static inline, pffid, struct pending_ffid)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -71,17 +121,40 @@ KHASH_MAP_INIT_INT64(idvec, vec_id_t)
 
 static lru(los)          s_los_cache;       /* key: (dest_id, chunk coord) */
 static lru(flow)         s_flow_cache;      /* key: (ffid) */
+static khash_t(ffblob)    *s_flow_blobs;      /* key: (hash of the directions) */
+/* The flow cache is bounded by the memory taken up by its' entries and the 
+ * (shared) directions they refer to, rather than by the number of entries. */
+static size_t            s_flow_bytes;
+static size_t            s_flow_budget = CONFIG_FLOW_CACHE_BUDGET;
+static size_t            s_flow_nblobs;
 /* The ffid cache maps a (dest_id, chunk coordinate) tuple to a flow field ID,
  * which could be used to retreive the relevant field from the flow cache. 
  * The reason for this is that the same flow field chunk can be shared between
  * many different paths. */
 static lru(ffid)         s_ffid_cache;      /* key: (dest_id, chunk_coord) */
 static lru(grid_path)    s_grid_path_cache; /* key: (chunk coord, tile start coord, tile dest coord) */
+/* A single route tree answers queries from any source portal to its 
+ * destination, including all the sub-routes of previously returned paths. */
+static lru(route)        s_route_cache;     /* key: (dest portal ID) */
 
 /* The following structures are maintained for efficient invalidation of entries:*/
 static khash_t(idvec)   *s_chunk_ffield_map; /* key: (chunk coord) */
 static khash_t(idvec)   *s_chunk_lfield_map; /* key: (chunk coord) */
 
+/* Fields may be produced by tasks running on the worker threads. These are 
+ * not inserted into the caches right away, since that may evict entries that
+ * the main thread is still holding pointers to. Instead, they are queued up 
+ * and committed from the main thread. The queues are always flushed before
+ * any invalidation takes place, so a field that has been computed before a
+ * change to the navigation data cannot outlive the invalidation.
+ */
+static vec_plos_t        s_pending_los;
+static vec_pflow_t       s_pending_flow;
+static vec_pffid_t       s_pending_ffid;
+
+/* Protects all of the above */
+static SDL_mutex        *s_lock;
+
 static struct priv_fc_stats{
     unsigned los_query;
     unsigned los_hit;
@@ -89,10 +162,15 @@ static struct priv_fc_stats{
     unsigned flow_query;
     unsigned flow_hit;
     unsigned flow_invalidated;
+    unsigned flow_evicted;
+    unsigned flow_shared;
     unsigned ffid_query;
     unsigned ffid_hit;
     unsigned grid_path_query;
     unsigned grid_path_hit;
+    unsigned route_query;
+    unsigned route_hit;
+    unsigned route_invalidated;
 }s_perfstats = {0};
 
 /*****************************************************************************/
@@ -138,6 +216,100 @@ static void on_grid_path_evict(struct grid_path_desc *victim)
     vec_coord_destroy(&victim->path);
 }
 
+static void on_route_evict(struct portal_route_tree *victim)
+{
+    AStar_RouteTreeDestroy(victim);
+}
+
+static uint64_t flow_dirs_hash(const struct flow_dirs *dirs)
+{
+    /* FNV-1a, taking a word at a time */
+    const uint8_t *bytes = (const uint8_t*)dirs->packed;
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for(size_t i = 0; i < sizeof(dirs->packed); i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash ^= word;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static struct flow_blob *flow_blob_acquire(const struct flow_dirs *dirs)
+{
+    uint64_t hash = flow_dirs_hash(dirs);
+    khiter_t k = kh_get(ffblob, s_flow_blobs, hash);
+
+    if(k != kh_end(s_flow_blobs)) {
+        struct flow_blob *blob = kh_val(s_flow_blobs, k);
+        if(0 == memcmp(&blob->dirs, dirs, sizeof(*dirs))) {
+            blob->refcount++;
+            s_perfstats.flow_shared++;
+            return blob;
+        }
+    }
+
+    struct flow_blob *ret = malloc(sizeof(struct flow_blob));
+    if(!ret)
+        return NULL;
+
+    ret->hash = hash;
+    ret->refcount = 1;
+    ret->dirs = *dirs;
+    s_flow_bytes += sizeof(struct flow_blob);
+    s_flow_nblobs++;
+
+    /* In the unlikely case of a hash collision, the new blob is just not shared */
+    if(k == kh_end(s_flow_blobs)) {
+        int status;
+        k = kh_put(ffblob, s_flow_blobs, hash, &status);
+        if(status != -1) {
+            kh_val(s_flow_blobs, k) = ret;
+        }
+    }
+    return ret;
+}
+
+static void flow_blob_release(struct flow_blob *blob)
+{
+    if(--blob->refcount > 0)
+        return;
+
+    khiter_t k = kh_get(ffblob, s_flow_blobs, blob->hash);
+    if(k != kh_end(s_flow_blobs) && kh_val(s_flow_blobs, k) == blob) {
+        kh_del(ffblob, s_flow_blobs, k);
+    }
+    s_flow_bytes -= sizeof(struct flow_blob);
+    s_flow_nblobs--;
+    free(blob);
+}
+
+static void on_flow_evict(struct flow_entry *victim)
+{
+    flow_blob_release(victim->blob);
+    s_flow_bytes -= sizeof(lru_node(flow));
+}
+
+static bool flow_remove(ff_id_t ffid)
+{
+    /* Removal doesn't invoke the eviction hook */
+    const struct flow_entry *entry = lru_flow_peek(&s_flow_cache, ffid);
+    if(!entry)
+        return false;
+
+    flow_blob_release(entry->blob);
+    s_flow_bytes -= sizeof(lru_node(flow));
+    return lru_flow_remove(&s_flow_cache, ffid);
+}
+
+static void flow_trim(void)
+{
+    while(s_flow_bytes > s_flow_budget && lru_flow_evict_oldest(&s_flow_cache)) {
+        s_perfstats.flow_evicted++;
+    }
+}
+
 static void destroy_all_entries(khash_t(idvec) *hash)
 {
     uint32_t key;
@@ -178,6 +350,68 @@ static bool dest_array_contains(dest_id_t *array, size_t size, dest_id_t item)
     return false;
 }
 
+static bool in_main_thread(void)
+{
+    return (SDL_ThreadID() == g_main_thread_id);
+}
+
+static void put_los(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf)
+{
+    uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
+    lru_los_put(&s_los_cache, key, lf);
+    field_map_add(s_chunk_lfield_map, key_for_chunk(chunk_coord), key);
+}
+
+static void put_flow(ff_id_t ffid, const struct flow_field *ff)
+{
+    /* Acquire the blob before the old entry is released, so that putting
+     * the same directions again doesn't free and re-allocate them. */
+    struct flow_blob *blob = flow_blob_acquire(&ff->dirs);
+    if(!blob)
+        return;
+
+    if(!lru_flow_peek(&s_flow_cache, ffid)
+    && s_flow_cache.used == s_flow_cache.capacity) {
+        s_perfstats.flow_evicted++;
+    }
+
+    struct flow_entry entry = (struct flow_entry){ff->chunk, ff->target, blob};
+    lru_flow_put(&s_flow_cache, ffid, &entry);
+    s_flow_bytes += sizeof(lru_node(flow));
+    flow_trim();
+
+    struct coord chunk = (struct coord){(ffid >> 8) & 0xff, ffid & 0xff};
+    field_map_add(s_chunk_ffield_map, key_for_chunk(chunk), ffid);
+}
+
+static void put_ffid(dest_id_t dest_id, struct coord chunk_coord, ff_id_t ffid)
+{
+    uint64_t key = key_for_dest_and_chunk(dest_id, chunk_coord);
+    lru_ffid_put(&s_ffid_cache, key, &ffid);
+}
+
+static void commit_pending(void)
+{
+    /* Commit the mappings last, so that they never refer to 
+     * a field that has not been inserted yet. */
+    for(int i = 0; i < vec_size(&s_pending_flow); i++) {
+        const struct pending_flow *curr = &vec_AT(&s_pending_flow, i);
+        put_flow(curr->id, &curr->ff);
+    }
+    for(int i = 0; i < vec_size(&s_pending_los); i++) {
+        const struct pending_los *curr = &vec_AT(&s_pending_los, i);
+        put_los(curr->id, curr->chunk, &curr->lf);
+    }
+    for(int i = 0; i < vec_size(&s_pending_ffid); i++) {
+        const struct pending_ffid *curr = &vec_AT(&s_pending_ffid, i);
+        put_ffid(curr->id, curr->chunk, curr->ffid);
+    }
+
+    vec_pflow_reset(&s_pending_flow);
+    vec_plos_reset(&s_pending_los);
+    vec_pffid_reset(&s_pending_ffid);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -187,30 +421,48 @@ bool N_FC_Init(void)
     if(!lru_los_init(&s_los_cache, CONFIG_LOS_CACHE_SZ, NULL))
         goto fail_los;
 
-    if(!lru_flow_init(&s_flow_cache, CONFIG_FLOW_CAHCE_SZ, NULL))
+    if(!lru_flow_init(&s_flow_cache, CONFIG_FLOW_CAHCE_SZ, on_flow_evict))
         goto fail_flow;
 
+    if(NULL == (s_flow_blobs = kh_init(ffblob)))
+        goto fail_flow_blobs;
+
     if(!lru_ffid_init(&s_ffid_cache, CONFIG_MAPPING_CACHE_SZ, NULL))
         goto fail_ffid;
 
     if(!lru_grid_path_init(&s_grid_path_cache, CONFIG_GRID_PATH_CACHE_SZ, on_grid_path_evict))
         goto fail_grid_path;
 
+    if(!lru_route_init(&s_route_cache, CONFIG_ROUTE_CACHE_SZ, on_route_evict))
+        goto fail_route;
+
     if(NULL == (s_chunk_ffield_map = kh_init(idvec)))
         goto fail_chunk_ffield;
 
     if(NULL == (s_chunk_lfield_map = kh_init(idvec)))
         goto fail_chunk_lfield;
 
+    if(NULL == (s_lock = SDL_CreateMutex()))
+        goto fail_lock;
+
+    vec_plos_init(&s_pending_los);
+    vec_pflow_init(&s_pending_flow);
+    vec_pffid_init(&s_pending_ffid);
     return true;
 
+fail_lock:
+    kh_destroy(idvec, s_chunk_lfield_map);
 fail_chunk_lfield:
     kh_destroy(idvec, s_chunk_ffield_map);
 fail_chunk_ffield:
+    lru_route_destroy(&s_route_cache);
+fail_route:
     lru_grid_path_destroy(&s_grid_path_cache);
 fail_grid_path:
     lru_ffid_destroy(&s_ffid_cache);
 fail_ffid:
+    kh_destroy(ffblob, s_flow_blobs);
+fail_flow_blobs:
     lru_flow_destroy(&s_flow_cache);
 fail_flow:
     lru_los_destroy(&s_los_cache);
@@ -222,37 +474,76 @@ void N_FC_Shutdown(void)
 {
     lru_los_destroy(&s_los_cache);
     lru_flow_destroy(&s_flow_cache);
+    kh_destroy(ffblob, s_flow_blobs);
     lru_ffid_destroy(&s_ffid_cache);
     lru_grid_path_destroy(&s_grid_path_cache);
+    lru_route_destroy(&s_route_cache);
 
     destroy_all_entries(s_chunk_ffield_map);
     kh_destroy(idvec, s_chunk_ffield_map);
 
     destroy_all_entries(s_chunk_lfield_map);
     kh_destroy(idvec, s_chunk_lfield_map);
+
+    vec_plos_destroy(&s_pending_los);
+    vec_pflow_destroy(&s_pending_flow);
+    vec_pffid_destroy(&s_pending_ffid);
+    SDL_DestroyMutex(s_lock);
 }
 
 void N_FC_ClearAll(void)
 {
+    SDL_LockMutex(s_lock);
+
+    vec_plos_reset(&s_pending_los);
+    vec_pflow_reset(&s_pending_flow);
+    vec_pffid_reset(&s_pending_ffid);
+
     lru_los_clear(&s_los_cache);
     lru_flow_clear(&s_flow_cache);
     lru_ffid_clear(&s_ffid_cache);
     lru_grid_path_clear(&s_grid_path_cache);
+    lru_route_clear(&s_route_cache);
 
     destroy_all_entries(s_chunk_ffield_map);
     kh_clear(idvec, s_chunk_ffield_map);
 
     destroy_all_entries(s_chunk_lfield_map);
     kh_clear(idvec, s_chunk_lfield_map);
+
+    SDL_UnlockMutex(s_lock);
 }
 
 void N_FC_ClearStats(void)
 {
+    SDL_LockMutex(s_lock);
     memset(&s_perfstats, 0, sizeof(s_perfstats));
+    SDL_UnlockMutex(s_lock);
+}
+
+void N_FC_CommitPending(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    SDL_LockMutex(s_lock);
+    commit_pending();
+    SDL_UnlockMutex(s_lock);
+}
+
+void N_FC_SetFlowCacheBudget(size_t bytes)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    SDL_LockMutex(s_lock);
+    s_flow_budget = bytes;
+    flow_trim();
+    SDL_UnlockMutex(s_lock);
 }
 
 void N_FC_GetStats(struct fc_stats *out_stats)
 {
+    SDL_LockMutex(s_lock);
+
     out_stats->los_used = s_los_cache.used;
     out_stats->los_max = s_los_cache.capacity;
     out_stats->los_hit_rate = !s_perfstats.los_query ? 0
@@ -264,6 +555,13 @@ void N_FC_GetStats(struct fc_stats *out_stats)
     out_stats->flow_hit_rate = !s_perfstats.flow_query ? 0
         : ((float)s_perfstats.flow_hit) / s_perfstats.flow_query;
     out_stats->flow_invalidated = s_perfstats.flow_invalidated;
+    out_stats->flow_hits = s_perfstats.flow_hit;
+    out_stats->flow_misses = s_perfstats.flow_query - s_perfstats.flow_hit;
+    out_stats->flow_evicted = s_perfstats.flow_evicted;
+    out_stats->flow_shared = s_perfstats.flow_shared;
+    out_stats->flow_unique = s_flow_nblobs;
+    out_stats->flow_bytes_used = s_flow_bytes;
+    out_stats->flow_bytes_max = s_flow_budget;
 
     out_stats->ffid_used = s_ffid_cache.used;
     out_stats->ffid_max = s_ffid_cache.capacity;
@@ -274,85 +572,216 @@ void N_FC_GetStats(struct fc_stats *out_stats)
     out_stats->grid_path_max = s_grid_path_cache.capacity;
     out_stats->grid_path_hit_rate = !s_perfstats.grid_path_hit ? 0
         : ((float)s_perfstats.grid_path_hit) / s_perfstats.grid_path_query;
+
+    out_stats->route_used = s_route_cache.used;
+    out_stats->route_max = s_route_cache.capacity;
+    out_stats->route_hit_rate = !s_perfstats.route_query ? 0
+        : ((float)s_perfstats.route_hit) / s_perfstats.route_query;
+    out_stats->route_invalidated = s_perfstats.route_invalidated;
+
+    SDL_UnlockMutex(s_lock);
 }
 
 bool N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord)
 {
+    SDL_LockMutex(s_lock);
+
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
     bool ret = lru_los_contains(&s_los_cache, key);
 
     s_perfstats.los_query++;
     s_perfstats.los_hit += !!ret;
+
+    SDL_UnlockMutex(s_lock);
     return ret;
 }
 
 const struct LOS_field *N_FC_LOSFieldAt(dest_id_t id, struct coord chunk_coord)
 {
+    ASSERT_IN_MAIN_THREAD();
+
+    SDL_LockMutex(s_lock);
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    return lru_los_at(&s_los_cache, key);
+    const struct LOS_field *ret = lru_los_at(&s_los_cache, key);
+    SDL_UnlockMutex(s_lock);
+    return ret;
 }
 
-void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf)
+bool N_FC_GetLOSField(dest_id_t id, struct coord chunk_coord, struct LOS_field *out)
 {
+    SDL_LockMutex(s_lock);
+
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    lru_los_put(&s_los_cache, key, lf);
-    field_map_add(s_chunk_lfield_map, key_for_chunk(chunk_coord), key);
+    bool ret = lru_los_get(&s_los_cache, key, out);
+
+    s_perfstats.los_query++;
+    s_perfstats.los_hit += !!ret;
+
+    SDL_UnlockMutex(s_lock);
+    return ret;
+}
+
+void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf)
+{
+    SDL_LockMutex(s_lock);
+
+    if(in_main_thread()) {
+        put_los(id, chunk_coord, lf);
+    }else{
+        vec_plos_push(&s_pending_los, (struct pending_los){id, chunk_coord, *lf});
+    }
+
+    SDL_UnlockMutex(s_lock);
 }
 
 bool N_FC_ContainsFlowField(ff_id_t ffid)
 {
+    SDL_LockMutex(s_lock);
+
     bool ret = lru_flow_contains(&s_flow_cache, ffid);
 
     s_perfstats.flow_query++;
     s_perfstats.flow_hit += !!ret;
+
+    SDL_UnlockMutex(s_lock);
     return ret;
 }
 
-const struct flow_field *N_FC_FlowFieldAt(ff_id_t ffid)
+bool N_FC_GetFlowDirs(ff_id_t ffid, struct flow_dirs *out)
+{
+    SDL_LockMutex(s_lock);
+
+    /* The directions are copied out while the lock is held, as the shared 
+     * blob may be released by any later put or trim. */
+    const struct flow_entry *entry = lru_flow_at(&s_flow_cache, ffid);
+    if(entry) {
+        *out = entry->blob->dirs;
+    }
+
+    SDL_UnlockMutex(s_lock);
+    return (entry != NULL);
+}
+
+bool N_FC_GetFlowField(ff_id_t ffid, struct flow_field *out)
 {
-    return lru_flow_at(&s_flow_cache, ffid);
+    SDL_LockMutex(s_lock);
+
+    struct flow_entry entry;
+    bool ret = lru_flow_get(&s_flow_cache, ffid, &entry);
+    if(ret) {
+        out->chunk = entry.chunk;
+        out->target = entry.target;
+        out->dirs = entry.blob->dirs;
+    }
+
+    s_perfstats.flow_query++;
+    s_perfstats.flow_hit += !!ret;
+
+    SDL_UnlockMutex(s_lock);
+    return ret;
 }
 
 void N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff)
 {
-    lru_flow_put(&s_flow_cache, ffid, ff);
+    SDL_LockMutex(s_lock);
 
-    struct coord chunk = (struct coord){(ffid >> 8) & 0xff, ffid & 0xff};
-    field_map_add(s_chunk_ffield_map, key_for_chunk(chunk), ffid);
+    if(in_main_thread()) {
+        put_flow(ffid, ff);
+    }else{
+        vec_pflow_push(&s_pending_flow, (struct pending_flow){ffid, *ff});
+    }
+
+    SDL_UnlockMutex(s_lock);
 }
 
 bool N_FC_GetDestFFMapping(dest_id_t id, struct coord chunk_coord, ff_id_t *out_ff)
 {
+    SDL_LockMutex(s_lock);
+
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
     bool ret = lru_ffid_get(&s_ffid_cache, key, out_ff);
 
     s_perfstats.ffid_query++;
     s_perfstats.ffid_hit += !!ret;
+
+    SDL_UnlockMutex(s_lock);
     return ret;
 }
 
 void N_FC_PutDestFFMapping(dest_id_t dest_id, struct coord chunk_coord, ff_id_t ffid)
 {
-    uint64_t key = key_for_dest_and_chunk(dest_id, chunk_coord);
-    lru_ffid_put(&s_ffid_cache, key, &ffid);
+    SDL_LockMutex(s_lock);
+
+    if(in_main_thread()) {
+        put_ffid(dest_id, chunk_coord, ffid);
+    }else{
+        vec_pffid_push(&s_pending_ffid, (struct pending_ffid){dest_id, chunk_coord, ffid});
+    }
+
+    SDL_UnlockMutex(s_lock);
 }
 
 bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, struct grid_path_desc *out)
 {
+    ASSERT_IN_MAIN_THREAD();
+
+    SDL_LockMutex(s_lock);
+
     uint64_t key = grid_path_key(local_start, local_dest, chunk);
     bool ret = lru_grid_path_get(&s_grid_path_cache, key, out);
 
     s_perfstats.grid_path_query++;
     s_perfstats.grid_path_hit += !!ret;
+
+    SDL_UnlockMutex(s_lock);
     return ret;
 }
 
 void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, const struct grid_path_desc *in)
 {
+    ASSERT_IN_MAIN_THREAD();
+
+    SDL_LockMutex(s_lock);
     uint64_t key = grid_path_key(local_start, local_dest, chunk);
     lru_grid_path_put(&s_grid_path_cache, key, in);
+    SDL_UnlockMutex(s_lock);
+}
+
+bool N_FC_GetPortalRoute(const struct nav_private *priv, uint32_t dst_id,
+                         size_t nsrc, const uint32_t *src_ids, const float *src_costs,
+                         vec_portal_t *out_path, float *out_cost, bool *out_found)
+{
+    SDL_LockMutex(s_lock);
+
+    /* The tree is only read while holding the lock, so it cannot be evicted 
+     * from under us by another thread */
+    struct portal_route_tree tree;
+    bool ret = lru_route_get(&s_route_cache, dst_id, &tree) && (tree.priv == priv);
+    if(ret) {
+        *out_found = AStar_RouteTreePath(&tree, nsrc, src_ids, src_costs, out_path, out_cost);
+    }
+
+    s_perfstats.route_query++;
+    s_perfstats.route_hit += !!ret;
+
+    SDL_UnlockMutex(s_lock);
+    return ret;
+}
+
+void N_FC_PutPortalRoute(uint32_t dst_id, const struct portal_route_tree *tree)
+{
+    SDL_LockMutex(s_lock);
+    lru_route_put(&s_route_cache, dst_id, tree);
+    SDL_UnlockMutex(s_lock);
+}
+
+void N_FC_ClearPortalRoutes(void)
+{
+    SDL_LockMutex(s_lock);
+    lru_route_clear(&s_route_cache);
+    SDL_UnlockMutex(s_lock);
 }
 
 void N_FC_InvalidateAllAtChunk(struct coord chunk)
@@ -363,6 +792,10 @@ void N_FC_InvalidateAllAtChunk(struct coord chunk)
      * appear multiple times. So, not all the fields in the lists will
      * necessarily be in the caches. */
 
+    ASSERT_IN_MAIN_THREAD();
+    SDL_LockMutex(s_lock);
+    commit_pending();
+
     uint64_t key = key_for_chunk(chunk);
 
     khiter_t k = kh_get(idvec, s_chunk_lfield_map, key);
@@ -382,22 +815,96 @@ void N_FC_InvalidateAllAtChunk(struct coord chunk)
 
         vec_id_t *keys = &kh_val(s_chunk_ffield_map, k);
         for(int i = 0; i < vec_size(keys); i++) {
-            bool found = lru_flow_remove(&s_flow_cache, vec_AT(keys, i));
+            bool found = flow_remove(vec_AT(keys, i));
             s_perfstats.flow_invalidated += !!found;
         }
         vec_id_destroy(keys);
         kh_del(idvec, s_chunk_ffield_map, k);
     }
+
+    SDL_UnlockMutex(s_lock);
+}
+
+void N_FC_InvalidateAtTiles(const struct nav_chunk *chunk, struct coord chunk_coord,
+                            const struct coord *tiles, size_t ntiles)
+{
+    ASSERT_IN_MAIN_THREAD();
+    SDL_LockMutex(s_lock);
+    commit_pending();
+
+    uint64_t key = key_for_chunk(chunk_coord);
+
+    /* Filter the chunk:field lists in-place, keeping only the keys of the 
+     * fields that are still in the caches and are not affected by the change */
+    khiter_t k = kh_get(idvec, s_chunk_lfield_map, key);
+    if(k != kh_end(s_chunk_lfield_map)) {
+
+        vec_id_t *keys = &kh_val(s_chunk_lfield_map, k);
+        size_t nkept = 0;
+
+        for(int i = 0; i < vec_size(keys); i++) {
+
+            const struct LOS_field *lf = lru_los_peek(&s_los_cache, vec_AT(keys, i));
+            if(!lf)
+                continue;
+
+            bool affected = false;
+            for(int j = 0; !affected && j < ntiles; j++) {
+                affected = N_LOSFieldAffected(lf, tiles[j]);
+            }
+
+            if(affected) {
+                lru_los_remove(&s_los_cache, vec_AT(keys, i));
+                s_perfstats.los_invalidated++;
+                continue;
+            }
+            vec_AT(keys, nkept++) = vec_AT(keys, i);
+        }
+        keys->size = nkept;
+    }
+
+    k = kh_get(idvec, s_chunk_ffield_map, key);
+    if(k != kh_end(s_chunk_ffield_map)) {
+
+        vec_id_t *keys = &kh_val(s_chunk_ffield_map, k);
+        size_t nkept = 0;
+
+        for(int i = 0; i < vec_size(keys); i++) {
+
+            const struct flow_entry *entry = lru_flow_peek(&s_flow_cache, vec_AT(keys, i));
+            if(!entry)
+                continue;
+
+            bool affected = false;
+            for(int j = 0; !affected && j < ntiles; j++) {
+                affected = N_FlowFieldAffected(&entry->blob->dirs, chunk, tiles[j]);
+            }
+
+            if(affected) {
+                flow_remove(vec_AT(keys, i));
+                s_perfstats.flow_invalidated++;
+                continue;
+            }
+            vec_AT(keys, nkept++) = vec_AT(keys, i);
+        }
+        keys->size = nkept;
+    }
+
+    SDL_UnlockMutex(s_lock);
 }
 
 void N_FC_InvalidateAllThroughChunk(struct coord chunk)
 {
-    dest_id_t paths[CONFIG_FLOW_CAHCE_SZ];
+    dest_id_t paths[CONFIG_MAPPING_CACHE_SZ];
     size_t npaths = 0;
 
     uint64_t key;
     ff_id_t ffid_val;
 
+    ASSERT_IN_MAIN_THREAD();
+    SDL_LockMutex(s_lock);
+    commit_pending();
+
     /* Make sure not to actually query the caches, in order to not mess up the age history */
     /* First find all the paths going through the chunk. */
     LRU_FOREACH_SAFE_REMOVE(ffid, &s_ffid_cache, key, ffid_val, {
@@ -415,7 +922,7 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk)
 
     /* Now that we know all the paths, find and remove all the flow 
      * fields belonging to them */
-    struct flow_field ff_val;
+    struct flow_entry ff_val;
     LRU_FOREACH_SAFE_REMOVE(flow, &s_flow_cache, key, ff_val, {
     
         (void)ff_val;
@@ -423,7 +930,7 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk)
 
         if(dest_array_contains(paths, npaths, curr_dest)) {
         
-            bool found = lru_flow_remove(&s_flow_cache, key);
+            bool found = flow_remove(key);
             s_perfstats.flow_invalidated += !!found;
         }
     });
@@ -441,5 +948,19 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk)
             s_perfstats.los_invalidated += !!found;
         }
     });
+
+    /* Finally, drop the portal routes which may have been taken through the chunk */
+    struct portal_route_tree route_val;
+    LRU_FOREACH_SAFE_REMOVE(route, &s_route_cache, key, route_val, {
+
+        if(AStar_RouteTreeUsesChunk(&route_val, chunk)) {
+
+            AStar_RouteTreeDestroy(&route_val);
+            lru_route_remove(&s_route_cache, key);
+            s_perfstats.route_invalidated++;
+        }
+    });
+
+    SDL_UnlockMutex(s_lock);
 }
 
@@ -44,6 +44,13 @@
 #include <stdbool.h>
 
 
+/* The caches may be queried and filled from any thread. The exceptions are the
+ * functions returning pointers into the caches and the invalidation functions, 
+ * which may only be called from the main thread. Entries that are put from 
+ * outside the main thread don't become visible until they are committed by 
+ * the main thread. 
+ */
+
 /*###########################################################################*/
 /* FC GENERAL                                                                */
 /*###########################################################################*/
@@ -51,12 +58,24 @@
 bool N_FC_Init(void);
 void N_FC_Shutdown(void);
 
+/* Insert all the entries that have been put from outside the main thread 
+ * into the caches. This is also done implicitly before any invalidation.
+ */
+void N_FC_CommitPending(void);
+
 /* Invalidate all LOS and Flow fields for a particular chunk 
  */
 void N_FC_InvalidateAllAtChunk(struct coord chunk);
 
+/* Invalidate the LOS and Flow fields at a chunk which may be affected by
+ * the passability of any of the specified tiles having changed
+ */
+void N_FC_InvalidateAtTiles(const struct nav_chunk *chunk, struct coord chunk_coord,
+                            const struct coord *tiles, size_t ntiles);
+
 /* Invalidate all LOS and Flow fields for paths (identified by the dest_id) which 
- * have at least one field at the specified chunk
+ * have at least one field at the specified chunk, as well as all the portal 
+ * routes which may pass through the chunk
  */
 void N_FC_InvalidateAllThroughChunk(struct coord chunk);
 
@@ -68,6 +87,7 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk);
  */
 const struct LOS_field  *N_FC_LOSFieldAt(dest_id_t id, struct coord chunk_coord);
 
+bool N_FC_GetLOSField(dest_id_t id, struct coord chunk_coord, struct LOS_field *out);
 bool N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord);
 void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf);
 
@@ -76,13 +96,16 @@ void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_f
 /* FLOW FIELD CACHING                                                        */
 /*###########################################################################*/
 
-/* Returned pointer should not be cached, as it may become invalid after eviction. 
- */
-const struct flow_field *N_FC_FlowFieldAt(ff_id_t ffid);
-
+bool N_FC_GetFlowDirs(ff_id_t ffid, struct flow_dirs *out);
+bool N_FC_GetFlowField(ff_id_t ffid, struct flow_field *out);
 bool N_FC_ContainsFlowField(ff_id_t ffid);
 void N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff);
 
+/* Set the maximum number of bytes taken up by the cached flow fields. Least 
+ * recently used fields are evicted until the cache fits within the budget.
+ */
+void N_FC_SetFlowCacheBudget(size_t bytes);
+
 bool N_FC_GetDestFFMapping(dest_id_t id, struct coord chunk_coord, ff_id_t *out_ff);
 void N_FC_PutDestFFMapping(dest_id_t dest_id, struct coord chunk_coord, ff_id_t ffid);
 
@@ -102,5 +125,26 @@ bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
 void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, const struct grid_path_desc *in);
 
+
+/*###########################################################################*/
+/* PORTAL ROUTE CACHING                                                      */
+/*###########################################################################*/
+
+/* Returns false if there is no cached route tree for the destination. Otherwise,
+ * 'out_found' is set to whether any of the sources has a route to it and, if 
+ * so, 'out_path' and 'out_cost' are filled in (see 'AStar_RouteTreePath'). 
+ */
+bool N_FC_GetPortalRoute(const struct nav_private *priv, uint32_t dst_id,
+                         size_t nsrc, const uint32_t *src_ids, const float *src_costs,
+                         vec_portal_t *out_path, float *out_cost, bool *out_found);
+
+/* The cache takes ownership of the tree's resources. 
+ */
+void N_FC_PutPortalRoute(uint32_t dst_id, const struct portal_route_tree *tree);
+
+/* Must be called whenever the portal graph is rebuilt or freed. 
+ */
+void N_FC_ClearPortalRoutes(void);
+
 #endif
 
@@ -48,8 +48,14 @@
 #include "../event.h"
 #include "../main.h"
 #include "../perf.h"
+#include "../sched.h"
+#include "../settings.h"
+#include "../config.h"
 #include "../lib/public/queue.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
 
+#include <SDL.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
@@ -67,6 +73,15 @@
 
 #define EPSILON                  (1.0f / 1024)
 
+#define MAX_PATH_REQUESTS        (512)
+/* Completed requests that have not been queried for this many frames are retired */
+#define PATH_REQUEST_TTL         (300)
+/* Past this, the local island IDs of a chunk are compacted by re-flooding it */
+#define MAX_LOCAL_IID            (ISLAND_NONE - FIELD_RES_R * FIELD_RES_C)
+
+#define BAKED_NAV_MAGIC          "PFNAV\0\0\0"
+#define BAKED_NAV_VERSION        (1)
+
 #define FOREACH_PORTAL(_priv, _local, ...)                                                      \
     do{                                                                                         \
         for(int chunk_r = 0; chunk_r < (_priv)->height; chunk_r++) {                            \
@@ -99,15 +114,136 @@ enum edge_type{
     EDGE_TOP   = (1 << 3),
 };
 
+enum req_state{
+    REQ_FREE,
+    REQ_PENDING,
+    REQ_DONE,
+};
+
+struct path_request{
+    /* The following are protected by the navigation lock. The generation 
+     * is bumped every time the request is retired, so that a task which
+     * is still working on it can tell that its' results are not wanted. 
+     */
+    uint32_t            gen;
+    enum req_state      state;
+    bool                found;
+    struct nav_private *priv;
+    vec3_t              map_pos;
+    struct tile_desc    src;
+    struct tile_desc    dst;
+    /* The following are only accessed from the main thread */
+    uint64_t            key;
+    unsigned long       last_used;
+};
+
+struct built_ff{
+    struct coord      chunk;
+    ff_id_t           id;
+    bool              has_ff;
+    struct flow_field ff;
+};
+
+struct built_los{
+    struct coord      chunk;
+    struct LOS_field  lf;
+};
+
+VEC_TYPE(td, struct tile_desc)
+VEC_IMPL(static inline, td, struct tile_desc)
+
+VEC_TYPE(bff, struct built_ff)
+VEC_IMPL(static inline, bff, struct built_ff)
+
+VEC_TYPE(blos, struct built_los)
+VEC_IMPL(static inline, blos, struct built_los)
+
+/* A path build runs either synchronously on the main thread or in a task 
+ * on behalf of a path request. In the latter case, the navigation data may 
+ * only be read while holding the navigation lock. The lock is released 
+ * between the steps of the build so that the main thread is never kept 
+ * waiting for longer than it takes to compute a single field.
+ */
+struct path_build{
+    struct path_request *req;
+    uint32_t             gen;
+    dest_id_t            dest;
+    /* Fields put from a task only become visible in the cache once they 
+     * are committed by the main thread. Keep track of them here, so that 
+     * the later steps of the build can see them. 
+     */
+    vec_bff_t            ffs;
+    vec_blos_t           los;
+};
+
+enum build_result{
+    BUILD_FOUND,
+    BUILD_NOT_FOUND,
+    BUILD_CANCELLED,
+};
+
+/* Layout of the baked navigation data. The header is followed by, for every 
+ * chunk in row-major order, its' portal count, its' 'cost_base', 'islands' and 
+ * 'local_islands' fields and then its' portals, each portal being immediately 
+ * followed by its' edges. Pointers between portals are stored as indices. The 
+ * portal travel tables are not baked, as they are rebuilt along with the 
+ * portals when the data is loaded. */
+struct baked_nav_hdr{
+    char     magic[8];
+    uint32_t version;
+    uint32_t field_res_r;
+    uint32_t field_res_c;
+    uint32_t max_portals;
+    uint32_t width;
+    uint32_t height;
+    uint64_t tiles_checksum;
+};
+
+struct baked_portal{
+    int32_t  component_id;
+    int32_t  endpoints[2][2];
+    /* (chunk index * MAX_PORTALS_PER_CHUNK) + portal index */
+    uint32_t connected;
+    uint32_t num_neighbours;
+};
+
+struct baked_edge{
+    /* Index of the neighbour portal within the same chunk */
+    uint32_t neighbour;
+    uint32_t es;
+    float    cost;
+};
+
 KHASH_SET_INIT_INT(coord)
 KHASH_SET_INIT_INT64(td)
+KHASH_MAP_INIT_INT64(req, int)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static khash_t(coord) *s_dirty_chunks;
-static bool            s_local_islands_dirty = false;
+/* The tiles which changed between being blocked and unblocked since the last 
+ * update. The first 's_nrepaired_tiles' of them have already been accounted 
+ * for in the 'local_islands' fields. */
+static vec_td_t        s_dirty_tiles;
+static size_t          s_nrepaired_tiles = 0;
+/* The chunks which have had static objects cut out of them since the portals
+ * and islands, respectively, have last been updated. */
+static khash_t(coord) *s_cutout_portal_chunks;
+static khash_t(coord) *s_cutout_island_chunks;
+
+/* Held by the main thread while modifying the navigation data and by the 
+ * path tasks while reading it. As the main thread is the only writer, it
+ * doesn't need to take the lock just to read.
+ */
+static SDL_mutex      *s_nav_lock;
+
+static struct path_request s_requests[MAX_PATH_REQUESTS];
+static int             s_free_requests[MAX_PATH_REQUESTS];
+static size_t          s_nfree_requests;
+/* key: (dest_id, source chunk, source local island) */
+static khash_t(req)   *s_request_table;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -523,7 +659,22 @@ static bool n_local_ports_connected(struct portal *a, struct portal *b,
     return false;
 }
 
-static int n_update_edge_states(struct nav_chunk *chunk)
+static void n_merge_components(struct nav_private *priv, int a, int b)
+{
+    if(a == b)
+        return;
+
+    struct portal *port;
+    FOREACH_PORTAL(priv, port, {
+        if(port->component_id == b)
+            port->component_id = a;
+    });
+}
+
+/* Edges that became active can only join components together, which is done
+ * in-place. If any edge got blocked, 'out_split' is set to signal that the 
+ * components need to be recomputed. */
+static int n_update_edge_states(struct nav_private *priv, struct nav_chunk *chunk, bool *out_split)
 {
     int ret = 0;
     for(int i = 0; i < chunk->num_portals; i++) {
@@ -541,6 +692,11 @@ static int n_update_edge_states(struct nav_chunk *chunk)
             if(new_es != old_es) {
                 port->edges[j].es = new_es;
                 ret++;
+
+                if(new_es == EDGE_STATE_BLOCKED)
+                    *out_split = true;
+                else
+                    n_merge_components(priv, port->component_id, neighb->component_id);
             }
         }
     }
@@ -786,12 +942,264 @@ static void n_update_local_islands(struct nav_chunk *chunk)
     }}
 }
 
+static uint16_t n_next_local_iid(const struct nav_chunk *chunk)
+{
+    int ret = 0;
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        if(chunk->local_islands[r][c] == ISLAND_NONE)
+            continue;
+        ret = MAX(ret, chunk->local_islands[r][c]);
+    }}
+    assert(ret + 1 < ISLAND_NONE);
+    return ret + 1;
+}
+
+/* Flood all the tiles connected to 'start' which have the 'from' island ID,
+ * setting them to 'to'. 'stack' must have room for every tile in the chunk. */
+static void n_relabel_island_local(struct nav_chunk *chunk, struct coord start, 
+                                   uint16_t from, uint16_t to, struct coord *stack)
+{
+    const struct coord deltas[] = {
+        { 0, -1},
+        { 0, +1},
+        {-1,  0},
+        {+1,  0},
+    };
+
+    assert(chunk->local_islands[start.r][start.c] == from);
+    size_t nstack = 0;
+    chunk->local_islands[start.r][start.c] = to;
+    stack[nstack++] = start;
+
+    while(nstack > 0) {
+    
+        struct coord curr = stack[--nstack];
+        for(int i = 0; i < ARR_SIZE(deltas); i++) {
+
+            struct coord neighb = (struct coord){curr.r + deltas[i].r, curr.c + deltas[i].c};
+            if(neighb.r < 0 || neighb.r >= FIELD_RES_R)
+                continue;
+            if(neighb.c < 0 || neighb.c >= FIELD_RES_C)
+                continue;
+            if(chunk->local_islands[neighb.r][neighb.c] != from)
+                continue;
+
+            chunk->local_islands[neighb.r][neighb.c] = to;
+            stack[nstack++] = neighb;
+        }
+    }
+}
+
+static int n_uf_find(int *parents, int idx)
+{
+    while(parents[idx] != idx) {
+        parents[idx] = parents[parents[idx]];
+        idx = parents[idx];
+    }
+    return idx;
+}
+
+/* Fix up the local islands after the passability of some of the tiles inside
+ * the [min, max] rectangle changed. Rather than flood filling the entire chunk,
+ * the connectivity is only examined within a window that is one tile larger
+ * than the rectangle. The tiles on the window's border haven't changed, so their
+ * island IDs are still valid. A window component touching border tiles of 
+ * different islands means that those islands have been joined together. An 
+ * island touching more than one window component may have been split in two, 
+ * and only in that case do we need to flood the island to find out. 
+ */
+static void n_repair_local_islands(struct nav_chunk *chunk, struct coord min, struct coord max)
+{
+    if((max.r - min.r + 1) * (max.c - min.c + 1) > (FIELD_RES_R * FIELD_RES_C) / 4) {
+        n_update_local_islands(chunk);
+        return;
+    }
+
+    const struct coord wmin = (struct coord){MAX(min.r - 1, 0), MAX(min.c - 1, 0)};
+    const struct coord wmax = (struct coord){MIN(max.r + 1, FIELD_RES_R - 1), MIN(max.c + 1, FIELD_RES_C - 1)};
+    const struct coord deltas[] = {
+        { 0, -1},
+        { 0, +1},
+        {-1,  0},
+        {+1,  0},
+    };
+
+    #define IN_RECT(_r, _c, _min, _max) \
+        ((_r) >= (_min).r && (_r) <= (_max).r && (_c) >= (_min).c && (_c) <= (_max).c)
+    #define PASSABLE(_r, _c) \
+        (chunk->cost_base[_r][_c] != COST_IMPASSABLE && chunk->blockers[_r][_c] == 0)
+
+    static struct coord stack[FIELD_RES_R * FIELD_RES_C];
+    static struct coord seeds[FIELD_RES_R * FIELD_RES_C];
+    static int comp_set[FIELD_RES_R * FIELD_RES_C];
+    static uint16_t comp_iid[FIELD_RES_R * FIELD_RES_C];
+    int16_t comps[FIELD_RES_R][FIELD_RES_C];
+
+    /* First, find the connected components of the passable tiles in the window */
+    int ncomps = 0;
+    for(int r = wmin.r; r <= wmax.r; r++)
+        for(int c = wmin.c; c <= wmax.c; c++)
+            comps[r][c] = -1;
+
+    for(int r = wmin.r; r <= wmax.r; r++) {
+    for(int c = wmin.c; c <= wmax.c; c++) {
+
+        if(comps[r][c] >= 0 || !PASSABLE(r, c))
+            continue;
+
+        size_t nstack = 0;
+        comps[r][c] = ncomps;
+        stack[nstack++] = (struct coord){r, c};
+
+        while(nstack > 0) {
+
+            struct coord curr = stack[--nstack];
+            for(int i = 0; i < ARR_SIZE(deltas); i++) {
+
+                int nr = curr.r + deltas[i].r;
+                int nc = curr.c + deltas[i].c;
+                if(!IN_RECT(nr, nc, wmin, wmax))
+                    continue;
+                if(comps[nr][nc] >= 0 || !PASSABLE(nr, nc))
+                    continue;
+
+                comps[nr][nc] = ncomps;
+                stack[nstack++] = (struct coord){nr, nc};
+            }
+        }
+        comp_set[ncomps] = -1;
+        seeds[ncomps] = (struct coord){r, c};
+        ncomps++;
+    }}
+
+    /* Next, union the islands which are touched by the same component */
+    uint16_t set_iids[2 * (FIELD_RES_R + FIELD_RES_C)];
+    int set_parents[2 * (FIELD_RES_R + FIELD_RES_C)];
+    int nsets = 0;
+
+    for(int r = wmin.r; r <= wmax.r; r++) {
+    for(int c = wmin.c; c <= wmax.c; c++) {
+
+        if(comps[r][c] < 0 || IN_RECT(r, c, min, max))
+            continue;
+
+        uint16_t iid = chunk->local_islands[r][c];
+        assert(iid != ISLAND_NONE);
+
+        int set = 0;
+        while(set < nsets && set_iids[set] != iid)
+            set++;
+        if(set == nsets) {
+            assert(nsets < ARR_SIZE(set_iids));
+            set_iids[nsets] = iid;
+            set_parents[nsets] = nsets;
+            nsets++;
+        }
+
+        int comp = comps[r][c];
+        if(comp_set[comp] < 0) {
+            comp_set[comp] = set;
+        }else{
+            int a = n_uf_find(set_parents, comp_set[comp]);
+            int b = n_uf_find(set_parents, set);
+            set_parents[MAX(a, b)] = MIN(a, b);
+        }
+    }}
+
+    /* Every island in a joined set takes on the smallest ID in the set */
+    uint16_t from[ARR_SIZE(set_iids)], to[ARR_SIZE(set_iids)];
+    int nremap = 0;
+
+    for(int i = 0; i < nsets; i++) {
+        uint16_t min_iid = set_iids[i];
+        for(int j = 0; j < nsets; j++) {
+            if(n_uf_find(set_parents, j) == n_uf_find(set_parents, i))
+                min_iid = MIN(min_iid, set_iids[j]);
+        }
+        if(min_iid != set_iids[i]) {
+            from[nremap] = set_iids[i];
+            to[nremap] = min_iid;
+            nremap++;
+        }
+        set_iids[i] = min_iid;
+    }
+
+    if(nremap > 0) {
+        for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            for(int i = 0; i < nremap; i++) {
+                if(chunk->local_islands[r][c] == from[i]) {
+                    chunk->local_islands[r][c] = to[i];
+                    break;
+                }
+            }
+        }}
+    }
+
+    /* Components touching no existing island are new islands */
+    uint16_t next_iid = 0;
+    for(int i = 0; i < ncomps; i++) {
+
+        if(comp_set[i] >= 0) {
+            comp_iid[i] = set_iids[n_uf_find(set_parents, comp_set[i])];
+            continue;
+        }
+        if(!next_iid && (next_iid = n_next_local_iid(chunk)) > MAX_LOCAL_IID) {
+            n_update_local_islands(chunk);
+            return;
+        }
+        comp_iid[i] = next_iid++;
+    }
+
+    for(int r = min.r; r <= max.r; r++) {
+    for(int c = min.c; c <= max.c; c++) {
+        chunk->local_islands[r][c] = (comps[r][c] >= 0) ? comp_iid[comps[r][c]] : ISLAND_NONE;
+    }}
+
+    /* Finally, check if any island touching multiple components got split */
+    for(int i = 0; i < ncomps; i++) {
+
+        if(comp_iid[i] == ISLAND_NONE)
+            continue;
+
+        bool shared = false;
+        for(int j = i + 1; !shared && j < ncomps; j++)
+            shared = (comp_iid[j] == comp_iid[i]);
+        if(!shared)
+            continue;
+
+        uint16_t iid = comp_iid[i];
+        if(!next_iid && (next_iid = n_next_local_iid(chunk)) > MAX_LOCAL_IID) {
+            n_update_local_islands(chunk);
+            return;
+        }
+
+        for(int j = i; j < ncomps; j++) {
+
+            if(comp_iid[j] != iid)
+                continue;
+            comp_iid[j] = ISLAND_NONE;
+
+            /* The component got reached when flooding one of the previous ones */
+            if(chunk->local_islands[seeds[j].r][seeds[j].c] != iid)
+                continue;
+            n_relabel_island_local(chunk, seeds[j], iid, next_iid++, stack);
+        }
+    }
+
+    #undef IN_RECT
+    #undef PASSABLE
+}
+
 static void n_update_dirty_local_islands(void *nav_private)
 {
     struct nav_private *priv = nav_private;
-    if(!s_local_islands_dirty)
+    if(s_nrepaired_tiles == vec_size(&s_dirty_tiles))
         return;
 
+    SDL_LockMutex(s_nav_lock);
     for(int i = kh_begin(s_dirty_chunks); i != kh_end(s_dirty_chunks); i++) {
 
         if(!kh_exist(s_dirty_chunks, i))
@@ -800,14 +1208,53 @@ static void n_update_dirty_local_islands(void *nav_private)
         uint32_t key = kh_key(s_dirty_chunks, i);
         struct coord curr = (struct coord){ key >> 16, key & 0xffff };
 
+        struct coord min = (struct coord){FIELD_RES_R, FIELD_RES_C};
+        struct coord max = (struct coord){-1, -1};
+
+        for(int j = s_nrepaired_tiles; j < vec_size(&s_dirty_tiles); j++) {
+
+            struct tile_desc td = vec_AT(&s_dirty_tiles, j);
+            if(td.chunk_r != curr.r || td.chunk_c != curr.c)
+                continue;
+
+            min = (struct coord){MIN(min.r, td.tile_r), MIN(min.c, td.tile_c)};
+            max = (struct coord){MAX(max.r, td.tile_r), MAX(max.c, td.tile_c)};
+        }
+
+        if(max.r < 0)
+            continue;
+
         struct nav_chunk *chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
-        n_update_local_islands(chunk);
+        n_repair_local_islands(chunk, min, max);
+    }
+    s_nrepaired_tiles = vec_size(&s_dirty_tiles);
+    SDL_UnlockMutex(s_nav_lock);
+}
+
+/* Drop only the cached fields at the chunk that the changed tiles could affect */
+static void n_invalidate_dirty_tiles(struct nav_chunk *chunk, struct coord chunk_coord)
+{
+    struct coord tiles[FIELD_RES_R * FIELD_RES_C];
+    bool seen[FIELD_RES_R][FIELD_RES_C] = {0};
+    size_t ntiles = 0;
+
+    for(int i = 0; i < vec_size(&s_dirty_tiles); i++) {
+
+        struct tile_desc td = vec_AT(&s_dirty_tiles, i);
+        if(td.chunk_r != chunk_coord.r || td.chunk_c != chunk_coord.c)
+            continue;
+        if(seen[td.tile_r][td.tile_c])
+            continue;
+
+        seen[td.tile_r][td.tile_c] = true;
+        tiles[ntiles++] = (struct coord){td.tile_r, td.tile_c};
     }
-    s_local_islands_dirty = false;
+    N_FC_InvalidateAtTiles(chunk, chunk_coord, tiles, ntiles);
 }
 
 static void n_update_blockers(struct nav_private *priv, struct tile_desc *tds, size_t ntds, int ref_delta)
 {
+    SDL_LockMutex(s_nav_lock);
     for(int i = 0; i < ntds; i++) {
     
         struct tile_desc curr = tds[i];
@@ -826,9 +1273,10 @@ static void n_update_blockers(struct nav_private *priv, struct tile_desc *tds, s
             kh_put(coord, s_dirty_chunks, key, &ret);
             assert(ret != -1);
 
-            s_local_islands_dirty = true;
+            vec_td_push(&s_dirty_tiles, curr);
         }
     }
+    SDL_UnlockMutex(s_nav_lock);
 }
 
 static void n_update_blockers_circle(struct nav_private *priv, vec2_t xz_pos, float range, 
@@ -939,55 +1387,80 @@ done:
     return ret; 
 }
 
-static void n_build_portal_travel_index(struct nav_chunk *chunk)
+static uint16_t n_quantize_travel_cost(float cost)
 {
-    queue_cc_t frontier;
-    queue_cc_init(&frontier, 1024);
-
-    for(int pi = 0; pi < chunk->num_portals; pi++) {
-
-        bool visited[FIELD_RES_R][FIELD_RES_C] = {0};
-        assert(queue_size(frontier) == 0);
+    float fixed = cost * PORTAL_COST_SCALE + 0.5f;
+    if(fixed >= PORTAL_COST_MAX)
+        return PORTAL_COST_MAX;
+    return (uint16_t)fixed;
+}
 
-        for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
+static bool n_build_portal_travel_table(struct nav_chunk *chunk, int port_idx)
+{
+    if(!chunk->portal_travel_costs[port_idx]) {
+        chunk->portal_travel_costs[port_idx] = malloc(sizeof(uint16_t[FIELD_RES_R][FIELD_RES_C]));
+        if(!chunk->portal_travel_costs[port_idx])
+            return false;
+    }
 
-            chunk->portal_travel_costs[pi][r][c] = FLT_MAX;
-        }}
+    queue_cc_t frontier;
+    if(!queue_cc_init(&frontier, 1024))
+        return false;
 
-        const struct portal *port = &chunk->portals[pi];
-        for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
-        for(int c = port->endpoints[0].c; c <= port->endpoints[1].c; c++) {
+    uint16_t (*costs)[FIELD_RES_C] = chunk->portal_travel_costs[port_idx];
+    memset(costs, 0xff, sizeof(uint16_t[FIELD_RES_R][FIELD_RES_C]));
 
-            struct cost_coord cc = (struct cost_coord){0.0f, (struct coord){r,c}};
-            queue_cc_push(&frontier, &cc);
-            visited[r][c] = true;
-        }}
+    /* A tile's cost is set when it is first pushed to the frontier, 
+     * so the table doubles as the 'visited' set. */
+    const struct portal *port = &chunk->portals[port_idx];
+    for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
+    for(int c = port->endpoints[0].c; c <= port->endpoints[1].c; c++) {
 
-        while(queue_size(frontier) > 0) {
+        struct cost_coord cc = (struct cost_coord){0.0f, (struct coord){r,c}};
+        queue_cc_push(&frontier, &cc);
+        costs[r][c] = 0;
+    }}
 
-            struct cost_coord curr;
-            queue_cc_pop(&frontier, &curr);
+    while(queue_size(frontier) > 0) {
 
-            chunk->portal_travel_costs[pi][curr.coord.r][curr.coord.c] = curr.cost;
+        struct cost_coord curr;
+        queue_cc_pop(&frontier, &curr);
 
-            struct coord neighbours[8];
-            float costs[8];
-            int num_neighbours = N_GridNeighbours(chunk->cost_base, curr.coord, neighbours, costs);
+        struct coord neighbours[8];
+        float neighb_costs[8];
+        int num_neighbours = N_GridNeighbours(chunk->cost_base, curr.coord, neighbours, neighb_costs);
 
-            for(int i = 0; i < num_neighbours; i++) {
+        for(int i = 0; i < num_neighbours; i++) {
 
-                if(visited[neighbours[i].r][neighbours[i].c])
-                    continue;
+            if(costs[neighbours[i].r][neighbours[i].c] != PORTAL_COST_NONE)
+                continue;
 
-                struct cost_coord cc = (struct cost_coord){curr.cost + costs[i], neighbours[i]};
-                queue_cc_push(&frontier, &cc);
-                visited[neighbours[i].r][neighbours[i].c] = true;
-            }
+            struct cost_coord cc = (struct cost_coord){curr.cost + neighb_costs[i], neighbours[i]};
+            queue_cc_push(&frontier, &cc);
+            costs[neighbours[i].r][neighbours[i].c] = n_quantize_travel_cost(cc.cost);
         }
     }
 
     queue_cc_destroy(&frontier);
+    chunk->travel_costs_valid |= (((uint64_t)1) << port_idx);
+    return true;
+}
+
+static void n_build_portal_travel_tables(struct nav_chunk *chunk)
+{
+    chunk->travel_costs_valid = 0;
+
+    /* Keep the tables of existing portals around for reuse */
+    for(int i = chunk->num_portals; i < MAX_PORTALS_PER_CHUNK; i++) {
+        free(chunk->portal_travel_costs[i]);
+        chunk->portal_travel_costs[i] = NULL;
+    }
+
+    /* A portal whose table fails to get built is left with its bit 
+     * cleared and is treated as unreachable from every tile. */
+    for(int i = 0; i < chunk->num_portals; i++) {
+        n_build_portal_travel_table(chunk, i);
+    }
 }
 
 static const struct portal *n_closest_reachable_portal(const struct nav_chunk *chunk, struct coord start)
@@ -998,7 +1471,7 @@ static const struct portal *n_closest_reachable_portal(const struct nav_chunk *c
     for(int i = 0; i < chunk->num_portals; i++) {
 
         const struct portal *curr = &chunk->portals[i];
-        float cost = chunk->portal_travel_costs[i][start.r][start.c];
+        float cost = N_PortalTravelCost(chunk, i, start);
 
         if(cost < min_cost) {
             ret = curr;
@@ -1098,8 +1571,8 @@ static bool n_normally_reachable(const struct nav_chunk *chunk, struct coord a,
 {
     for(int i = 0; i < chunk->num_portals; i++) {
     
-        bool areach = (chunk->portal_travel_costs[i][a.r][a.c] != FLT_MAX);
-        bool breach = (chunk->portal_travel_costs[i][b.r][b.c] != FLT_MAX);
+        bool areach = (N_PortalTravelCost(chunk, i, a) != FLT_MAX);
+        bool breach = (N_PortalTravelCost(chunk, i, b) != FLT_MAX);
         if(areach != breach)
             return false;
     }
@@ -1143,71 +1616,735 @@ static khash_t(td) *n_moving_entities_tileset(struct nav_private *priv, vec3_t m
     return ret;
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
-
-bool N_Init(void)
+static bool n_field_solver_validate(const struct sval *new_val)
 {
-    if(!N_FC_Init())
+    if(new_val->type != ST_TYPE_INT)
         return false;
+    return (new_val->as_int >= FIELD_SOLVER_DIJKSTRA && new_val->as_int <= FIELD_SOLVER_SWEEP);
+}
 
-    if((s_dirty_chunks = kh_init(coord)) == NULL)
+static void n_field_solver_commit(const struct sval *new_val)
+{
+    /* Don't switch solvers under a field build in a path task */
+    SDL_LockMutex(s_nav_lock);
+    N_FlowFieldSetSolver(new_val->as_int);
+    SDL_UnlockMutex(s_nav_lock);
+}
+
+static bool n_flow_cache_budget_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
         return false;
+    /* Leave room for at least a handful of fields */
+    return (new_val->as_int >= 64);
+}
 
-    return true;
+static void n_flow_cache_budget_commit(const struct sval *new_val)
+{
+    N_FC_SetFlowCacheBudget((size_t)new_val->as_int * 1024);
 }
 
-void N_Update(void *nav_private)
+static bool n_bench_flow_field(const struct nav_private *priv, struct coord chunk, 
+                               struct field_target target, struct flow_field *ff, 
+                               struct nav_bench_result *out)
 {
-    PERF_ENTER();
+    uint64_t begin = SDL_GetPerformanceCounter();
+    N_FlowFieldInit(chunk, priv, ff);
+    if(!N_FlowFieldUpdate(chunk, priv, target, ff))
+        return false;
+    out->flow_ms += (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+    out->nflow++;
+
+    enum field_solver solver = N_FlowFieldGetSolver();
+    if(solver == FIELD_SOLVER_DIJKSTRA)
+        return true;
+
+    /* Validate the result against the reference solver */
+    struct flow_field ref;
+    N_FlowFieldSetSolver(FIELD_SOLVER_DIJKSTRA);
+    N_FlowFieldInit(chunk, priv, &ref);
+    bool ok = N_FlowFieldUpdate(chunk, priv, target, &ref);
+    N_FlowFieldSetSolver(solver);
+
+    if(ok && 0 != memcmp(&ff->dirs, &ref.dirs, sizeof(ref.dirs))) {
+        out->nmismatched++;
+    }
+    return ok;
+}
 
-    struct nav_private *priv = nav_private;
-    bool components_dirty = false;
+static void n_build_init(struct path_build *build, struct path_request *req, 
+                         uint32_t gen, dest_id_t dest)
+{
+    build->req = req;
+    build->gen = gen;
+    build->dest = dest;
+    vec_bff_init(&build->ffs);
+    vec_blos_init(&build->los);
+}
 
-    for(int i = kh_begin(s_dirty_chunks); i != kh_end(s_dirty_chunks); i++) {
+static void n_build_destroy(struct path_build *build)
+{
+    vec_bff_destroy(&build->ffs);
+    vec_blos_destroy(&build->los);
+}
 
-        if(!kh_exist(s_dirty_chunks, i))
-            continue;
+/* Returns false if the request has been retired in the meantime, in which 
+ * case the build must be abandoned without touching the navigation data.
+ */
+static bool n_build_step_begin(struct path_build *build)
+{
+    if(!build->req)
+        return true;
 
-        uint32_t key = kh_key(s_dirty_chunks, i);
-        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
-        N_FC_InvalidateAllAtChunk(curr);
+    SDL_LockMutex(s_nav_lock);
+    if(build->req->gen != build->gen) {
+        SDL_UnlockMutex(s_nav_lock);
+        return false;
+    }
+    return true;
+}
 
-        struct nav_chunk *chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
-        int nflipped = n_update_edge_states(chunk);
+static void n_build_step_end(struct path_build *build)
+{
+    if(!build->req)
+        return;
+    SDL_UnlockMutex(s_nav_lock);
+}
 
-        if(nflipped) {
-            components_dirty = true;
-            N_FC_InvalidateAllThroughChunk(curr);
-        }
+static const struct built_ff *n_build_local_ff(const struct path_build *build, ff_id_t id)
+{
+    for(int i = vec_size(&build->ffs) - 1; i >= 0; i--) {
+        const struct built_ff *curr = &vec_AT(&build->ffs, i);
+        if(curr->has_ff && curr->id == id)
+            return curr;
     }
+    return NULL;
+}
 
-    n_update_dirty_local_islands(priv);
-    if(components_dirty)
-        n_update_components(priv);
+static bool n_build_contains_ff(const struct path_build *build, ff_id_t id)
+{
+    return n_build_local_ff(build, id) || N_FC_ContainsFlowField(id);
+}
 
-    kh_clear(coord, s_dirty_chunks);
-    PERF_RETURN_VOID();
+static bool n_build_get_ff(const struct path_build *build, ff_id_t id, struct flow_field *out)
+{
+    const struct built_ff *local = n_build_local_ff(build, id);
+    if(local) {
+        *out = local->ff;
+        return true;
+    }
+    return N_FC_GetFlowField(id, out);
 }
 
-void N_Shutdown(void)
+static bool n_build_get_mapping(const struct path_build *build, struct coord chunk, ff_id_t *out)
 {
-    kh_destroy(coord, s_dirty_chunks);
-    N_FC_Shutdown();
+    for(int i = vec_size(&build->ffs) - 1; i >= 0; i--) {
+        const struct built_ff *curr = &vec_AT(&build->ffs, i);
+        if(curr->chunk.r == chunk.r && curr->chunk.c == chunk.c) {
+            *out = curr->id;
+            return true;
+        }
+    }
+    return N_FC_GetDestFFMapping(build->dest, chunk, out);
 }
 
-void *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
-                        const struct tile **chunk_tiles, bool update)
+/* Map the chunk to the flow field with the specified ID for this path. If 
+ * 'ff' is set, the field is also (re-)inserted into the cache. 
+ */
+static void n_build_put_mapping(struct path_build *build, struct coord chunk, 
+                                ff_id_t id, const struct flow_field *ff)
 {
-    struct nav_private *ret;
-    size_t alloc_size = sizeof(struct nav_private) + (w * h * sizeof(struct nav_chunk));
+    if(ff) {
+        N_FC_PutFlowField(id, ff);
+    }
+    N_FC_PutDestFFMapping(build->dest, chunk, id);
 
-    ret = malloc(alloc_size);
-    if(!ret)
-        goto fail_alloc;
+    if(!build->req)
+        return;
 
-    ret->width = w;
+    struct built_ff entry = (struct built_ff){
+        .chunk = chunk,
+        .id = id,
+        .has_ff = (ff != NULL)
+    };
+    if(ff) {
+        entry.ff = *ff;
+    }
+    vec_bff_push(&build->ffs, entry);
+}
+
+static bool n_build_get_los(const struct path_build *build, struct coord chunk, 
+                            struct LOS_field *out)
+{
+    for(int i = vec_size(&build->los) - 1; i >= 0; i--) {
+        const struct built_los *curr = &vec_AT(&build->los, i);
+        if(curr->chunk.r == chunk.r && curr->chunk.c == chunk.c) {
+            *out = curr->lf;
+            return true;
+        }
+    }
+    return N_FC_GetLOSField(build->dest, chunk, out);
+}
+
+static void n_build_put_los(struct path_build *build, struct coord chunk, 
+                            const struct LOS_field *lf)
+{
+    N_FC_PutLOSField(build->dest, chunk, lf);
+
+    if(!build->req)
+        return;
+    vec_blos_push(&build->los, (struct built_los){chunk, *lf});
+}
+
+/* Generate the flow and LOS fields needed to get from 'src_desc' to 'dst_desc'
+ * and add them to the field cache. 
+ */
+static enum build_result n_build_path(struct nav_private *priv, struct tile_desc src_desc, 
+                                      struct tile_desc dst_desc, vec3_t map_pos, 
+                                      struct path_build *build)
+{
+    PERF_ENTER();
+
+    dest_id_t ret = build->dest;
+    struct coord dst_chunk_coord = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
+
+    if(!n_build_step_begin(build))
+        PERF_RETURN(BUILD_CANCELLED);
+
+    /* Handle the case where no path exists between the source and destination 
+     * (i.e. they are on different 'islands'). 
+     */
+    const struct nav_chunk *src_chunk = &priv->chunks[src_desc.chunk_r * priv->width + src_desc.chunk_c];
+    const struct nav_chunk *dst_chunk = &priv->chunks[dst_desc.chunk_r * priv->width + dst_desc.chunk_c];
+    uint16_t src_iid = src_chunk->islands[src_desc.tile_r][src_desc.tile_c];
+    uint16_t dst_iid = dst_chunk->islands[dst_desc.tile_r][dst_desc.tile_c];
+
+    if(src_iid != dst_iid) {
+        n_build_step_end(build);
+        PERF_RETURN(BUILD_NOT_FOUND); 
+    }
+
+    /* Even if a mapping exists, the actual flow field may have been evicted from
+     * the cache, due to space constraints or invalidation. */
+    ff_id_t id;
+    struct flow_field ff;
+
+    if(!n_build_get_mapping(build, dst_chunk_coord, &id)
+    || !n_build_contains_ff(build, id)) {
+
+        struct field_target target = (struct field_target){
+            .type = TARGET_TILE,
+            .tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c}
+        };
+
+        id = N_FlowField_ID(dst_chunk_coord, target);
+
+        if(!n_build_contains_ff(build, id)) {
+        
+            N_FlowFieldInit(dst_chunk_coord, priv, &ff);
+            if(!N_FlowFieldUpdate(dst_chunk_coord, priv, target, &ff)) {
+                n_build_step_end(build);
+                PERF_RETURN(BUILD_NOT_FOUND);
+            }
+            n_build_put_mapping(build, dst_chunk_coord, id, &ff);
+        }else{
+            n_build_put_mapping(build, dst_chunk_coord, id, NULL);
+        }
+    }
+
+    /* Create the LOS field for the destination chunk, if necessary */
+    struct LOS_field prev_los, lf;
+    if(!n_build_get_los(build, dst_chunk_coord, &prev_los)) {
+
+        if(!N_LOSFieldCreate(ret, dst_chunk_coord, dst_desc, priv, map_pos, &prev_los, NULL)) {
+            n_build_step_end(build);
+            PERF_RETURN(BUILD_NOT_FOUND);
+        }
+        n_build_put_los(build, dst_chunk_coord, &prev_los);
+    }
+
+    /* Source and destination positions are in the same chunk, and a path exists
+     * between them. In this case, we only need a single flow field. .
+     */
+    if(src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c
+    && src_chunk->local_islands[src_desc.tile_r][src_desc.tile_c] == src_chunk->local_islands[dst_desc.tile_r][dst_desc.tile_c]) {
+
+        n_build_step_end(build);
+        PERF_RETURN(BUILD_FOUND);
+    }
+
+    /* If the source and destination are on the same chunk and, in the absence of blockers,
+     * would be reachable from one another, that means that the destination is blocked in
+     * by blockers. In this case, get as close as possible. 
+     */
+    if((src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c)
+    && n_normally_reachable(src_chunk, 
+        (struct coord){src_desc.tile_r, src_desc.tile_c},
+        (struct coord){dst_desc.tile_r, dst_desc.tile_c})) {
+        
+        n_build_step_end(build);
+        PERF_RETURN(BUILD_FOUND);
+    }
+    n_build_step_end(build);
+
+    if(!n_build_step_begin(build))
+        PERF_RETURN(BUILD_CANCELLED);
+
+    const struct portal *dst_port = n_closest_reachable_portal(dst_chunk, 
+        (struct coord){dst_desc.tile_r, dst_desc.tile_c});
+
+    if(!dst_port) {
+        n_build_step_end(build);
+        PERF_RETURN(BUILD_NOT_FOUND); 
+    }
+
+    float cost;
+    vec_portal_t path;
+    vec_portal_init(&path);
+
+    bool path_exists = AStar_PortalGraphPath(src_desc, dst_port, priv, &path, &cost);
+    n_build_step_end(build);
+
+    if(!path_exists) {
+        vec_portal_destroy(&path);
+        PERF_RETURN(BUILD_NOT_FOUND); 
+    }
+
+    struct coord prev_los_coord = dst_chunk_coord;
+
+    /* Traverse the portal path _backwards_ and generate the required fields, if they are not already 
+     * cached. Add the results to the fieldcache. */
+    for(int i = vec_size(&path)-1; i > 0; i--) {
+
+        if(!n_build_step_begin(build)) {
+            vec_portal_destroy(&path);
+            PERF_RETURN(BUILD_CANCELLED);
+        }
+
+        const struct portal *curr_node = vec_AT(&path, i - 1);
+        const struct portal *next_hop = vec_AT(&path, i);
+
+        /* If the very first hop takes us into another chunk, that means that the 'nearest portal'
+         * to the source borders the 'next' chunk already. In this case, we must remember to
+         * still generate a flow field for the current chunk steering to this portal. */
+        if(i == 1 && (next_hop->chunk.r != src_desc.chunk_r || next_hop->chunk.c != src_desc.chunk_c))
+            next_hop = vec_AT(&path, 0);
+
+        if(curr_node->connected == next_hop) {
+            n_build_step_end(build);
+            continue;
+        }
+
+        /* Since we are moving from 'closest portal' to 'closest portal', it 
+         * may be possible that the very last hop takes us from another portal in the 
+         * destination chunk to the destination portal. This is not needed and will
+         * overwrite the destination flow field made earlier. */
+        if(curr_node->chunk.r == dst_desc.chunk_r 
+        && curr_node->chunk.c == dst_desc.chunk_c
+        && next_hop == dst_port) {
+            n_build_step_end(build);
+            continue;
+        }
+
+        struct coord chunk_coord = curr_node->chunk;
+        struct field_target target = (struct field_target){
+            .type = TARGET_PORTAL,
+            .port = next_hop
+        };
+
+        ff_id_t new_id = N_FlowField_ID(chunk_coord, target);
+        ff_id_t exist_id;
+
+        if(n_build_get_mapping(build, chunk_coord, &exist_id)
+        && n_build_contains_ff(build, exist_id)) {
+
+            /* The exact flow field we need has already been made */
+            if(new_id == exist_id)
+                goto ff_exists;
+
+            /* This is the edge case when a path to a particular target takes us through
+             * the same chunk more than once. This can happen if a chunk is divided into
+             * 'islands' by unpathable barriers. */
+            if(n_build_get_ff(build, exist_id, &ff)) {
+
+                if(!N_FlowFieldUpdate(chunk_coord, priv, target, &ff))
+                    goto fail;
+                /* We set the updated flow field for the new (least recently used) key. Since in 
+                 * this case more than one flowfield ID maps to the same field but we only keep 
+                 * one of the IDs, it may be possible that the same flowfield will be redundantly 
+                 * updated at a later time. However, this is largely inconsequential. */
+                n_build_put_mapping(build, chunk_coord, new_id, &ff);
+                goto ff_exists;
+            }
+        }
+
+        if(!n_build_contains_ff(build, new_id)) {
+        
+            N_FlowFieldInit(chunk_coord, priv, &ff);
+            if(!N_FlowFieldUpdate(chunk_coord, priv, target, &ff))
+                goto fail;
+            n_build_put_mapping(build, chunk_coord, new_id, &ff);
+        }else{
+            n_build_put_mapping(build, chunk_coord, new_id, NULL);
+        }
+
+    ff_exists:
+        /* Reference field in the cache */
+        if(!build->req) {
+            struct flow_dirs dirs;
+            bool exists = N_FC_GetFlowDirs(new_id, &dirs);
+            assert(exists);
+            (void)exists;
+        }
+
+        if(!n_build_get_los(build, chunk_coord, &lf)) {
+
+            assert((abs(prev_los_coord.r - chunk_coord.r) + abs(prev_los_coord.c - chunk_coord.c)) == 1);
+            assert(prev_los.chunk.r == prev_los_coord.r && prev_los.chunk.c == prev_los_coord.c);
+
+            if(!N_LOSFieldCreate(ret, chunk_coord, dst_desc, priv, map_pos, &lf, &prev_los))
+                goto fail;
+            n_build_put_los(build, chunk_coord, &lf);
+        }
+
+        prev_los = lf;
+        prev_los_coord = chunk_coord;
+        n_build_step_end(build);
+    }
+    vec_portal_destroy(&path);
+
+    PERF_RETURN(BUILD_FOUND);
+
+fail:
+    n_build_step_end(build);
+    vec_portal_destroy(&path);
+    PERF_RETURN(BUILD_NOT_FOUND);
+}
+
+static struct result n_path_task(void *arg)
+{
+    uint32_t idx = ((uintptr_t)arg) & 0xffffffff;
+    uint32_t gen = ((uintptr_t)arg) >> 32;
+    struct path_request *req = &s_requests[idx];
+
+    SDL_LockMutex(s_nav_lock);
+    if(req->gen != gen) {
+        SDL_UnlockMutex(s_nav_lock);
+        return NULL_RESULT;
+    }
+    struct nav_private *priv = req->priv;
+    struct tile_desc src = req->src;
+    struct tile_desc dst = req->dst;
+    vec3_t map_pos = req->map_pos;
+    SDL_UnlockMutex(s_nav_lock);
+
+    struct path_build build;
+    n_build_init(&build, req, gen, n_dest_id(dst));
+    enum build_result result = n_build_path(priv, src, dst, map_pos, &build);
+    n_build_destroy(&build);
+
+    SDL_LockMutex(s_nav_lock);
+    if(result != BUILD_CANCELLED && req->gen == gen) {
+        req->state = REQ_DONE;
+        req->found = (result == BUILD_FOUND);
+    }
+    SDL_UnlockMutex(s_nav_lock);
+
+    return NULL_RESULT;
+}
+
+static uint64_t n_request_key(dest_id_t dest, struct tile_desc src, uint16_t local_iid)
+{
+    return (((uint64_t)dest) << 32)
+         | (((uint64_t)src.chunk_r & 0xff) << 24)
+         | (((uint64_t)src.chunk_c & 0xff) << 16)
+         | (((uint64_t)local_iid));
+}
+
+static void n_retire_request(int idx)
+{
+    struct path_request *req = &s_requests[idx];
+
+    SDL_LockMutex(s_nav_lock);
+    req->gen++;
+    req->state = REQ_FREE;
+    SDL_UnlockMutex(s_nav_lock);
+
+    khiter_t k = kh_get(req, s_request_table, req->key);
+    assert(k != kh_end(s_request_table));
+    kh_del(req, s_request_table, k);
+
+    assert(s_nfree_requests < MAX_PATH_REQUESTS);
+    s_free_requests[s_nfree_requests++] = idx;
+}
+
+static void n_retire_requests(bool pending_only)
+{
+    uint64_t key;
+    int idx;
+    (void)key;
+
+    SDL_LockMutex(s_nav_lock);
+    kh_foreach(s_request_table, key, idx, {
+        if(!pending_only || s_requests[idx].state == REQ_PENDING)
+            n_retire_request(idx);
+    });
+    SDL_UnlockMutex(s_nav_lock);
+}
+
+static void n_retire_stale_requests(void)
+{
+    uint64_t key;
+    int idx;
+    (void)key;
+
+    kh_foreach(s_request_table, key, idx, {
+        if(g_frame_idx - s_requests[idx].last_used > PATH_REQUEST_TTL)
+            n_retire_request(idx);
+    });
+}
+
+/* Returns a rough direction towards the destination, to be followed while the
+ * fields for the path are still being built. Outside of the destination chunk, 
+ * this leads to the portal that appears to be the most promising, based on the
+ * cost of reaching it and its' straight-line distance to the destination.
+ */
+static vec2_t n_coarse_seek_dir(const struct nav_private *priv, struct tile_desc tile, 
+                                struct tile_desc dst)
+{
+    const struct nav_chunk *chunk = &priv->chunks[IDX(tile.chunk_r, priv->width, tile.chunk_c)];
+    struct coord curr = (struct coord){
+        tile.chunk_r * FIELD_RES_R + tile.tile_r,
+        tile.chunk_c * FIELD_RES_C + tile.tile_c
+    };
+    struct coord target = (struct coord){
+        dst.chunk_r * FIELD_RES_R + dst.tile_r,
+        dst.chunk_c * FIELD_RES_C + dst.tile_c
+    };
+
+    if(tile.chunk_r != dst.chunk_r || tile.chunk_c != dst.chunk_c) {
+
+        float min_cost = FLT_MAX;
+        struct coord best = curr;
+
+        for(int i = 0; i < chunk->num_portals; i++) {
+
+            float travel_cost = N_PortalTravelCost(chunk, i, (struct coord){tile.tile_r, tile.tile_c});
+            if(travel_cost == FLT_MAX)
+                continue;
+
+            const struct portal *port = &chunk->portals[i];
+            struct coord center = (struct coord){
+                tile.chunk_r * FIELD_RES_R + (port->endpoints[0].r + port->endpoints[1].r) / 2,
+                tile.chunk_c * FIELD_RES_C + (port->endpoints[0].c + port->endpoints[1].c) / 2
+            };
+            float dr = target.r - center.r;
+            float dc = target.c - center.c;
+            float cost = travel_cost + sqrtf(dr * dr + dc * dc);
+
+            if(cost < min_cost) {
+                min_cost = cost;
+                best = center;
+            }
+        }
+        target = best;
+    }
+
+    if(target.r == curr.r && target.c == curr.c)
+        return (vec2_t){0.0f};
+
+    /* Tile rows increase along the +Z axis and columns along the -X axis */
+    vec2_t ret = (vec2_t){ -(target.c - curr.c), (target.r - curr.r) };
+    PFM_Vec2_Normal(&ret, &ret);
+    return ret;
+}
+
+/* Mark the chunks in the set and, if 'neighbours' is set, the chunks that 
+ * share a border with them */
+static void n_chunk_mask(const struct nav_private *priv, khash_t(coord) *set, 
+                         bool neighbours, bool *out)
+{
+    memset(out, 0, priv->width * priv->height * sizeof(bool));
+
+    for(int i = kh_begin(set); i != kh_end(set); i++) {
+
+        if(!kh_exist(set, i))
+            continue;
+
+        uint32_t key = kh_key(set, i);
+        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
+        out[IDX(curr.r, priv->width, curr.c)] = true;
+
+        if(!neighbours)
+            continue;
+        if(curr.r > 0)                out[IDX(curr.r - 1, priv->width, curr.c)] = true;
+        if(curr.r < priv->height - 1) out[IDX(curr.r + 1, priv->width, curr.c)] = true;
+        if(curr.c > 0)                out[IDX(curr.r, priv->width, curr.c - 1)] = true;
+        if(curr.c < priv->width - 1)  out[IDX(curr.r, priv->width, curr.c + 1)] = true;
+    }
+}
+
+/* Only the chunks set in 'relink' (or all of them, if it's NULL) get their 
+ * portals linked anew. The portals along the borders between the other chunks 
+ * get re-created the same and in the same order, so their links to one another 
+ * are carried over instead of being searched for again. 
+ */
+static void n_rebuild_portals(struct nav_private *priv, const bool *relink)
+{
+    size_t nchunks = priv->width * priv->height;
+    size_t nsaved = 0;
+
+    for(int i = 0; relink && i < nchunks; i++) {
+        if(!relink[i])
+            nsaved += priv->chunks[i].num_portals;
+    }
+
+    struct portal *saved = malloc(nsaved * sizeof(struct portal));
+    if(nsaved && !saved)
+        relink = NULL;
+
+    struct portal *cursor = saved;
+    for(int i = 0; relink && i < nchunks; i++) {
+
+        const struct nav_chunk *curr_chunk = &priv->chunks[i];
+        if(relink[i])
+            continue;
+        memcpy(cursor, curr_chunk->portals, curr_chunk->num_portals * sizeof(struct portal));
+        cursor += curr_chunk->num_portals;
+    }
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
+            
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        curr_chunk->num_portals = 0;
+    }}
+    
+    n_create_portals(priv);
+
+    cursor = saved;
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
+            
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        if(!relink || relink[IDX(chunk_r, priv->width, chunk_c)]) {
+            n_link_chunk_portals(curr_chunk, (struct coord){chunk_r, chunk_c});
+            n_build_portal_travel_tables(curr_chunk);
+            continue;
+        }
+
+        for(int i = 0; i < curr_chunk->num_portals; i++) {
+
+            struct portal *port = &curr_chunk->portals[i];
+            const struct portal *prev = cursor++;
+            assert(!memcmp(port->endpoints, prev->endpoints, sizeof(port->endpoints)));
+
+            port->num_neighbours = prev->num_neighbours;
+            memcpy(port->edges, prev->edges, prev->num_neighbours * sizeof(struct edge));
+        }
+    }}
+    assert(cursor == saved + (relink ? nsaved : 0));
+    free(saved);
+}
+
+/* Only the islands which had tiles in the chunks set in 'changed' (or all of 
+ * them, if it's NULL) get flooded anew. */
+static void n_rebuild_islands(struct nav_private *priv, const bool *changed)
+{
+    /* We assign a unique ID to each set of tiles that are mutually connected
+     * (i.e. are on the same 'island'). The tile's 'island ID' can then be 
+     * queried from the 'islands' field using the coordinate. 
+     * To build the field, we treat every tile in the cost field as a node in
+     * a graph, with cardinally adjacent pathable tiles being the 'neighbors'. 
+     * Then we solve an instance of the 'coonected components' problem. 
+     */
+
+    /* Cutting out objects can only ever split islands apart, so the islands 
+     * without tiles in the changed chunks are kept as they are. The IDs of 
+     * the stale islands are reused first and the rest of the new islands get 
+     * IDs past all of the old ones. */
+    uint64_t stale[(ISLAND_NONE + 1) / 64] = {0};
+    int max_id = -1;
+
+    for(int i = 0; changed && i < priv->width * priv->height; i++) {
+
+        if(!changed[i])
+            continue;
+
+        const struct nav_chunk *curr_chunk = &priv->chunks[i];
+        for(int tile_r = 0; tile_r < FIELD_RES_R; tile_r++) {
+        for(int tile_c = 0; tile_c < FIELD_RES_C; tile_c++) {
+
+            uint16_t id = curr_chunk->islands[tile_r][tile_c];
+            if(id != ISLAND_NONE)
+                stale[id / 64] |= ((uint64_t)1 << (id % 64));
+        }}
+    }
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+
+        /* Initialize every (stale) node as 'unvisited' */
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        if(!changed) {
+            memset(curr_chunk->islands, 0xff, sizeof(curr_chunk->islands));
+            continue;
+        }
+
+        for(int tile_r = 0; tile_r < FIELD_RES_R; tile_r++) {
+        for(int tile_c = 0; tile_c < FIELD_RES_C; tile_c++) {
+
+            uint16_t id = curr_chunk->islands[tile_r][tile_c];
+            if(id == ISLAND_NONE)
+                continue;
+            max_id = MAX(max_id, id);
+            if(stale[id / 64] & ((uint64_t)1 << (id % 64)))
+                curr_chunk->islands[tile_r][tile_c] = ISLAND_NONE;
+        }}
+    }}
+
+    int reuse_id = 0;
+    uint16_t island_id = max_id + 1;
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+
+        for(int tile_r = 0; tile_r < FIELD_RES_R; tile_r++) {
+        for(int tile_c = 0; tile_c < FIELD_RES_C; tile_c++) {
+
+            if(curr_chunk->islands[tile_r][tile_c] != ISLAND_NONE)
+                continue;
+
+            if(curr_chunk->cost_base[tile_r][tile_c] == COST_IMPASSABLE)
+                continue;
+
+            while(reuse_id < ISLAND_NONE && !(stale[reuse_id / 64] & ((uint64_t)1 << (reuse_id % 64))))
+                reuse_id++;
+
+            struct tile_desc td = {chunk_r, chunk_c, tile_r, tile_c};
+            if(reuse_id < ISLAND_NONE) {
+                n_visit_island(priv, reuse_id++, td);
+            }else{
+                n_visit_island(priv, island_id++, td);
+            }
+        }}
+    }}
+}
+
+/* Builds navigation data that is not yet visible to any path requests */
+static struct nav_private *n_build_private(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
+                                           const struct tile **chunk_tiles, bool update)
+{
+    struct nav_private *ret;
+    size_t alloc_size = sizeof(struct nav_private) + (w * h * sizeof(struct nav_chunk));
+
+    ret = malloc(alloc_size);
+    if(!ret)
+        goto fail_alloc;
+
+    ret->width = w;
     ret->height = h;
 
     assert(FIELD_RES_R >= chunk_h && FIELD_RES_R % chunk_h == 0);
@@ -1220,6 +2357,8 @@ void *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
         struct nav_chunk *curr_chunk = &ret->chunks[IDX(chunk_r, ret->width, chunk_c)];
         const struct tile *curr_tiles = chunk_tiles[IDX(chunk_r, ret->width, chunk_c)];
         curr_chunk->num_portals = 0;
+        curr_chunk->travel_costs_valid = 0;
+        memset(curr_chunk->portal_travel_costs, 0, sizeof(curr_chunk->portal_travel_costs));
 
         for(int tile_r = 0; tile_r < chunk_h; tile_r++) {
         for(int tile_c = 0; tile_c < chunk_w; tile_c++) {
@@ -1234,19 +2373,456 @@ void *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
         memset(curr_chunk->blockers, 0, sizeof(curr_chunk->blockers));
     }}
 
-    n_make_cliff_edges(ret, chunk_tiles, chunk_w, chunk_h);
-    N_UpdatePortals(ret);
-    N_UpdateIslandsField(ret);
+    n_make_cliff_edges(ret, chunk_tiles, chunk_w, chunk_h);
+
+    for(int i = 0; i < ret->width * ret->height; i++) {
+        n_update_local_islands(&ret->chunks[i]);
+    }
+    n_rebuild_portals(ret, NULL);
+    n_rebuild_islands(ret, NULL);
+    return ret;
+
+fail_alloc:
+    return NULL;
+}
+
+static void n_free_private(struct nav_private *priv)
+{
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        for(int j = 0; j < MAX_PORTALS_PER_CHUNK; j++)
+            free(priv->chunks[i].portal_travel_costs[j]);
+    }
+    free(priv);
+}
+
+static bool n_baked_read(const unsigned char **cursor, const unsigned char *end, 
+                         void *out, size_t size)
+{
+    if((size_t)(end - *cursor) < size)
+        return false;
+
+    /* The data is not necessarily aligned - copy it out */
+    memcpy(out, *cursor, size);
+    *cursor += size;
+    return true;
+}
+
+static bool n_baked_read_chunk(struct nav_private *priv, struct coord coord,
+                               const unsigned char **cursor, const unsigned char *end)
+{
+    struct nav_chunk *chunk = &priv->chunks[IDX(coord.r, priv->width, coord.c)];
+    size_t nchunks = priv->width * priv->height;
+
+    /* Read the fields straight into the chunk */
+    uint32_t num_portals;
+    if(!n_baked_read(cursor, end, &num_portals, sizeof(num_portals)))
+        return false;
+    if(num_portals > MAX_PORTALS_PER_CHUNK)
+        return false;
+    chunk->num_portals = num_portals;
+
+    if(!n_baked_read(cursor, end, chunk->cost_base, sizeof(chunk->cost_base)))
+        return false;
+    if(!n_baked_read(cursor, end, chunk->islands, sizeof(chunk->islands)))
+        return false;
+    if(!n_baked_read(cursor, end, chunk->local_islands, sizeof(chunk->local_islands)))
+        return false;
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        struct baked_portal bport;
+        if(!n_baked_read(cursor, end, &bport, sizeof(bport)))
+            return false;
+        if(bport.num_neighbours >= MAX_PORTALS_PER_CHUNK)
+            return false;
+        if(bport.connected >= nchunks * MAX_PORTALS_PER_CHUNK)
+            return false;
+
+        struct portal *port = &chunk->portals[i];
+        port->component_id = bport.component_id;
+        port->chunk = coord;
+        port->endpoints[0] = (struct coord){bport.endpoints[0][0], bport.endpoints[0][1]};
+        port->endpoints[1] = (struct coord){bport.endpoints[1][0], bport.endpoints[1][1]};
+        port->num_neighbours = bport.num_neighbours;
+        port->connected = &priv->chunks[bport.connected / MAX_PORTALS_PER_CHUNK]
+                          .portals[bport.connected % MAX_PORTALS_PER_CHUNK];
+
+        for(int j = 0; j < 2; j++) {
+            if(port->endpoints[j].r < 0 || port->endpoints[j].r >= FIELD_RES_R)
+                return false;
+            if(port->endpoints[j].c < 0 || port->endpoints[j].c >= FIELD_RES_C)
+                return false;
+        }
+
+        for(int j = 0; j < port->num_neighbours; j++) {
+
+            struct baked_edge bedge;
+            if(!n_baked_read(cursor, end, &bedge, sizeof(bedge)))
+                return false;
+            if(bedge.neighbour >= chunk->num_portals)
+                return false;
+            if(bedge.es != EDGE_STATE_ACTIVE && bedge.es != EDGE_STATE_BLOCKED)
+                return false;
+
+            port->edges[j] = (struct edge){
+                .es = bedge.es,
+                .neighbour = &chunk->portals[bedge.neighbour],
+                .cost = bedge.cost
+            };
+        }
+    }
+    return true;
+}
+
+/* The links between portals of different chunks can only be checked once 
+ * all the chunks have been read */
+static bool n_baked_links_valid(struct nav_private *priv)
+{
+    struct portal *port;
+    FOREACH_PORTAL(priv, port, {
+
+        size_t chunk_idx = ((const char*)port->connected - (const char*)priv->chunks) 
+                         / sizeof(struct nav_chunk);
+        const struct nav_chunk *conn_chunk = &priv->chunks[chunk_idx];
+
+        if(port->connected - conn_chunk->portals >= conn_chunk->num_portals)
+            return false;
+        if(port->connected->connected != port)
+            return false;
+    });
+    return true;
+}
+
+static bool n_baked_write_chunk(const struct nav_private *priv, const struct nav_chunk *chunk,
+                                SDL_RWops *stream)
+{
+    uint32_t num_portals = chunk->num_portals;
+    if(!SDL_RWwrite(stream, &num_portals, sizeof(num_portals), 1))
+        return false;
+    if(!SDL_RWwrite(stream, chunk->cost_base, sizeof(chunk->cost_base), 1))
+        return false;
+    if(!SDL_RWwrite(stream, chunk->islands, sizeof(chunk->islands), 1))
+        return false;
+    if(!SDL_RWwrite(stream, chunk->local_islands, sizeof(chunk->local_islands), 1))
+        return false;
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        const struct nav_chunk *conn_chunk = &priv->chunks[
+            IDX(port->connected->chunk.r, priv->width, port->connected->chunk.c)];
+
+        struct baked_portal bport = {0};
+        bport.component_id = port->component_id;
+        bport.endpoints[0][0] = port->endpoints[0].r;
+        bport.endpoints[0][1] = port->endpoints[0].c;
+        bport.endpoints[1][0] = port->endpoints[1].r;
+        bport.endpoints[1][1] = port->endpoints[1].c;
+        bport.connected = (conn_chunk - priv->chunks) * MAX_PORTALS_PER_CHUNK
+                        + (port->connected - conn_chunk->portals);
+        bport.num_neighbours = port->num_neighbours;
+
+        if(!SDL_RWwrite(stream, &bport, sizeof(bport), 1))
+            return false;
+
+        for(int j = 0; j < port->num_neighbours; j++) {
+
+            struct baked_edge bedge = {0};
+            bedge.neighbour = port->edges[j].neighbour - chunk->portals;
+            bedge.es = port->edges[j].es;
+            bedge.cost = port->edges[j].cost;
+
+            if(!SDL_RWwrite(stream, &bedge, sizeof(bedge), 1))
+                return false;
+        }
+    }
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool N_Init(void)
+{
+    if(!N_FC_Init())
+        goto fail_fc;
+
+    if((s_dirty_chunks = kh_init(coord)) == NULL)
+        goto fail_dirty_chunks;
+
+    if((s_cutout_portal_chunks = kh_init(coord)) == NULL)
+        goto fail_cutout_portal_chunks;
+
+    if((s_cutout_island_chunks = kh_init(coord)) == NULL)
+        goto fail_cutout_island_chunks;
+
+    if((s_request_table = kh_init(req)) == NULL)
+        goto fail_request_table;
+
+    if((s_nav_lock = SDL_CreateMutex()) == NULL)
+        goto fail_lock;
+
+    vec_td_init(&s_dirty_tiles);
+    s_nrepaired_tiles = 0;
+
+    for(int i = 0; i < MAX_PATH_REQUESTS; i++) {
+        s_free_requests[i] = MAX_PATH_REQUESTS - i - 1;
+    }
+    s_nfree_requests = MAX_PATH_REQUESTS;
+
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.game.flow_field_solver",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = FIELD_SOLVER_SWEEP
+        },
+        .prio = 0,
+        .validate = n_field_solver_validate,
+        .commit = n_field_solver_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval setting;
+    status = Settings_Get("pf.game.flow_field_solver", &setting);
+    assert(status == SS_OKAY);
+    n_field_solver_commit(&setting);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.flow_field_cache_budget_kb",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_FLOW_CACHE_BUDGET / 1024
+        },
+        .prio = 0,
+        .validate = n_flow_cache_budget_validate,
+        .commit = n_flow_cache_budget_commit,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Get("pf.game.flow_field_cache_budget_kb", &setting);
+    assert(status == SS_OKAY);
+    n_flow_cache_budget_commit(&setting);
+    return true;
+
+fail_lock:
+    kh_destroy(req, s_request_table);
+fail_request_table:
+    kh_destroy(coord, s_cutout_island_chunks);
+fail_cutout_island_chunks:
+    kh_destroy(coord, s_cutout_portal_chunks);
+fail_cutout_portal_chunks:
+    kh_destroy(coord, s_dirty_chunks);
+fail_dirty_chunks:
+    N_FC_Shutdown();
+fail_fc:
+    return false;
+}
+
+void N_Update(void *nav_private)
+{
+    PERF_ENTER();
+
+    struct nav_private *priv = nav_private;
+    bool edges_dirty = false;
+    bool components_split = false;
+
+    /* Paths that are no longer being followed don't need to be kept up */
+    n_retire_stale_requests();
+
+    SDL_LockMutex(s_nav_lock);
+    /* The edge states are derived from the local islands */
+    n_update_dirty_local_islands(priv);
+
+    for(int i = kh_begin(s_dirty_chunks); i != kh_end(s_dirty_chunks); i++) {
+
+        if(!kh_exist(s_dirty_chunks, i))
+            continue;
+
+        uint32_t key = kh_key(s_dirty_chunks, i);
+        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
+        struct nav_chunk *chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
+
+        n_invalidate_dirty_tiles(chunk, curr);
+        int nflipped = n_update_edge_states(priv, chunk, &components_split);
+
+        if(nflipped) {
+            edges_dirty = true;
+            N_FC_InvalidateAllThroughChunk(curr);
+        }
+    }
+
+    if(components_split) {
+        n_update_components(priv);
+    }
+    if(edges_dirty) {
+        /* The in-flight requests may be routing through portals that 
+         * have just been blocked off */
+        n_retire_requests(true);
+    }
+
+    kh_clear(coord, s_dirty_chunks);
+    vec_td_reset(&s_dirty_tiles);
+    s_nrepaired_tiles = 0;
+    SDL_UnlockMutex(s_nav_lock);
+    PERF_RETURN_VOID();
+}
+
+void N_Shutdown(void)
+{
+    n_retire_requests(false);
+    SDL_DestroyMutex(s_nav_lock);
+    kh_destroy(req, s_request_table);
+    kh_destroy(coord, s_dirty_chunks);
+    kh_destroy(coord, s_cutout_portal_chunks);
+    kh_destroy(coord, s_cutout_island_chunks);
+    vec_td_destroy(&s_dirty_tiles);
+    N_FC_Shutdown();
+}
+
+void *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
+                        const struct tile **chunk_tiles, bool update)
+{
+    struct nav_private *ret = n_build_private(w, h, chunk_w, chunk_h, chunk_tiles, update);
+    if(!ret)
+        return NULL;
+
+    N_FC_ClearPortalRoutes();
+    return ret;
+}
+
+size_t N_BakedHeaderSize(void)
+{
+    return sizeof(struct baked_nav_hdr);
+}
+
+size_t N_BakedCheckHeader(size_t w, size_t h, uint64_t tiles_checksum, const void *data)
+{
+    struct baked_nav_hdr hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if(memcmp(hdr.magic, BAKED_NAV_MAGIC, sizeof(hdr.magic))
+    || hdr.version != BAKED_NAV_VERSION
+    || hdr.field_res_r != FIELD_RES_R
+    || hdr.field_res_c != FIELD_RES_C
+    || hdr.max_portals != MAX_PORTALS_PER_CHUNK
+    || hdr.width != w
+    || hdr.height != h
+    || hdr.tiles_checksum != tiles_checksum)
+        return 0;
+
+    const struct nav_chunk *chunk = NULL;
+    size_t max_chunk_size = sizeof(uint32_t)
+                          + sizeof(chunk->cost_base)
+                          + sizeof(chunk->islands)
+                          + sizeof(chunk->local_islands)
+                          + MAX_PORTALS_PER_CHUNK * (sizeof(struct baked_portal)
+                          + MAX_PORTALS_PER_CHUNK * sizeof(struct baked_edge));
+    return sizeof(hdr) + w * h * max_chunk_size;
+}
+
+void *N_BuildFromBaked(size_t w, size_t h, uint64_t tiles_checksum, 
+                       const void *data, size_t size)
+{
+    const unsigned char *cursor = data;
+    const unsigned char *end = cursor + size;
+
+    if(size < sizeof(struct baked_nav_hdr)
+    || size > N_BakedCheckHeader(w, h, tiles_checksum, data))
+        goto fail_hdr;
+    cursor += sizeof(struct baked_nav_hdr);
+
+    struct nav_private *ret;
+    size_t alloc_size = sizeof(struct nav_private) + (w * h * sizeof(struct nav_chunk));
+
+    ret = malloc(alloc_size);
+    if(!ret)
+        goto fail_alloc;
+
+    ret->width = w;
+    ret->height = h;
+
+    for(int chunk_r = 0; chunk_r < ret->height; chunk_r++){
+    for(int chunk_c = 0; chunk_c < ret->width;  chunk_c++){
+
+        struct nav_chunk *curr_chunk = &ret->chunks[IDX(chunk_r, ret->width, chunk_c)];
+        curr_chunk->travel_costs_valid = 0;
+        memset(curr_chunk->portal_travel_costs, 0, sizeof(curr_chunk->portal_travel_costs));
+        memset(curr_chunk->blockers, 0, sizeof(curr_chunk->blockers));
+
+        if(!n_baked_read_chunk(ret, (struct coord){chunk_r, chunk_c}, &cursor, end))
+            goto fail_read;
+    }}
+
+    if(cursor != end || !n_baked_links_valid(ret))
+        goto fail_read;
+
+    for(int i = 0; i < ret->width * ret->height; i++) {
+        n_build_portal_travel_tables(&ret->chunks[i]);
+    }
+
+    N_FC_ClearPortalRoutes();
     return ret;
 
+fail_read:
+    free(ret);
 fail_alloc:
+fail_hdr:
     return NULL;
 }
 
+bool N_WriteBaked(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
+                  const struct tile **chunk_tiles, uint64_t tiles_checksum, 
+                  SDL_RWops *stream)
+{
+    bool ret = false;
+
+    /* The live navigation data can't be written out as-is, since the blockers
+     * and static object cutouts in it would get baked in as permanent terrain.
+     * Build a private copy from just the tiles instead. */
+    struct nav_private *priv = n_build_private(w, h, chunk_w, chunk_h, chunk_tiles, true);
+    if(!priv)
+        goto fail_build;
+
+    struct baked_nav_hdr hdr = {0};
+    memcpy(hdr.magic, BAKED_NAV_MAGIC, sizeof(hdr.magic));
+    hdr.version = BAKED_NAV_VERSION;
+    hdr.field_res_r = FIELD_RES_R;
+    hdr.field_res_c = FIELD_RES_C;
+    hdr.max_portals = MAX_PORTALS_PER_CHUNK;
+    hdr.width = priv->width;
+    hdr.height = priv->height;
+    hdr.tiles_checksum = tiles_checksum;
+
+    if(!SDL_RWwrite(stream, &hdr, sizeof(hdr), 1))
+        goto out;
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++){
+
+        const struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        if(!n_baked_write_chunk(priv, curr_chunk, stream))
+            goto out;
+    }}
+    ret = true;
+
+out:
+    n_free_private(priv);
+fail_build:
+    return ret;
+}
+
 void N_FreePrivate(void *nav_private)
 {
     assert(nav_private);
-    free(nav_private);
+
+    /* Make sure no task will touch the navigation data from this point on */
+    n_retire_requests(false);
+    N_FC_ClearPortalRoutes();
+
+    kh_clear(coord, s_cutout_portal_chunks);
+    kh_clear(coord, s_cutout_island_chunks);
+    n_free_private(nav_private);
 }
 
 void N_RenderPathableChunk(void *nav_private, mat4x4_t *chunk_model,
@@ -1320,9 +2896,10 @@ void N_RenderPathFlowField(void *nav_private, const struct map *map,
     ff_id_t field_id;
     if(!N_FC_GetDestFFMapping(id, (struct coord){chunk_r, chunk_c}, &field_id))
         return;
-    const struct flow_field *ff = N_FC_FlowFieldAt(field_id);
-    if(!ff)
+    struct flow_dirs dirs;
+    if(!N_FC_GetFlowDirs(field_id, &dirs))
         return;
+    const struct flow_dirs *ff = &dirs;
 
     for(int r = 0; r < FIELD_RES_R; r++) {
     for(int c = 0; c < FIELD_RES_C; c++) {
@@ -1336,7 +2913,7 @@ void N_RenderPathFlowField(void *nav_private, const struct map *map,
             square_x - square_x_len / 2.0f,
             square_z + square_z_len / 2.0f
         };
-        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[ff->field[r][c].dir_idx];
+        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[N_FlowDir(ff, r, c)];
     }}
 
     size_t count = FIELD_RES_R * FIELD_RES_C;
@@ -1439,9 +3016,10 @@ void N_RenderEnemySeekField(void *nav_private, const struct map *map,
     if(!N_FC_ContainsFlowField(ffid))
         return;
 
-    const struct flow_field *ff = N_FC_FlowFieldAt(ffid);
-    if(!ff)
+    struct flow_dirs dirs;
+    if(!N_FC_GetFlowDirs(ffid, &dirs))
         return;
+    const struct flow_dirs *ff = &dirs;
 
     for(int r = 0; r < FIELD_RES_R; r++) {
     for(int c = 0; c < FIELD_RES_C; c++) {
@@ -1455,15 +3033,15 @@ void N_RenderEnemySeekField(void *nav_private, const struct map *map,
             square_x - square_x_len / 2.0f,
             square_z + square_z_len / 2.0f
         };
-        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[ff->field[r][c].dir_idx];
+        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[N_FlowDir(ff, r, c)];
 
         *corners_base++ = (vec2_t){square_x, square_z};
         *corners_base++ = (vec2_t){square_x, square_z + square_z_len};
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z + square_z_len};
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
 
-        *colors_base++ = ff->field[r][c].dir_idx == FD_NONE ? (vec3_t){1.0f, 0.0f, 0.0f}
-                                                            : (vec3_t){0.0f, 1.0f, 0.0f};
+        *colors_base++ = N_FlowDir(ff, r, c) == FD_NONE ? (vec3_t){1.0f, 0.0f, 0.0f}
+                                                        : (vec3_t){0.0f, 1.0f, 0.0f};
     }}
 
     assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
@@ -1676,75 +3254,59 @@ void N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *o
     struct tile_desc tds[4096];
     size_t ntiles = M_Tile_AllUnderObj(map_pos, res, obb, tds, ARR_SIZE(tds));
 
+    SDL_LockMutex(s_nav_lock);
     for(int i = 0; i < ntiles; i++) {
 
-        priv->chunks[IDX(tds[i].chunk_r, priv->width, tds[i].chunk_c)]
-            .cost_base[tds[i].tile_r][tds[i].tile_c] = COST_IMPASSABLE;
+        struct nav_chunk *chunk = &priv->chunks[IDX(tds[i].chunk_r, priv->width, tds[i].chunk_c)];
+        chunk->cost_base[tds[i].tile_r][tds[i].tile_c] = COST_IMPASSABLE;
+
+        int ret;
+        uint64_t key = ((tds[i].chunk_r & 0xffff) << 16) | (tds[i].chunk_c & 0xffff);
+        kh_put(coord, s_cutout_portal_chunks, key, &ret);
+        assert(ret != -1);
+        kh_put(coord, s_cutout_island_chunks, key, &ret);
+        assert(ret != -1);
     }
+    SDL_UnlockMutex(s_nav_lock);
 }
 
 void N_UpdatePortals(void *nav_private)
 {
     struct nav_private *priv = nav_private;
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        curr_chunk->num_portals = 0;
-    }}
-    
-    n_create_portals(priv);
+    bool relink[priv->width * priv->height];
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        n_link_chunk_portals(curr_chunk, (struct coord){chunk_r, chunk_c});
-        n_build_portal_travel_index(curr_chunk);
-    }}
+    SDL_LockMutex(s_nav_lock);
+    n_retire_requests(true);
+
+    /* The cost fields only change where objects have been cut out, and that 
+     * only affects the portals of the chunk and the ones bordering it */
+    n_chunk_mask(priv, s_cutout_portal_chunks, true, relink);
+    n_rebuild_portals(priv, relink);
+    kh_clear(coord, s_cutout_portal_chunks);
+
+    N_FC_ClearPortalRoutes();
+    SDL_UnlockMutex(s_nav_lock);
 }
 
 void N_UpdateIslandsField(void *nav_private)
 {
-    /* We assign a unique ID to each set of tiles that are mutually connected
-     * (i.e. are on the same 'island'). The tile's 'island ID' can then be 
-     * queried from the 'islands' field using the coordinate. 
-     * To build the field, we treat every tile in the cost field as a node in
-     * a graph, with cardinally adjacent pathable tiles being the 'neighbors'. 
-     * Then we solve an instance of the 'coonected components' problem. 
-     */
-
     struct nav_private *priv = nav_private;
-    uint16_t island_id = 0;
-
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
-    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
-
-        /* Initialize every node as 'unvisited' */
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        memset(curr_chunk->islands, 0xff, sizeof(curr_chunk->islands));
-    }}
-
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
-    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
 
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-
-        for(int tile_r = 0; tile_r < FIELD_RES_R; tile_r++) {
-        for(int tile_c = 0; tile_c < FIELD_RES_C; tile_c++) {
+    bool changed[priv->width * priv->height];
 
-            if(curr_chunk->islands[tile_r][tile_c] != ISLAND_NONE)
-                continue;
+    SDL_LockMutex(s_nav_lock);
+    n_retire_requests(true);
 
-            if(curr_chunk->cost_base[tile_r][tile_c] == COST_IMPASSABLE)
-                continue;
+    n_chunk_mask(priv, s_cutout_island_chunks, false, changed);
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        if(changed[i])
+            n_update_local_islands(&priv->chunks[i]);
+    }
+    n_rebuild_islands(priv, changed);
+    kh_clear(coord, s_cutout_island_chunks);
 
-            struct tile_desc td = {chunk_r, chunk_c, tile_r, tile_c};
-            n_visit_island(priv, island_id, td);
-            island_id++;
-        }}
-    }}
+    SDL_UnlockMutex(s_nav_lock);
 }
 
 dest_id_t N_DestIDForPos(void *nav_private, vec3_t map_pos, vec2_t xz_pos)
@@ -1787,183 +3349,118 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
 
     dest_id_t ret = n_dest_id(dst_desc);
 
-    /* Handle the case where no path exists between the source and destination 
-     * (i.e. they are on different 'islands'). 
-     */
-    const struct nav_chunk *src_chunk = &priv->chunks[src_desc.chunk_r * priv->width + src_desc.chunk_c];
-    const struct nav_chunk *dst_chunk = &priv->chunks[dst_desc.chunk_r * priv->width + dst_desc.chunk_c];
-    uint16_t src_iid = src_chunk->islands[src_desc.tile_r][src_desc.tile_c];
-    uint16_t dst_iid = dst_chunk->islands[dst_desc.tile_r][dst_desc.tile_c];
-
-    if(src_iid != dst_iid)
-        PERF_RETURN(false); 
-
-    /* Even if a mapping exists, the actual flow field may have been evicted from
-     * the cache, due to space constraints or invalidation. */
-    ff_id_t id;
-    if(!N_FC_GetDestFFMapping(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &id)
-    || !N_FC_ContainsFlowField(id)) {
-
-        struct field_target target = (struct field_target){
-            .type = TARGET_TILE,
-            .tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c}
-        };
-
-        struct flow_field ff;
-        id = N_FlowField_ID((struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, target);
-
-        if(!N_FC_ContainsFlowField(id)) {
-        
-            struct coord chunk = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
-            N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, target, &ff);
-            N_FC_PutFlowField(id, &ff);
-        }
-
-        N_FC_PutDestFFMapping(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, id);
-    }
-
-    /* Create the LOS field for the destination chunk, if necessary */
-    if(!N_FC_ContainsLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c})) {
-
-        struct LOS_field lf;
-        N_LOSFieldCreate(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, dst_desc, priv, map_pos, &lf, NULL);
-        N_FC_PutLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &lf);
-    }
-
-    /* Source and destination positions are in the same chunk, and a path exists
-     * between them. In this case, we only need a single flow field. .
-     */
-    if(src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c
-    && src_chunk->local_islands[src_desc.tile_r][src_desc.tile_c] == src_chunk->local_islands[dst_desc.tile_r][dst_desc.tile_c]) {
-
-        *out_dest_id = ret;
-        PERF_RETURN(true);
-    }
-
-    /* If the source and destination are on the same chunk and, in the absence of blockers,
-     * would be reachable from one another, that means that the destination is blocked in
-     * by blockers. In this case, get as close as possible. 
-     */
-    if((src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c)
-    && n_normally_reachable(src_chunk, 
-        (struct coord){src_desc.tile_r, src_desc.tile_c},
-        (struct coord){dst_desc.tile_r, dst_desc.tile_c})) {
-        
-        *out_dest_id = ret;
-        PERF_RETURN(true);
-    }
-
-    const struct portal *dst_port = n_closest_reachable_portal(dst_chunk, 
-        (struct coord){dst_desc.tile_r, dst_desc.tile_c});
-
-    if(!dst_port)
-        PERF_RETURN(false); 
-
-    float cost;
-    vec_portal_t path;
-    vec_portal_init(&path);
+    struct path_build build;
+    n_build_init(&build, NULL, 0, ret);
+    enum build_result status = n_build_path(priv, src_desc, dst_desc, map_pos, &build);
+    n_build_destroy(&build);
 
-    bool path_exists = AStar_PortalGraphPath(src_desc, dst_port, priv, &path, &cost);
-    if(!path_exists) {
-        vec_portal_destroy(&path);
-        PERF_RETURN(false); 
-    }
+    if(status != BUILD_FOUND)
+        PERF_RETURN(false);
 
-    struct coord prev_los_coord = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
+    *out_dest_id = ret; 
+    PERF_RETURN(true);
+}
 
-    /* Traverse the portal path _backwards_ and generate the required fields, if they are not already 
-     * cached. Add the results to the fieldcache. */
-    for(int i = vec_size(&path)-1; i > 0; i--) {
+enum path_status N_RequestPathAsync(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                                    vec3_t map_pos, dest_id_t *out_dest_id)
+{
+    ASSERT_IN_MAIN_THREAD();
+    PERF_ENTER();
 
-        const struct portal *curr_node = vec_AT(&path, i - 1);
-        const struct portal *next_hop = vec_AT(&path, i);
+    struct nav_private *priv = nav_private;
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
 
-        /* If the very first hop takes us into another chunk, that means that the 'nearest portal'
-         * to the source borders the 'next' chunk already. In this case, we must remember to
-         * still generate a flow field for the current chunk steering to this portal. */
-        if(i == 1 && (next_hop->chunk.r != src_desc.chunk_r || next_hop->chunk.c != src_desc.chunk_c))
-            next_hop = vec_AT(&path, 0);
+    n_update_dirty_local_islands(nav_private);
 
-        if(curr_node->connected == next_hop)
-            continue;
+    bool result;
+    (void)result;
 
-        /* Since we are moving from 'closest portal' to 'closest portal', it 
-         * may be possible that the very last hop takes us from another portal in the 
-         * destination chunk to the destination portal. This is not needed and will
-         * overwrite the destination flow field made earlier. */
-        if(curr_node->chunk.r == dst_desc.chunk_r 
-        && curr_node->chunk.c == dst_desc.chunk_c
-        && next_hop == dst_port)
-            continue;
+    struct tile_desc src_desc, dst_desc;
+    result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc);
+    assert(result);
+    result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_desc);
+    assert(result);
 
-        struct coord chunk_coord = curr_node->chunk;
-        struct field_target target = (struct field_target){
-            .type = TARGET_PORTAL,
-            .port = next_hop
-        };
+    dest_id_t ret = n_dest_id(dst_desc);
+    *out_dest_id = ret;
 
-        ff_id_t new_id = N_FlowField_ID(chunk_coord, target);
-        ff_id_t exist_id;
-        struct flow_field ff;
+    const struct nav_chunk *src_chunk = &priv->chunks[IDX(src_desc.chunk_r, priv->width, src_desc.chunk_c)];
+    const struct nav_chunk *dst_chunk = &priv->chunks[IDX(dst_desc.chunk_r, priv->width, dst_desc.chunk_c)];
 
-        if(N_FC_GetDestFFMapping(ret, chunk_coord, &exist_id)
-        && N_FC_ContainsFlowField(exist_id)) {
+    if(src_chunk->islands[src_desc.tile_r][src_desc.tile_c] 
+    != dst_chunk->islands[dst_desc.tile_r][dst_desc.tile_c])
+        PERF_RETURN(PATH_UNREACHABLE);
 
-            /* The exact flow field we need has already been made */
-            if(new_id == exist_id)
-                goto ff_exists;
+    uint64_t key = n_request_key(ret, src_desc, 
+        src_chunk->local_islands[src_desc.tile_r][src_desc.tile_c]);
 
-            /* This is the edge case when a path to a particular target takes us through
-             * the same chunk more than once. This can happen if a chunk is divided into
-             * 'islands' by unpathable barriers. */
-            const struct flow_field *exist_ff  = N_FC_FlowFieldAt(exist_id);
-            memcpy(&ff, exist_ff, sizeof(struct flow_field));
-
-            N_FlowFieldUpdate(chunk_coord, priv, target, &ff);
-            /* We set the updated flow field for the new (least recently used) key. Since in 
-             * this case more than one flowfield ID maps to the same field but we only keep 
-             * one of the IDs, it may be possible that the same flowfield will be redundantly 
-             * updated at a later time. However, this is largely inconsequential. */
-            N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
-            N_FC_PutFlowField(new_id, &ff);
-
-            goto ff_exists;
-        }
+    khiter_t k = kh_get(req, s_request_table, key);
+    if(k != kh_end(s_request_table)) {
 
-        N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
-        if(!N_FC_ContainsFlowField(new_id)) {
-        
-            N_FlowFieldInit(chunk_coord, priv, &ff);
-            N_FlowFieldUpdate(chunk_coord, priv, target, &ff);
-            N_FC_PutFlowField(new_id, &ff);
-        }
+        int idx = kh_val(s_request_table, k);
+        struct path_request *req = &s_requests[idx];
+        req->last_used = g_frame_idx;
 
-    ff_exists:
-        assert(N_FC_ContainsFlowField(new_id));
-        /* Reference field in the cache */
-        (void)N_FC_FlowFieldAt(new_id);
+        SDL_LockMutex(s_nav_lock);
+        enum req_state state = req->state;
+        bool found = req->found;
+        SDL_UnlockMutex(s_nav_lock);
 
-        if(!N_FC_ContainsLOSField(ret, chunk_coord)) {
+        if(state == REQ_PENDING)
+            PERF_RETURN(PATH_PENDING);
+        if(!found)
+            PERF_RETURN(PATH_UNREACHABLE);
 
-            assert((abs(prev_los_coord.r - chunk_coord.r) + abs(prev_los_coord.c - chunk_coord.c)) == 1);
-            assert(N_FC_ContainsLOSField(ret, prev_los_coord));
+        /* The fields may have been evicted or invalidated since the request 
+         * was completed. In that case, the request must be issued again. */
+        ff_id_t ffid;
+        N_FC_CommitPending();
+        if(N_FC_GetDestFFMapping(ret, (struct coord){src_desc.chunk_r, src_desc.chunk_c}, &ffid)
+        && N_FC_ContainsFlowField(ffid))
+            PERF_RETURN(PATH_READY);
 
-            const struct LOS_field *prev_los = N_FC_LOSFieldAt(ret, prev_los_coord);
-            assert(prev_los);
-            assert(prev_los->chunk.r == prev_los_coord.r && prev_los->chunk.c == prev_los_coord.c);
+        n_retire_request(idx);
+    }
 
-            struct LOS_field lf;
-            N_LOSFieldCreate(ret, chunk_coord, dst_desc, priv, map_pos, &lf, prev_los);
-            N_FC_PutLOSField(ret, chunk_coord, &lf);
-        }
+    if(s_nfree_requests == 0) {
+        bool found = N_RequestPath(nav_private, xz_src, xz_dest, map_pos, out_dest_id);
+        PERF_RETURN(found ? PATH_READY : PATH_UNREACHABLE);
+    }
 
-        prev_los_coord = chunk_coord;
+    int idx = s_free_requests[--s_nfree_requests];
+    struct path_request *req = &s_requests[idx];
+
+    SDL_LockMutex(s_nav_lock);
+    assert(req->state == REQ_FREE);
+    req->state = REQ_PENDING;
+    req->found = false;
+    req->priv = priv;
+    req->map_pos = map_pos;
+    req->src = src_desc;
+    req->dst = dst_desc;
+    uint32_t gen = req->gen;
+    SDL_UnlockMutex(s_nav_lock);
+
+    req->key = key;
+    req->last_used = g_frame_idx;
+
+    int status;
+    k = kh_put(req, s_request_table, key, &status);
+    assert(status != -1 && status != 0);
+    kh_val(s_request_table, k) = idx;
+
+    uint64_t arg = (((uint64_t)gen) << 32) | idx;
+    if(NULL_TID == Sched_Create(0, n_path_task, (void*)((uintptr_t)arg), NULL, TASK_BIG_STACK)) {
+
+        n_retire_request(idx);
+        bool found = N_RequestPath(nav_private, xz_src, xz_dest, map_pos, out_dest_id);
+        PERF_RETURN(found ? PATH_READY : PATH_UNREACHABLE);
     }
-    vec_portal_destroy(&path);
 
-    *out_dest_id = ret; 
-    PERF_RETURN(true);
+    PERF_RETURN(PATH_PENDING);
 }
 
 vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
@@ -1977,34 +3474,45 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
         FIELD_RES_C, FIELD_RES_R
     };
 
-    struct tile_desc tile;
+    struct tile_desc tile, dst_tile;
     bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
     assert(result);
 
     ff_id_t ffid;
-    if(!N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid)) {
-
-        dest_id_t ret;
-        bool result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
-        if(!result)
-            return (vec2_t){0.0f};
-        assert(ret == id);
-        N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid);
+    struct flow_dirs dirs;
+    const struct flow_dirs *ff = NULL;
+    if(N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid)
+    && N_FC_GetFlowDirs(ffid, &dirs)) {
+        ff = &dirs;
     }
 
-    const struct flow_field *ff = N_FC_FlowFieldAt(ffid);
-    if(!ff || ff->field[tile.tile_r][tile.tile_c].dir_idx == FD_NONE) {
+    /* The fields for this chunk are either missing or don't lead anywhere from 
+     * the current tile. Request a path starting at the current position. The 
+     * fields are built in the background, so until they are ready, just head 
+     * in the general direction of the destination. 
+     */
+    if(!ff || N_FlowDir(ff, tile.tile_r, tile.tile_c) == FD_NONE) {
 
         dest_id_t ret;
-        bool result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
-        if(!result)
+        switch(N_RequestPathAsync(nav_private, curr_pos, xz_dest, map_pos, &ret)) {
+        case PATH_UNREACHABLE:
             return (vec2_t){0.0f};
+        case PATH_PENDING:
+            result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_tile);
+            assert(result);
+            return n_coarse_seek_dir(priv, tile, dst_tile);
+        case PATH_READY:
+            break;
+        }
         assert(ret == id);
-        N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid);
+
+        if(!N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid))
+            return (vec2_t){0.0f};
     }
 
-    ff = N_FC_FlowFieldAt(ffid);
-    assert(ff);
+    if(!N_FC_GetFlowDirs(ffid, &dirs))
+        return (vec2_t){0.0f};
+    ff = &dirs;
 
     /*   1. The original path took us through another global 'island' in
      *      this chunk which is separated from the current tile's island 
@@ -2012,7 +3520,7 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
      *      would have updated the flow field with a valid direction for
      *      the current tile.
      */
-    if(ff->field[tile.tile_r][tile.tile_c].dir_idx != FD_NONE)
+    if(N_FlowDir(ff, tile.tile_r, tile.tile_c) != FD_NONE)
         goto ff_found;
 
     const struct nav_chunk *chunk = &priv->chunks[IDX(tile.chunk_r, priv->width, tile.chunk_c)];
@@ -2025,10 +3533,13 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
      */
     if(local_iid == ISLAND_NONE) {
 
-        struct flow_field exist_ff = *ff;
-        N_FlowFieldUpdateToNearestPathable(chunk, (struct coord){tile.tile_r, tile.tile_c}, &exist_ff);
-        N_FC_PutFlowField(ffid, &exist_ff);
-        ff = N_FC_FlowFieldAt(ffid);
+        struct flow_field exist_ff;
+        result = N_FC_GetFlowField(ffid, &exist_ff);
+        assert(result);
+        if(N_FlowFieldUpdateToNearestPathable(chunk, (struct coord){tile.tile_r, tile.tile_c}, &exist_ff)) {
+            N_FC_PutFlowField(ffid, &exist_ff);
+            dirs = exist_ff.dirs;
+        }
         goto ff_found;
     }
 
@@ -2038,8 +3549,11 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
      *      the frontier was prevented from advancing from the destination
      *      due to blockers).
      */
-    struct flow_field exist_ff = *ff;
-    N_FlowFieldUpdateIslandToNearest(local_iid, priv, &exist_ff);
+    struct flow_field exist_ff;
+    result = N_FC_GetFlowField(ffid, &exist_ff);
+    assert(result);
+    if(!N_FlowFieldUpdateIslandToNearest(local_iid, priv, &exist_ff))
+        goto ff_found;
     N_FC_PutFlowField(ffid, &exist_ff);
 
     /*   4. If the direction is still FD_NONE, that means that the
@@ -2047,11 +3561,11 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
      *      We have nothing left to do but pass the 'None' direction
      *      to the caller.
      */
-    ff = N_FC_FlowFieldAt(ffid);
+    ff = &exist_ff.dirs;
 
 ff_found:
     assert(ff);
-    dir_idx = ff->field[tile.tile_r][tile.tile_c].dir_idx;
+    dir_idx = N_FlowDir(ff, tile.tile_r, tile.tile_c);
     return g_flow_dir_lookup[dir_idx];
 }
 
@@ -2101,7 +3615,8 @@ vec2_t N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map
         && target_tile.chunk_c == curr_tile.chunk_c) {
         
             N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, target, &ff);
+            if(!N_FlowFieldUpdate(chunk, priv, target, &ff))
+                return (vec2_t){0.0f, 0.0f};
             N_FC_PutFlowField(ffid, &ff);
             done = true;
         }
@@ -2118,7 +3633,8 @@ vec2_t N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map
             };
 
             N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, pm_target, &ff);
+            if(!N_FlowFieldUpdate(chunk, priv, pm_target, &ff))
+                return (vec2_t){0.0f, 0.0f};
             N_FC_PutFlowField(ffid, &ff);
             done = true;
         }
@@ -2157,29 +3673,35 @@ vec2_t N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map
             };
 
             N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, portal_target, &ff);
-            N_FC_PutFlowField(ffid, &ff);
-
+            bool built = N_FlowFieldUpdate(chunk, priv, portal_target, &ff);
             vec_portal_destroy(&path);
+
+            if(!built)
+                return (vec2_t){0.0f, 0.0f};
+            N_FC_PutFlowField(ffid, &ff);
         }
 
         assert(N_FC_ContainsFlowField(ffid));
     }
 
-    const struct flow_field *pff = N_FC_FlowFieldAt(ffid);
-    assert(pff);
+    struct flow_dirs dirs;
+    bool exists = N_FC_GetFlowDirs(ffid, &dirs);
+    assert(exists);
+    (void)exists;
 
-    int dir_idx = pff->field[curr_tile.tile_r][curr_tile.tile_c].dir_idx;
+    int dir_idx = N_FlowDir(&dirs, curr_tile.tile_r, curr_tile.tile_c);
     if(dir_idx == FD_NONE) {
 
         const struct nav_chunk *nchunk = &priv->chunks[IDX(curr_tile.chunk_r, priv->width, curr_tile.chunk_c)];
         uint16_t local_iid = nchunk->local_islands[curr_tile.tile_r][curr_tile.tile_c];
 
-        struct flow_field exist_ff = *pff;
-        N_FlowFieldUpdateIslandToNearest(local_iid, priv, &exist_ff);
-        N_FC_PutFlowField(ffid, &exist_ff);
-
-        dir_idx = exist_ff.field[curr_tile.tile_r][curr_tile.tile_c].dir_idx;
+        struct flow_field exist_ff;
+        result = N_FC_GetFlowField(ffid, &exist_ff);
+        assert(result);
+        if(N_FlowFieldUpdateIslandToNearest(local_iid, priv, &exist_ff)) {
+            N_FC_PutFlowField(ffid, &exist_ff);
+            dir_idx = N_FlowDir(&exist_ff.dirs, curr_tile.tile_r, curr_tile.tile_c);
+        }
     }
 
     return g_flow_dir_lookup[dir_idx];
@@ -2372,6 +3894,22 @@ bool N_PortalReachableFromTile(const struct portal *port, struct coord tile, con
     return false;
 }
 
+float N_PortalTravelCost(const struct nav_chunk *chunk, int port_idx, struct coord tile)
+{
+    assert(port_idx >= 0 && port_idx < chunk->num_portals);
+
+    /* The tables are only ever written along with the portals themselves, 
+     * so they can be read without taking the navigation lock, same as the 
+     * portals. */
+    if(!(chunk->travel_costs_valid & (((uint64_t)1) << port_idx)))
+        return FLT_MAX;
+
+    uint16_t cost = chunk->portal_travel_costs[port_idx][tile.r][tile.c];
+    if(cost == PORTAL_COST_NONE)
+        return FLT_MAX;
+    return ((float)cost) / PORTAL_COST_SCALE;
+}
+
 int N_GridNeighbours(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord coord, 
                      struct coord out_neighbours[static 8], float out_costs[static 8])
 {
@@ -2538,3 +4076,86 @@ out:
     return ret;
 }
 
+bool N_BenchFields(void *nav_private, vec3_t map_pos, size_t niters, 
+                   struct nav_bench_result *out)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    struct nav_private *priv = nav_private;
+    struct flow_field *ff = malloc(sizeof(struct flow_field));
+    struct LOS_field *lf = malloc(sizeof(struct LOS_field));
+    if(!ff || !lf) {
+        free(ff);
+        free(lf);
+        return false;
+    }
+
+    memset(out, 0, sizeof(*out));
+    uint32_t seed = 0x1234567;
+
+    /* Keep path tasks from touching the navigation data for the duration */
+    SDL_LockMutex(s_nav_lock);
+
+    for(int i = 0; i < niters; i++) {
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        struct coord chunk_coord = (struct coord){chunk_r, chunk_c};
+
+        for(int j = 0; j < chunk->num_portals; j++) {
+
+            struct field_target target = (struct field_target){
+                .type = TARGET_PORTAL,
+                .port = &chunk->portals[j]
+            };
+
+            if(!n_bench_flow_field(priv, chunk_coord, target, ff, out))
+                goto fail;
+        }
+
+        /* Pick a pseudo-random pathable tile as the destination */
+        seed = seed * 1664525u + 1013904223u;
+        int start = (seed >> 8) % (FIELD_RES_R * FIELD_RES_C);
+        int tile = -1;
+
+        for(int j = 0; j < FIELD_RES_R * FIELD_RES_C; j++) {
+            int curr = (start + j) % (FIELD_RES_R * FIELD_RES_C);
+            if(chunk->cost_base[curr / FIELD_RES_C][curr % FIELD_RES_C] != COST_IMPASSABLE) {
+                tile = curr;
+                break;
+            }
+        }
+        if(tile == -1)
+            continue;
+
+        struct tile_desc dst_desc = (struct tile_desc){
+            chunk_r, chunk_c, 
+            tile / FIELD_RES_C, tile % FIELD_RES_C
+        };
+        struct field_target target = (struct field_target){
+            .type = TARGET_TILE,
+            .tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c}
+        };
+
+        if(!n_bench_flow_field(priv, chunk_coord, target, ff, out))
+            goto fail;
+
+        uint64_t begin = SDL_GetPerformanceCounter();
+        if(!N_LOSFieldCreate(n_dest_id(dst_desc), chunk_coord, dst_desc, priv, map_pos, lf, NULL))
+            goto fail;
+        out->los_ms += (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+        out->nlos++;
+    }}}
+
+    SDL_UnlockMutex(s_nav_lock);
+    free(ff);
+    free(lf);
+    return true;
+
+fail:
+    SDL_UnlockMutex(s_nav_lock);
+    free(ff);
+    free(lf);
+    return false;
+}
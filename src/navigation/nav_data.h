@@ -44,6 +44,11 @@
 #define FIELD_RES_C           64
 #define COST_IMPASSABLE       0xff
 #define ISLAND_NONE           0xffff
+/* Portal travel costs are stored in fixed-point, in units of 
+ * 1/PORTAL_COST_SCALE of a tile traversal. */
+#define PORTAL_COST_SCALE     8
+#define PORTAL_COST_MAX       0xfffe
+#define PORTAL_COST_NONE      0xffff
 
 struct coord{
     int r, c;
@@ -82,11 +87,14 @@ struct nav_chunk{
      * cost may never be reached.
      */
     uint8_t         cost_base[FIELD_RES_R][FIELD_RES_C]; 
-    /* Holds the cost to travel from every tile to every portal,
-     * when the portal is reachable from the tile. This field is 
-     * synchronized with the 'cost_base' field.
+    /* Holds the cost to travel from every tile to a portal, or
+     * 'PORTAL_COST_NONE' when the portal is not reachable from the 
+     * tile. The tables are computed whenever the chunk's portals
+     * are (re)linked. A set bit in the 'travel_costs_valid' mask 
+     * means the portal's table has been successfully built.
      */
-    float           portal_travel_costs[MAX_PORTALS_PER_CHUNK][FIELD_RES_R][FIELD_RES_C];
+    uint64_t        travel_costs_valid;
+    uint16_t      (*portal_travel_costs[MAX_PORTALS_PER_CHUNK])[FIELD_RES_C];
     /* Every tile in the 'blockers' holds a reference count for
      * how many stationary entities are currently 'retaining' that 
      * tile by being positioned on it. 'Blocked' tiles are treated 
@@ -50,6 +50,9 @@ struct nav_private{
 bool N_PortalReachableFromTile(const struct portal *port, struct coord tile, 
                                const struct nav_chunk *chunk);
 
+/* Returns FLT_MAX if the portal is not reachable from the tile */
+float N_PortalTravelCost(const struct nav_chunk *chunk, int port_idx, struct coord tile);
+
 int  N_GridNeighbours(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord coord, 
                       struct coord out_neighbours[static 8], float out_costs[static 8]);
 
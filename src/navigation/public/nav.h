@@ -45,9 +45,16 @@ struct map;
 struct obb;
 struct entity;
 struct map_resolution;
+struct SDL_RWops;
 
 typedef uint32_t dest_id_t;
 
+enum path_status{
+    PATH_PENDING,
+    PATH_READY,
+    PATH_UNREACHABLE,
+};
+
 struct fc_stats{
     unsigned los_used;
     unsigned los_max;
@@ -57,12 +64,34 @@ struct fc_stats{
     unsigned flow_max;
     float    flow_hit_rate;
     unsigned flow_invalidated;
+    unsigned flow_hits;
+    unsigned flow_misses;
+    unsigned flow_evicted;
+    /* Number of fields stored by referencing identical cached directions */
+    unsigned flow_shared;
+    unsigned flow_unique;
+    size_t   flow_bytes_used;
+    size_t   flow_bytes_max;
     unsigned ffid_used;
     unsigned ffid_max;
     float    ffid_hit_rate;
     unsigned grid_path_used;
     unsigned grid_path_max;
     float    grid_path_hit_rate;
+    unsigned route_used;
+    unsigned route_max;
+    float    route_hit_rate;
+    unsigned route_invalidated;
+};
+
+struct nav_bench_result{
+    size_t nflow;
+    double flow_ms;
+    size_t nlos;
+    double los_ms;
+    /* Number of flow fields that differ from the ones built with
+     * the reference (Dijkstra) solver */
+    size_t nmismatched;
 };
 
 #define DEST_ID_INVALID (~((uint32_t)0))
@@ -100,7 +129,39 @@ void     *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
                             const struct tile **chunk_tiles, bool update);
 
 /* ------------------------------------------------------------------------
- * Clean up resources allocated by 'N_BuildForMapData'.
+ * Restore a navigation context from the data written by 'N_WriteBaked',
+ * skipping the rebuild. Returns NULL if the data is malformed, has been 
+ * written by an incompatible build or for tiles with a different checksum. 
+ * The caller should then fall back to 'N_BuildForMapData'.
+ * ------------------------------------------------------------------------
+ */
+void     *N_BuildFromBaked(size_t w, size_t h, uint64_t tiles_checksum, 
+                           const void *data, size_t size);
+
+/* ------------------------------------------------------------------------
+ * Check the leading 'N_BakedHeaderSize()' bytes of baked navigation data
+ * before the rest of it is read in. Returns the largest size that the data
+ * for a map with these dimensions can take up, or 0 if the data has been 
+ * written by an incompatible build or for tiles with a different checksum.
+ * ------------------------------------------------------------------------
+ */
+size_t    N_BakedHeaderSize(void);
+size_t    N_BakedCheckHeader(size_t w, size_t h, uint64_t tiles_checksum, const void *data);
+
+/* ------------------------------------------------------------------------
+ * Build the cost fields, portal graph and islands for the tiles alone (not
+ * taking into account any blockers or static object cutouts) and write them
+ * in a binary form that can be loaded with 'N_BuildFromBaked'. The arguments
+ * are the same as for 'N_BuildForMapData'. 'tiles_checksum' identifies the 
+ * tiles that the navigation data has been built for.
+ * ------------------------------------------------------------------------
+ */
+bool      N_WriteBaked(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
+                       const struct tile **chunk_tiles, uint64_t tiles_checksum, 
+                       struct SDL_RWops *stream);
+
+/* ------------------------------------------------------------------------
+ * Clean up resources allocated by 'N_BuildForMapData' or 'N_BuildFromBaked'.
  * ------------------------------------------------------------------------
  */
 void      N_FreePrivate(void *nav_private);
@@ -179,14 +240,18 @@ void      N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct o
 /* ------------------------------------------------------------------------
  * Update portals and the links between them after there have been 
  * changes to the cost field, as new obstructions could have closed off 
- * paths or removed obstructions could have opened up new ones.
+ * paths or removed obstructions could have opened up new ones. Only the
+ * chunks that have had objects cut out of them since the last update, and
+ * the chunks bordering them, get their portals linked anew.
  * ------------------------------------------------------------------------
  */
 void      N_UpdatePortals(void *nav_private);
 
 /* ------------------------------------------------------------------------
  * Update the islands (sets of tiles which are reachable from one another)
- * information after there have been changes to the cost field.
+ * information after there have been changes to the cost field. Only the 
+ * islands touching the chunks that have had objects cut out of them since 
+ * the last update are rebuilt.
  * ------------------------------------------------------------------------
  */
 void      N_UpdateIslandsField(void *nav_private);
@@ -208,6 +273,17 @@ dest_id_t N_DestIDForPos(void *nav_private, vec3_t map_pos, vec2_t xz_pos);
 bool      N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
                         vec3_t map_pos, dest_id_t *out_dest_id);
 
+/* ------------------------------------------------------------------------
+ * Asynchronous version of 'N_RequestPath'. The first call for a particular 
+ * source and destination submits a task to build the path and its' fields 
+ * on the scheduler workers. Subsequent calls for the same source chunk and
+ * destination return the status of the outstanding request, until the
+ * fields are ready. May only be called from the main thread.
+ * ------------------------------------------------------------------------
+ */
+enum path_status N_RequestPathAsync(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                                    vec3_t map_pos, dest_id_t *out_dest_id);
+
 /* ------------------------------------------------------------------------
  * Returns the desired velocity for an entity at 'curr_pos' for it to flow
  * towards a particular destination.
@@ -295,6 +371,17 @@ void      N_GetResolution(void *nav_private, struct map_resolution *out);
  */
 bool      N_ObjectBuildable(void *nav_private, vec3_t map_pos, const struct obb *obb);
 
+/* ------------------------------------------------------------------------
+ * Repeatedly builds uncached flow fields (towards every portal and towards 
+ * a tile of every chunk) and LOS fields 'niters' times, and reports the 
+ * number of fields built and the time spent building them. When a solver
+ * other than the reference one is selected, every flow field is also 
+ * checked against the reference solver's output.
+ * ------------------------------------------------------------------------
+ */
+bool      N_BenchFields(void *nav_private, vec3_t map_pos, size_t niters, 
+                        struct nav_bench_result *out);
+
 /*###########################################################################*/
 /* NAV FIELD CACHE                                                           */
 /*###########################################################################*/
@@ -536,34 +536,15 @@ static struct tex_desc batch_tdesc_for_tid(struct gl_batch *batch, GLuint tid)
     return kh_value(batch->tid_desc_map, k);
 }
 
-static bool batch_chunk_compare(struct tile_desc a, struct tile_desc b)
-{
-    uint32_t ia = batch_td_key(a);
-    uint32_t ib = batch_td_key(b);
-    return ia > ib;
-}
-
-/* Sort the 'ents' array in-place by the chunk coordinate of the entities. Fill
- * 'out' with a list of descriptors about what subrange of the sorted array 
- * corresponds to which chunk */
-static size_t batch_sort_by_chunk(vec_rstat_t *ents, struct chunk_batch_desc *out, size_t maxout)
+/* The draw lists are sorted by R_DrawSortKey, which places all the entities of
+ * a chunk (and all the instances of a model within it) next to each other. Fill 
+ * 'out' with a list of descriptors about what subrange of the array corresponds 
+ * to which chunk. */
+static size_t batch_group_by_chunk(const vec_rstat_t *ents, struct chunk_batch_desc *out, size_t maxout)
 {
     if(vec_size(ents) == 0)
         return 0;
 
-    int i = 1;
-    while(i < vec_size(ents)) {
-        int j = i;
-        while(j > 0 && batch_chunk_compare(vec_AT(ents, j - 1).td, vec_AT(ents, j).td)) {
-
-            struct ent_stat_rstate tmp = vec_AT(ents, j - 1);
-            vec_AT(ents, j - 1) = vec_AT(ents, j);
-            vec_AT(ents, j) = tmp;
-            j--;
-        }
-        i++;
-    }
-
     size_t ret = 0;
 
     struct chunk_batch_desc curr = (struct chunk_batch_desc){
@@ -576,37 +557,27 @@ static size_t batch_sort_by_chunk(vec_rstat_t *ents, struct chunk_batch_desc *ou
         if(batch_td_key(vec_AT(ents, i - 1).td) != batch_td_key(vec_AT(ents, i).td)) {
             curr.end_idx = i - 1;
             out[ret++] = curr;
+            if(ret == maxout)
+                return ret;
             curr = (struct chunk_batch_desc){
                 .chunk_r = vec_AT(ents, i).td.chunk_r,
                 .chunk_c = vec_AT(ents, i).td.chunk_c,
                 .start_idx = i,
             };
         }
-        if(ret == maxout)
-            break;
     }
 
-    curr.end_idx = i - 1;
+    curr.end_idx = vec_size(ents) - 1;
     out[ret++] = curr;
 
     return ret;
 }
 
-static size_t batch_sort_by_inst_stat(struct ent_stat_rstate *ents, size_t nents, 
+static size_t batch_group_by_inst_stat(const struct ent_stat_rstate *ents, size_t nents, 
                                       struct inst_group_desc *out, size_t maxout)
 {
-    int i = 1;
-    while(i < nents) {
-        int j = i;
-        while(j > 0 && ((uintptr_t)ents[j - 1].render_private) > ((uintptr_t)ents[j].render_private)) {
-
-            struct ent_stat_rstate tmp = ents[j - 1];
-            ents[j - 1] = ents[j];
-            ents[j] = tmp;
-            j--;
-        }
-        i++;
-    }
+    if(nents == 0)
+        return 0;
 
     size_t ret = 0;
 
@@ -616,40 +587,30 @@ static size_t batch_sort_by_inst_stat(struct ent_stat_rstate *ents, size_t nents
     };
     for(int i = 1; i < nents; i++) {
     
-        if(((uintptr_t)ents[i - 1].render_private) != ((uintptr_t)ents[i].render_private)) {
+        if(ents[i - 1].render_private != ents[i].render_private) {
 
             curr.end_idx = i - 1;
             out[ret++] = curr;
+            if(ret == maxout)
+                return ret;
             curr = (struct inst_group_desc){
                 .render_private = ents[i].render_private,
                 .start_idx = i,
             };
         }
-        if(ret == maxout)
-            break;
     }
 
-    curr.end_idx = i - 1;
+    curr.end_idx = nents - 1;
     out[ret++] = curr;
 
     return ret;
 }
 
-static size_t batch_sort_by_inst_anim(struct ent_anim_rstate *ents, size_t nents, 
+static size_t batch_group_by_inst_anim(const struct ent_anim_rstate *ents, size_t nents, 
                                       struct inst_group_desc *out, size_t maxout)
 {
-    int i = 1;
-    while(i < nents) {
-        int j = i;
-        while(j > 0 && ((uintptr_t)ents[j - 1].render_private) > ((uintptr_t)ents[j].render_private)) {
-
-            struct ent_anim_rstate tmp = ents[j - 1];
-            ents[j - 1] = ents[j];
-            ents[j] = tmp;
-            j--;
-        }
-        i++;
-    }
+    if(nents == 0)
+        return 0;
 
     size_t ret = 0;
 
@@ -659,20 +620,20 @@ static size_t batch_sort_by_inst_anim(struct ent_anim_rstate *ents, size_t nents
     };
     for(int i = 1; i < nents; i++) {
     
-        if(((uintptr_t)ents[i - 1].render_private) != ((uintptr_t)ents[i].render_private)) {
+        if(ents[i - 1].render_private != ents[i].render_private) {
 
             curr.end_idx = i - 1;
             out[ret++] = curr;
+            if(ret == maxout)
+                return ret;
             curr = (struct inst_group_desc){
                 .render_private = ents[i].render_private,
                 .start_idx = i,
             };
         }
-        if(ret == maxout)
-            break;
     }
 
-    curr.end_idx = i - 1;
+    curr.end_idx = nents - 1;
     out[ret++] = curr;
 
     return ret;
@@ -1057,7 +1018,7 @@ static void batch_render_stat(struct gl_batch *batch, struct ent_stat_rstate *en
     GL_PERF_ENTER();
 
     struct inst_group_desc descs[MAX_BATCHES];
-    size_t ninsts = batch_sort_by_inst_stat(ents, nents, descs, ARR_SIZE(descs));
+    size_t ninsts = batch_group_by_inst_stat(ents, nents, descs, ARR_SIZE(descs));
 
     struct draw_call_desc dcalls[MAX_BATCHES];
     size_t ndcalls = batch_sort_by_vbo(batch, descs, ninsts, dcalls, ARR_SIZE(dcalls));
@@ -1078,7 +1039,7 @@ static void batch_render_anim(struct gl_batch *batch, struct ent_anim_rstate *en
     GL_PERF_ENTER();
 
     struct inst_group_desc descs[MAX_BATCHES];
-    size_t ninsts = batch_sort_by_inst_anim(ents, nents, descs, ARR_SIZE(descs));
+    size_t ninsts = batch_group_by_inst_anim(ents, nents, descs, ARR_SIZE(descs));
 
     struct draw_call_desc dcalls[MAX_BATCHES];
     size_t ndcalls = batch_sort_by_vbo(batch, descs, ninsts, dcalls, ARR_SIZE(dcalls));
@@ -1119,7 +1080,7 @@ static void batch_render_anim_all(vec_ranim_t *ents, bool shadows, enum render_p
 static void batch_render_stat_all(vec_rstat_t *ents, bool shadows, enum render_pass pass)
 {
     struct chunk_batch_desc descs[MAX_BATCHES];
-    size_t nbatches = batch_sort_by_chunk(ents, descs, ARR_SIZE(descs));
+    size_t nbatches = batch_group_by_chunk(ents, descs, ARR_SIZE(descs));
 
     if(nbatches == 0)
         return;
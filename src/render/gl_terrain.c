@@ -57,6 +57,26 @@ static struct texture_arr     s_map_textures;
 static bool                   s_map_ctx_active = false;
 static struct gl_ring        *s_fog_ring;
 static struct map_resolution  s_res;
+/* Copy of the most recent fog-of-war state, patched with partial updates 
+ * before being streamed to the GPU. */
+static unsigned char         *s_fog_shadow;
+static size_t                 s_fog_size;
+/* Set once a fog field has been pushed into the current ringbuffer section. 
+ * The simulation only sends the fog when it changes, so the first bind after 
+ * a sync streams the shadow copy. */
+static bool                   s_fog_streamed;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void fog_stream(void)
+{
+    if(s_fog_streamed)
+        return;
+    R_GL_RingbufferPush(s_fog_ring, s_fog_shadow, s_fog_size);
+    s_fog_streamed = true;
+}
 
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
@@ -69,9 +89,14 @@ void R_GL_MapInit(const char map_texfiles[][256], const size_t *num_textures,
     ASSERT_IN_RENDER_THREAD();
 
     size_t nchunks = res->chunk_w * res->chunk_h;
-    s_fog_ring = R_GL_RingbufferInit(nchunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT * 3, RING_UBYTE);
+    s_fog_size = nchunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT;
+    s_fog_ring = R_GL_RingbufferInit(s_fog_size * 3, RING_UBYTE);
     assert(s_fog_ring);
 
+    s_fog_shadow = calloc(1, s_fog_size);
+    assert(s_fog_shadow);
+    s_fog_streamed = false;
+
     bool status = R_GL_Texture_ArrayMakeMap(map_texfiles, *num_textures, &s_map_textures, GL_TEXTURE0);
     assert(status);
 
@@ -91,7 +116,31 @@ void R_GL_MapInit(const char map_texfiles[][256], const size_t *num_textures,
 void R_GL_MapUpdateFog(void *buff, const size_t *size)
 {
     GL_PERF_ENTER();
+    assert(*size == s_fog_size);
+    memcpy(s_fog_shadow, buff, *size);
     R_GL_RingbufferPush(s_fog_ring, buff, *size);
+    s_fog_streamed = true;
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_MapUpdateFogRanges(const size_t *ranges, const size_t *nranges, 
+                             const unsigned char *data)
+{
+    GL_PERF_ENTER();
+
+    for(int i = 0; i < *nranges; i++) {
+
+        size_t begin = ranges[i * 2 + 0];
+        size_t end = ranges[i * 2 + 1];
+        assert(begin < end && end <= s_fog_size);
+
+        memcpy(s_fog_shadow + begin, data, end - begin);
+        data += end - begin;
+    }
+
+    R_GL_RingbufferPush(s_fog_ring, s_fog_shadow, s_fog_size);
+    s_fog_streamed = true;
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
@@ -100,6 +149,8 @@ void R_GL_MapShutdown(void)
 {
     R_GL_Texture_ArrayFree(s_map_textures);
     R_GL_RingbufferDestroy(s_fog_ring);
+    free(s_fog_shadow);
+    s_fog_shadow = NULL;
 }
 
 /* Push a fully 'visible' field into the ringbuffer. Must be followed
@@ -110,6 +161,7 @@ void R_GL_MapUpdateFogClear(void)
     void *buff = malloc(size);
     memset(buff, 0x2, size);
     R_GL_RingbufferPush(s_fog_ring, buff, size);
+    s_fog_streamed = true;
     free(buff);
 }
 
@@ -129,6 +181,7 @@ void R_GL_MapBegin(const bool *shadows, const vec2_t *pos)
     R_GL_Shader_InstallProg(shader_prog);
 
     R_GL_Texture_BindArray(&s_map_textures, shader_prog);
+    fog_stream();
     R_GL_RingbufferBindLast(s_fog_ring, GL_TEXTURE1, shader_prog, "visbuff");
 
 	R_GL_StateSet(GL_U_MAP_POS, (struct uval){
@@ -155,11 +208,13 @@ void R_GL_MapInvalidate(void)
 {
     GL_PERF_ENTER();
     R_GL_RingbufferSyncLast(s_fog_ring);
+    s_fog_streamed = false;
     GL_PERF_RETURN_VOID();
 }
 
 void R_GL_MapFogBindLast(GLuint tunit, GLuint shader_prog, const char *uname)
 {
+    fog_stream();
     R_GL_RingbufferBindLast(s_fog_ring, tunit, shader_prog, uname);
 }
 
@@ -43,8 +43,10 @@
 #include "../lib/public/pf_string.h"
 #include "../config.h"
 #include "../main.h"
+#include "../asset_load.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <math.h>
 
@@ -68,27 +70,54 @@ static GLuint        s_null_tex;
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool texture_gl_init(const char *path, GLuint *out)
+/* stb_image's own vertical flip is a process-wide setting, which is not safe 
+ * to toggle while images are being decoded on the loader threads. So images 
+ * are always decoded top row first and flipped here when necessary. */
+static void texture_flip_rows(unsigned char *data, int width, int height, int nr_channels)
+{
+    size_t stride = width * nr_channels;
+    for(int r = 0; r < height / 2; r++) {
+
+        unsigned char *top = data + r * stride;
+        unsigned char *bot = data + (height - 1 - r) * stride;
+        for(size_t i = 0; i < stride; i++) {
+            unsigned char tmp = top[i];
+            top[i] = bot[i];
+            bot[i] = tmp;
+        }
+    }
+}
+
+static bool texture_decode(const char *path, bool flip, struct texture_image *out)
+{
+    out->data = stbi_load(path, &out->width, &out->height, &out->nr_channels, 0);
+    if(!out->data)
+        return false;
+
+    if(out->nr_channels != 3 && out->nr_channels != 4) {
+        stbi_image_free(out->data);
+        out->data = NULL;
+        return false;
+    }
+
+    if(flip) {
+        texture_flip_rows(out->data, out->width, out->height, out->nr_channels);
+    }
+    return true;
+}
+
+static void texture_gl_upload(const struct texture_image *img, GLuint *out)
 {
     ASSERT_IN_RENDER_THREAD();
 
     GLuint ret;
-    int width, height, nr_channels;
-    unsigned char *data;
-    
-    data = stbi_load(path, &width, &height, &nr_channels, 0);
-    if(!data)
-        goto fail_load;
-
     glActiveTexture(GL_TEXTURE0);
     glGenTextures(1, &ret);
     glBindTexture(GL_TEXTURE_2D, ret);
 
-    if(nr_channels != 3 && nr_channels != 4)
-        goto fail_format;
-
-    GLint format = (nr_channels == 3) ? GL_RGB : GL_RGBA;
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    GLint format = (img->nr_channels == 3) ? GL_RGB : GL_RGBA;
+    glTexImage2D(GL_TEXTURE_2D, 0, format, img->width, img->height, 0, format, 
+        GL_UNSIGNED_BYTE, img->data);
     glGenerateMipmap(GL_TEXTURE_2D);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -97,14 +126,69 @@ static bool texture_gl_init(const char *path, GLuint *out)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, LOD_BIAS);
 
-    stbi_image_free(data);
     *out = ret;
+}
+
+static bool texture_gl_init(const char *path, bool flip, GLuint *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    struct texture_image img;
+    if(!texture_decode(path, flip, &img))
+        return false;
+
+    texture_gl_upload(&img, out);
+    stbi_image_free(img.data);
     return true;
+}
 
-fail_format:
-    stbi_image_free(data);
-fail_load:
-    return false;
+static void texture_paths(const char *basedir, const char *name, 
+                          char *out_path, char *out_path_maps)
+{
+    if(basedir) {
+        pf_snprintf(out_path, 512, "%s/%s", basedir, name);
+    }else{
+        out_path[0] = '\0';
+    }
+    pf_snprintf(out_path_maps, 512, "%s/assets/map_textures/%s", g_basepath, name);
+}
+
+static void texture_table_put(const char *key, GLuint id)
+{
+    int put_ret;
+    khiter_t k = kh_put(tex, s_name_tex_table, pf_strdup(key), &put_ret);
+    assert(put_ret != -1 && put_ret != 0);
+    kh_value(s_name_tex_table, k) = id;
+}
+
+struct decode_job{
+    const char (*texnames)[256];
+    unsigned char *resized;
+    bool *ok;
+};
+
+static void texture_decode_map_job(void *arg, size_t idx)
+{
+    struct decode_job *job = arg;
+    char path[512];
+    pf_snprintf(path, sizeof(path), "%s/assets/map_textures/%s", g_basepath, job->texnames[idx]);
+
+    int width, height, nr_channels;
+    unsigned char *orig_data = stbi_load(path, &width, &height, &nr_channels, 0);
+    if(!orig_data) {
+        job->ok[idx] = false;
+        return;
+    }
+
+    const size_t texsz = CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * 3;
+    int res = stbir_resize_uint8(orig_data, width, height, 0, job->resized + idx * texsz, 
+        CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, 0, 3);
+
+    assert(1 == res);
+    stbi_image_free(orig_data);
+
+    texture_flip_rows(job->resized + idx * texsz, CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, 3);
+    job->ok[idx] = true;
 }
 
 static void texture_make_null(GLuint *out)
@@ -190,7 +274,7 @@ bool R_GL_Texture_GetForName(const char *basedir, const char *name, GLuint *out)
     return true;
 }
 
-bool R_GL_Texture_Load(const char *basedir, const char *name, GLuint *out)
+static bool texture_load(const char *basedir, const char *name, bool flip, GLuint *out)
 {
     ASSERT_IN_RENDER_THREAD();
 
@@ -201,22 +285,13 @@ bool R_GL_Texture_Load(const char *basedir, const char *name, GLuint *out)
     if((k = kh_get(tex, s_name_tex_table, name)) != kh_end(s_name_tex_table))
         goto fail;
 
-    if(basedir) {
-        pf_snprintf(texture_path, sizeof(texture_path), "%s/%s", basedir, name);
-    }else{
-        texture_path[0] = '\0';
-    }
-    pf_snprintf(texture_path_maps, sizeof(texture_path_maps), "%s/assets/map_textures/%s", g_basepath, name);
+    texture_paths(basedir, name, texture_path, texture_path_maps);
 
-    if(!texture_gl_init(texture_path, &ret)
-    && !texture_gl_init(texture_path_maps, &ret))
+    if(!texture_gl_init(texture_path, flip, &ret)
+    && !texture_gl_init(texture_path_maps, flip, &ret))
         goto fail;
 
-    int put_ret;
-    k = kh_put(tex, s_name_tex_table, pf_strdup(texture_path), &put_ret);
-    assert(put_ret != -1 && put_ret != 0);
-    kh_value(s_name_tex_table, k) = ret;
-
+    texture_table_put(texture_path, ret);
     *out = ret;
     GL_ASSERT_OK();
     return true;
@@ -225,6 +300,37 @@ fail:
     return false;
 }
 
+bool R_GL_Texture_Load(const char *basedir, const char *name, GLuint *out)
+{
+    return texture_load(basedir, name, true, out);
+}
+
+bool R_GL_Texture_Decode(const char *basedir, const char *name, struct texture_image *out)
+{
+    char texture_path[512], texture_path_maps[512];
+    texture_paths(basedir, name, texture_path, texture_path_maps);
+
+    return texture_decode(texture_path, true, out)
+        || texture_decode(texture_path_maps, true, out);
+}
+
+void R_GL_Texture_LoadDecoded(const char *basedir, const char *name, struct texture_image *img)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    GLuint ret;
+    char texture_path[512], texture_path_maps[512];
+    texture_paths(basedir, name, texture_path, texture_path_maps);
+
+    if(kh_get(tex, s_name_tex_table, texture_path) == kh_end(s_name_tex_table)) {
+
+        texture_gl_upload(img, &ret);
+        texture_table_put(texture_path, ret);
+        GL_ASSERT_OK();
+    }
+    stbi_image_free(img->data);
+}
+
 bool R_GL_Texture_AddExisting(const char *name, GLuint id)
 {
     ASSERT_IN_RENDER_THREAD();
@@ -429,25 +535,28 @@ bool R_GL_Texture_ArrayMakeMap(const char texnames[][256], size_t num_textures,
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
 
-    for(int i = 0; i < num_textures; i++) {
+    /* Decode and resize all the textures in parallel, then upload them in order */
+    const size_t texsz = CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * 3;
+    struct decode_job job = {
+        .texnames = texnames,
+        .resized = malloc(num_textures * texsz),
+        .ok = malloc(num_textures * sizeof(bool)),
+    };
+    if(!job.resized || !job.ok)
+        goto fail_load;
 
-        char path[512];
-        pf_snprintf(path, sizeof(path), "%s/assets/map_textures/%s", g_basepath, texnames[i]);
+    AL_RunParallel(texture_decode_map_job, &job, num_textures);
 
-        int width, height, nr_channels;
-        unsigned char *orig_data = stbi_load(path, &width, &height, &nr_channels, 0);
-        if(!orig_data)
-            goto fail_load;
-
-        GLubyte resized_data[CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * 3];
-        int res = stbir_resize_uint8(orig_data, width, height, 0, resized_data, CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, 0, 3);
+    for(int i = 0; i < num_textures; i++) {
 
-        assert(1 == res);
-        stbi_image_free(orig_data);
+        if(!job.ok[i])
+            goto fail_load;
 
         glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, CONFIG_TILE_TEX_RES, 
-            CONFIG_TILE_TEX_RES, 1, GL_RGB, GL_UNSIGNED_BYTE, resized_data);
+            CONFIG_TILE_TEX_RES, 1, GL_RGB, GL_UNSIGNED_BYTE, job.resized + i * texsz);
     }
+    free(job.resized);
+    free(job.ok);
 
     glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -460,6 +569,8 @@ bool R_GL_Texture_ArrayMakeMap(const char texnames[][256], size_t num_textures,
     return true;
 
 fail_load:
+    free(job.resized);
+    free(job.ok);
     glDeleteTextures(1, &out->id);
     return false;
 }
@@ -513,3 +624,13 @@ void R_GL_Texture_GetOrLoad(const char *basedir, const char *name, GLuint *out)
     R_GL_Texture_Load(basedir, name, out);
 }
 
+void R_GL_Texture_GetOrLoadUpright(const char *basedir, const char *name, GLuint *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    if(R_GL_Texture_GetForName(basedir, name, out))
+        return;
+
+    texture_load(basedir, name, false, out);
+}
+
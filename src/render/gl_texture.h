@@ -51,6 +51,13 @@ struct texture_arr{
     GLuint tunit;
 };
 
+/* Pixels decoded from an image file, ready to be uploaded */
+struct texture_image{
+    int            width, height;
+    int            nr_channels;
+    unsigned char *data;
+};
+
 bool R_GL_Texture_Init(void);
 void R_GL_Texture_Shutdown(void);
 
@@ -69,8 +76,14 @@ void R_GL_Texture_BindArray(const struct texture_arr *arr, GLuint shader_prog);
 bool R_GL_Texture_Load(const char *basedir, const char *name, GLuint *out);
 void R_GL_Texture_Free(const char *basedir, const char *name);
 void R_GL_Texture_GetOrLoad(const char *basedir, const char *name, GLuint *out);
+/* Same as above, but the image rows are not flipped (for UI images) */
+void R_GL_Texture_GetOrLoadUpright(const char *basedir, const char *name, GLuint *out);
 bool R_GL_Texture_GetForName(const char *basedir, const char *name, GLuint *out);
 void R_GL_Texture_GetSize(GLuint texid, int *out_w, int *out_h, int *out_d);
 bool R_GL_Texture_AddExisting(const char *name, GLuint id);
 
+/* Can be called from any thread. The pixels are freed by 'R_GL_Texture_LoadDecoded'. */
+bool R_GL_Texture_Decode(const char *basedir, const char *name, struct texture_image *out);
+void R_GL_Texture_LoadDecoded(const char *basedir, const char *name, struct texture_image *img);
+
 #endif
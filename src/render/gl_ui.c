@@ -42,7 +42,6 @@
 #include "gl_perf.h"
 #include "../main.h"
 #include "../lib/public/pf_nuklear.h"
-#include "../lib/public/stb_image.h"
 
 #include <assert.h>
 
@@ -107,9 +106,7 @@ static void exec_draw_commands(const struct nk_draw_list *dl, GLuint shader_prog
             }
             case NK_COMMAND_IMAGE_TEXPATH: {
 
-                stbi_set_flip_vertically_on_load(false);
-                R_GL_Texture_GetOrLoad(g_basepath, ud->texpath, (GLuint*)&cmd->texture.id);
-                stbi_set_flip_vertically_on_load(true);
+                R_GL_Texture_GetOrLoadUpright(g_basepath, ud->texpath, (GLuint*)&cmd->texture.id);
                 break;
             }
             default: assert(0);
@@ -369,11 +369,23 @@ void  R_GL_MapBegin(const bool *shadows, const vec2_t *pos);
 void  R_GL_MapEnd(void);
 
 /* ---------------------------------------------------------------------------
- * Send the current-frame fog-of-war information to the rendering susbsystem.
+ * Send the current fog-of-war information to the rendering susbsystem. It 
+ * only needs to be sent when it changes, as the most recent state is kept and
+ * streamed to the GPU every frame.
  * ---------------------------------------------------------------------------
  */
 void  R_GL_MapUpdateFog(void *buff, const size_t *size);
 
+/* ---------------------------------------------------------------------------
+ * Like 'R_GL_MapUpdateFog', but only the tiles in the '*nranges' [begin, end) 
+ * index pairs of 'ranges' are updated. The new states of the tiles of all 
+ * the ranges are packed back-to-back in 'data'. The remaining tiles keep their
+ * most recent state.
+ * ---------------------------------------------------------------------------
+ */
+void  R_GL_MapUpdateFogRanges(const size_t *ranges, const size_t *nranges, 
+                              const unsigned char *data);
+
 /* ---------------------------------------------------------------------------
  * Must be Called once per frame when we are sure there will be no more draw 
  * commands touching the map data.
@@ -40,15 +40,47 @@
 #include <SDL_rwops.h>
 
 struct pfobj_hdr;
+struct cooked_reader;
 struct map;
 struct tile;
 
 /* ---------------------------------------------------------------------------
- * Consumes lines of the stream and uses them to populate a new private context
- * for the model. The context is returned in a malloc'd buffer.
+ * Consumes the same lines of the stream as 'R_AL_PrivParse' and writes the 
+ * data to 'out' in the cooked (binary) format.
  * ---------------------------------------------------------------------------
  */
-void  *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream);
+bool   R_AL_CookFromStream(const struct pfobj_hdr *header, SDL_RWops *stream, SDL_RWops *out);
+
+/* ---------------------------------------------------------------------------
+ * Populate a new private context for the model, either by consuming lines of 
+ * the stream or from a cooked model. The parsing functions do not touch any 
+ * global state and can be called from any thread. The vertex data they return 
+ * must be passed to 'R_AL_PrivUpload' (from the main thread), which queues the 
+ * GL initialization of the context. The vertex buffer of 'R_AL_PrivParse' is 
+ * malloc'd, while that of 'R_AL_PrivParseCooked' points into the reader's data.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_AL_PrivParse(const struct pfobj_hdr *header, SDL_RWops *stream, void **out_vbuff);
+void  *R_AL_PrivParseCooked(const struct pfobj_hdr *header, struct cooked_reader *reader,
+                            const void **out_vbuff);
+void   R_AL_PrivUpload(void *priv, const char *base_path, const void *vbuff);
+
+/* ---------------------------------------------------------------------------
+ * The names of the textures referenced by the model's materials.
+ * ---------------------------------------------------------------------------
+ */
+size_t      R_AL_PrivNumTextures(const void *priv);
+const char *R_AL_PrivTextureName(const void *priv, size_t idx);
+
+/* ---------------------------------------------------------------------------
+ * Decodes a texture file into memory. Can be called from any thread. The
+ * result must be passed to 'R_AL_TextureUpload' (from the main thread), which 
+ * takes ownership of it and queues the upload. Models subsequently loaded 
+ * from the same directory will then re-use the texture.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_AL_TextureDecode(const char *basedir, const char *name);
+void   R_AL_TextureUpload(const char *basedir, const char *name, void *image);
 
 /* ---------------------------------------------------------------------------
  * Dumps private render data in PF Object format.
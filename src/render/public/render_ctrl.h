@@ -40,6 +40,8 @@
 #include "../../lib/public/stalloc.h"
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 #include <SDL_mutex.h>
 #include <SDL_thread.h>
@@ -119,6 +121,21 @@ const char *R_GetInfo(enum render_info attr);
 /* Shadows */
 void        R_LightFrustum(vec3_t light_pos, vec3_t cam_pos, vec3_t cam_dir, struct frustum *out);
 
+/* Batching 
+ *
+ * Every draw is given a 64-bit key, laid out in the following way (from the 
+ * most significant bit):
+ *
+ *   [63]    - translucency (translucent draws go after all opaque ones)
+ *   [62:47] - chunk coordinate of the entity (0 for animated entities)
+ *   [46:23] - model ID (draws of instances of the same model are adjacent)
+ *   [22:0]  - depth (front-to-back for opaque, back-to-front for translucent)
+ *
+ * Lists sorted by this key are consumed by the batch renderer as-is.
+ */
+uint64_t    R_DrawSortKey(const void *render_private, bool translucent, 
+                          const struct tile_desc *td, float depth);
+
 /* Tile */
 int         R_TileGetTriMesh(const struct map *map, struct tile_desc *td, mat4x4_t *model, vec3_t out[]);
 
@@ -41,6 +41,7 @@
 #include "gl_assert.h"
 #include "gl_state.h"
 #include "gl_batch.h"
+#include "render_private.h"
 #include "../settings.h"
 #include "../main.h"
 #include "../ui.h"
@@ -56,6 +57,7 @@
 
 #define EPSILON     (1.0f/1024)
 #define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
 
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
@@ -709,6 +711,30 @@ void R_ClearWS(struct render_workspace *ws)
     stalloc_clear(&ws->args);
 }
 
+uint64_t R_DrawSortKey(const void *render_private, bool translucent, 
+                       const struct tile_desc *td, float depth)
+{
+    const struct render_private *priv = render_private;
+
+    uint64_t chunk = 0;
+    if(td) {
+        chunk = ((((uint64_t)td->chunk_r) & 0xff) << 8)
+              | ((((uint64_t)td->chunk_c) & 0xff) << 0);
+    }
+
+    /* The bit patterns of non-negative floats sort in the same order as the
+     * values, so the top bits (minus the sign) make for a coarse depth. */
+    union{ float as_float; uint32_t as_int; }bits = { .as_float = MAX(depth, 0.0f) };
+    uint64_t zbits = (bits.as_int >> 8) & 0x7fffff;
+    if(translucent)
+        zbits = ~zbits & 0x7fffff;
+
+    return (((uint64_t)translucent)            << 63)
+         | (chunk                              << 47)
+         | ((((uint64_t)priv->id) & 0xffffff)  << 23)
+         | zbits;
+}
+
 const char *R_GetInfo(enum render_info attr)
 {
     switch(attr) {
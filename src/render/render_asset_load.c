@@ -35,12 +35,14 @@
 
 #include "public/render.h"
 #include "public/render_ctrl.h"
+#include "public/render_al.h"
 #include "render_private.h"
 #include "gl_vertex.h"
 #include "gl_material.h"
 #include "gl_render.h"
 #include "gl_assert.h"
 #include "gl_shader.h"
+#include "gl_texture.h"
 
 #include "../main.h"
 #include "../perf.h"
@@ -58,6 +60,11 @@
 
 #define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
 
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static SDL_atomic_t s_next_priv_id;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -132,7 +139,7 @@ fail:
     return false;
 }
 
-static bool al_read_material(SDL_RWops *stream, const char *basedir, struct material *out, bool *out_null)
+static bool al_read_material(SDL_RWops *stream, struct material *out, bool *out_null)
 {
     char line[MAX_LINE_LEN];
 
@@ -164,21 +171,88 @@ static bool al_read_material(SDL_RWops *stream, const char *basedir, struct mate
         goto fail;
     out->texname[sizeof(out->texname)-1] = '\0';
 
+    *out_null = false;
+    return true;
+
+fail:
+    return false;
+}
+
+static void al_load_texture(const char *basedir, struct material *mat)
+{
     R_PushCmd((struct rcmd){
         .func = R_GL_Texture_GetOrLoad,
         .nargs = 3,
         .args = {
             R_PushArg(basedir, strlen(basedir) + 1),
-            R_PushArg(out->texname, strlen(out->texname) + 1),
-            &out->texture.id,
+            R_PushArg(mat->texname, strlen(mat->texname) + 1),
+            &mat->texture.id,
         },
     });
+}
 
-    *out_null = false;
+static bool al_read_vertices(SDL_RWops *stream, size_t num_verts, bool anim, void *out)
+{
+    for(int i = 0; i < num_verts; i++) {
+
+        bool status;
+        char ignoreline[MAX_LINE_LEN];
+
+        if(anim) {
+            status = al_read_anim_vertex(stream, ((struct anim_vert*)out) + i);
+        }else{
+            status = al_read_vertex(stream, ((struct vertex*)out) + i, ignoreline);
+        }
+        if(!status)
+            return false;
+    }
     return true;
+}
 
-fail:
-    return false;
+static bool al_read_materials(SDL_RWops *stream, size_t num_mats, struct material *out)
+{
+    for(int i = 0; i < num_mats; i++) {
+
+        bool null;
+        if(!al_read_material(stream, &out[i], &null)) 
+            return false;
+        assert(!null);
+    }
+    return true;
+}
+
+static void al_priv_upload(struct render_private *priv, const char *basedir, bool anim,
+                           const void *vbuff, size_t vbuff_sz)
+{
+    for(int i = 0; i < priv->num_materials; i++) {
+
+        priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
+        priv->materials[i].texture.id = -1;
+        al_load_texture(basedir, &priv->materials[i]);
+    }
+
+    struct sval sh_setting;
+    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
+    assert(status == SS_OKAY);
+
+    const char *shader;
+    if(sh_setting.as_bool) {
+        shader = anim ? "mesh.animated.textured-phong-shadowed" 
+                      : "mesh.static.textured-phong-shadowed";
+    }else{
+        shader = anim ? "mesh.animated.textured-phong" 
+                      : "mesh.static.textured-phong";
+    }
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_Init,
+        .nargs = 3,
+        .args = {
+            priv,
+            (void*)shader,
+            R_PushArg(vbuff, vbuff_sz),
+        },
+    });
 }
 
 size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
@@ -206,81 +280,173 @@ size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
  *
  */
 
-void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
+static struct render_private *al_priv_init(const struct pfobj_hdr *header)
 {
-    PERF_ENTER();
     struct render_private *priv = malloc(al_priv_buffsize_from_header(header));
     if(!priv)
-        goto fail_alloc_priv;
+        return NULL;
 
     bool anim = (header->num_as > 0);
     priv->vertex_stride = anim ? sizeof(struct anim_vert) : sizeof(struct vertex);
+    priv->mesh.num_verts = header->num_verts;
+    priv->num_materials = header->num_materials;
+    priv->materials = (void*)(priv + 1);
+    priv->id = SDL_AtomicAdd(&s_next_priv_id, 1);
+    return priv;
+}
 
+void *R_AL_PrivParse(const struct pfobj_hdr *header, SDL_RWops *stream, void **out_vbuff)
+{
+    struct render_private *priv = al_priv_init(header);
+    if(!priv)
+        goto fail_alloc_priv;
+
+    bool anim = (header->num_as > 0);
     size_t vbuff_sz = header->num_verts * priv->vertex_stride;
     void *vbuff = malloc(vbuff_sz);
     if(!vbuff)
         goto fail_alloc_vbuff;
 
-    priv->mesh.num_verts = header->num_verts;
-    priv->num_materials = header->num_materials;
-    priv->materials = (void*)(priv + 1);
+    if(!al_read_vertices(stream, header->num_verts, anim, vbuff))
+        goto fail_parse;
 
-    for(int i = 0; i < header->num_verts; i++) {
+    if(!al_read_materials(stream, header->num_materials, priv->materials))
+        goto fail_parse;
 
-        bool status;
-        char ignoreline[MAX_LINE_LEN];
+    *out_vbuff = vbuff;
+    return priv;
 
-        if(anim) {
-            status = al_read_anim_vertex(stream, ((struct anim_vert*)vbuff) + i);
-        }else{
-            status = al_read_vertex(stream, ((struct vertex*)vbuff) + i, ignoreline);
-        }
-        if(!status)
-            goto fail_parse;
-    }
+fail_parse:
+    free(vbuff);
+fail_alloc_vbuff:
+    free(priv);
+fail_alloc_priv:
+    return NULL;
+}
 
-    for(int i = 0; i < header->num_materials; i++) {
+void R_AL_PrivUpload(void *priv_data, const char *base_path, const void *vbuff)
+{
+    struct render_private *priv = priv_data;
+    bool anim = (priv->vertex_stride == sizeof(struct anim_vert));
+    al_priv_upload(priv, base_path, anim, vbuff, priv->mesh.num_verts * priv->vertex_stride);
+}
 
-        bool null;
-        priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
-        priv->materials[i].texture.id = -1;
-        if(!al_read_material(stream, base_path, &priv->materials[i], &null)) 
-            goto fail_parse;
-        assert(!null);
-    }
+size_t R_AL_PrivNumTextures(const void *priv_data)
+{
+    const struct render_private *priv = priv_data;
+    return priv->num_materials;
+}
 
-    struct sval sh_setting;
-    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
-    assert(status == SS_OKAY);
+const char *R_AL_PrivTextureName(const void *priv_data, size_t idx)
+{
+    const struct render_private *priv = priv_data;
+    assert(idx < priv->num_materials);
+    return priv->materials[idx].texname;
+}
 
-    const char *shader;
-    if(sh_setting.as_bool) {
-        shader = anim ? "mesh.animated.textured-phong-shadowed" 
-                      : "mesh.static.textured-phong-shadowed";
-    }else{
-        shader = anim ? "mesh.animated.textured-phong" 
-                      : "mesh.static.textured-phong";
+void *R_AL_TextureDecode(const char *basedir, const char *name)
+{
+    struct texture_image *ret = malloc(sizeof(struct texture_image));
+    if(!ret)
+        return NULL;
+
+    if(!R_GL_Texture_Decode(basedir, name, ret)) {
+        free(ret);
+        return NULL;
     }
+    return ret;
+}
 
+void R_AL_TextureUpload(const char *basedir, const char *name, void *image)
+{
     R_PushCmd((struct rcmd){
-        .func = R_GL_Init,
+        .func = R_GL_Texture_LoadDecoded,
         .nargs = 3,
         .args = {
-            priv,
-            (void*)shader,
-            R_PushArg(vbuff, vbuff_sz),
+            R_PushArg(basedir, strlen(basedir) + 1),
+            R_PushArg(name, strlen(name) + 1),
+            R_PushArg(image, sizeof(struct texture_image)),
         },
     });
+    free(image);
+}
+
+/*
+ * Cooked render data layout:
+ *
+ *  +---------------------------------+
+ *  | uint32_t vertex_stride          |
+ *  | uint32_t sizeof(struct material)|
+ *  +---------------------------------+
+ *  | struct vertex[num_verts] or     |
+ *  | struct anim_vert[num_verts]     |
+ *  +---------------------------------+
+ *  | struct material[num_materials]  |
+ *  +---------------------------------+
+ *
+ * The texture handles of the materials are not meaningful and are 
+ * re-initialized when loading.
+ */
+
+bool R_AL_CookFromStream(const struct pfobj_hdr *header, SDL_RWops *stream, SDL_RWops *out)
+{
+    bool anim = (header->num_as > 0);
+    uint32_t layout[2] = {
+        anim ? sizeof(struct anim_vert) : sizeof(struct vertex),
+        sizeof(struct material)
+    };
 
+    size_t vbuff_sz = header->num_verts * layout[0];
+    void *vbuff = malloc(vbuff_sz);
+    struct material *mats = calloc(header->num_materials, sizeof(struct material));
+    bool ret = false;
+
+    if(!vbuff || !mats)
+        goto out;
+
+    if(!al_read_vertices(stream, header->num_verts, anim, vbuff))
+        goto out;
+    if(!al_read_materials(stream, header->num_materials, mats))
+        goto out;
+
+    ret = AL_CookedWrite(out, layout, sizeof(layout))
+       && AL_CookedWrite(out, vbuff, vbuff_sz)
+       && AL_CookedWrite(out, mats, header->num_materials * sizeof(struct material));
+
+out:
+    free(mats);
     free(vbuff);
-    PERF_RETURN(priv);
+    return ret;
+}
+
+void *R_AL_PrivParseCooked(const struct pfobj_hdr *header, struct cooked_reader *reader,
+                           const void **out_vbuff)
+{
+    struct render_private *priv = al_priv_init(header);
+    if(!priv)
+        goto fail_alloc_priv;
+
+    const uint32_t *layout = AL_CookedRead(reader, 2 * sizeof(uint32_t));
+    if(!layout || layout[0] != priv->vertex_stride || layout[1] != sizeof(struct material))
+        goto fail_parse;
+
+    size_t vbuff_sz = header->num_verts * priv->vertex_stride;
+    const void *vbuff = AL_CookedRead(reader, vbuff_sz);
+    if(!vbuff)
+        goto fail_parse;
+
+    const void *mats = AL_CookedRead(reader, header->num_materials * sizeof(struct material));
+    if(!mats)
+        goto fail_parse;
+    memcpy(priv->materials, mats, header->num_materials * sizeof(struct material));
+
+    *out_vbuff = vbuff;
+    return priv;
 
 fail_parse:
-    free(vbuff);
-fail_alloc_vbuff:
     free(priv);
 fail_alloc_priv:
-    PERF_RETURN(NULL);
+    return NULL;
 }
 
 void R_AL_DumpPrivate(FILE *stream, void *priv_data)
@@ -40,6 +40,8 @@
 #include "gl_texture.h"
 #include "../map/public/tile.h"
 
+#include <stdint.h>
+
 struct terrain_vert;
 struct map;
 
@@ -51,6 +53,8 @@ struct render_private{
     GLuint              shader_prog;
     GLuint              shader_prog_dp; /* for the depth pass */
     GLuint              vertex_stride;
+    /* Unique per loaded model, used for grouping the draws of its' instances */
+    uint32_t            id;
 };
 
 /* Tile */
@@ -43,8 +43,20 @@
 #include <stdio.h>
 #include <SDL.h>
 #include <assert.h>
+#include <string.h>
+#include <stdlib.h>
 
 
+struct scene_ent{
+    char            name[128];
+    char            path[256];
+    khash_t(attr)  *attr_table;
+    vec_attr_t      constructor_args;
+};
+
+VEC_TYPE(sent, struct scene_ent)
+VEC_IMPL(static inline, sent, struct scene_ent)
+
 VEC_IMPL(extern, attr, struct attr)
 __KHASH_IMPL(attr, extern, kh_cstr_t, struct attr, 1, kh_str_hash_func, kh_str_hash_equal)
 
@@ -52,22 +64,32 @@ __KHASH_IMPL(attr, extern, kh_cstr_t, struct attr, 1, kh_str_hash_func, kh_str_h
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool scene_load_entity(SDL_RWops *stream)
+static void scene_ent_destroy(struct scene_ent *ent)
+{
+    const char *key;
+    struct attr val;
+    kh_foreach(ent->attr_table, key, val, { 
+        (void)val;
+        free((void*)key);
+    });
+    
+    kh_destroy(attr, ent->attr_table);
+    vec_attr_destroy(&ent->constructor_args);
+}
+
+static bool scene_parse_entity(SDL_RWops *stream, struct scene_ent *out)
 {
     char line[MAX_LINE_LEN];
-    char name[128];
-    char path[256];
     unsigned num_atts;
 
-    khash_t(attr) *attr_table = kh_init(attr);
-    if(!attr_table)
+    out->attr_table = kh_init(attr);
+    if(!out->attr_table)
         goto fail_alloc;
 
-    vec_attr_t constructor_args;
-    vec_attr_init(&constructor_args);
+    vec_attr_init(&out->constructor_args);
 
     READ_LINE(stream, line, fail_parse);
-    if(!sscanf(line, "entity %s %s %u", name, path, &num_atts))
+    if(!sscanf(line, "entity %127s %255s %u", out->name, out->path, &num_atts))
         goto fail_parse;
 
     for(int i = 0; i < num_atts; i++) {
@@ -76,9 +98,9 @@ static bool scene_load_entity(SDL_RWops *stream)
             goto fail_parse;
 
         int ret;
-        khiter_t k = kh_put(attr, attr_table, pf_strdup(attr.key), &ret);
+        khiter_t k = kh_put(attr, out->attr_table, pf_strdup(attr.key), &ret);
         assert(ret != -1 && ret != 0);
-        kh_value(attr_table, k) = attr;
+        kh_value(out->attr_table, k) = attr;
 
         if(!strcmp(attr.key, "constructor_arguments")) {
 
@@ -86,37 +108,53 @@ static bool scene_load_entity(SDL_RWops *stream)
             struct attr const_arg;
             
             for(int j = 0; j < num_args; j++) {
-                if(!Attr_Parse(stream, &const_arg, false)) {
-                    vec_attr_destroy(&constructor_args);
+                if(!Attr_Parse(stream, &const_arg, false))
                     goto fail_parse;
-                }
-                vec_attr_push(&constructor_args, const_arg);
+                vec_attr_push(&out->constructor_args, const_arg);
             }
         }
     }
-
-    if(!S_Entity_ObjFromAtts(path, name, attr_table, &constructor_args))
-        goto fail_init;
-
-    const char *key;
-    struct attr val;
-    kh_foreach(attr_table, key, val, { 
-        (void)val;
-        free((void*)key);
-    });
-    
-    kh_destroy(attr, attr_table);
-    vec_attr_destroy(&constructor_args);
     return true;
 
-fail_init:
-    vec_attr_destroy(&constructor_args);
 fail_parse:
-    kh_destroy(attr, attr_table);
+    scene_ent_destroy(out);
 fail_alloc:
     return false;
 }
 
+/* Parse and decode all the distinct models of the scene in parallel, so that 
+ * the entities created afterwards only need to look them up. */
+static void scene_preload_models(const vec_sent_t *ents)
+{
+    size_t nents = vec_size(ents);
+    const char **dirs = malloc(nents * sizeof(char*));
+    const char **names = malloc(nents * sizeof(char*));
+    char (*paths)[256] = malloc(nents * sizeof(*paths));
+    size_t count = 0;
+
+    if(!dirs || !names || !paths)
+        goto out;
+
+    for(int i = 0; i < nents; i++) {
+
+        pf_strlcpy(paths[count], vec_AT(ents, i).path, sizeof(paths[count]));
+        char *slash = strrchr(paths[count], '/');
+        if(!slash)
+            continue;
+        *slash = '\0';
+
+        dirs[count] = paths[count];
+        names[count] = slash + 1;
+        count++;
+    }
+
+    AL_PreloadPFObjs(count, dirs, names);
+
+out:
+    free(paths);
+    free(names);
+    free(dirs);
+}
 
 static bool scene_load_faction(SDL_RWops *stream)
 {
@@ -150,6 +188,8 @@ bool Scene_Load(const char *path)
     SDL_RWops *stream;
     char line[MAX_LINE_LEN];
     unsigned num_factions, num_ents;
+    vec_sent_t ents;
+    bool ret = false;
 
     stream = SDL_RWFromFile(path, "r");
     if(!stream)
@@ -168,17 +208,34 @@ bool Scene_Load(const char *path)
     if(!sscanf(line, "num_entities %u", &num_ents))
         goto fail_parse;
 
+    vec_sent_init(&ents);
+    if(!vec_sent_resize(&ents, num_ents))
+        goto fail_parse;
+
     for(int i = 0; i < num_ents; i++) {
-        if(!scene_load_entity(stream))
-            goto fail_parse;
+        struct scene_ent ent;
+        if(!scene_parse_entity(stream, &ent))
+            goto fail_ents;
+        vec_sent_push(&ents, ent);
     }
 
-    SDL_RWclose(stream);
-    return true;
-    
+    scene_preload_models(&ents);
+
+    for(int i = 0; i < num_ents; i++) {
+        struct scene_ent *ent = &vec_AT(&ents, i);
+        if(!S_Entity_ObjFromAtts(ent->path, ent->name, ent->attr_table, &ent->constructor_args))
+            goto fail_ents;
+    }
+    ret = true;
+
+fail_ents:
+    for(int i = 0; i < vec_size(&ents); i++) {
+        scene_ent_destroy(&vec_AT(&ents, i));
+    }
+    vec_sent_destroy(&ents);
 fail_parse:
     SDL_RWclose(stream);
 fail_stream:
-    return false;
+    return ret;
 }
 
@@ -45,10 +45,19 @@
 #include "lib/public/queue.h"
 #include "lib/public/khash.h"
 #include "lib/public/pf_string.h"
+#include "settings.h"
 
 #include <SDL.h>
 #include <inttypes.h>
 
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 
 enum taskstate{
     TASK_STATE_ACTIVE,
@@ -114,6 +123,9 @@ enum{
     _SCHED_REQ_FREE = _SCHED_REQ_COUNT + 1,
 };
 
+QUEUE_TYPE(tid, uint32_t)
+QUEUE_IMPL(static, tid, uint32_t)
+
 struct task{
     enum taskstate state;
     struct context ctx;
@@ -124,27 +136,51 @@ struct task{
     struct request req;
     uint64_t       retval;
     void          *stackmem;
+    size_t         stacksz;
     struct future *future;
     void          *arg;
     void         (*destructor)(void*);
     void          *darg;
     struct task   *prev, *next;
     SDL_Event      earg;
+    /* Protects the message queue and the parent-child 
+     * relationship state of this task */
+    SDL_SpinLock   lock;
+    queue_tid_t    msgq;
+    bool           parent_waiting;
 };
 
-#define MAX_TASKS               (512)
+/* Stacks are reserved from the OS on demand, with a guard page 
+ * below the lowest usable address. Physical memory is only committed
+ * for the pages that actually get touched by the task.
+ */
+struct stack_pool{
+    size_t       stacksz;
+    size_t       max_idle;
+    SDL_SpinLock lock;
+    size_t       nidle;
+    size_t       capacity;
+    void       **idle;
+};
+
+#define TASK_BLOCK_SZ           (256)
+#define MAX_TASK_BLOCKS         (256)
+#define MAX_TASKS               (TASK_BLOCK_SZ * MAX_TASK_BLOCKS)
 #define MAX_WORKER_THREADS      (64)
 #define STACK_SZ                (64 * 1024)
 #define BIG_STACK_SZ            (8 * 1024 * 1024)
+#define MAX_IDLE_STACKS         (1024)
+#define MAX_IDLE_BIG_STACKS     (32)
+#define MSGQ_INIT_CAP           (8)
 #define SCHED_TICK_MS           (1.0f / CONFIG_SCHED_TARGET_FPS * 1000.0f)
 #define ALIGNED(val, align)     (((val) + ((align) - 1)) & ~((align) - 1))
+#define MIN(a, b)               ((a) < (b) ? (a) : (b))
+#define MAX(a, b)               ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)             (sizeof(a)/sizeof(a[0]))
 
 PQUEUE_TYPE(task, struct task*)
 PQUEUE_IMPL(static, task, struct task*)
 
-QUEUE_TYPE(tid, uint32_t)
-QUEUE_IMPL(static, tid, uint32_t)
-
 KHASH_MAP_INIT_INT64(tid, uint32_t)
 KHASH_MAP_INIT_INT(tqueue, queue_tid_t)
 
@@ -166,38 +202,72 @@ static khash_t(tid)    *s_thread_worker_id_map;
 static struct context   s_main_ctx;
 static struct task     *s_freehead;
 
-static struct task      s_tasks[MAX_TASKS];
-static char             s_stacks[MAX_TASKS][STACK_SZ];
-static queue_tid_t      s_msg_queues[MAX_TASKS];
-static bool             s_parent_waiting[MAX_TASKS];
+/* The task table grows on demand, one block at a time. Blocks are 
+ * never moved or freed until shutdown, so task pointers remain stable. 
+ * A block pointer is always published before any of the TIDs inside 
+ * of it are handed out.
+ */
+static struct task     *s_task_blocks[MAX_TASK_BLOCKS];
+static size_t           s_ntask_blocks;
 static khash_t(tqueue) *s_event_queues;
 
-/* Lock used to serialzie the scheduler requests */
-static SDL_mutex       *s_request_lock;
+static struct stack_pool s_stacks;
+static struct stack_pool s_big_stacks;
+static size_t           s_page_size;
+#if defined(_WIN32)
+static PVOID            s_stack_veh;
+#endif
+
+/* Lock protecting the task free list and the task table */
+static SDL_SpinLock     s_alloc_lock;
+/* Lock protecting the event queues */
+static SDL_mutex       *s_event_lock;
+
+/* Each worker thread owns a ready queue. Tasks that are made ready 
+ * by a worker are pushed onto its' own queue, so that most of the 
+ * traffic is uncontended. When a worker runs out of tasks in its'
+ * own queue, it will attempt to steal from the other queues. Tasks
+ * that are made ready from the main thread are distributed among the 
+ * worker queues in round-robin order.
+ *
+ * The tasks pinned to the main thread are placed in a separate queue, 
+ * which is only ever de-queued from by the main thread. The main thread 
+ * is also free to steal from any of the worker queues.
+ *
+ * Each queue is protected by its' own spinlock.
+ */
+static pq_task_t        s_ready_queues[MAX_WORKER_THREADS];
+static SDL_SpinLock     s_ready_queue_locks[MAX_WORKER_THREADS];
+static size_t           s_nqueues;
+static SDL_atomic_t     s_next_queue;
 
-/* The active worker threads wait on the ready cond to be 
+static pq_task_t        s_ready_queue_main;
+static SDL_SpinLock     s_ready_queue_main_lock;
+
+/* The total number of tasks in all the ready queues */
+static SDL_atomic_t     s_nready;
+
+/* Threads that have run out of work wait on the ready cond to be 
  * notified when the ready queue(s) becomes non-empty, so that
  * they can pop a task to execute. At the end of a frame, the 
  * ready condition variable is also used to notify the workers 
  * that the 'quiesce' flags has been set, instructing them to 
  * go back to waiting on a start/quit command. 
- * 
- * We have 2 diff. queues to allow only de-queuing tasks based
- * on the thread. The worker threads will not dequeue from the 
- * 'main' queues.
  *
- * All the queues are protected by the ready lock.
+ * The 'sleepers' count is incremented before a thread checks the 
+ * ready queues for the last time prior to going to sleep, allowing 
+ * the producers to skip taking the ready lock when nobody is waiting.
  */
-static pq_task_t        s_ready_queue;
-static pq_task_t        s_ready_queue_main;
-
 static SDL_mutex       *s_ready_lock;
 static SDL_cond        *s_ready_cond;
+static SDL_atomic_t     s_nsleepers;
 static int              s_nwaiters;     /* protected by ready lock */
-static bool             s_quiesce;      /* protected by ready lock */
+static SDL_atomic_t     s_quiesce;
 static int              s_idle_workers; /* protected by ready lock */
 
 static size_t           s_nworkers;
+static size_t           s_nactive_workers;
+static size_t           s_nactive_workers_next;
 static SDL_Thread      *s_worker_threads[MAX_WORKER_THREADS];
 static struct context   s_worker_contexts[MAX_WORKER_THREADS];
 
@@ -209,6 +279,38 @@ static bool             s_worker_quit[MAX_WORKER_THREADS];
 static SDL_mutex       *s_worker_locks[MAX_WORKER_THREADS];
 static SDL_cond        *s_worker_conds[MAX_WORKER_THREADS];
 
+/* Per-thread counters are only written by their' owning thread 
+ * and accumulated by the main thread once all workers are idle. 
+ * The last slot is used by the main thread.
+ */
+static uint64_t         s_tasks_run[MAX_WORKER_THREADS + 1];
+static uint64_t         s_tasks_stolen[MAX_WORKER_THREADS + 1];
+static struct sched_stats s_last_stats;
+
+/* State for synthetic tasks that can be spawned for benchmarking 
+ * the scheduler throughput */
+static int              s_bench_ntasks;
+static SDL_atomic_t     s_bench_gen;
+
+/* State of the data-parallel job set by the currently executing
+ * Sched_RunParallel call. Jobs are handed out by bumping the 'next' 
+ * index. Rather than spawning tasks, the worker threads join in on 
+ * the job directly, between popping tasks, for as long as the 'active' 
+ * flag is set. The fields are set under the lock before the job is 
+ * published and are read-only for the duration of the job. The caller 
+ * waits on the 'done' cond for the helpers to leave the job.
+ */
+static struct{
+    SDL_mutex      *lock;
+    SDL_cond       *done;
+    SDL_atomic_t    active;
+    int             nhelpers;   /* protected by lock */
+    parallel_func_t code;
+    void           *arg;
+    size_t          njobs;
+    SDL_atomic_t    next;
+}s_parallel;
+
 static enum simstate    s_prev_ss;
 
 /*****************************************************************************/
@@ -355,9 +457,9 @@ __asm__(
 static void sched_init_ctx(struct task *task, void *code)
 {
     char *stack_end = task->stackmem;
-    char *stack_base = stack_end + STACK_SZ;
+    char *stack_base = stack_end + task->stacksz;
     stack_base = (char*)ALIGNED((uintptr_t)stack_base, 32);
-    if(stack_base >= stack_end + STACK_SZ)
+    if(stack_base >= stack_end + task->stacksz)
         stack_base -= 32;
 
     /* This is the address where we will jump to upon 
@@ -493,10 +595,79 @@ static uint32_t sched_curr_thread_worker_id(void)
     return kh_val(s_thread_worker_id_map, k);
 }
 
+static inline struct task *sched_task_get(uint32_t tid)
+{
+    assert(tid > 0 && tid <= s_ntask_blocks * TASK_BLOCK_SZ);
+    return &s_task_blocks[(tid - 1) / TASK_BLOCK_SZ][(tid - 1) % TASK_BLOCK_SZ];
+}
+
+/* Every ready queue is kept large enough to hold all the tasks in the task 
+ * table at once, so that putting an already-created task back on a ready 
+ * queue never needs to allocate. 
+ */
+static bool sched_reserve_ready(size_t ntasks)
+{
+    bool ret = true;
+
+    SDL_AtomicLock(&s_ready_queue_main_lock);
+    ret &= pq_task_reserve(&s_ready_queue_main, ntasks + 1);
+    SDL_AtomicUnlock(&s_ready_queue_main_lock);
+
+    for(int i = 0; ret && i < s_nqueues; i++) {
+        SDL_AtomicLock(&s_ready_queue_locks[i]);
+        ret &= pq_task_reserve(&s_ready_queues[i], ntasks + 1);
+        SDL_AtomicUnlock(&s_ready_queue_locks[i]);
+    }
+    return ret;
+}
+
+static bool sched_grow_tasks(void)
+{
+    if(s_ntask_blocks == MAX_TASK_BLOCKS)
+        return false;
+
+    if(!sched_reserve_ready((s_ntask_blocks + 1) * TASK_BLOCK_SZ))
+        return false;
+
+    struct task *block = calloc(TASK_BLOCK_SZ, sizeof(struct task));
+    if(!block)
+        return false;
+
+    uint32_t base = s_ntask_blocks * TASK_BLOCK_SZ;
+    for(int i = 0; i < TASK_BLOCK_SZ; i++) {
+
+        block[i].tid = base + i + 1;
+        if(!queue_tid_init(&block[i].msgq, MSGQ_INIT_CAP))
+            goto fail_msgq;
+    }
+
+    for(int i = 0; i < TASK_BLOCK_SZ; i++) {
+        block[i].prev = (i > 0) ? &block[i - 1] : NULL;
+        block[i].next = (i < TASK_BLOCK_SZ - 1) ? &block[i + 1] : s_freehead;
+    }
+    if(s_freehead)
+        s_freehead->prev = &block[TASK_BLOCK_SZ - 1];
+    s_freehead = block;
+
+    s_task_blocks[s_ntask_blocks++] = block;
+    return true;
+
+fail_msgq:
+    for(int i = 0; i < TASK_BLOCK_SZ; i++) {
+        queue_tid_destroy(&block[i].msgq);
+    }
+    free(block);
+    return false;
+}
+
 static struct task *sched_task_alloc(void)
 {
-    if(!s_freehead)
+    SDL_AtomicLock(&s_alloc_lock);
+
+    if(!s_freehead && !sched_grow_tasks()) {
+        SDL_AtomicUnlock(&s_alloc_lock);
         return NULL;
+    }
 
     struct task *ret = s_freehead;
     if(ret->prev)
@@ -505,37 +676,382 @@ static struct task *sched_task_alloc(void)
         ret->next->prev = ret->prev;
 
     s_freehead = s_freehead->next;
+    SDL_AtomicUnlock(&s_alloc_lock);
     return ret;
 }
 
 static void sched_task_free(struct task *task)
 {
+    SDL_AtomicLock(&s_alloc_lock);
     task->next = s_freehead;
     task->prev = NULL;
     if(s_freehead)
         s_freehead->prev = task;
     s_freehead = task;
+    SDL_AtomicUnlock(&s_alloc_lock);
 }
 
-static void sched_reactivate(struct task *task)
+static void stack_unmap(void *stack, size_t size);
+
+static void sched_destroy_tasks(void)
+{
+    for(int i = 0; i < s_ntask_blocks; i++) {
+        for(int j = 0; j < TASK_BLOCK_SZ; j++) {
+            struct task *curr = &s_task_blocks[i][j];
+            if(curr->stackmem) {
+                stack_unmap(curr->stackmem, curr->stacksz);
+            }
+            queue_tid_destroy(&curr->msgq);
+        }
+        free(s_task_blocks[i]);
+        s_task_blocks[i] = NULL;
+    }
+    s_ntask_blocks = 0;
+    s_freehead = NULL;
+}
+
+#if defined(_WIN32)
+
+/* The system only grows the stacks that it knows about, so touching the 
+ * guard page below the committed part of a fiber stack raises an exception
+ * instead. By then, the touched page has already been committed and had its' 
+ * guard cleared. Move the guard down by one page and retry the access. Once 
+ * the stack is fully committed, the PAGE_NOACCESS page at the bottom of it 
+ * catches overflows.
+ */
+static LONG CALLBACK stack_guard_handler(EXCEPTION_POINTERS *info)
+{
+    if(info->ExceptionRecord->ExceptionCode != STATUS_GUARD_PAGE_VIOLATION)
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    char *addr = (char*)info->ExceptionRecord->ExceptionInformation[1];
+    char *page = (char*)((uintptr_t)addr & ~((uintptr_t)s_page_size - 1));
+
+    MEMORY_BASIC_INFORMATION mbi, bottom;
+    if(!VirtualQuery(page, &mbi, sizeof(mbi)))
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    /* Only fiber stacks start with a single committed PAGE_NOACCESS page */
+    char *base = mbi.AllocationBase;
+    if(!VirtualQuery(base, &bottom, sizeof(bottom))
+    || bottom.State != MEM_COMMIT
+    || bottom.Protect != PAGE_NOACCESS
+    || bottom.RegionSize != s_page_size
+    || page - base > BIG_STACK_SZ)
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    char *below = page - s_page_size;
+    if(below > base 
+    && VirtualQuery(below, &mbi, sizeof(mbi)) 
+    && mbi.State == MEM_RESERVE) {
+        VirtualAlloc(below, s_page_size, MEM_COMMIT, PAGE_READWRITE | PAGE_GUARD);
+    }
+    return EXCEPTION_CONTINUE_EXECUTION;
+}
+
+#endif
+
+static void *stack_map(size_t size)
+{
+#if defined(_WIN32)
+    /* Only reserve the stack. The top page is committed up front and the page
+     * under it is a guard page, which commits the rest of the stack one page 
+     * at a time as it is touched (see 'stack_guard_handler'). */
+    char *mem = VirtualAlloc(NULL, size + s_page_size, MEM_RESERVE, PAGE_NOACCESS);
+    if(!mem)
+        return NULL;
+    char *top = mem + s_page_size + size;
+    if(!VirtualAlloc(mem, s_page_size, MEM_COMMIT, PAGE_NOACCESS)
+    || !VirtualAlloc(top - s_page_size, s_page_size, MEM_COMMIT, PAGE_READWRITE)
+    || !VirtualAlloc(top - 2 * s_page_size, s_page_size, MEM_COMMIT, PAGE_READWRITE | PAGE_GUARD)) {
+        VirtualFree(mem, 0, MEM_RELEASE);
+        return NULL;
+    }
+#else
+    char *mem = mmap(NULL, size + s_page_size, PROT_READ | PROT_WRITE, 
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(mem == MAP_FAILED)
+        return NULL;
+    if(0 != mprotect(mem, s_page_size, PROT_NONE)) {
+        munmap(mem, size + s_page_size);
+        return NULL;
+    }
+#endif
+    return mem + s_page_size;
+}
+
+static void stack_unmap(void *stack, size_t size)
+{
+    char *mem = (char*)stack - s_page_size;
+#if defined(_WIN32)
+    VirtualFree(mem, 0, MEM_RELEASE);
+#else
+    munmap(mem, size + s_page_size);
+#endif
+}
+
+static void stack_pool_init(struct stack_pool *pool, size_t stacksz, size_t max_idle)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->stacksz = stacksz;
+    pool->max_idle = max_idle;
+}
+
+static void stack_pool_trim(struct stack_pool *pool, size_t keep)
+{
+    SDL_AtomicLock(&pool->lock);
+    while(pool->nidle > keep) {
+        stack_unmap(pool->idle[--pool->nidle], pool->stacksz);
+    }
+    SDL_AtomicUnlock(&pool->lock);
+}
+
+static void stack_pool_destroy(struct stack_pool *pool)
 {
-    SDL_LockMutex(s_ready_lock); 
+    stack_pool_trim(pool, 0);
+    free(pool->idle);
+    memset(pool, 0, sizeof(*pool));
+}
+
+static void *stack_pool_get(struct stack_pool *pool)
+{
+    void *ret = NULL;
+
+    SDL_AtomicLock(&pool->lock);
+    if(pool->nidle > 0) {
+        ret = pool->idle[--pool->nidle];
+    }
+    SDL_AtomicUnlock(&pool->lock);
+
+    if(!ret) {
+        ret = stack_map(pool->stacksz);
+    }
+    return ret;
+}
+
+static void stack_pool_put(struct stack_pool *pool, void *stack)
+{
+    SDL_AtomicLock(&pool->lock);
+
+    if(pool->nidle == pool->max_idle) {
+        SDL_AtomicUnlock(&pool->lock);
+        stack_unmap(stack, pool->stacksz);
+        return;
+    }
+
+    if(pool->nidle == pool->capacity) {
+
+        size_t newcap = pool->capacity ? pool->capacity * 2 : 64;
+        void **newidle = realloc(pool->idle, newcap * sizeof(void*));
+        if(!newidle) {
+            SDL_AtomicUnlock(&pool->lock);
+            stack_unmap(stack, pool->stacksz);
+            return;
+        }
+        pool->idle = newidle;
+        pool->capacity = newcap;
+    }
+
+    pool->idle[pool->nidle++] = stack;
+    SDL_AtomicUnlock(&pool->lock);
+}
+
+static void sched_task_release_stack(struct task *task)
+{
+    if(!task->stackmem)
+        return;
+
+    if(task->flags & TASK_BIG_STACK) {
+        stack_pool_put(&s_big_stacks, task->stackmem);
+    }else{
+        stack_pool_put(&s_stacks, task->stackmem);
+    }
+    task->stackmem = NULL;
+}
+
+static bool sched_in_worker(void)
+{
+    uint64_t key = thread_id_to_key(SDL_ThreadID());
+    khiter_t k = kh_get(tid, s_thread_worker_id_map, key);
+    return (k != kh_end(s_thread_worker_id_map));
+}
+
+static int sched_thread_stats_idx(void)
+{
+    if(SDL_ThreadID() == g_main_thread_id)
+        return MAX_WORKER_THREADS;
+    return sched_curr_thread_worker_id();
+}
+
+static size_t sched_target_queue(void)
+{
+    if(sched_in_worker()) {
+        return sched_curr_thread_worker_id();
+    }
+    return (size_t)SDL_AtomicAdd(&s_next_queue, 1) % s_nqueues;
+}
+
+static void sched_wake_sleepers(bool all)
+{
+    if(SDL_AtomicGet(&s_nsleepers) == 0)
+        return;
+
+    SDL_LockMutex(s_ready_lock);
+    if(all) {
+        SDL_CondBroadcast(s_ready_cond);
+    }else{
+        SDL_CondSignal(s_ready_cond);
+    }
+    SDL_UnlockMutex(s_ready_lock);
+}
+
+static bool sched_try_activate(struct task *task)
+{
+    bool ret;
     task->state = TASK_STATE_READY;
 
     if(task->flags & TASK_MAIN_THREAD_PINNED) {
-        pq_task_push(&s_ready_queue_main, task->prio, task);
+
+        SDL_AtomicLock(&s_ready_queue_main_lock);
+        ret = pq_task_push(&s_ready_queue_main, task->prio, task);
+        SDL_AtomicUnlock(&s_ready_queue_main_lock);
+
+        if(!ret)
+            return false;
+
+        SDL_AtomicAdd(&s_nready, 1);
+        /* Make sure the main thread gets woken up */
+        sched_wake_sleepers(true);
+
     }else{
-        pq_task_push(&s_ready_queue, task->prio, task);
+
+        size_t qidx = sched_target_queue();
+        SDL_AtomicLock(&s_ready_queue_locks[qidx]);
+        ret = pq_task_push(&s_ready_queues[qidx], task->prio, task);
+        SDL_AtomicUnlock(&s_ready_queue_locks[qidx]);
+
+        if(!ret)
+            return false;
+
+        SDL_AtomicAdd(&s_nready, 1);
+        sched_wake_sleepers(false);
     }
+    return true;
+}
 
-    SDL_CondSignal(s_ready_cond);
-    SDL_UnlockMutex(s_ready_lock);
+/* Put a task that has already been created back on a ready queue. There 
+ * is always room reserved for it (see 'sched_reserve_ready'), so this 
+ * cannot fail. 
+ */
+static void sched_reactivate(struct task *task)
+{
+    bool ret = sched_try_activate(task);
+    assert(ret);
+    (void)ret;
+}
+
+static bool sched_try_pop_queue(size_t qidx, struct task **out)
+{
+    if(pq_size(&s_ready_queues[qidx]) == 0)
+        return false;
+
+    SDL_AtomicLock(&s_ready_queue_locks[qidx]);
+    bool ret = pq_task_pop(&s_ready_queues[qidx], out);
+    SDL_AtomicUnlock(&s_ready_queue_locks[qidx]);
+
+    if(ret) {
+        SDL_AtomicAdd(&s_nready, -1);
+    }
+    return ret;
+}
+
+static bool sched_try_pop_main(struct task **out)
+{
+    if(pq_size(&s_ready_queue_main) == 0)
+        return false;
+
+    SDL_AtomicLock(&s_ready_queue_main_lock);
+    bool ret = pq_task_pop(&s_ready_queue_main, out);
+    SDL_AtomicUnlock(&s_ready_queue_main_lock);
+
+    if(ret) {
+        SDL_AtomicAdd(&s_nready, -1);
+    }
+    return ret;
+}
+
+/* Pop from the queue with index 'first', falling back to stealing 
+ * from the other queues in order. 
+ */
+static struct task *sched_try_pop_or_steal(size_t first)
+{
+    struct task *ret = NULL;
+    if(SDL_AtomicGet(&s_nready) == 0)
+        return NULL;
+
+    if(sched_try_pop_queue(first, &ret))
+        return ret;
+
+    for(int i = 1; i < s_nqueues; i++) {
+        size_t victim = (first + i) % s_nqueues;
+        if(sched_try_pop_queue(victim, &ret)) {
+            s_tasks_stolen[sched_thread_stats_idx()]++;
+            return ret;
+        }
+    }
+    return NULL;
+}
+
+/* The main thread serves both the pinned tasks and the shared queues. Take 
+ * whichever task at the head of the queues is the most urgent, preferring 
+ * the pinned ones on ties. 
+ */
+static struct task *sched_main_try_pop(void)
+{
+    struct task *ret = NULL;
+    float main_prio;
+
+    if(pq_size(&s_ready_queue_main) == 0)
+        return sched_try_pop_or_steal(0);
+
+    SDL_AtomicLock(&s_ready_queue_main_lock);
+    bool has_main = pq_task_top_prio(&s_ready_queue_main, &main_prio);
+    SDL_AtomicUnlock(&s_ready_queue_main_lock);
+
+    if(!has_main)
+        return sched_try_pop_or_steal(0);
+
+    for(int i = 0; i < s_nqueues; i++) {
+
+        if(pq_size(&s_ready_queues[i]) == 0)
+            continue;
+
+        float prio;
+        bool popped = false;
+
+        SDL_AtomicLock(&s_ready_queue_locks[i]);
+        if(pq_task_top_prio(&s_ready_queues[i], &prio) && prio < main_prio)
+            popped = pq_task_pop(&s_ready_queues[i], &ret);
+        SDL_AtomicUnlock(&s_ready_queue_locks[i]);
+
+        if(popped) {
+            SDL_AtomicAdd(&s_nready, -1);
+            if(i > 0) {
+                s_tasks_stolen[sched_thread_stats_idx()]++;
+            }
+            return ret;
+        }
+    }
+
+    if(sched_try_pop_main(&ret))
+        return ret;
+    return sched_try_pop_or_steal(0);
 }
 
 __attribute__((used)) static void sched_task_exit(struct result ret)
 {
     uint32_t tid = sched_curr_thread_tid();
-    struct task *task = &s_tasks[tid - 1];
+    struct task *task = sched_task_get(tid);
 
     if(task->future) {
         task->future->res = ret;
@@ -558,9 +1074,15 @@ __attribute__((used)) static void sched_task_exit(struct result ret)
     assert(0);
 }
 
-static void sched_task_init(struct task *task, int prio, uint32_t flags, 
+static bool sched_task_init(struct task *task, int prio, uint32_t flags, 
                             void *code, void *arg, struct future *future, uint32_t parent)
 {
+    struct stack_pool *pool = (flags & TASK_BIG_STACK) ? &s_big_stacks : &s_stacks;
+    task->stackmem = stack_pool_get(pool);
+    if(!task->stackmem)
+        return false;
+    task->stacksz = pool->stacksz;
+
     task->prio = prio;
     task->parent_tid = parent;
     task->flags = flags;
@@ -574,19 +1096,62 @@ static void sched_task_init(struct task *task, int prio, uint32_t flags,
         SDL_AtomicSet(&task->future->status, FUTURE_INCOMPLETE);    
     }
 
-    if(flags & TASK_BIG_STACK) {
-        task->stackmem = malloc(BIG_STACK_SZ);
-    }else{
-        task->stackmem = s_stacks[task->tid - 1];
+    sched_init_ctx(task, code);
+    if(!sched_try_activate(task)) {
+        sched_task_release_stack(task);
+        return false;
     }
+    return true;
+}
 
-    sched_init_ctx(task, code);
-    sched_reactivate(task);
+/* Make room for one more sender in the receiver's message queue. The larger 
+ * queue is allocated without holding the receiver's spinlock and only swapped
+ * in under it. Returns with the lock held and a free slot in the queue on 
+ * success.
+ */
+static bool sched_msgq_reserve_locked(struct task *recv_task)
+{
+    SDL_AtomicLock(&recv_task->lock);
+
+    while(queue_size(recv_task->msgq) == recv_task->msgq.capacity) {
+
+        size_t cap = recv_task->msgq.capacity;
+        SDL_AtomicUnlock(&recv_task->lock);
+
+        queue_tid_t grown;
+        if(!queue_tid_init(&grown, cap * 2))
+            return false;
+
+        SDL_AtomicLock(&recv_task->lock);
+        if(recv_task->msgq.capacity != cap) {
+            queue_tid_destroy(&grown);
+            continue;
+        }
+
+        uint32_t tid;
+        while(queue_tid_pop(&recv_task->msgq, &tid)) {
+            queue_tid_push(&grown, &tid);
+        }
+        queue_tid_t old = recv_task->msgq;
+        recv_task->msgq = grown;
+
+        SDL_AtomicUnlock(&recv_task->lock);
+        queue_tid_destroy(&old);
+        SDL_AtomicLock(&recv_task->lock);
+    }
+    return true;
 }
 
 static void sched_send(struct task *task, uint32_t tid, void *msg, size_t msglen)
 {
-    struct task *recv_task = &s_tasks[tid - 1];
+    struct task *recv_task = sched_task_get(tid);
+    task->retval = true;
+
+    if(!sched_msgq_reserve_locked(recv_task)) {
+        task->retval = false;
+        sched_reactivate(task);
+        return;
+    }
 
     /* write data to blocked send-blocked task to unblock it */
     if(recv_task->state == TASK_STATE_SEND_BLOCKED) {
@@ -599,27 +1164,35 @@ static void sched_send(struct task *task, uint32_t tid, void *msg, size_t msglen
         memcpy(dst, msg, msglen);
         *out_send = task->tid;
 
+        /* Take the receiver out of the send-blocked state before releasing
+         * the lock, so that no other sender can write to it */
+        recv_task->state = TASK_STATE_READY;
         task->state = TASK_STATE_REPLY_BLOCKED;
-        assert(recv_task->state != TASK_STATE_EVENT_BLOCKED);
+        SDL_AtomicUnlock(&recv_task->lock);
         sched_reactivate(recv_task);
 
     }else{
 
         task->state = TASK_STATE_RECV_BLOCKED;
-        queue_tid_push(&s_msg_queues[tid - 1], &task->tid);
+        bool pushed = queue_tid_push(&recv_task->msgq, &task->tid);
+        assert(pushed);
+        (void)pushed;
+        SDL_AtomicUnlock(&recv_task->lock);
     }
 }
 
 static void sched_receive(struct task *task, uint32_t *out_tid, void *msg, size_t msglen)
 {
-    if(queue_size(s_msg_queues[task->tid - 1]) > 0) {
+    SDL_AtomicLock(&task->lock);
+
+    if(queue_size(task->msgq) > 0) {
     
         uint32_t send_tid = 0;
         assert(task->state != TASK_STATE_SEND_BLOCKED);
-        queue_tid_pop(&s_msg_queues[task->tid - 1], &send_tid);
+        queue_tid_pop(&task->msgq, &send_tid);
         assert(send_tid > 0);
 
-        struct task *send_task = &s_tasks[send_tid - 1];
+        struct task *send_task = sched_task_get(send_tid);
         void *src = (void*)send_task->req.argv[1];
         size_t srclen = (size_t)send_task->req.argv[2];
 
@@ -629,18 +1202,23 @@ static void sched_receive(struct task *task, uint32_t *out_tid, void *msg, size_
 
         assert(send_task->state == TASK_STATE_RECV_BLOCKED);
         send_task->state = TASK_STATE_REPLY_BLOCKED;
+        SDL_AtomicUnlock(&task->lock);
+
         assert(task->state != TASK_STATE_EVENT_BLOCKED);
         sched_reactivate(task);
 
     }else{
 
         task->state = TASK_STATE_SEND_BLOCKED;
+        SDL_AtomicUnlock(&task->lock);
     }
 }
 
 static void sched_reply(struct task *task, uint32_t tid, void *reply, size_t replylen)
 {
-    struct task *send_task = &s_tasks[tid - 1];
+    /* The sender is reply-blocked on this task, so nobody else
+     * can be touching it concurrently */
+    struct task *send_task = sched_task_get(tid);
     assert(send_task->state == TASK_STATE_REPLY_BLOCKED);
 
     void *dst = (void*)send_task->req.argv[3];
@@ -657,6 +1235,7 @@ static void sched_reply(struct task *task, uint32_t tid, void *reply, size_t rep
 
 static void sched_await_event(struct task *task, int event)
 {
+    SDL_LockMutex(s_event_lock);
     task->state = TASK_STATE_EVENT_BLOCKED;
 
     int status;
@@ -669,6 +1248,7 @@ static void sched_await_event(struct task *task, int event)
         queue_tid_init(&kh_val(s_event_queues, k), 32);
     }
     queue_tid_push(&kh_val(s_event_queues, k), &task->tid);
+    SDL_UnlockMutex(s_event_lock);
 }
 
 static uint32_t sched_create(int prio, task_func_t code, void *arg, struct future *result, 
@@ -678,35 +1258,40 @@ static uint32_t sched_create(int prio, task_func_t code, void *arg, struct futur
     if(!task)
         return NULL_TID;
 
-    sched_task_init(task, prio, flags, code, arg, result, parent);
+    if(!sched_task_init(task, prio, flags, code, arg, result, parent)) {
+        sched_task_free(task);
+        return NULL_TID;
+    }
     return task->tid;
 }
 
 static bool sched_wait(struct task *task, uint32_t child_tid)
 {
-    if(child_tid > MAX_TASKS)
+    if(child_tid == NULL_TID || child_tid > s_ntask_blocks * TASK_BLOCK_SZ)
         return false;
 
-    struct task *child = &s_tasks[child_tid - 1];
+    struct task *child = sched_task_get(child_tid);
     if(child->parent_tid != task->tid
     || (child->flags & TASK_DETACHED))
         return false;
 
+    SDL_AtomicLock(&child->lock);
+
     if(child->state == TASK_STATE_ZOMBIE) {
+        SDL_AtomicUnlock(&child->lock);
         sched_task_free(child);
         assert(task->state != TASK_STATE_EVENT_BLOCKED);
         sched_reactivate(task);
         return true;
     }
 
-    s_parent_waiting[child_tid - 1] = true;
+    child->parent_waiting = true;
+    SDL_AtomicUnlock(&child->lock);
     return true;
 }
 
 static void sched_task_service_request(struct task *task)
 {
-    SDL_LockMutex(s_request_lock);
-
     switch((int)task->req.type) {
     case SCHED_REQ_CREATE:
         task->retval = sched_create(
@@ -768,35 +1353,43 @@ static void sched_task_service_request(struct task *task)
         break;
     case SCHED_REQ_WAIT:
         task->retval = sched_wait(task, task->req.argv[0]);
+        if(!task->retval) {
+            sched_reactivate(task);
+        }
         break;
     case _SCHED_REQ_FREE:
 
-        if(task->flags & TASK_BIG_STACK) {
-            free(task->stackmem);
-        }
+        sched_task_release_stack(task);
+
         if(task->flags & TASK_DETACHED) {
             sched_task_free(task);
-        }else if(s_parent_waiting[task->tid - 1]) {
+            break;
+        }
+
+        SDL_AtomicLock(&task->lock);
+        if(task->parent_waiting) {
+
+            struct task *parent = sched_task_get(task->parent_tid);
+            task->parent_waiting = false;
+            SDL_AtomicUnlock(&task->lock);
 
-            struct task *parent = &s_tasks[task->parent_tid - 1];
-            s_parent_waiting[task->tid - 1] = false;
             assert(parent->state != TASK_STATE_EVENT_BLOCKED);
             sched_reactivate(parent);
             sched_task_free(task);
         }else{
             task->state = TASK_STATE_ZOMBIE;
+            SDL_AtomicUnlock(&task->lock);
         }
         break;
     default: assert(0);    
     }
-
-    SDL_UnlockMutex(s_request_lock);
 }
 
 static void sched_task_run(struct task *task)
 {
     sched_set_thread_tid(SDL_ThreadID(), task->tid);
     task->state = TASK_STATE_ACTIVE;
+    s_tasks_run[sched_thread_stats_idx()]++;
 
     char name[64];
     pf_snprintf(name, sizeof(name), "Task %03u", task->tid);
@@ -853,11 +1446,11 @@ static void sched_init_thread_worker_id_map(void)
 static void sched_wait_workers_done(void)
 {
     SDL_LockMutex(s_ready_lock);
-    while(s_idle_workers < s_nworkers)
+    while(s_idle_workers < s_nactive_workers)
         SDL_CondWait(s_ready_cond, s_ready_lock);
     SDL_UnlockMutex(s_ready_lock);
 
-    assert(s_idle_workers == s_nworkers);
+    assert(s_idle_workers == s_nactive_workers);
     assert(s_nwaiters == 0);
 }
 
@@ -867,16 +1460,36 @@ static void sched_quiesce_workers(void)
     PERF_ENTER();
 
     SDL_LockMutex(s_ready_lock);
-    s_quiesce = true;
+    SDL_AtomicSet(&s_quiesce, true);
     SDL_CondBroadcast(s_ready_cond);
     SDL_UnlockMutex(s_ready_lock);
 
     sched_wait_workers_done();
 
-    s_quiesce = false;
+    SDL_AtomicSet(&s_quiesce, false);
     PERF_RETURN_VOID();
 }
 
+static void sched_accumulate_stats(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    s_last_stats.tasks_run = 0;
+    s_last_stats.tasks_stolen = 0;
+
+    for(int i = 0; i < ARR_SIZE(s_tasks_run); i++) {
+        s_last_stats.tasks_run += s_tasks_run[i];
+        s_last_stats.tasks_stolen += s_tasks_stolen[i];
+        s_tasks_run[i] = 0;
+        s_tasks_stolen[i] = 0;
+    }
+    s_last_stats.nworkers = s_nworkers;
+    s_last_stats.nactive_workers = s_nactive_workers;
+}
+
+static bool sched_parallel_pending(void);
+static bool sched_parallel_join(void);
+
 static void worker_wait_on_cmd(int id)
 {
     SDL_LockMutex(s_worker_locks[id]);
@@ -894,21 +1507,31 @@ static void worker_notify_done(int id)
     SDL_UnlockMutex(s_ready_lock);
 }
 
-static struct task *worker_wait_task_or_quiesce(void)
+static struct task *worker_wait_task_or_quiesce(int id)
 {
-    struct task *task = NULL;
+    if(SDL_AtomicGet(&s_quiesce))
+        return NULL;
+
+    /* Fast path: don't touch the ready lock while there is work to do */
+    struct task *task = sched_try_pop_or_steal(id);
+    if(task)
+        return task;
 
     SDL_LockMutex(s_ready_lock);
     s_nwaiters++;
+    SDL_AtomicAdd(&s_nsleepers, 1);
 
-    if(s_nwaiters == s_nworkers) {
+    if(s_nwaiters == s_nactive_workers) {
         SDL_CondBroadcast(s_ready_cond);
     }
 
-    while(!s_quiesce && !pq_task_pop(&s_ready_queue, &task)) {
+    while(!SDL_AtomicGet(&s_quiesce) 
+       && !sched_parallel_pending()
+       && !(task = sched_try_pop_or_steal(id))) {
         SDL_CondWait(s_ready_cond, s_ready_lock);
     }
 
+    SDL_AtomicAdd(&s_nsleepers, -1);
     s_nwaiters--;
     SDL_UnlockMutex(s_ready_lock);
 
@@ -919,9 +1542,14 @@ static void worker_do_work(int id)
 {
     while(Perf_CurrFrameMS() < SCHED_TICK_MS) {
 
-        struct task *task = worker_wait_task_or_quiesce();
-        if(!task)
+        if(sched_parallel_join())
+            continue;
+
+        struct task *task = worker_wait_task_or_quiesce(id);
+        if(!task && SDL_AtomicGet(&s_quiesce))
             return;
+        if(!task)
+            continue;
 
         assert(task);
         sched_task_run(task);
@@ -951,6 +1579,200 @@ static int tasks_compare(void *a, void *b)
     return ((uintptr_t)(ta) - (uintptr_t)(tb));
 }
 
+static bool sched_remove_ready(struct task *task)
+{
+    bool found = false;
+
+    SDL_AtomicLock(&s_ready_queue_main_lock);
+    found = pq_task_remove(&s_ready_queue_main, tasks_compare, task);
+    SDL_AtomicUnlock(&s_ready_queue_main_lock);
+
+    for(int i = 0; !found && i < s_nqueues; i++) {
+        SDL_AtomicLock(&s_ready_queue_locks[i]);
+        found = pq_task_remove(&s_ready_queues[i], tasks_compare, task);
+        SDL_AtomicUnlock(&s_ready_queue_locks[i]);
+    }
+
+    if(found) {
+        SDL_AtomicAdd(&s_nready, -1);
+    }
+    return found;
+}
+
+static void sched_clear_queue(pq_task_t *queue)
+{
+    while(pq_size(queue)) {
+        struct task *curr = NULL;
+        pq_task_pop(queue, &curr);
+        SDL_AtomicAdd(&s_nready, -1);
+    }
+}
+
+/* Tears down every task that is still alive, regardless of whether it 
+ * is ready, blocked or a zombie, and puts all of them back on the free 
+ * list. Must only be called once the ready queues have been emptied.
+ */
+static void sched_reset_tasks(void)
+{
+    /* Only the tasks that haven't exited yet still own a stack */
+    for(int i = 0; i < s_ntask_blocks; i++) {
+        for(int j = 0; j < TASK_BLOCK_SZ; j++) {
+
+            struct task *curr = &s_task_blocks[i][j];
+            if(curr->stackmem && curr->destructor) {
+                curr->destructor(curr->darg);
+            }
+            sched_task_release_stack(curr);
+
+            curr->destructor = NULL;
+            curr->darg = NULL;
+            curr->future = NULL;
+            curr->parent_waiting = false;
+            queue_tid_clear(&curr->msgq);
+        }
+    }
+
+    SDL_AtomicLock(&s_alloc_lock);
+    s_freehead = NULL;
+
+    for(int i = s_ntask_blocks - 1; i >= 0; i--) {
+        for(int j = TASK_BLOCK_SZ - 1; j >= 0; j--) {
+
+            struct task *curr = &s_task_blocks[i][j];
+            curr->prev = NULL;
+            curr->next = s_freehead;
+            if(s_freehead)
+                s_freehead->prev = curr;
+            s_freehead = curr;
+        }
+    }
+    SDL_AtomicUnlock(&s_alloc_lock);
+}
+
+static struct result bench_task(void *arg)
+{
+    int gen = (uintptr_t)arg;
+    volatile uint64_t accum = 0;
+
+    while(SDL_AtomicGet(&s_bench_gen) == gen) {
+        for(int i = 0; i < 1000; i++)
+            accum += i;
+        Task_Yield();
+    }
+    return NULL_RESULT;
+}
+
+static void sched_bench_spawn(int ntasks)
+{
+    int gen = SDL_AtomicAdd(&s_bench_gen, 1) + 1;
+    for(int i = 0; i < ntasks; i++) {
+        sched_create(0, bench_task, (void*)((uintptr_t)gen), NULL, TASK_DETACHED, NULL_TID);
+    }
+    s_bench_ntasks = ntasks;
+}
+
+static void sched_parallel_work(void)
+{
+    int idx;
+    while((idx = SDL_AtomicAdd(&s_parallel.next, 1)) < (int)s_parallel.njobs) {
+        s_parallel.code(s_parallel.arg, idx);
+    }
+}
+
+static bool sched_parallel_pending(void)
+{
+    return SDL_AtomicGet(&s_parallel.active)
+        && SDL_AtomicGet(&s_parallel.next) < (int)s_parallel.njobs;
+}
+
+/* Called by the worker threads to help out with the currently published 
+ * data-parallel job, if there is one. Returns true if any work was done.
+ */
+static bool sched_parallel_join(void)
+{
+    if(!sched_parallel_pending())
+        return false;
+
+    SDL_LockMutex(s_parallel.lock);
+    if(!SDL_AtomicGet(&s_parallel.active)) {
+        SDL_UnlockMutex(s_parallel.lock);
+        return false;
+    }
+    s_parallel.nhelpers++;
+    SDL_UnlockMutex(s_parallel.lock);
+
+    sched_parallel_work();
+
+    SDL_LockMutex(s_parallel.lock);
+    if(--s_parallel.nhelpers == 0) {
+        SDL_CondSignal(s_parallel.done);
+    }
+    SDL_UnlockMutex(s_parallel.lock);
+    return true;
+}
+
+static bool active_workers_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= 0 && new_val->as_int <= s_nworkers);
+}
+
+static void active_workers_commit(const struct sval *new_val)
+{
+    /* Takes effect at the start of the next frame */
+    s_nactive_workers_next = new_val->as_int ? new_val->as_int : s_nworkers;
+}
+
+static bool bench_tasks_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= 0 && new_val->as_int <= MAX_TASKS / 2);
+}
+
+static void bench_tasks_commit(const struct sval *new_val)
+{
+    if(new_val->as_int == s_bench_ntasks)
+        return;
+    sched_bench_spawn(new_val->as_int);
+}
+
+static void sched_create_settings(void)
+{
+    ss_e status;
+    (void)status;
+
+    status = Settings_Create((struct setting){
+        .name = "pf.debug.sched_active_workers",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 0
+        },
+        .prio = 0,
+        .validate = active_workers_validate,
+        .commit = active_workers_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval setting;
+    status = Settings_Get("pf.debug.sched_active_workers", &setting);
+    assert(status == SS_OKAY);
+    active_workers_commit(&setting);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.debug.sched_bench_tasks",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 0
+        },
+        .prio = 0,
+        .validate = bench_tasks_validate,
+        .commit = bench_tasks_commit,
+    });
+    assert(status == SS_OKAY);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -967,9 +1789,9 @@ bool Sched_Init(void)
     if(!s_thread_worker_id_map)
         goto fail_thread_worker_id_map;
 
-    s_request_lock = SDL_CreateMutex();
-    if(!s_request_lock)
-        goto fail_req_lock;
+    s_event_lock = SDL_CreateMutex();
+    if(!s_event_lock)
+        goto fail_event_lock;
 
     s_event_queues = kh_init(tqueue);
     if(!s_event_queues)
@@ -983,35 +1805,54 @@ bool Sched_Init(void)
     if(!s_ready_cond)
         goto fail_ready_cond;
 
-    pq_task_init(&s_ready_queue);
-    if(!pq_task_reserve(&s_ready_queue, MAX_TASKS))
-        goto fail_ready_queue;
+    s_parallel.lock = SDL_CreateMutex();
+    if(!s_parallel.lock)
+        goto fail_parallel_lock;
 
-    pq_task_init(&s_ready_queue_main);
-    if(!pq_task_reserve(&s_ready_queue_main, MAX_TASKS))
-        goto fail_ready_queue_main;
-
-    assert(MAX_TASKS >= 2);
-    s_tasks[0].prev = NULL;
-    s_tasks[0].next = &s_tasks[1];
-    s_tasks[MAX_TASKS-1].prev = &s_tasks[MAX_TASKS - 2];
-    s_tasks[MAX_TASKS-1].next = NULL;
+    s_parallel.done = SDL_CreateCond();
+    if(!s_parallel.done)
+        goto fail_parallel_done;
+    SDL_AtomicSet(&s_parallel.active, false);
 
-    for(int i = 1; i < MAX_TASKS-1; i++) {
-        s_tasks[i].next = &s_tasks[i + 1];
-        s_tasks[i].prev = &s_tasks[i - 1];
+    /* On a single-core system, all the tasks will just be run on the main thread */
+    s_nworkers = SDL_GetCPUCount() - 1;
+    s_nworkers = MIN(s_nworkers, MAX_WORKER_THREADS);
+    s_nactive_workers = s_nworkers;
+    s_nactive_workers_next = s_nworkers;
+    s_nqueues = MAX(s_nworkers, 1);
+
+    SDL_AtomicSet(&s_nready, 0);
+    SDL_AtomicSet(&s_nsleepers, 0);
+    SDL_AtomicSet(&s_quiesce, false);
+    SDL_AtomicSet(&s_next_queue, 0);
+
+    for(int i = 0; i < s_nqueues; i++) {
+        pq_task_init(&s_ready_queues[i]);
+        if(!pq_task_reserve(&s_ready_queues[i], TASK_BLOCK_SZ))
+            goto fail_ready_queue;
     }
-    s_freehead = s_tasks;
 
-    for(int i = 0; i < MAX_TASKS; i++) {
+    pq_task_init(&s_ready_queue_main);
+    if(!pq_task_reserve(&s_ready_queue_main, TASK_BLOCK_SZ))
+        goto fail_ready_queue_main;
 
-        s_tasks[i].tid = i + 1;
-        if(!queue_tid_init(&s_msg_queues[i], MAX_TASKS))
-            goto fail_msg_queue;
-    }
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    s_page_size = si.dwPageSize;
+    s_stack_veh = AddVectoredExceptionHandler(1, stack_guard_handler);
+    if(!s_stack_veh)
+        goto fail_stack_veh;
+#else
+    s_page_size = sysconf(_SC_PAGESIZE);
+#endif
+    stack_pool_init(&s_stacks, STACK_SZ, MAX_IDLE_STACKS);
+    stack_pool_init(&s_big_stacks, BIG_STACK_SZ, MAX_IDLE_BIG_STACKS);
 
-    /* On a single-core system, all the tasks will just be run on the main thread */
-    s_nworkers = SDL_GetCPUCount() - 1;
+    s_freehead = NULL;
+    s_ntask_blocks = 0;
+    if(!sched_grow_tasks())
+        goto fail_tasks;
 
     for(int i = 0; i < s_nworkers; i++) {
 
@@ -1039,6 +1880,7 @@ bool Sched_Init(void)
 
     sched_init_thread_tid_map();
     sched_init_thread_worker_id_map();
+    sched_create_settings();
     Task_CreateServices();
     return true;
 
@@ -1056,22 +1898,32 @@ fail_worker_sync:
         if(s_worker_conds[i])
             SDL_DestroyCond(s_worker_conds[i]);
     }
-fail_msg_queue:
-    for(int i = 0; i < MAX_TASKS; i++) {
-        queue_tid_destroy(s_msg_queues + i);
-    }
+    sched_destroy_tasks();
+fail_tasks:
+    stack_pool_destroy(&s_stacks);
+    stack_pool_destroy(&s_big_stacks);
+#if defined(_WIN32)
+    RemoveVectoredExceptionHandler(s_stack_veh);
+fail_stack_veh:
+#endif
     pq_task_destroy(&s_ready_queue_main);
 fail_ready_queue_main:
-    pq_task_destroy(&s_ready_queue);
 fail_ready_queue:
+    for(int i = 0; i < s_nqueues; i++) {
+        pq_task_destroy(&s_ready_queues[i]);
+    }
+    SDL_DestroyCond(s_parallel.done);
+fail_parallel_done:
+    SDL_DestroyMutex(s_parallel.lock);
+fail_parallel_lock:
     SDL_DestroyCond(s_ready_cond);
 fail_ready_cond:
     SDL_DestroyMutex(s_ready_lock);
 fail_ready_lock:
     kh_destroy(tqueue, s_event_queues);
 fail_event_queue:
-    SDL_DestroyMutex(s_request_lock);
-fail_req_lock:
+    SDL_DestroyMutex(s_event_lock);
+fail_event_lock:
     kh_destroy(tid, s_thread_worker_id_map);
 fail_thread_worker_id_map:
     kh_destroy(tid, s_thread_tid_map);
@@ -1092,12 +1944,17 @@ void Sched_Shutdown(void)
     });
     kh_destroy(tqueue, s_event_queues);
 
+    SDL_DestroyCond(s_parallel.done);
+    SDL_DestroyMutex(s_parallel.lock);
     SDL_DestroyCond(s_ready_cond);
     SDL_DestroyMutex(s_ready_lock);
     kh_destroy(tid, s_thread_tid_map);
     kh_destroy(tid, s_thread_worker_id_map);
-    SDL_DestroyMutex(s_request_lock);
-    pq_task_destroy(&s_ready_queue);
+    SDL_DestroyMutex(s_event_lock);
+
+    for(int i = 0; i < s_nqueues; i++) {
+        pq_task_destroy(&s_ready_queues[i]);
+    }
     pq_task_destroy(&s_ready_queue_main);
 
     for(int i = 0; i < s_nworkers; i++) {
@@ -1108,15 +1965,18 @@ void Sched_Shutdown(void)
         SDL_DestroyMutex(s_worker_locks[i]);
         SDL_DestroyCond(s_worker_conds[i]);
     }
-    for(int i = 0; i < MAX_TASKS; i++) {
-        queue_tid_destroy(s_msg_queues + i);
-    }
+    sched_destroy_tasks();
+    stack_pool_destroy(&s_stacks);
+    stack_pool_destroy(&s_big_stacks);
+#if defined(_WIN32)
+    RemoveVectoredExceptionHandler(s_stack_veh);
+#endif
 }
 
 void Sched_HandleEvent(int event, void *arg, int event_source)
 {
     ASSERT_IN_MAIN_THREAD();
-    SDL_LockMutex(s_request_lock);
+    SDL_LockMutex(s_event_lock);
 
     khiter_t k = kh_get(tqueue, s_event_queues, event);
     if(k == kh_end(s_event_queues))
@@ -1128,7 +1988,7 @@ void Sched_HandleEvent(int event, void *arg, int event_source)
         uint32_t tid;
         queue_tid_pop(waiters, &tid);
 
-        struct task *task = &s_tasks[tid - 1];
+        struct task *task = sched_task_get(tid);
         assert(task->state == TASK_STATE_EVENT_BLOCKED);
 
         int *source = (void*)task->req.argv[1];
@@ -1152,7 +2012,7 @@ void Sched_HandleEvent(int event, void *arg, int event_source)
     }
 
 out:
-    SDL_UnlockMutex(s_request_lock);
+    SDL_UnlockMutex(s_event_lock);
 }
 
 void Sched_StartBackgroundTasks(void)
@@ -1165,9 +2025,10 @@ void Sched_StartBackgroundTasks(void)
 
     SDL_LockMutex(s_ready_lock);
     s_idle_workers = 0;
+    s_nactive_workers = s_nactive_workers_next;
     SDL_UnlockMutex(s_ready_lock);
 
-    for(int i = 0; i < s_nworkers; i++) {
+    for(int i = 0; i < s_nactive_workers; i++) {
     
         SDL_LockMutex(s_worker_locks[i]);
         s_worker_start[i] = true;
@@ -1189,11 +2050,15 @@ void Sched_Tick(void)
         int nwaiters = 0;
         struct task *curr = NULL;
 
+        if((curr = sched_main_try_pop()))
+            goto run;
+
         SDL_LockMutex(s_ready_lock);
-        while(!pq_size(&s_ready_queue_main) 
-           && !pq_size(&s_ready_queue) 
-           && ((nwaiters = s_nwaiters) < s_nworkers)
-           && (s_idle_workers < s_nworkers)) {
+        SDL_AtomicAdd(&s_nsleepers, 1);
+
+        while(!(curr = sched_main_try_pop())
+           && ((nwaiters = s_nwaiters) < s_nactive_workers)
+           && (s_idle_workers < s_nactive_workers)) {
 
             size_t left = (Perf_CurrFrameMS() < SCHED_TICK_MS) 
                         ? SCHED_TICK_MS - Perf_CurrFrameMS() 
@@ -1201,32 +2066,23 @@ void Sched_Tick(void)
 
             SDL_CondWaitTimeout(s_ready_cond, s_ready_lock, left);
             if(left == 0) {
-                s_quiesce = true;
+                SDL_AtomicSet(&s_quiesce, true);
                 SDL_CondBroadcast(s_ready_cond); 
             }
         }
-        if(pq_size(&s_ready_queue_main) || pq_size(&s_ready_queue)) {
-
-            float prio_main = -1.0, prio_gen = -1.0;
-            pq_task_top_prio(&s_ready_queue_main, &prio_main);
-            pq_task_top_prio(&s_ready_queue, &prio_gen);
 
-            if(prio_gen > prio_main) {
-                pq_task_pop(&s_ready_queue, &curr);
-            }else {
-                pq_task_pop(&s_ready_queue_main, &curr);
-            }
-        }
+        SDL_AtomicAdd(&s_nsleepers, -1);
         SDL_UnlockMutex(s_ready_lock);
 
         /* When the ready queue is empty and all the workers are in a state of waiting, 
          * there is no more work to be done. In that case, let's not waste any more time. 
          */
-        if(curr == NULL && nwaiters == s_nworkers)
+        if(curr == NULL && nwaiters == s_nactive_workers)
             break;
-        if(curr == NULL && s_idle_workers == s_nworkers)
+        if(curr == NULL && s_idle_workers == s_nactive_workers)
             break;
 
+    run:
         assert(curr);
         sched_task_run(curr);
         sched_task_service_request(curr);
@@ -1234,47 +2090,73 @@ void Sched_Tick(void)
     }while(Perf_CurrFrameMS() < SCHED_TICK_MS);
 
     sched_quiesce_workers();
+    sched_accumulate_stats();
     PERF_RETURN_VOID();
 }
 
 uint32_t Sched_Create(int prio, task_func_t code, void *arg, struct future *result, int flags)
 {
     ASSERT_IN_MAIN_THREAD();
-
-    SDL_LockMutex(s_request_lock);
-    uint32_t ret = sched_create(prio, code, arg, result, flags | TASK_DETACHED, NULL_TID);
-    SDL_UnlockMutex(s_request_lock);
-
-    return ret;
+    return sched_create(prio, code, arg, result, flags | TASK_DETACHED, NULL_TID);
 }
 
 bool Sched_RunSync(uint32_t tid)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    SDL_LockMutex(s_request_lock);
-    bool ret = false;
-
-    struct task *task = &s_tasks[tid - 1];
-    if(!(task->flags & TASK_DETACHED)) {
-        goto out;
-    }
-
-    SDL_LockMutex(s_ready_lock);
-    bool found = pq_task_remove(&s_ready_queue, tasks_compare, task) 
-              || pq_task_remove(&s_ready_queue_main, tasks_compare, task);
-    SDL_UnlockMutex(s_ready_lock);
+    struct task *task = sched_task_get(tid);
+    if(!(task->flags & TASK_DETACHED))
+        return false;
 
-    if(!found)
-        goto out;
+    if(!sched_remove_ready(task))
+        return false;
 
     sched_task_run(task);
     sched_task_service_request(task);
-    ret = true;
+    return true;
+}
 
-out:
-    SDL_UnlockMutex(s_request_lock);
-    return ret;
+/* Invoke 'code' once for every index in [0, njobs), spreading the invocations 
+ * over the worker threads. The calling thread participates in the work and the 
+ * call returns only once all the invocations have completed. 
+ */
+void Sched_RunParallel(parallel_func_t code, void *arg, size_t njobs)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(njobs == 0)
+        return;
+
+    /* The workers are only running between the calls to Sched_StartBackgroundTasks 
+     * and Sched_Tick. Outside of that window, just do all the work inline. 
+     */
+    if(s_prev_ss != G_RUNNING || s_nactive_workers == 0 || njobs == 1) {
+        for(size_t i = 0; i < njobs; i++)
+            code(arg, i);
+        return;
+    }
+
+    SDL_LockMutex(s_parallel.lock);
+    assert(s_parallel.nhelpers == 0);
+    s_parallel.code = code;
+    s_parallel.arg = arg;
+    s_parallel.njobs = njobs;
+    SDL_AtomicSet(&s_parallel.next, 0);
+    SDL_AtomicSet(&s_parallel.active, true);
+    SDL_UnlockMutex(s_parallel.lock);
+
+    sched_wake_sleepers(true);
+    sched_parallel_work();
+
+    /* All the jobs have been handed out by now. Wait for the ones that 
+     * have been picked up by the workers to be completed and for the 
+     * workers to stop touching the job state.
+     */
+    SDL_LockMutex(s_parallel.lock);
+    SDL_AtomicSet(&s_parallel.active, false);
+    while(s_parallel.nhelpers > 0)
+        SDL_CondWait(s_parallel.done, s_parallel.lock);
+    SDL_UnlockMutex(s_parallel.lock);
 }
 
 void Sched_ClearState(void)
@@ -1283,46 +2165,38 @@ void Sched_ClearState(void)
 
     sched_quiesce_workers();
 
-    SDL_LockMutex(s_ready_lock);
-
-    while(pq_size(&s_ready_queue)) {
-        struct task *curr = NULL;
-        pq_task_pop(&s_ready_queue, &curr);
-        if(curr->destructor) {
-            curr->destructor(curr->darg);
-        }
-        sched_task_free(curr);
-    }
-
-    while(pq_size(&s_ready_queue_main)) {
-        struct task *curr = NULL;
-        pq_task_pop(&s_ready_queue_main, &curr);
-        if(curr->destructor) {
-            curr->destructor(curr->darg);
-        }
-        sched_task_free(curr);
+    for(int i = 0; i < s_nqueues; i++) {
+        SDL_AtomicLock(&s_ready_queue_locks[i]);
+        sched_clear_queue(&s_ready_queues[i]);
+        SDL_AtomicUnlock(&s_ready_queue_locks[i]);
     }
 
-    SDL_UnlockMutex(s_ready_lock);
+    SDL_AtomicLock(&s_ready_queue_main_lock);
+    sched_clear_queue(&s_ready_queue_main);
+    SDL_AtomicUnlock(&s_ready_queue_main_lock);
 
+    SDL_LockMutex(s_event_lock);
     for(khiter_t k = kh_begin(s_event_queues); k != kh_end(s_event_queues); k++) {
         if(!kh_exist(s_event_queues, k))
             continue;
         queue_tid_clear(&kh_val(s_event_queues, k));
     }
+    SDL_UnlockMutex(s_event_lock);
 
-    for(int i = 0; i < MAX_TASKS; i++) {
-        queue_tid_clear(&s_msg_queues[i]);
-        s_parent_waiting[i] = false;
-    }
+    sched_reset_tasks();
+
+    /* Release the memory of the stacks that are no longer in use */
+    stack_pool_trim(&s_stacks, 0);
+    stack_pool_trim(&s_big_stacks, 0);
 
+    s_bench_ntasks = 0;
     Task_CreateServices();
 }
 
 uint64_t Sched_Request(struct request req)
 {
     uint32_t tid = sched_curr_thread_tid();
-    struct task *task = &s_tasks[tid - 1];
+    struct task *task = sched_task_get(tid);
 
     task->req = req;
 
@@ -1344,3 +2218,9 @@ bool Sched_FutureIsReady(const struct future *future)
     return (SDL_AtomicGet((SDL_atomic_t*)&future->status) == FUTURE_COMPLETE);
 }
 
+void Sched_GetStats(struct sched_stats *out)
+{
+    ASSERT_IN_MAIN_THREAD();
+    *out = s_last_stats;
+}
+
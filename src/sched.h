@@ -85,7 +85,16 @@ enum{
     TASK_BIG_STACK          = (1 << 2),
 };
 
+struct sched_stats{
+    /* The following are accumulated over the previous tick */
+    uint64_t tasks_run;
+    uint64_t tasks_stolen;
+    int      nworkers;
+    int      nactive_workers;
+};
+
 typedef struct result (*task_func_t)(void *);
+typedef void (*parallel_func_t)(void *arg, size_t idx);
 
 /* The following may only be called from any context */
 
@@ -100,7 +109,9 @@ void     Sched_StartBackgroundTasks(void);
 void     Sched_Tick(void);
 uint32_t Sched_Create(int prio, task_func_t code, void *arg, struct future *result, int flags);
 bool     Sched_RunSync(uint32_t tid);
+void     Sched_RunParallel(parallel_func_t code, void *arg, size_t njobs);
 void     Sched_ClearState(void);
+void     Sched_GetStats(struct sched_stats *out);
 
 /* The following may only be called from task context 
  * (i.e. from the body of a task function) */
@@ -687,6 +687,7 @@ static int PyEntity_set_scale(PyEntityObject *self, PyObject *value, void *closu
         &self->ent->scale.raw[0], &self->ent->scale.raw[1], &self->ent->scale.raw[2]))
         return -1;
 
+    G_UpdateBounds(self->ent);
     return 0;
 }
 
@@ -708,6 +709,7 @@ static int PyEntity_set_rotation(PyEntityObject *self, PyObject *value, void *cl
         &self->ent->rotation.raw[2], &self->ent->rotation.raw[3]))
         return -1;
 
+    G_UpdateBounds(self->ent);
     return 0;
 }
 
@@ -748,6 +750,7 @@ static int PyEntity_set_selection_radius(PyEntityObject *self, PyObject *value,
     }
 
     self->ent->selection_radius = PyFloat_AsDouble(value);
+    G_Pos_UpdateRadius(self->ent->uid, self->ent->selection_radius);
     G_Move_UpdateSelectionRadius(self->ent, self->ent->selection_radius);
     return 0;
 }
@@ -793,6 +796,7 @@ static int PyEntity_set_faction_id(PyEntityObject *self, PyObject *value, void *
     vec2_t xz_pos = G_Pos_GetXZ(self->ent->uid);
 
     self->ent->faction_id = PyInt_AS_LONG(value);
+    G_Pos_UpdateFaction(self->ent->uid, self->ent->faction_id);
 
     G_Fog_UpdateVisionRange(xz_pos, old, self->ent->vision_range, 0.0f);
     G_Fog_UpdateVisionRange(xz_pos, self->ent->faction_id, 0.0f, self->ent->vision_range);
@@ -945,6 +949,9 @@ static PyObject *PyEntity_set_model(PyEntityObject *self, PyObject *args)
         PyErr_SetString(PyExc_RuntimeError, "Could not set the model to the specified PFOBJ file.");
         return NULL;
     }
+
+    /* The new model may have different bounds and animation flags */
+    G_UpdateBounds(self->ent);
     Py_RETURN_NONE;
 }
 
@@ -1131,6 +1138,7 @@ static PyObject *PyEntity_unpickle(PyObject *cls, PyObject *args, PyObject *kwar
     CHK_TRUE((-1 != (rawflags = PyInt_AsLong(flags))), fail_unpickle_atts);
     G_SetStatic(ent, rawflags & ENTITY_FLAG_STATIC);
     ent->flags = rawflags;
+    G_UpdateBounds(ent);
 
     status = PyObject_SetAttrString(entobj, "selection_radius", sel_radius);
     CHK_TRUE(0 == status, fail_unpickle_atts);
@@ -39,6 +39,7 @@
 #include "py_traverse.h"
 #include "private_types.h"
 #include "../lib/public/pf_string.h"
+#include "../lib/public/SDL_vec_rwops.h"
 #include "../asset_load.h"
 
 
@@ -136,6 +137,19 @@ typedef void *mod_ty; //symtable.h wants this
 #define EMPTY_TUPLE     ')' /* push empty tuple                                     */
 #define SETITEMS        'u' /* modify dict by adding topmost key+value pairs        */
 
+/* Binary opcodes. These are emitted in place of their ASCII counterparts above, 
+ * which are still accepted by the unpickler so that older pickles can be loaded. 
+ * Memo indices and lengths are LEB128 varints and ints are zigzag-encoded varints.
+ */
+
+#define BINGET          'h' /* push item from memo on stack; varint index           */
+#define BINPUT          'q' /* store stack top in memo; varint index                */
+#define BININT          'J' /* push integer; zigzag varint argument                 */
+#define BINLONG         'K' /* push long; length-prefixed little-endian 2's complement */
+#define BINFLOAT        'G' /* push float; 8-byte little-endian IEEE 754 argument   */
+#define BINSTRING       'T' /* push string; length-prefixed raw bytes               */
+#define BINUNICODE      'X' /* push Unicode string; length-prefixed UTF-8 argument  */
+
 /* Permafrost Engine extensions to protocol 0 */
 
 #define PF_EXTEND       'x' /* Interpret the next opcode as a Permafrost Engine extension opcode */
@@ -215,6 +229,7 @@ typedef void *mod_ty; //symtable.h wants this
 #define PF_OP_METHODCALL '-' /* Push an operator.methodcaller instance from top 3 TOS items */
 #define PF_CUSTOM       '+' /* Push an instance returned by an __unpickle__ static method of a type */
 #define PF_ALLOC        ':' /* Allocate an object (call tp_alloc) using the type on TOS */
+#define PF_BINBYTEARRAY ';' /* Push byte array from length-prefixed raw bytes and type */
 
 #define EXC_START_MAGIC ((void*)0x1234)
 #define EXC_END_MAGIC   ((void*)0x4321)
@@ -271,6 +286,9 @@ static int memo_idx(const struct pickle_ctx *ctx, PyObject *obj);
 static bool emit_get(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw);
 static bool emit_put(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw);
 static bool emit_alloc(const struct pickle_ctx *ctx, SDL_RWops *rw);
+static bool emit_varint_op(SDL_RWops *rw, char op, uint64_t val);
+static bool read_varint(SDL_RWops *rw, uint64_t *out);
+static PyObject *read_blob(SDL_RWops *rw);
 static void deferred_free(struct pickle_ctx *ctx, PyObject *obj);
 
 /* Pickling functions */
@@ -364,6 +382,12 @@ static int op_stop          (struct unpickle_ctx *, SDL_RWops *);
 static int op_string        (struct unpickle_ctx *, SDL_RWops *);
 static int op_put           (struct unpickle_ctx *, SDL_RWops *);
 static int op_get           (struct unpickle_ctx *, SDL_RWops *);
+static int op_binint        (struct unpickle_ctx *, SDL_RWops *);
+static int op_binlong       (struct unpickle_ctx *, SDL_RWops *);
+static int op_binstring     (struct unpickle_ctx *, SDL_RWops *);
+static int op_binput        (struct unpickle_ctx *, SDL_RWops *);
+static int op_binget        (struct unpickle_ctx *, SDL_RWops *);
+static int op_binfloat      (struct unpickle_ctx *, SDL_RWops *);
 static int op_mark          (struct unpickle_ctx *, SDL_RWops *);
 static int op_pop           (struct unpickle_ctx *, SDL_RWops *);
 static int op_pop_mark      (struct unpickle_ctx *, SDL_RWops *);
@@ -376,6 +400,9 @@ static int op_setitems      (struct unpickle_ctx *, SDL_RWops *);
 static int op_none          (struct unpickle_ctx *, SDL_RWops *);
 static int op_unicode       (struct unpickle_ctx *, SDL_RWops *);
 static int op_float         (struct unpickle_ctx *, SDL_RWops *);
+#ifdef Py_USING_UNICODE
+static int op_binunicode    (struct unpickle_ctx *, SDL_RWops *);
+#endif
 
 static int op_ext_builtin   (struct unpickle_ctx *, SDL_RWops *);
 static int op_ext_type      (struct unpickle_ctx *, SDL_RWops *);
@@ -387,6 +414,7 @@ static int op_ext_cell      (struct unpickle_ctx *, SDL_RWops *);
 static int op_ext_true      (struct unpickle_ctx *, SDL_RWops *);
 static int op_ext_false     (struct unpickle_ctx *, SDL_RWops *);
 static int op_ext_bytearray (struct unpickle_ctx *, SDL_RWops *);
+static int op_ext_binbytearray(struct unpickle_ctx *, SDL_RWops *);
 static int op_ext_super     (struct unpickle_ctx *, SDL_RWops *);
 static int op_ext_popmark   (struct unpickle_ctx *, SDL_RWops *);
 static int op_ext_emptyfunc (struct unpickle_ctx *, SDL_RWops *);
@@ -691,6 +719,15 @@ static unpickle_func_t s_op_dispatch_table[256] = {
     [UNICODE] = op_unicode,
 #endif
     [FLOAT] = op_float,
+    [BININT] = op_binint,
+    [BINLONG] = op_binlong,
+    [BINSTRING] = op_binstring,
+    [BINGET] = op_binget,
+    [BINPUT] = op_binput,
+#ifdef Py_USING_UNICODE
+    [BINUNICODE] = op_binunicode,
+#endif
+    [BINFLOAT] = op_binfloat,
 };
 
 static unpickle_func_t s_ext_op_dispatch_table[256] = {
@@ -769,6 +806,7 @@ static unpickle_func_t s_ext_op_dispatch_table[256] = {
     [PF_OP_METHODCALL] = op_ext_oper_methodcaller,
     [PF_CUSTOM] = op_ext_custom,
     [PF_ALLOC] = op_ext_alloc,
+    [PF_BINBYTEARRAY] = op_ext_binbytearray,
 };
 
 /* Statically-linked builtin modules not imported on initialization which also contain C builtins */
@@ -1564,6 +1602,26 @@ static bool attr_is_user_descr(PyObject *obj, PyObject *name)
  * object on attribute lookup. 
  * This function returns a new reference.
  */
+/* Exact instances of these types have no '__dict__' and no writable attributes, 
+ * so there is no point in walking their attributes. This is by far the most 
+ * common case for large object graphs. */
+static bool attrs_never_writable(PyObject *obj)
+{
+    PyTypeObject *type = obj->ob_type;
+    return (obj == Py_None)
+        || (type == &PyBool_Type)
+        || (type == &PyInt_Type)
+        || (type == &PyLong_Type)
+        || (type == &PyFloat_Type)
+        || (type == &PyString_Type)
+#ifdef Py_USING_UNICODE
+        || (type == &PyUnicode_Type)
+#endif
+        || (type == &PyTuple_Type)
+        || (type == &PyList_Type)
+        || (type == &PyDict_Type);
+}
+
 static PyObject *nonderived_writable_attrs(PyObject *obj)
 {
     /* Calling 'dir' on a proxy object will get the attributes of 
@@ -1908,27 +1966,14 @@ fail:
 static int string_pickle(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
 {
     TRACE_PICKLE(obj);
-    char op = STRING;
-    char *repr_str;
-    PyObject *repr = NULL;
-
     CHK_TRUE(pickle_obj(ctx, (PyObject*)obj->ob_type, rw), fail);
 
-    if (NULL == (repr = PyObject_Repr((PyObject*)obj))) {
-        assert(PyErr_Occurred());
-        return -1;
-    }
-    repr_str = PyString_AS_STRING((PyStringObject *)repr);
-
-    CHK_TRUE(rw->write(rw, &op, 1, 1), fail);
-    CHK_TRUE(rw->write(rw, repr_str, strlen(repr_str), 1), fail);
-    CHK_TRUE(rw->write(rw, "\n", 1, 1), fail);
-
-    Py_XDECREF(repr);
+    Py_ssize_t len = PyString_GET_SIZE(obj);
+    CHK_TRUE(emit_varint_op(rw, BINSTRING, len), fail);
+    CHK_TRUE(len == 0 || rw->write(rw, PyString_AS_STRING(obj), len, 1), fail);
     return 0;
 
 fail:
-    Py_XDECREF(repr);
     DEFAULT_ERR(PyExc_IOError, "Error writing to pickle stream");
     return -1;
 }
@@ -1938,24 +1983,12 @@ static int bytearray_pickle(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw
     TRACE_PICKLE(obj);
     CHK_TRUE(pickle_obj(ctx, (PyObject*)obj->ob_type, rw), fail);
 
-    char *buff = PyByteArray_AS_STRING(obj);
-    size_t len = PyByteArray_GET_SIZE(obj);
-
-    Py_UNICODE *uni = malloc(Py_UNICODE_SIZE * len);
-    for(int i = 0; i < len; i++)
-        uni[i] = buff[i];
-    PyObject *uniobj = PyUnicode_FromUnicode(uni, len);
-
-    PyObject *str = PyUnicode_EncodeUTF7(PyUnicode_AS_UNICODE(uniobj), PyUnicode_GET_SIZE(uniobj), true, true, "strict"); 
-    assert(strlen(PyString_AS_STRING(str)) == PyString_GET_SIZE(str));
-    vec_pobj_push(&ctx->to_free, str);
+    Py_ssize_t len = PyByteArray_GET_SIZE(obj);
+    const char xtend = PF_EXTEND;
 
-    Py_DECREF(uniobj);
-    free(uni);
-    CHK_TRUE(pickle_obj(ctx, str, rw), fail);
-    
-    const char ops[] = {PF_EXTEND, PF_BYTEARRAY};
-    CHK_TRUE(rw->write(rw, ops, ARR_SIZE(ops), 1), fail);
+    CHK_TRUE(rw->write(rw, &xtend, 1, 1), fail);
+    CHK_TRUE(emit_varint_op(rw, PF_BINBYTEARRAY, len), fail);
+    CHK_TRUE(len == 0 || rw->write(rw, PyByteArray_AS_STRING(obj), len, 1), fail);
     return 0;
 
 fail:
@@ -2161,17 +2194,15 @@ static int unicode_pickle(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
     assert(PyUnicode_Check(obj));
     CHK_TRUE(pickle_obj(ctx, (PyObject*)obj->ob_type, rw), fail);
 
-    const char unicode = UNICODE;
-    CHK_TRUE(rw->write(rw, &unicode, 1, 1), fail);
+    PyObject *utf8 = PyUnicode_AsUTF8String(obj);
+    CHK_TRUE(utf8, fail);
 
-    PyObject *str = PyUnicode_EncodeUTF7(PyUnicode_AS_UNICODE(obj), PyUnicode_GET_SIZE(obj), true, true, "strict"); 
-    assert(strlen(PyString_AS_STRING(str)) == PyString_GET_SIZE(str));
+    Py_ssize_t len = PyString_GET_SIZE(utf8);
+    bool success = emit_varint_op(rw, BINUNICODE, len)
+                && (len == 0 || rw->write(rw, PyString_AS_STRING(utf8), len, 1));
+    Py_DECREF(utf8);
 
-    int nwritten = rw->write(rw, PyString_AS_STRING(str), 1, PyString_GET_SIZE(str));
-    CHK_TRUE(nwritten == PyString_GET_SIZE(str), fail);
-    vec_pobj_push(&ctx->to_free, str);
-
-    CHK_TRUE(rw->write(rw, "\0\n", 2, 1), fail);
+    CHK_TRUE(success, fail);
     return 0;
 
 fail:
@@ -2250,25 +2281,9 @@ static int float_pickle(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
     assert(PyFloat_Check(obj));
     CHK_TRUE(pickle_obj(ctx, (PyObject*)obj->ob_type, rw), fail);
 
-    double d = PyFloat_AS_DOUBLE(obj);
-
-    const char ops[] = {FLOAT};
-    CHK_TRUE(rw->write(rw, ops, ARR_SIZE(ops), 1), fail);
-
-    char *buff = PyOS_double_to_string(d, 'g', 17, 0, NULL);
-    if(!buff) {
-        PyErr_NoMemory();
-        goto fail;
-    }
-
-    if(!rw->write(rw, buff, strlen(buff), 1)) {
-        PyMem_Free(buff);
-        goto fail;
-    }
-    PyMem_Free(buff);
-    buff = NULL;
-
-    CHK_TRUE(rw->write(rw, "\n", 1, 1), fail);
+    unsigned char buff[1 + 8] = {BINFLOAT};
+    CHK_TRUE(0 == _PyFloat_Pack8(PyFloat_AS_DOUBLE(obj), buff + 1, 1), fail);
+    CHK_TRUE(rw->write(rw, buff, ARR_SIZE(buff), 1), fail);
     return 0;
 
 fail:
@@ -2320,25 +2335,31 @@ fail:
 static int long_pickle(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
 {
     TRACE_PICKLE(obj);
-    PyObject *repr = NULL;
+    unsigned char *buff = NULL;
 
     assert(PyLong_Check(obj));
     CHK_TRUE(pickle_obj(ctx, (PyObject*)obj->ob_type, rw), fail);
 
-    repr = PyObject_Repr(obj);
-    CHK_TRUE(repr, fail);
-    size_t repr_len = strlen(PyString_AS_STRING(repr)) - 1; /* strip L suffix */
-    assert(PyString_AS_STRING(repr)[repr_len] == 'L');
+    size_t nbits = _PyLong_NumBits(obj);
+    CHK_TRUE(nbits != (size_t)-1 || !PyErr_Occurred(), fail);
 
-    const char ops[] = {LONG};
-    CHK_TRUE(rw->write(rw, ops, ARR_SIZE(ops), 1), fail);
-    CHK_TRUE(rw->write(rw, PyString_AS_STRING(repr), repr_len, 1), fail);
-    CHK_TRUE(rw->write(rw, "\n", 1, 1), fail);
-    Py_DECREF(repr);
+    /* Leave room for the sign bit */
+    size_t nbytes = (nbits >> 3) + 1;
+    buff = malloc(nbytes);
+    if(!buff) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+
+    CHK_TRUE(0 == _PyLong_AsByteArray((PyLongObject*)obj, buff, nbytes, 1, 1), fail);
+    CHK_TRUE(emit_varint_op(rw, BINLONG, nbytes), fail);
+    CHK_TRUE(rw->write(rw, buff, nbytes, 1), fail);
+
+    free(buff);
     return 0;
 
 fail:
-    Py_XDECREF(repr);
+    free(buff);
     DEFAULT_ERR(PyExc_IOError, "Error writing to pickle stream");
     return -1;
 }
@@ -2350,12 +2371,11 @@ static int int_pickle(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
     assert(PyInt_Check(obj));
     CHK_TRUE(pickle_obj(ctx, (PyObject*)obj->ob_type, rw), fail);
 
-    char str[32];
-    long l = PyInt_AS_LONG((PyIntObject *)obj);
+    /* Zigzag encoding keeps small negative values short */
+    int64_t l = PyInt_AS_LONG((PyIntObject *)obj);
+    uint64_t zz = ((uint64_t)l << 1) ^ (uint64_t)(l >> 63);
 
-    str[0] = INT;
-    PyOS_snprintf(str + 1, sizeof(str) - 1, "%ld\n", l);
-    CHK_TRUE(rw->write(rw, str, 1, strlen(str)), fail);
+    CHK_TRUE(emit_varint_op(rw, BININT, zz), fail);
     return 0;
 
 fail:
@@ -3844,6 +3864,90 @@ fail_underflow:
     return -1;
 }
 
+static int op_binint(struct unpickle_ctx *ctx, SDL_RWops *rw)
+{
+    TRACE_OP(BININT, ctx);
+
+    if(vec_size(&ctx->stack) < 1) {
+        SET_RUNTIME_EXC("Stack underflow");
+        goto fail_underflow;
+    }
+    PyObject *type = vec_pobj_pop(&ctx->stack);
+
+    if(!PyType_Check(type)
+    || !PyType_IsSubtype((PyTypeObject*)type, &PyInt_Type)) {
+        SET_RUNTIME_EXC("BININT: Expecting 'int' type or subtype on TOS");
+        goto fail_typecheck;
+    }
+    PyObject *ctype = constructor_type((PyTypeObject*)type);
+    assert(ctype);
+
+    uint64_t zz;
+    CHK_TRUE(read_varint(rw, &zz), fail);
+
+    int64_t l = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+    if(l < LONG_MIN || l > LONG_MAX) {
+        SET_RUNTIME_EXC("Int out of range in pickle stream [offset: %ld]", (long)rw->seek(rw, RW_SEEK_CUR, 0));
+        goto fail;
+    }
+
+    PyObject *retval = PyObject_CallFunction(ctype, "l", (long)l);
+    CHK_TRUE(retval, fail);
+
+    vec_pobj_push(&ctx->stack, retval);
+    Py_DECREF(type);
+    return 0;
+
+fail:
+    DEFAULT_ERR(PyExc_IOError, "Error reading from pickle stream");
+fail_typecheck:
+    Py_DECREF(type);
+fail_underflow:
+    return -1;
+}
+
+static int op_binlong(struct unpickle_ctx *ctx, SDL_RWops *rw)
+{
+    TRACE_OP(BINLONG, ctx);
+
+    if(vec_size(&ctx->stack) < 1) {
+        SET_RUNTIME_EXC("Stack underflow");
+        goto fail_underflow;
+    }
+    PyObject *type = vec_pobj_pop(&ctx->stack);
+
+    if(!PyType_Check(type)
+    || !PyType_IsSubtype((PyTypeObject*)type, &PyLong_Type)) {
+        SET_RUNTIME_EXC("BINLONG: Expecting 'long' type or subtype on TOS");
+        goto fail_typecheck;
+    }
+    PyObject *ctype = constructor_type((PyTypeObject*)type);
+    assert(ctype);
+
+    PyObject *blob = read_blob(rw);
+    CHK_TRUE(blob, fail);
+
+    PyObject *tmp = _PyLong_FromByteArray((unsigned char*)PyString_AS_STRING(blob), 
+        PyString_GET_SIZE(blob), 1, 1);
+    Py_DECREF(blob);
+    CHK_TRUE(tmp, fail);
+
+    PyObject *retval = PyObject_CallFunctionObjArgs(ctype, tmp, NULL);
+    Py_DECREF(tmp);
+    CHK_TRUE(retval, fail);
+
+    vec_pobj_push(&ctx->stack, retval);
+    Py_DECREF(type);
+    return 0;
+
+fail:
+    DEFAULT_ERR(PyExc_IOError, "Error reading from pickle stream");
+fail_typecheck:
+    Py_DECREF(type);
+fail_underflow:
+    return -1;
+}
+
 static int op_stop(struct unpickle_ctx *ctx, SDL_RWops *rw)
 {
     TRACE_OP(STOP, ctx);
@@ -3930,6 +4034,43 @@ fail_underflow:
     return -1;
 }
 
+static int op_binstring(struct unpickle_ctx *ctx, SDL_RWops *rw)
+{
+    TRACE_OP(BINSTRING, ctx);
+
+    if(vec_size(&ctx->stack) < 1) {
+        SET_RUNTIME_EXC("Stack underflow");
+        goto fail_underflow;
+    }
+    PyObject *type = vec_pobj_pop(&ctx->stack);
+
+    if(!PyType_Check(type)
+    || !PyType_IsSubtype((PyTypeObject*)type, &PyString_Type)) {
+        SET_RUNTIME_EXC("BINSTRING: Expecting str type or subtype on TOS");
+        goto fail_typecheck;
+    }
+    PyObject *ctype = constructor_type((PyTypeObject*)type);
+    assert(ctype);
+
+    PyObject *blob = read_blob(rw);
+    CHK_TRUE(blob, fail);
+
+    PyObject *retval = PyObject_CallFunctionObjArgs(ctype, blob, NULL);
+    Py_DECREF(blob);
+    CHK_TRUE(retval, fail);
+
+    vec_pobj_push(&ctx->stack, retval);
+    Py_DECREF(type);
+    return 0;
+
+fail:
+    DEFAULT_ERR(PyExc_IOError, "Error reading from pickle stream");
+fail_typecheck:
+    Py_DECREF(type);
+fail_underflow:
+    return -1;
+}
+
 static int op_put(struct unpickle_ctx *ctx, SDL_RWops *rw)
 {
     TRACE_OP(PUT, ctx);
@@ -3993,6 +4134,53 @@ fail:
     return -1;
 }
 
+static int op_binput(struct unpickle_ctx *ctx, SDL_RWops *rw)
+{
+    TRACE_OP(BINPUT, ctx);
+
+    uint64_t idx;
+    CHK_TRUE(read_varint(rw, &idx), fail);
+
+    if(vec_size(&ctx->stack) < 1) {
+        SET_RUNTIME_EXC("Stack underflow");
+        return -1;
+    }
+
+    if(idx != vec_size(&ctx->memo)) {
+        SET_RUNTIME_EXC("Bad index %ld (expected %d)", (long)idx, (int)vec_size(&ctx->memo));
+        return -1;
+    }
+
+    CHK_TRUE(vec_pobj_push(&ctx->memo, TOP(&ctx->stack)), fail);
+    Py_INCREF(TOP(&ctx->memo)); /* The memo references everything in it */
+    return 0;
+
+fail:
+    DEFAULT_ERR(PyExc_IOError, "Error reading from pickle stream");
+    return -1;
+}
+
+static int op_binget(struct unpickle_ctx *ctx, SDL_RWops *rw)
+{
+    TRACE_OP(BINGET, ctx);
+
+    uint64_t idx;
+    CHK_TRUE(read_varint(rw, &idx), fail);
+
+    if(vec_size(&ctx->memo) <= idx) {
+        SET_RUNTIME_EXC("No memo entry for index: %ld", (long)idx);
+        return -1;
+    }
+
+    vec_pobj_push(&ctx->stack, vec_AT(&ctx->memo, idx));
+    Py_INCREF(TOP(&ctx->stack));
+    return 0;
+
+fail:
+    DEFAULT_ERR(PyExc_IOError, "Error reading from pickle stream");
+    return -1;
+}
+
 static int op_mark(struct unpickle_ctx *ctx, SDL_RWops *rw)
 {
     TRACE_OP(MARK, ctx);
@@ -4326,6 +4514,47 @@ fail_typecheck:
 fail_underflow:
     return -1;
 }
+
+static int op_binunicode(struct unpickle_ctx *ctx, SDL_RWops *rw)
+{
+    TRACE_OP(BINUNICODE, ctx);
+
+    if(vec_size(&ctx->stack) < 1) {
+        SET_RUNTIME_EXC("Stack underflow");
+        goto fail_underflow;
+    }
+    PyObject *type = vec_pobj_pop(&ctx->stack);
+
+    if(!PyType_Check(type)
+    || !PyType_IsSubtype((PyTypeObject*)type, &PyUnicode_Type)) {
+        SET_RUNTIME_EXC("BINUNICODE: Expecting unicode type or subtype on TOS");
+        goto fail_typecheck;
+    }
+    PyObject *ctype = constructor_type((PyTypeObject*)type);
+    assert(ctype);
+
+    PyObject *blob = read_blob(rw);
+    CHK_TRUE(blob, fail);
+
+    PyObject *tmp = PyUnicode_DecodeUTF8(PyString_AS_STRING(blob), PyString_GET_SIZE(blob), "strict");
+    Py_DECREF(blob);
+    CHK_TRUE(tmp, fail);
+
+    PyObject *retval = PyObject_CallFunctionObjArgs(ctype, tmp, NULL);
+    Py_DECREF(tmp);
+    CHK_TRUE(retval, fail);
+
+    vec_pobj_push(&ctx->stack, retval);
+    Py_DECREF(type);
+    return 0;
+
+fail:
+    DEFAULT_ERR(PyExc_IOError, "Error reading from pickle stream");
+fail_typecheck:
+    Py_DECREF(type);
+fail_underflow:
+    return -1;
+}
 #endif
 
 static int op_float(struct unpickle_ctx *ctx, SDL_RWops *rw)
@@ -4372,6 +4601,45 @@ fail_underflow:
     return -1;
 }
 
+static int op_binfloat(struct unpickle_ctx *ctx, SDL_RWops *rw)
+{
+    TRACE_OP(BINFLOAT, ctx);
+
+    if(vec_size(&ctx->stack) < 1) {
+        SET_RUNTIME_EXC("Stack underflow");
+        goto fail_underflow;
+    }
+    PyObject *type = vec_pobj_pop(&ctx->stack);
+
+    if(!PyType_Check(type)
+    || !PyType_IsSubtype((PyTypeObject*)type, &PyFloat_Type)) {
+        SET_RUNTIME_EXC("BINFLOAT: Expecting 'float' type or subtype on TOS");
+        goto fail_typecheck;
+    }
+    PyObject *ctype = constructor_type((PyTypeObject*)type);
+    assert(ctype);
+
+    unsigned char buff[8];
+    CHK_TRUE(rw->read(rw, buff, ARR_SIZE(buff), 1), fail);
+
+    double d = _PyFloat_Unpack8(buff, 1);
+    CHK_TRUE(d != -1.0 || !PyErr_Occurred(), fail);
+
+    PyObject *retval = PyObject_CallFunction(ctype, "d", d);
+    CHK_TRUE(retval, fail);
+
+    vec_pobj_push(&ctx->stack, retval);
+    Py_DECREF(type);
+    return 0;
+
+fail:
+    DEFAULT_ERR(PyExc_IOError, "Error reading from pickle stream");
+fail_typecheck:
+    Py_DECREF(type);
+fail_underflow:
+    return -1;
+}
+
 static int op_ext_builtin(struct unpickle_ctx *ctx, SDL_RWops *rw)
 {
     TRACE_OP(PF_BUILTIN, ctx);
@@ -4750,6 +5018,47 @@ fail_underflow:
     return ret;
 }
 
+static int op_ext_binbytearray(struct unpickle_ctx *ctx, SDL_RWops *rw)
+{
+    TRACE_OP(PF_BINBYTEARRAY, ctx);
+    int ret = -1;
+
+    if(vec_size(&ctx->stack) < 1) {
+        SET_RUNTIME_EXC("Stack underflow"); 
+        goto fail_underflow;
+    }
+
+    PyObject *type = vec_pobj_pop(&ctx->stack);
+
+    if(!PyType_Check(type)
+    || !PyType_IsSubtype((PyTypeObject*)type, &PyByteArray_Type)) {
+        SET_RUNTIME_EXC("PF_BINBYTEARRAY: Expecting bytearray type of subtype at TOS");
+        goto fail_typecheck;
+    }
+
+    PyObject *ctype = constructor_type((PyTypeObject*)type);
+    assert(ctype);
+
+    PyObject *blob = read_blob(rw);
+    CHK_TRUE(blob, fail_typecheck);
+
+    PyObject *tmp = PyByteArray_FromStringAndSize(PyString_AS_STRING(blob), PyString_GET_SIZE(blob));
+    Py_DECREF(blob);
+    CHK_TRUE(tmp, fail_typecheck);
+
+    PyObject *ba = PyObject_CallFunctionObjArgs(ctype, tmp, NULL);
+    Py_DECREF(tmp);
+    CHK_TRUE(ba, fail_typecheck);
+
+    vec_pobj_push(&ctx->stack, ba);
+    ret = 0;
+
+fail_typecheck:
+    Py_DECREF(type);
+fail_underflow:
+    return ret;
+}
+
 static int op_ext_super(struct unpickle_ctx *ctx, SDL_RWops *rw)
 {
     TRACE_OP(PF_SUPER, ctx);
@@ -7357,20 +7666,70 @@ static void memoize(struct pickle_ctx *ctx, PyObject *obj)
     kh_value(ctx->memo, k) = (struct memo_entry){idx, obj};
 }
 
+static bool emit_varint_op(SDL_RWops *rw, char op, uint64_t val)
+{
+    unsigned char buff[1 + 10];
+    size_t len = 0;
+
+    buff[len++] = op;
+    do{
+        buff[len] = val & 0x7f;
+        val >>= 7;
+        if(val)
+            buff[len] |= 0x80;
+        len++;
+    }while(val);
+
+    return rw->write(rw, buff, len, 1);
+}
+
+static bool read_varint(SDL_RWops *rw, uint64_t *out)
+{
+    uint64_t ret = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+
+        unsigned char byte;
+        if(!rw->read(rw, &byte, 1, 1))
+            return false;
+
+        ret |= ((uint64_t)(byte & 0x7f)) << shift;
+        if(!(byte & 0x80)) {
+            *out = ret;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns a new reference to a string holding the length-prefixed payload */
+static PyObject *read_blob(SDL_RWops *rw)
+{
+    uint64_t len;
+    if(!read_varint(rw, &len) || len > PY_SSIZE_T_MAX) {
+        SET_RUNTIME_EXC("Bad length in pickle stream [offset: %ld]", (long)rw->seek(rw, RW_SEEK_CUR, 0));
+        return NULL;
+    }
+
+    PyObject *ret = PyString_FromStringAndSize(NULL, len);
+    if(!ret)
+        return NULL;
+
+    if(len > 0 && !rw->read(rw, PyString_AS_STRING(ret), len, 1)) {
+        Py_DECREF(ret);
+        SET_EXC(PyExc_IOError, "Error reading from pickle stream");
+        return NULL;
+    }
+    return ret;
+}
+
 static bool emit_get(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
 {
-    char str[32];
-    pf_snprintf(str, ARR_SIZE(str), "%c%d\n", GET, memo_idx(ctx, obj));
-    str[ARR_SIZE(str)-1] = '\0';
-    return rw->write(rw, str, 1, strlen(str));
+    return emit_varint_op(rw, BINGET, memo_idx(ctx, obj));
 }
 
 static bool emit_put(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
 {
-    char str[32];
-    pf_snprintf(str, ARR_SIZE(str), "%c%d\n", PUT, memo_idx(ctx, obj));
-    str[ARR_SIZE(str)-1] = '\0';
-    return rw->write(rw, str, 1, strlen(str));
+    return emit_varint_op(rw, BINPUT, memo_idx(ctx, obj));
 }
 
 static bool emit_alloc(const struct pickle_ctx *ctx, SDL_RWops *rw)
@@ -7388,6 +7747,9 @@ static bool pickle_attrs(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
 {
     /* The parent object must already be memoized to handle self-referencing */
     assert(memo_contains(ctx, obj));
+    if(attrs_never_writable(obj))
+        return 0;
+
     const char mark = MARK;
     CHK_TRUE(rw->write(rw, &mark, 1, 1), fail);
 
@@ -7565,11 +7927,21 @@ bool S_PickleObjgraph(PyObject *obj, SDL_RWops *stream)
     if(!ret) 
         goto err;
 
-    if(!pickle_obj(&ctx, obj, stream))
+    /* The pickler emits a large number of small writes. Batch them 
+     * up rather than passing each one to the underlying stream. */
+    SDL_RWops *buffered = PFSDL_BufferedWriteRWOps(stream);
+    if(!buffered) {
+        PyErr_NoMemory();
         goto err;
+    }
 
     char term[] = {STOP, '\0'};
-    CHK_TRUE(stream->write(stream, term, 1, ARR_SIZE(term)), err_write);
+    bool success = pickle_obj(&ctx, obj, buffered)
+                && buffered->write(buffered, term, 1, ARR_SIZE(term));
+
+    /* Closing flushes the buffer */
+    success = (0 == SDL_RWclose(buffered)) && success;
+    CHK_TRUE(success, err_write);
 
     pickle_ctx_destroy(&ctx);
     return true;
@@ -941,11 +941,16 @@ static PyObject *PyTask_send(PyTaskObject *self, PyObject *args)
     pytask_req_set(self, args, NULL, PYREQ_SEND);
     pytask_pop_ctx(self);
 
-    Task_Send(recepient_tid, &message, sizeof(message), &reply, sizeof(reply));
+    bool sent = Task_Send(recepient_tid, &message, sizeof(message), &reply, sizeof(reply));
 
     pytask_push_ctx(self);
     pytask_req_clear(self);
 
+    if(!sent) {
+        Py_DECREF(message);
+        PyErr_SetString(PyExc_RuntimeError, "Unable to send the message: out of memory.");
+        return NULL;
+    }
     return reply; /* steal the reply object reference */
 }
 
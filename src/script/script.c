@@ -61,6 +61,8 @@
 #include "../ui.h"
 #include "../session.h"
 #include "../perf.h"
+#include "../sched.h"
+#include "../asset_load.h"
 
 #include <SDL.h>
 #include <stdio.h>
@@ -70,6 +72,7 @@
 
 static PyObject *PyPf_load_map(PyObject *self, PyObject *args, PyObject *kwargs);
 static PyObject *PyPf_load_map_string(PyObject *self, PyObject *args, PyObject *kwargs);
+static PyObject *PyPf_save_map(PyObject *self, PyObject *args, PyObject *kwargs);
 static PyObject *PyPf_set_ambient_light_color(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_emit_light_color(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_emit_light_pos(PyObject *self, PyObject *args);
@@ -90,6 +93,9 @@ static PyObject *PyPf_get_native_resolution(PyObject *self);
 static PyObject *PyPf_get_basedir(PyObject *self);
 static PyObject *PyPf_get_render_info(PyObject *self);
 static PyObject *PyPf_get_nav_perfstats(PyObject *self);
+static PyObject *PyPf_get_sched_perfstats(PyObject *self);
+static PyObject *PyPf_bench(PyObject *self, PyObject *args);
+static PyObject *PyPf_cook_pfobj(PyObject *self, PyObject *args);
 static PyObject *PyPf_get_mouse_pos(PyObject *self);
 static PyObject *PyPf_mouse_over_ui(PyObject *self);
 static PyObject *PyPf_ui_text_edit_has_focus(PyObject *self);
@@ -168,6 +174,12 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_load_map_string, METH_VARARGS | METH_KEYWORDS,
     "Loads the map from the specified PFMAP string."},
 
+    {"save_map", 
+    (PyCFunction)PyPf_save_map, METH_VARARGS | METH_KEYWORDS,
+    "Writes the currently loaded map to the specified file. Unless 'bake_nav' is False, the "
+    "navigation data is written out as well, so that it does not need to be rebuilt when "
+    "the map is loaded."},
+
     {"set_ambient_light_color", 
     (PyCFunction)PyPf_set_ambient_light_color, METH_VARARGS,
     "Sets the global ambient light color (specified as an RGB multiplier) for the scene."},
@@ -242,6 +254,27 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_get_nav_perfstats, METH_NOARGS,
     "Returns a dictionary holding various performance couners for the navigation subsystem."},
 
+    {"get_sched_perfstats", 
+    (PyCFunction)PyPf_get_sched_perfstats, METH_NOARGS,
+    "Returns a dictionary holding the task scheduler counters for the previous frame."},
+
+    {"bench", 
+    (PyCFunction)PyPf_bench, METH_VARARGS,
+    "Runs the named engine microbenchmark with the remaining arguments and returns a dictionary "
+    "of its' results, which always includes the total wall time ('total_ms'). The benchmarks are: "
+    "'spatial_index' (number of entities, number of rounds) - the timings of every spatial index "
+    "for the current map; 'nav_fields' (number of iterations) - the flow and LOS field build "
+    "throughput for every chunk of the current map and the number of flow fields that differ "
+    "from the reference solver; 'event_dispatch' (number of handlers, number of events) - the "
+    "event dispatch timings with a fixed and a churning set of handlers; 'pickle' (object) - "
+    "the timings and size of pickling the object to memory and back, and the unpickled copy."},
+
+    {"cook_pfobj", 
+    (PyCFunction)PyPf_cook_pfobj, METH_VARARGS,
+    "Converts the specified PFOBJ file (given by directory and filename, relative to the "
+    "base directory) to the binary format, which is written alongside it and is loaded in "
+    "preference to the original for as long as the original is not modified."},
+
     {"get_mouse_pos", 
     (PyCFunction)PyPf_get_mouse_pos, METH_NOARGS,
     "Get the (x, y) cursor position on the screen."},
@@ -506,7 +539,8 @@ static PyObject *PyPf_load_map(PyObject *self, PyObject *args, PyObject *kwargs)
     }
     pf_strlcat(pfmap_path, pfmap, sizeof(pfmap_path));
 
-    SDL_RWops *stream = SDL_RWFromFile(pfmap_path, "r");
+    /* The file may contain binary navigation data */
+    SDL_RWops *stream = SDL_RWFromFile(pfmap_path, "rb");
     if(!stream) {
         char errbuff[256];
         pf_snprintf(errbuff, sizeof(errbuff), "Unable to open PFMap file %s", pfmap_path);
@@ -524,6 +558,64 @@ static PyObject *PyPf_load_map(PyObject *self, PyObject *args, PyObject *kwargs)
     Py_RETURN_NONE;
 }
 
+static PyObject *PyPf_save_map(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"dir", "pfmap", "bake_nav", NULL};
+    const char *dir, *pfmap;
+    int bake_nav = true;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "zs|i", kwlist, &dir, &pfmap, &bake_nav)) {
+        PyErr_SetString(PyExc_TypeError, "The first argument must be a string or NULL (base directory). "
+            "The second argument must be a string (PFMAP filepath).");
+        return NULL;
+    }
+
+    char pfmap_path[512] = { [0] = '\0' };
+    pf_strlcat(pfmap_path, g_basepath, sizeof(pfmap_path));
+    pf_strlcat(pfmap_path, "/", sizeof(pfmap_path));
+    if(dir && strlen(dir) > 0) {
+        pf_strlcat(pfmap_path, dir, sizeof(pfmap_path));
+        pf_strlcat(pfmap_path, "/", sizeof(pfmap_path));
+    }
+    pf_strlcat(pfmap_path, pfmap, sizeof(pfmap_path));
+
+    /* Write the map out to a temporary file first, so that a failure partway
+     * through never leaves behind a truncated map in place of the original */
+    char tmp_path[sizeof(pfmap_path) + 8];
+    pf_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", pfmap_path);
+
+    SDL_RWops *stream = SDL_RWFromFile(tmp_path, "wb");
+    if(!stream) {
+        PyErr_Format(PyExc_RuntimeError, "Unable to open PFMap file %s for writing", tmp_path);
+        return NULL;
+    }
+
+    if(!G_SaveMap(stream, bake_nav)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to write the map.");
+        SDL_RWclose(stream);
+        remove(tmp_path);
+        return NULL;
+    }
+
+    if(SDL_RWclose(stream) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to write the map.");
+        remove(tmp_path);
+        return NULL;
+    }
+
+#if defined(_WIN32)
+    /* rename() does not replace an existing file on Windows */
+    remove(pfmap_path);
+#endif
+    if(rename(tmp_path, pfmap_path) != 0) {
+        PyErr_Format(PyExc_RuntimeError, "Unable to replace PFMap file %s", pfmap_path);
+        remove(tmp_path);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_load_map_string(PyObject *self, PyObject *args, PyObject *kwargs)
 {
     static char *kwlist[] = {"mapstr", "update_navgrid", NULL};
@@ -883,17 +975,272 @@ static PyObject *PyPf_get_nav_perfstats(PyObject *self)
     rval |= PyDict_SetItemString(ret, "flow_max",           Py_BuildValue("i", stats.flow_max));
     rval |= PyDict_SetItemString(ret, "flow_hit_rate",      Py_BuildValue("f", stats.flow_hit_rate));
     rval |= PyDict_SetItemString(ret, "flow_invalidated",   Py_BuildValue("i", stats.flow_invalidated));
+    rval |= PyDict_SetItemString(ret, "flow_hits",          Py_BuildValue("i", stats.flow_hits));
+    rval |= PyDict_SetItemString(ret, "flow_misses",        Py_BuildValue("i", stats.flow_misses));
+    rval |= PyDict_SetItemString(ret, "flow_evicted",       Py_BuildValue("i", stats.flow_evicted));
+    rval |= PyDict_SetItemString(ret, "flow_shared",        Py_BuildValue("i", stats.flow_shared));
+    rval |= PyDict_SetItemString(ret, "flow_unique",        Py_BuildValue("i", stats.flow_unique));
+    rval |= PyDict_SetItemString(ret, "flow_bytes_used",    Py_BuildValue("n", (Py_ssize_t)stats.flow_bytes_used));
+    rval |= PyDict_SetItemString(ret, "flow_bytes_max",     Py_BuildValue("n", (Py_ssize_t)stats.flow_bytes_max));
     rval |= PyDict_SetItemString(ret, "ffid_used",          Py_BuildValue("i", stats.ffid_used));
     rval |= PyDict_SetItemString(ret, "ffid_max",           Py_BuildValue("i", stats.ffid_max));
     rval |= PyDict_SetItemString(ret, "ffid_hit_rate",      Py_BuildValue("f", stats.ffid_hit_rate));
     rval |= PyDict_SetItemString(ret, "grid_path_used",     Py_BuildValue("i", stats.grid_path_used));
     rval |= PyDict_SetItemString(ret, "grid_path_max",      Py_BuildValue("i", stats.grid_path_max));
     rval |= PyDict_SetItemString(ret, "grid_path_hit_rate", Py_BuildValue("f", stats.grid_path_hit_rate));
+    rval |= PyDict_SetItemString(ret, "route_used",         Py_BuildValue("i", stats.route_used));
+    rval |= PyDict_SetItemString(ret, "route_max",          Py_BuildValue("i", stats.route_max));
+    rval |= PyDict_SetItemString(ret, "route_hit_rate",     Py_BuildValue("f", stats.route_hit_rate));
+    rval |= PyDict_SetItemString(ret, "route_invalidated",  Py_BuildValue("i", stats.route_invalidated));
     assert(0 == rval);
 
     return ret;
 }
 
+static PyObject *PyPf_get_sched_perfstats(PyObject *self)
+{
+    PyObject *ret = PyDict_New();
+    if(!ret) {
+        return NULL;
+    }
+
+    struct sched_stats stats;
+    Sched_GetStats(&stats);
+
+    int rval = 0;
+    rval |= PyDict_SetItemString(ret, "tasks_run",          Py_BuildValue("K", (unsigned long long)stats.tasks_run));
+    rval |= PyDict_SetItemString(ret, "tasks_stolen",       Py_BuildValue("K", (unsigned long long)stats.tasks_stolen));
+    rval |= PyDict_SetItemString(ret, "nworkers",           Py_BuildValue("i", stats.nworkers));
+    rval |= PyDict_SetItemString(ret, "nactive_workers",    Py_BuildValue("i", stats.nactive_workers));
+    assert(0 == rval);
+
+    return ret;
+}
+
+static PyObject *bench_spatial_index(PyObject *args)
+{
+    int nents, niters;
+    if(!PyArg_ParseTuple(args, "ii", &nents, &niters)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting two integers: number of entities and number of iterations.");
+        return NULL;
+    }
+
+    if(nents <= 0 || nents > 32768 || niters <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The number of entities must be in the range [1, 32768] "
+            "and the number of iterations must be positive.");
+        return NULL;
+    }
+
+    PyObject *ret = PyDict_New();
+    if(!ret) {
+        return NULL;
+    }
+
+    const struct{
+        const char *name;
+        enum pos_index_type type;
+    }indices[] = {
+        {"quadtree",    POS_INDEX_QUADTREE},
+        {"grid",        POS_INDEX_GRID},
+    };
+
+    for(int i = 0; i < ARR_SIZE(indices); i++) {
+
+        struct pos_bench_result res;
+        if(!G_Pos_BenchIndex(indices[i].type, nents, niters, &res)) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+
+        PyObject *entry = Py_BuildValue("{s:d, s:d, s:d, s:K}",
+            "insert_ms",    res.insert_ms,
+            "move_ms",      res.move_ms,
+            "query_ms",     res.query_ms,
+            "nresults",     (unsigned long long)res.nresults);
+        if(!entry) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+
+        PyDict_SetItemString(ret, indices[i].name, entry);
+        Py_DECREF(entry);
+    }
+
+    return ret;
+}
+
+static PyObject *bench_nav_fields(PyObject *args)
+{
+    int niters;
+    if(!PyArg_ParseTuple(args, "i", &niters)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one integer: number of iterations.");
+        return NULL;
+    }
+
+    if(niters <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The number of iterations must be positive.");
+        return NULL;
+    }
+
+    struct nav_bench_result res;
+    if(!G_BenchNavFields(niters, &res))
+        return NULL;
+
+    return Py_BuildValue("{s:K, s:d, s:d, s:K, s:d, s:d, s:K}",
+        "flow_fields",      (unsigned long long)res.nflow,
+        "flow_ms",          res.flow_ms,
+        "flow_per_sec",     res.flow_ms > 0.0 ? res.nflow * 1000.0 / res.flow_ms : 0.0,
+        "los_fields",       (unsigned long long)res.nlos,
+        "los_ms",           res.los_ms,
+        "los_per_sec",      res.los_ms > 0.0 ? res.nlos * 1000.0 / res.los_ms : 0.0,
+        "flow_mismatched",  (unsigned long long)res.nmismatched);
+}
+
+static PyObject *bench_event_dispatch(PyObject *args)
+{
+    int nhandlers, nevents;
+    if(!PyArg_ParseTuple(args, "ii", &nhandlers, &nevents)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting two integers: number of handlers and number of events.");
+        return NULL;
+    }
+
+    if(nhandlers <= 0 || nevents <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The number of handlers and the number of events must be positive.");
+        return NULL;
+    }
+
+    struct event_bench_result res;
+    if(!E_BenchDispatch(nhandlers, nevents, &res))
+        return NULL;
+
+    return Py_BuildValue("{s:K, s:d, s:d, s:d}",
+        "calls",            (unsigned long long)res.ncalls,
+        "dispatch_ms",      res.dispatch_ms,
+        "churn_ms",         res.churn_ms,
+        "ns_per_call",      res.ncalls ? (res.dispatch_ms + res.churn_ms) * 1e6 / res.ncalls : 0.0);
+}
+
+static PyObject *bench_pickle(PyObject *args)
+{
+    PyObject *obj;
+    if(!PyArg_ParseTuple(args, "O", &obj)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one argument: the object to pickle.");
+        return NULL;
+    }
+
+    SDL_RWops *stream = PFSDL_VectorRWOps();
+    if(!stream)
+        return PyErr_NoMemory();
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    if(!S_PickleObjgraph(obj, stream)) {
+        assert(PyErr_Occurred());
+        SDL_RWclose(stream);
+        return NULL;
+    }
+    uint64_t pickled = SDL_GetPerformanceCounter();
+
+    Sint64 size = SDL_RWsize(stream);
+    SDL_RWseek(stream, 0, RW_SEEK_SET);
+
+    PyObject *copy = S_UnpickleObjgraph(stream);
+    uint64_t end = SDL_GetPerformanceCounter();
+    SDL_RWclose(stream);
+
+    if(!copy) {
+        assert(PyErr_Occurred());
+        return NULL;
+    }
+
+    double freq = SDL_GetPerformanceFrequency();
+    PyObject *ret = Py_BuildValue("{s:d, s:d, s:L, s:O}",
+        "pickle_ms",        (pickled - begin) * 1000.0 / freq,
+        "unpickle_ms",      (end - pickled) * 1000.0 / freq,
+        "size",             (long long)size,
+        "copy",             copy);
+    Py_DECREF(copy);
+    return ret;
+}
+
+/* The benchmarks parse their own arguments and return a dictionary of results.
+ * Returning NULL without setting an exception means that the benchmark could 
+ * not be run in the current engine state. 
+ */
+static const struct{
+    const char *name;
+    PyObject *(*run)(PyObject *args);
+    bool        needs_map;
+}s_benchmarks[] = {
+    {"spatial_index",   bench_spatial_index,    true},
+    {"nav_fields",      bench_nav_fields,       true},
+    {"event_dispatch",  bench_event_dispatch,   false},
+    {"pickle",          bench_pickle,           false},
+};
+
+static PyObject *PyPf_bench(PyObject *self, PyObject *args)
+{
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args);
+    if(nargs < 1 || !PyString_Check(PyTuple_GET_ITEM(args, 0))) {
+        PyErr_SetString(PyExc_TypeError, "First argument must be the name of the benchmark.");
+        return NULL;
+    }
+
+    const char *name = PyString_AS_STRING(PyTuple_GET_ITEM(args, 0));
+    int idx = -1;
+    for(int i = 0; i < ARR_SIZE(s_benchmarks); i++) {
+        if(!strcmp(s_benchmarks[i].name, name)) {
+            idx = i;
+            break;
+        }
+    }
+
+    if(idx == -1) {
+        PyErr_Format(PyExc_ValueError, "Unknown benchmark: %s", name);
+        return NULL;
+    }
+
+    PyObject *bench_args = PyTuple_GetSlice(args, 1, nargs);
+    if(!bench_args)
+        return NULL;
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    PyObject *ret = s_benchmarks[idx].run(bench_args);
+    uint64_t end = SDL_GetPerformanceCounter();
+    Py_DECREF(bench_args);
+
+    if(!ret) {
+        if(!PyErr_Occurred()) {
+            PyErr_Format(PyExc_RuntimeError, "Failed to run the %s benchmark.%s", name,
+                s_benchmarks[idx].needs_map ? " Make sure a map is loaded." : "");
+        }
+        return NULL;
+    }
+
+    PyObject *total = PyFloat_FromDouble((end - begin) * 1000.0 / SDL_GetPerformanceFrequency());
+    if(!total || 0 != PyDict_SetItemString(ret, "total_ms", total)) {
+        Py_XDECREF(total);
+        Py_DECREF(ret);
+        return NULL;
+    }
+    Py_DECREF(total);
+    return ret;
+}
+
+static PyObject *PyPf_cook_pfobj(PyObject *self, PyObject *args)
+{
+    const char *dirpath, *filename;
+    if(!PyArg_ParseTuple(args, "ss", &dirpath, &filename)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting two strings: directory and filename.");
+        return NULL;
+    }
+
+    if(!AL_CookPFObj(dirpath, filename)) {
+        PyErr_Format(PyExc_RuntimeError, "Failed to cook PFOBJ file: %s/%s", dirpath, filename);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_get_mouse_pos(PyObject *self)
 {
     int mouse_x, mouse_y;
@@ -1664,7 +2011,7 @@ static PyObject *PyPf_save_session(PyObject *self, PyObject *args)
         return NULL;
     }
 
-    FILE *file = fopen(str, "w");
+    FILE *file = fopen(str, "wb");
     if(!file) {
         char buff[256];
         pf_snprintf(buff, sizeof(buff), "Unable to open file (%s) for writing.\n", str);
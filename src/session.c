@@ -49,7 +49,7 @@
 #include <assert.h>
 
 
-#define PFSAVE_VERSION  (1.0f)
+#define PFSAVE_VERSION  (1.1f)
 #define MIN(a, b)       ((a) < (b) ? (a) : (b))
 
 VEC_TYPE(stream, SDL_RWops*)
@@ -191,7 +191,7 @@ static bool session_load(const char *file, char *errstr, size_t errlen)
     assert(result);
     SDL_RWseek(current, 0, RW_SEEK_SET);
 
-    SDL_RWops *stream = SDL_RWFromFile(file, "r");
+    SDL_RWops *stream = SDL_RWFromFile(file, "rb");
     if(!stream) {
         pf_snprintf(errstr, errlen, "Could not open session file: %s", file);
         goto fail_stream;
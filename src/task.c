@@ -290,9 +290,9 @@ void Task_Yield(void)
     Sched_Request((struct request){ .type = SCHED_REQ_YIELD });
 }
 
-void Task_Send(uint32_t tid, void *msg, size_t msglen, void *reply, size_t replylen)
+bool Task_Send(uint32_t tid, void *msg, size_t msglen, void *reply, size_t replylen)
 {
-    Sched_Request((struct request){ 
+    return Sched_Request((struct request){ 
         .type = SCHED_REQ_SEND,
         .argv[0] = (uint64_t)tid,
         .argv[1] = (uint64_t)msg,
@@ -407,7 +407,8 @@ uint32_t Task_WhoIs(const char *name, bool blocking)
         .blocking = blocking
     };
     uint32_t resp;
-    Task_Send(s_ns_tid, &nr, sizeof(nr), &resp, sizeof(resp));
+    if(!Task_Send(s_ns_tid, &nr, sizeof(nr), &resp, sizeof(resp)))
+        return NULL_TID;
     return resp;
 }
 
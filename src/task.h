@@ -53,7 +53,7 @@ bool     Task_Wait(uint32_t child_tid);
 uint32_t Task_MyTid(void);
 uint32_t Task_ParentTid(void);
 void     Task_Yield(void);
-void     Task_Send(uint32_t tid, void *msg, size_t msglen, void *reply, size_t replylen);
+bool     Task_Send(uint32_t tid, void *msg, size_t msglen, void *reply, size_t replylen);
 void     Task_Receive(uint32_t *tid, void *msg, size_t msglen);
 void     Task_Reply(uint32_t tid, void *reply, size_t replylen);
 void    *Task_AwaitEvent(int event, int *source);